@@ -220,6 +220,23 @@ bool ApplicationSettings::InitializeApplicationSettingsFile( void )
         AppSettingsPropTree.put( L"sampleParam.minCyclesCaptured", L"16" ); // Bin width 6.25% of stimulus frequency
         AppSettingsPropTree.put( L"sampleParam.noiseRejectBandwidth", L"100.0" ); // 100 Hz
         AppSettingsPropTree.put( L"sampleParam.lowNoiseOversampling", L"64" ); // 64x
+        AppSettingsPropTree.put( L"dftTuning.threads", L"1" ); // Serial; 0 means one per logical processor
+        AppSettingsPropTree.put( L"dftTuning.harmonics", L"0" ); // Fundamental only
+        AppSettingsPropTree.put( L"dftTuning.window", DFT_WINDOW_RECTANGULAR ); // See DftWindow_T
+        AppSettingsPropTree.put( L"dftTuning.trend", DFT_TREND_NONE ); // See DftTrend_T
+        AppSettingsPropTree.put( L"dftTuning.estimator", GOERTZEL_DFT_ESTIMATOR ); // See MeasurementEstimator_T
+        AppSettingsPropTree.put( L"dftTuning.spectrumDiagnostics", false );
+        AppSettingsPropTree.put( L"dftTuning.frequencyRefinement", false );
+        AppSettingsPropTree.put( L"dftTuning.subBlocks", L"8" ); // For the gain and phase standard errors
+        AppSettingsPropTree.put( L"sampleParam.targetGainStdErrDb", L"0.0" ); // No target; capture fully
+        AppSettingsPropTree.put( L"sampleParam.targetPhaseStdErrDeg", L"0.0" ); // No target; capture fully
+        AppSettingsPropTree.put( L"sampleParam.averagingCount", L"1" ); // No averaging
+        AppSettingsPropTree.put( L"sampleParam.stimulusType", STEPPED_SINE_STIMULUS ); // See StimulusType_T
+        AppSettingsPropTree.put( L"sampleParam.streamingCapture", false ); // Block mode captures
+        AppSettingsPropTree.put( L"sampleParam.probeCapture", false ); // No probe captures
+        AppSettingsPropTree.put( L"sampleParam.hardwareSweep", false ); // Every step captured singly
+        AppSettingsPropTree.put( L"sampleParam.pipelinedSweep", true ); // Stage the next stimulus during processing
+        AppSettingsPropTree.put( L"sampleParam.predictiveAutorange", false ); // Predict starting ranges from the response trend
 
         AppSettingsPropTree.put( L"qualityLimits.enable", L"false" ); // Quality limits off
         AppSettingsPropTree.put( L"qualityLimits.amplitudeLowerLimit", L"0.0" );
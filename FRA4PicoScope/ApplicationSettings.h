@@ -447,6 +447,167 @@ class ApplicationSettings
             AppSettingsPropTree.put( L"sampleParam.lowNoiseOversampling", lowNoiseOversample );
         }
 
+        inline uint16_t GetDftThreadsAsUint16( void )
+        {
+            return AppSettingsPropTree.get<uint16_t>( L"dftTuning.threads", 1 );
+        }
+        inline const wstring GetDftThreadsAsString( void )
+        {
+            return AppSettingsPropTree.get<wstring>( L"dftTuning.threads", L"1" );
+        }
+        inline void SetDftThreads( uint16_t dftThreads )
+        {
+            AppSettingsPropTree.put( L"dftTuning.threads", dftThreads );
+        }
+
+        inline uint8_t GetHarmonicsAsUint8( void )
+        {
+            return (uint8_t)AppSettingsPropTree.get<uint16_t>( L"dftTuning.harmonics", 0 );
+        }
+        inline const wstring GetHarmonicsAsString( void )
+        {
+            return AppSettingsPropTree.get<wstring>( L"dftTuning.harmonics", L"0" );
+        }
+        inline void SetHarmonics( uint8_t harmonics )
+        {
+            AppSettingsPropTree.put( L"dftTuning.harmonics", (uint16_t)harmonics );
+        }
+
+        inline DftWindow_T GetDftWindow( void )
+        {
+            return (DftWindow_T)AppSettingsPropTree.get<int>( L"dftTuning.window", DFT_WINDOW_RECTANGULAR );
+        }
+        inline void SetDftWindow( DftWindow_T dftWindow )
+        {
+            AppSettingsPropTree.put( L"dftTuning.window", dftWindow );
+        }
+
+        inline DftTrend_T GetDftTrend( void )
+        {
+            return (DftTrend_T)AppSettingsPropTree.get<int>( L"dftTuning.trend", DFT_TREND_NONE );
+        }
+        inline void SetDftTrend( DftTrend_T dftTrend )
+        {
+            AppSettingsPropTree.put( L"dftTuning.trend", dftTrend );
+        }
+
+        inline MeasurementEstimator_T GetEstimator( void )
+        {
+            return (MeasurementEstimator_T)AppSettingsPropTree.get<int>( L"dftTuning.estimator", GOERTZEL_DFT_ESTIMATOR );
+        }
+        inline void SetEstimator( MeasurementEstimator_T estimator )
+        {
+            AppSettingsPropTree.put( L"dftTuning.estimator", estimator );
+        }
+
+        inline bool GetSpectrumDiagnostics( void )
+        {
+            return AppSettingsPropTree.get<bool>( L"dftTuning.spectrumDiagnostics", false );
+        }
+        inline void SetSpectrumDiagnostics( bool spectrumDiagnostics )
+        {
+            AppSettingsPropTree.put( L"dftTuning.spectrumDiagnostics", spectrumDiagnostics );
+        }
+
+        inline bool GetFrequencyRefinement( void )
+        {
+            return AppSettingsPropTree.get<bool>( L"dftTuning.frequencyRefinement", false );
+        }
+        inline void SetFrequencyRefinement( bool frequencyRefinement )
+        {
+            AppSettingsPropTree.put( L"dftTuning.frequencyRefinement", frequencyRefinement );
+        }
+
+        inline uint8_t GetSubBlocksAsUint8( void )
+        {
+            return (uint8_t)AppSettingsPropTree.get<uint16_t>( L"dftTuning.subBlocks", 8 );
+        }
+        inline void SetSubBlocks( uint8_t subBlocks )
+        {
+            AppSettingsPropTree.put( L"dftTuning.subBlocks", (uint16_t)subBlocks );
+        }
+
+        inline double GetTargetGainStdErrDbAsDouble( void )
+        {
+            return AppSettingsPropTree.get<double>( L"sampleParam.targetGainStdErrDb", 0.0 );
+        }
+        inline void SetTargetGainStdErrDb( double targetGainStdErrDb )
+        {
+            AppSettingsPropTree.put( L"sampleParam.targetGainStdErrDb", targetGainStdErrDb );
+        }
+
+        inline double GetTargetPhaseStdErrDegAsDouble( void )
+        {
+            return AppSettingsPropTree.get<double>( L"sampleParam.targetPhaseStdErrDeg", 0.0 );
+        }
+        inline void SetTargetPhaseStdErrDeg( double targetPhaseStdErrDeg )
+        {
+            AppSettingsPropTree.put( L"sampleParam.targetPhaseStdErrDeg", targetPhaseStdErrDeg );
+        }
+
+        inline uint16_t GetAveragingCountAsUint16( void )
+        {
+            return AppSettingsPropTree.get<uint16_t>( L"sampleParam.averagingCount", 1 );
+        }
+        inline void SetAveragingCount( uint16_t averagingCount )
+        {
+            AppSettingsPropTree.put( L"sampleParam.averagingCount", averagingCount );
+        }
+
+        inline StimulusType_T GetStimulusType( void )
+        {
+            return (StimulusType_T)AppSettingsPropTree.get<int>( L"sampleParam.stimulusType", STEPPED_SINE_STIMULUS );
+        }
+        inline void SetStimulusType( StimulusType_T stimulusType )
+        {
+            AppSettingsPropTree.put( L"sampleParam.stimulusType", stimulusType );
+        }
+
+        inline bool GetStreamingCapture( void )
+        {
+            return AppSettingsPropTree.get<bool>( L"sampleParam.streamingCapture", false );
+        }
+        inline void SetStreamingCapture( bool streamingCapture )
+        {
+            AppSettingsPropTree.put( L"sampleParam.streamingCapture", streamingCapture );
+        }
+
+        inline bool GetProbeCapture( void )
+        {
+            return AppSettingsPropTree.get<bool>( L"sampleParam.probeCapture", false );
+        }
+        inline void SetProbeCapture( bool probeCapture )
+        {
+            AppSettingsPropTree.put( L"sampleParam.probeCapture", probeCapture );
+        }
+
+        inline bool GetHardwareSweep( void )
+        {
+            return AppSettingsPropTree.get<bool>( L"sampleParam.hardwareSweep", false );
+        }
+        inline void SetHardwareSweep( bool hardwareSweep )
+        {
+            AppSettingsPropTree.put( L"sampleParam.hardwareSweep", hardwareSweep );
+        }
+
+        inline bool GetPipelinedSweep( void )
+        {
+            return AppSettingsPropTree.get<bool>( L"sampleParam.pipelinedSweep", true );
+        }
+        inline void SetPipelinedSweep( bool pipelinedSweep )
+        {
+            AppSettingsPropTree.put( L"sampleParam.pipelinedSweep", pipelinedSweep );
+        }
+
+        inline bool GetPredictiveAutorange( void )
+        {
+            return AppSettingsPropTree.get<bool>( L"sampleParam.predictiveAutorange", false );
+        }
+        inline void SetPredictiveAutorange( bool predictiveAutorange )
+        {
+            AppSettingsPropTree.put( L"sampleParam.predictiveAutorange", predictiveAutorange );
+        }
+
         inline double GetNoiseRejectBandwidthAsDouble(void)
         {
             return AppSettingsPropTree.get<double>( L"sampleParam.noiseRejectBandwidth" );
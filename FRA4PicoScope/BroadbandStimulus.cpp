@@ -0,0 +1,224 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: BroadbandStimulus.cpp
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "BroadbandStimulus.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <algorithm>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: BroadbandStimulus
+//
+// Purpose: Design a periodic broadband stimulus: a multisine (sum of equal amplitude sines) at exactly the
+// frequencies to be measured, or a logarithmic chirp sweeping across them.
+//
+// Parameters:
+//    Design
+//             [in] stimulusType - MULTISINE_STIMULUS or LOG_CHIRP_STIMULUS
+//             [in] waveformSize - samples per period; must be a power of 2
+//             [in] toneCycles - the frequencies to excite, as whole cycles per period, ascending and each less
+//                               than waveformSize/2
+//             [out] return - false if the design isn't possible
+//    GetWaveform
+//             [out] return - one period, scaled to a peak of 32767
+//    GetCrestFactor
+//             [out] return - peak over RMS of the designed waveform
+//
+// Notes:
+//
+// - The multisine is the more efficient stimulus, putting all its power at the measured frequencies, but the
+//   sum of many sines has a high crest factor unless the phases are chosen carefully, and crest factor costs
+//   signal to noise ratio, since the peak is what's limited by the generator and channel ranges.  The phases
+//   start as Schroeder's [1], phi_m = -pi*m*(m-1)/M for the m-th of M tones, which spreads the tones' peaks
+//   over the period.  They're then improved by iterative clipping [2]: clip the time signal below its peak,
+//   transform, restore the tones' magnitudes (and remove energy outside the tones), keeping the phases, and
+//   transform back.  When the tones are sparse, as on a logarithmic grid, most of the clipped energy falls
+//   between them and the phases barely move, so the phase change is over-relaxed.  The best crest factor
+//   seen is kept.  Dense tone sets reach about 1.6; 20 tones spread over two decades about 2.8, against 6.5
+//   for equal phases and 1.41 for one sine.
+//
+// - The logarithmic chirp sweeps from the lowest to the highest tone once per period, spending equal time per
+//   octave.  Its start frequency is adjusted so a period holds a whole number of cycles, making it continuous
+//   when repeated.  It has the lowest crest factor (about 1.41) but spreads power over every bin in the band,
+//   and puts less power at the higher frequencies, so it's better suited to wide bands of few steps with a
+//   quiet system.
+//
+//   [1] Schroeder, M.R. (1970), "Synthesis of Low-Peak-Factor Signals and Binary Sequences With Low
+//       Autocorrelation", IEEE Transactions on Information Theory, 16 (1): 85-89
+//   [2] Van der Ouderaa, E.; Schoukens, J.; Renneboog, J. (1988), "Peak Factor Minimization Using a Time-Frequency
+//       Domain Swapping Algorithm", IEEE Transactions on Instrumentation and Measurement, 37 (1): 145-147
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+const double BroadbandStimulus::clipRatio = 0.9;
+const double BroadbandStimulus::overRelaxation = 30.0;
+
+BroadbandStimulus::BroadbandStimulus( void ) : W(0), crestFactor(0.0)
+{
+}
+
+bool BroadbandStimulus::Design( StimulusType_T stimulusType, uint32_t waveformSize, const vector<uint32_t>& toneCycles )
+{
+    if (toneCycles.empty() || !fft.Init( waveformSize ) || toneCycles.back() >= waveformSize / 2)
+    {
+        return false;
+    }
+
+    W = waveformSize;
+    signal.resize( W );
+    spectrum.resize( W );
+
+    if (LOG_CHIRP_STIMULUS == stimulusType && toneCycles.size() > 1)
+    {
+        DesignLogChirp( toneCycles );
+    }
+    else
+    {
+        DesignMultisine( toneCycles );
+    }
+
+    Quantize();
+
+    return true;
+}
+
+vector<int16_t>& BroadbandStimulus::GetWaveform( void )
+{
+    return waveform;
+}
+
+double BroadbandStimulus::GetCrestFactor( void )
+{
+    return crestFactor;
+}
+
+void BroadbandStimulus::DesignMultisine( const vector<uint32_t>& toneCycles )
+{
+    uint32_t M = (uint32_t)toneCycles.size();
+    double bestCrestFactor = (numeric_limits<double>::max)();
+    vector<double> bestSignal;
+
+    vector<complex<double>> phases( M ), tones( M );
+
+    // Schroeder phases, as unit phasors
+    fill( spectrum.begin(), spectrum.end(), complex<double>( 0.0, 0.0 ) );
+    for (uint32_t m = 0; m < M; m++)
+    {
+        phases[m] = polar( 1.0, -M_PI * (double)m * (double)(m + 1) / (double)M );
+        spectrum[toneCycles[m]] = phases[m];
+    }
+
+    for (uint8_t iteration = 0; iteration <= crestFactorIterations; iteration++)
+    {
+        double peak = 0.0, sumSquares = 0.0, crestFactorThisIteration;
+
+        // Real signal from the positive frequency tones
+        for (uint32_t m = 0; m < M; m++)
+        {
+            spectrum[W - toneCycles[m]] = conj( spectrum[toneCycles[m]] );
+        }
+        fft.Inverse( spectrum );
+        for (uint32_t n = 0; n < W; n++)
+        {
+            signal[n] = spectrum[n].real();
+            peak = max( peak, fabs( signal[n] ) );
+            sumSquares += signal[n] * signal[n];
+        }
+
+        crestFactorThisIteration = peak / sqrt( sumSquares / (double)W );
+        if (crestFactorThisIteration < bestCrestFactor)
+        {
+            bestCrestFactor = crestFactorThisIteration;
+            bestSignal = signal;
+        }
+
+        if (iteration == crestFactorIterations || 1 == M)
+        {
+            break;
+        }
+
+        // Clip, then restore the tone magnitudes taking the phases from the clipped signal, with the
+        // change exaggerated
+        double clipLevel = clipRatio * peak;
+        for (uint32_t n = 0; n < W; n++)
+        {
+            spectrum[n] = complex<double>( min( clipLevel, max( -clipLevel, signal[n] ) ), 0.0 );
+        }
+        fft.Forward( spectrum );
+        for (uint32_t m = 0; m < M; m++)
+        {
+            tones[m] = phases[m] + overRelaxation * (spectrum[toneCycles[m]] - phases[m]);
+            phases[m] = abs( tones[m] ) > 0.0 ? tones[m] / abs( tones[m] ) : phases[m];
+        }
+        fill( spectrum.begin(), spectrum.end(), complex<double>( 0.0, 0.0 ) );
+        for (uint32_t m = 0; m < M; m++)
+        {
+            spectrum[toneCycles[m]] = phases[m];
+        }
+    }
+
+    signal = bestSignal;
+}
+
+void BroadbandStimulus::DesignLogChirp( const vector<uint32_t>& toneCycles )
+{
+    // Sweep from half a tone spacing below the lowest tone to the same above the highest so the end tones get
+    // as much power as the others
+    double spacing = pow( (double)toneCycles.back() / (double)toneCycles.front(), 1.0 / (double)(toneCycles.size() - 1) );
+    double startCycles = (double)toneCycles.front() / sqrt( spacing );
+    double ratio = (double)toneCycles.back() * spacing / startCycles;
+    double logRatio = log( ratio );
+
+    // Cycles per period are startCycles*(ratio-1)/ln(ratio); round to a whole number
+    double totalCycles = max( 1.0, floor( startCycles * (ratio - 1.0) / logRatio + 0.5 ) );
+    startCycles = totalCycles * logRatio / (ratio - 1.0);
+
+    for (uint32_t n = 0; n < W; n++)
+    {
+        double t = (double)n / (double)W;
+        double cycles = startCycles * (exp( t * logRatio ) - 1.0) / logRatio;
+        signal[n] = sin( 2.0 * M_PI * (cycles - floor( cycles )) );
+    }
+}
+
+void BroadbandStimulus::Quantize( void )
+{
+    double peak = 0.0, sumSquares = 0.0;
+
+    for (uint32_t n = 0; n < W; n++)
+    {
+        peak = max( peak, fabs( signal[n] ) );
+        sumSquares += signal[n] * signal[n];
+    }
+    crestFactor = peak > 0.0 ? peak / sqrt( sumSquares / (double)W ) : 0.0;
+
+    waveform.resize( W );
+    for (uint32_t n = 0; n < W; n++)
+    {
+        waveform[n] = peak > 0.0 ? (int16_t)floor( 32767.0 * signal[n] / peak + 0.5 ) : 0;
+    }
+}
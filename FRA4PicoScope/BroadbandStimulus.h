@@ -0,0 +1,69 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: BroadbandStimulus.h
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <vector>
+#include "FRA4PicoScopeInterfaceTypes.h"
+#include "Fft.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: class BroadbandStimulus
+//
+// Purpose: Designs one period of a broadband stimulus for the arbitrary waveform generator, which
+//          excites a whole band of frequency steps at once.  See BroadbandStimulus.cpp for details.
+//
+// Parameters: N/A
+//
+// Notes: Tones are specified as whole cycles per waveform period, so the stimulus is exactly
+//        periodic and a capture of whole periods has no leakage between tones.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+class BroadbandStimulus
+{
+    public:
+        BroadbandStimulus(void);
+
+        bool Design( StimulusType_T stimulusType, uint32_t waveformSize, const vector<uint32_t>& toneCycles );
+        vector<int16_t>& GetWaveform( void );
+        double GetCrestFactor( void );
+
+        static const uint8_t crestFactorIterations = 100;
+        static const double clipRatio;
+        static const double overRelaxation;
+
+    private:
+        void DesignMultisine( const vector<uint32_t>& toneCycles );
+        void DesignLogChirp( const vector<uint32_t>& toneCycles );
+        void Quantize( void );
+
+        uint32_t W;
+        Fft fft;
+        vector<complex<double>> spectrum;
+        vector<double> signal;
+        vector<int16_t> waveform;
+        double crestFactor;
+};
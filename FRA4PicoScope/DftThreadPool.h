@@ -0,0 +1,82 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: DftThreadPool.h
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "GoertzelKernels.h"
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: class DftThreadPool
+//
+// Purpose: A pool of worker threads which runs a DFT kernel over a block of samples in parallel,
+//          by dividing it into sub-blocks and combining the sub-block states (CombineGoertzelState).
+//
+// Parameters: N/A
+//
+// Notes: The calling thread processes the first sub-block itself, so a pool of N threads uses
+//        N-1 workers.  Results match serial execution to within rounding; see FeedGoertzel.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+class DftThreadPool
+{
+    public:
+        DftThreadPool(void);
+        ~DftThreadPool(void);
+        bool Initialize( uint16_t numThreads );
+        uint16_t GetNumThreads( void );
+        void FeedGoertzel( GoertzelKernel_T kernel, DftRecurrence_T recurrence, double freqRatio,
+                           const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n, const __m128d& KappaVec,
+                           __m128d& aVec, __m128d& bVec, SAMPLE_SUMS_T& sums );
+
+        static const uint32_t minSamplesPerThread = 1 << 16;
+
+    private:
+        typedef struct
+        {
+            DftThreadPool* pool;
+            HANDLE hStartEvent;
+            HANDLE hDoneEvent;
+            HANDLE hThread;
+            // Work description
+            GoertzelKernel_T kernel;
+            const int16_t* inputSamples;
+            const int16_t* outputSamples;
+            uint32_t n;
+            double Kappa;
+            // Results; not vectors so that the vector<> of these need not be aligned
+            double a[2], b[2];
+            SAMPLE_SUMS_T sums;
+        } DFT_WORKER_T;
+
+        static DWORD WINAPI WorkerThread( LPVOID lpThreadParameter );
+        void Shutdown( void );
+
+        vector<DFT_WORKER_T> workers;
+        vector<HANDLE> doneEvents;
+        bool exitWorkers;
+        CRITICAL_SECTION poolLock;
+};
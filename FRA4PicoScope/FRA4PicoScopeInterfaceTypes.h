@@ -75,6 +75,40 @@ typedef enum
     HIGH_NOISE
 } SamplingMode_T;
 
+typedef enum
+{
+    DFT_WINDOW_RECTANGULAR, // No window; the original behaviour
+    DFT_WINDOW_HANN,
+    DFT_WINDOW_BLACKMAN_HARRIS, // 4 term, -92 dB sidelobes
+    DFT_WINDOW_FLAT_TOP, // 5 term, for amplitude accuracy
+    NUM_DFT_WINDOWS
+} DftWindow_T;
+
+typedef enum
+{
+    DFT_TREND_NONE, // Only d.c. is removed; the original behaviour
+    DFT_TREND_LINEAR, // D.c. plus a linear drift
+    DFT_TREND_EXPONENTIAL, // D.c. plus an exponentially settling offset, e.g. an a.c. coupling transient
+    NUM_DFT_TRENDS
+} DftTrend_T;
+
+typedef enum
+{
+    GOERTZEL_DFT_ESTIMATOR, // Single bin DFT; see GoertzelDft
+    SINE_FIT_3_PARAMETER, // Least squares sine fit at the stimulus frequency; see SineFit
+    SINE_FIT_4_PARAMETER, // Least squares sine fit, also fitting the frequency
+    LOCK_IN_DEMODULATOR, // Quadrature mixer, CIC decimator and FIR filter; see LockInDemodulator
+    NUM_MEASUREMENT_ESTIMATORS
+} MeasurementEstimator_T;
+
+typedef enum
+{
+    STEPPED_SINE_STIMULUS, // One frequency step at a time, from the built-in sine generator
+    MULTISINE_STIMULUS, // Crest factor optimised sum of sines at a band's steps, from the arbitrary waveform generator; see BroadbandStimulus
+    LOG_CHIRP_STIMULUS, // Periodic logarithmic chirp across a band's steps, from the arbitrary waveform generator
+    NUM_STIMULUS_TYPES
+} StimulusType_T;
+
 typedef enum
 {
     OK, // Measurement is acceptable
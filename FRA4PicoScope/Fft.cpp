@@ -0,0 +1,166 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: Fft.cpp
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "Fft.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Fft
+//
+// Purpose: In-place iterative radix-2 decimation in time FFT [1].
+//
+// Parameters:
+//    Init
+//             [in] size - number of points; must be a power of 2, at least 2
+//             [out] return - false if the size isn't supported
+//    Forward
+//             [in/out] data - size points; replaced with X[k] = sum x[n] * exp(-2*pi*i*k*n/N)
+//    Inverse
+//             [in/out] data - size points; replaced with x[n] = (1/N) * sum X[k] * exp(2*pi*i*k*n/N)
+//    NextPowerOfTwo, PreviousPowerOfTwo
+//             [in] n - a number, at least 1
+//             [out] return - the smallest power of 2 >= n; the largest power of 2 <= n
+//
+// Notes: The twiddle factors are each computed directly rather than by recurrence, so the rounding error grows
+//        only as log2(N).
+//
+//   [1] Cooley, J.W.; Tukey, J.W. (1965), "An Algorithm for the Machine Calculation of Complex Fourier Series",
+//       Mathematics of Computation, 19 (90): 297-301
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Fft::Fft( void ) : N(0)
+{
+}
+
+bool Fft::Init( uint32_t size )
+{
+    uint32_t log2N = 0;
+
+    if (size < 2 || (size & (size - 1)))
+    {
+        return false;
+    }
+
+    if (size != N)
+    {
+        N = size;
+        while (((uint32_t)1 << log2N) < N)
+        {
+            log2N++;
+        }
+
+        twiddles.resize( N / 2 );
+        for (uint32_t k = 0; k < N / 2; k++)
+        {
+            twiddles[k] = polar( 1.0, -2.0 * M_PI * (double)k / (double)N );
+        }
+
+        bitReversed.resize( N );
+        for (uint32_t n = 0; n < N; n++)
+        {
+            uint32_t reversed = 0;
+            for (uint32_t bit = 0; bit < log2N; bit++)
+            {
+                reversed |= ((n >> bit) & 1) << (log2N - 1 - bit);
+            }
+            bitReversed[n] = reversed;
+        }
+    }
+
+    return true;
+}
+
+void Fft::Forward( vector<complex<double>>& data )
+{
+    Transform( data, false );
+}
+
+void Fft::Inverse( vector<complex<double>>& data )
+{
+    Transform( data, true );
+
+    double scale = 1.0 / (double)N;
+    for (uint32_t n = 0; n < N; n++)
+    {
+        data[n] *= scale;
+    }
+}
+
+uint32_t Fft::GetSize( void )
+{
+    return N;
+}
+
+uint32_t Fft::NextPowerOfTwo( uint32_t n )
+{
+    uint32_t powerOfTwo = 1;
+    while (powerOfTwo < n && powerOfTwo < ((uint32_t)1 << 31))
+    {
+        powerOfTwo <<= 1;
+    }
+    return powerOfTwo;
+}
+
+uint32_t Fft::PreviousPowerOfTwo( uint32_t n )
+{
+    uint32_t powerOfTwo = 1;
+    while (powerOfTwo <= n / 2)
+    {
+        powerOfTwo <<= 1;
+    }
+    return powerOfTwo;
+}
+
+void Fft::Transform( vector<complex<double>>& data, bool inverse )
+{
+    // Permute into bit reversed order
+    for (uint32_t n = 0; n < N; n++)
+    {
+        if (n < bitReversed[n])
+        {
+            swap( data[n], data[bitReversed[n]] );
+        }
+    }
+
+    // Butterflies; the inverse uses the conjugate twiddles
+    for (uint32_t span = 1; span < N; span <<= 1)
+    {
+        uint32_t twiddleStride = N / (2 * span);
+        for (uint32_t start = 0; start < N; start += 2 * span)
+        {
+            for (uint32_t k = 0; k < span; k++)
+            {
+                complex<double> w = inverse ? conj( twiddles[k * twiddleStride] ) : twiddles[k * twiddleStride];
+                complex<double> t = w * data[start + k + span];
+                data[start + k + span] = data[start + k] - t;
+                data[start + k] += t;
+            }
+        }
+    }
+}
@@ -0,0 +1,63 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: Fft.h
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <vector>
+#include <complex>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: class Fft
+//
+// Purpose: Radix-2 fast Fourier transform, for analyses that need every bin of a record rather
+//          than the few the Goertzel DFT computes.  See Fft.cpp for details.
+//
+// Parameters: N/A
+//
+// Notes: The size must be a power of 2.  Twiddle factors and the bit reversal permutation are
+//        computed once by Init, so one object can transform many records of the same size.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+class Fft
+{
+    public:
+        Fft(void);
+
+        bool Init( uint32_t size );
+        void Forward( vector<complex<double>>& data );
+        void Inverse( vector<complex<double>>& data );
+        uint32_t GetSize( void );
+
+        static uint32_t NextPowerOfTwo( uint32_t n );
+        static uint32_t PreviousPowerOfTwo( uint32_t n );
+
+    private:
+        void Transform( vector<complex<double>>& data, bool inverse );
+
+        uint32_t N;
+        vector<complex<double>> twiddles; // exp(-2*pi*i*k/N), k < N/2
+        vector<uint32_t> bitReversed;
+};
@@ -0,0 +1,1681 @@
+﻿//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: GoertzelDft.cpp
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "GoertzelDft.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <complex>
+#include <limits>
+#include <malloc.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft
+//
+// Purpose: The Goertzel algorithm is a fast method of computing a single point DFT.  Both magnitude and phase
+// are returned.  The advantage of performing the Goertzel algorithm vs an FFT is that for our application we're only
+// interested in a single frequency per measurement, and thus Goertzel is faster than FFT.  Also, an FFT requires the
+// full sample buffer to be stored.  Without an additional decimation, storing the whole sample buffer would be highly
+// impractical for some PicoScopes (up to 4GB of RAM needed).  This implementation is a generalized Goertzel algorithm
+// which allows for a non-integer bin (k ∈ R) [1], and thus is really a single point DTFT.  An important advantage of
+// the generalized Goertzel is that we don't have to adjust the number of samples or sampling rate to maintain accuracy
+// of the frequency selection.  These functions also compute other useful parameters such as amplitude and purity, which
+// can be used for data quality decisions.
+//
+// Parameters: 
+//    Init
+//             [in] totalSamples - Total number of samples in the full signal
+//             [in] fSamp - frequency of the sampling
+//             [in] fDetect - frequency to detect
+//    Feed
+//             [in] inputSamples - input channel data sample points
+//             [in] outputSamples - output channel data sample points
+//             [in] n - number of samples in this block of samples
+//             [out] return - true when this was the last block and the results are available
+//    GetResults
+//             [output] [in/out]putMagnitude - The Goertzel magnitude
+//             [output] [in/out]putPhase - The Goertzel phase
+//             [output] [in/out]putAmplitude - The measured amplitude of the signal
+//             [output] [in/out]putPurity - The purity of the signal (signal power over total power)
+//    GetHarmonicResults
+//             [in] harmonicIndex - 0 for the 2nd harmonic, 1 for the 3rd, etc.
+//             [output] [in/out]putMagnitude, [in/out]putPhase, [in/out]putAmplitude - as for GetResults
+//    GetThd
+//             [output] [in/out]putThd - RMS sum of the measured harmonic amplitudes over the fundamental amplitude
+//
+// Notes:
+//
+// - The standard recurrence used by the original Goertzel is known to have numerical accuracy
+//   issues [2] - i.e. O(N^2) error growth for theta near 0 or PI.  This can start to be a real problem for
+//   scopes with very large sample buffers (e.g. currently up to 1GS on the 6000 series).  The Reinsch
+//   modifications are a well known technique to deal with error at these extremes [2][3].  As theta approaches
+//   PI/2, the Reinsch recurrence numerical accuracy becomes worse than Goertzel [4].  To achieve the least
+//   error, the technique of Oliver [4] will be used to divide the domain into three regions, applying the
+//   best recurrence to each:
+//  (0.0 - 0.305*PI): REINSCH_0; (0.305*PI - 0.705*PI): GOERTZEL; (0.705*PI - PI): REINSCH_PI
+//
+// - The d.c. energy calculation can be seen as an execution of the Goertzel with Magic Circle Oscillator.
+//   When the tuning frequency is 0Hz, the tuning parameter is 0.  Thus the energy calculation is simplified
+//   to a sum of the samples, which the kernels accumulate exactly in integer arithmetic (SAMPLE_SUMS_T), as they
+//   do the sum of squares for the Parseval energy.
+//    - The idea to use alternate oscillators comes from the work of Clay Turner on Oscillator theory and
+//      application to the Goertzel:
+//      Ref. http://www.claysturner.com/dsp/digital_resonators.pdf
+//      Ref. http://www.claysturner.com/dsp/ResonatorTable.pdf
+//
+// - In experimenting with different oscillators, it was found that the (k ∈ R) phase correction factor can
+//   differ from e^j*2pi*k, but it still remains dependent only on k.  However, since this application is only
+//   interested in phase shift between input and output signals, and these have the same frequency (k), we need
+//   not apply the (k ∈ R) phase correction factor.  So, this implementation does not produce a "mathematically
+//   correct" phase, but that's OK for our application.
+//
+// - The benefit of processing the input and output signals together is that we can take advantage of SIMD
+//   parallelism (SSE, AVX, etc);  However, since the MSVC auto-vectorizer seems unable to vectorize the core
+//   loop, we're going to code it with intrinsics.  The core loop lives in GoertzelKernels*.cpp, with SSE2,
+//   AVX2 and AVX-512 versions chosen at runtime according to the CPU.
+//
+// - Since the recurrences are linear, a block of samples can be split into sub-blocks run from zero state
+//   and then merged exactly.  DftThreadPool uses this to compute the DFT on multiple threads.
+//
+// - Optionally, a bank of bins at the harmonics of fDetect is computed in the same pass over the data
+//   (SetNumHarmonics).  Each bin uses the recurrence best suited to its own theta, and since theta increases
+//   with the harmonic number the bins form at most three contiguous groups, one per recurrence.  Each group is
+//   run by a bank kernel (GoertzelBankKernel_T) which vectorizes across bins.  Harmonics at or above the
+//   Nyquist frequency are not measured.  The bank runs on the calling thread only.
+//
+// - Optionally, a window is applied (SetWindow) so that the capture need not contain a whole number of cycles,
+//   and far fewer cycles are needed to reject d.c. and the other harmonics.  A time domain window table would
+//   need as many entries as samples (up to 1GS), so instead the windows are cosine sums,
+//   w[n] = a0 - a1*cos(2*pi*n/N) + a2*cos(4*pi*n/N) - ..., which are applied in the frequency domain:
+//   Xw(theta) = a0*X(theta) - a1/2*[X(theta-2*pi/N) + X(theta+2*pi/N)] + a2/2*[...] - ...
+//   The extra bins needed at theta +/- 2*pi*k/N, for the fundamental, d.c. and each harmonic, are run in the
+//   bank.  The bins must be summed coherently, so for windowed measurements each bin's output is first
+//   corrected to the true DTFT phase (referenced to the first sample).  Amplitude, magnitude and d.c. are
+//   normalised by the window's coherent gain (a0), so results are on the same scale as rectangular ones.
+//
+// - Optionally, the capture is divided into K sub-blocks of whole cycles (SetNumSubBlocks), and the
+//   fundamental's DTFT is also taken for each, so that the scatter of the sub-block gains and phases gives a
+//   standard error for the measurement.  A sub-block's DTFT is the difference of the running DTFT at its ends,
+//   which is just the recurrence's state finished early, so this costs nothing per sample.  Each sub-block's
+//   d.c. (from the exact sums) is removed from its DTFT, since a sub-block's d.c. leakage isn't cancelled by
+//   the others'.  A caller which has what it needs can stop at a sub-block boundary (Truncate).
+//
+//   [1] Goertzel algorithm generalized to non-integer multiples of fundamental frequency
+//       Petr Sysel and Pavel Rajmic
+//       EURASIP Journal on Advances in Signal Processing 2012 2012:56.
+//       doi:10.1186/1687-6180-2012-56
+//
+//   [2] An error analysis of Goertzel's (Watt's) method for computing Fourier coefficients
+//       W.M. Gentleman
+//       Comput. J., Vol. 12, 1969, pp. 160-165.
+//       doi:10.1093/comjnl/12.2.160
+//
+//   [3] Stoer, J.; Bulirsch, R. (2002), "Introduction to Numerical Analysis", Springer
+//
+//   [4] On the sensitivity to rounding errors of Chebyshev series approximations
+//       J. Oliver
+//       Journal of Computational and Applied Mathematics
+//       Volume 3, Issue 2, June 1977, Pages 89-98
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+// Cosine sum window coefficients, indexed by DftWindow_T.  Terms alternate in sign, starting positive.
+static const double windowCoefficients[NUM_DFT_WINDOWS][GoertzelDft::maxWindowTerms] =
+{
+    { 1.0 },
+    { 0.5, 0.5 },
+    { 0.35875, 0.48829, 0.14128, 0.01168 }, // Harris 78
+    { 0.21557895, 0.41663158, 0.277263158, 0.083578947, 0.006947368 } // SRS flat top (HFT70 family)
+};
+static const uint8_t windowTerms[NUM_DFT_WINDOWS] = { 1, 2, 4, 5 };
+static const wchar_t* windowNames[NUM_DFT_WINDOWS] = { L"rectangular", L"Hann", L"Blackman-Harris", L"flat-top" };
+
+const double GoertzelDft::recurrenceThreshold1 = 0.305 * M_PI; // Oliver 77
+const double GoertzelDft::recurrenceThreshold2 = 0.705 * M_PI; // Oliver 77
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::SelectRecurrence
+//
+// Purpose: Choose the recurrence and compute its coefficient for a bin
+//
+// Parameters: [in] binFreqRatio - bin frequency / sampling frequency
+//             [out] recurrence - the recurrence to use
+//             [out] binKappa - the recurrence coefficient
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void GoertzelDft::SelectRecurrence( double binFreqRatio, DftRecurrence_T& recurrence, double& binKappa )
+{
+    double binTheta = 2.0 * M_PI * binFreqRatio;
+    double halfTheta;
+
+    if (binTheta < recurrenceThreshold1)
+    {
+        recurrence = REINSCH_0;
+        halfTheta = M_PI * binFreqRatio;
+        binKappa = -4.0 * pow( sin( halfTheta ), 2.0 );
+    }
+    else if (binTheta < recurrenceThreshold2)
+    {
+        recurrence = GOERTZEL;
+        binKappa = 2.0 * cos( binTheta );
+    }
+    else
+    {
+        recurrence = REINSCH_PI;
+        halfTheta = M_PI * binFreqRatio;
+        binKappa = 4.0 * pow( cos( halfTheta ), 2.0 );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: FinishBin
+//
+// Purpose: Iterate a bin's recurrence once more with 0 input (to get correct phase), and compute
+//          the complex output
+//
+// Parameters: [in] recurrence - the bin's recurrence
+//             [in] binKappa - the bin's recurrence coefficient
+//             [in] binTheta - the bin's frequency in radians per sample
+//             [in] a, b - the bin's state after the last sample
+//             [out] return - the complex DFT output
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static complex<double> FinishBin( DftRecurrence_T recurrence, double binKappa, double binTheta, double a, double b )
+{
+    double tau;
+
+    if (REINSCH_0 == recurrence)
+    {
+        b = b + binKappa * a;
+        a = a + b;
+        return complex<double>( b + a * binKappa/2.0, a * sin( binTheta ) );
+    }
+    else if (GOERTZEL == recurrence)
+    {
+        tau = binKappa * a - b;
+        b = a;
+        a = tau;
+        return complex<double>( a - b * cos( binTheta ), b * sin( binTheta ) );
+    }
+    else // REINSCH_PI
+    {
+        b = binKappa * a - b;
+        a = b - a;
+        return complex<double>( b - a * binKappa/2.0, -a * sin( binTheta ) );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: DtftPhaseFactor
+//
+// Purpose: Compute the factor which converts a bin's FinishBin output to the true DTFT,
+//          X(theta) = sum of x[n]*e^(-j*theta*n) for n = 0 .. N-1
+//
+// Parameters: [in] recurrence - the bin's recurrence
+//             [in] binFreqRatio - bin frequency / sampling frequency
+//             [in] N - number of samples
+//             [out] return - the phase factor
+//
+// Notes: The phase is computed from the fractional cycles, with the rounding error of the product
+//        recovered, as in CombineGoertzelState, since N can be up to 1GS.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static complex<double> DtftPhaseFactor( DftRecurrence_T recurrence, double binFreqRatio, uint32_t N )
+{
+    // The Reinsch outputs are referenced to one sample later than Goertzel's
+    double numSamples = (GOERTZEL == recurrence) ? (double)N : (double)N + 1.0;
+    double cycles = binFreqRatio * numSamples;
+    double cyclesError = fma( binFreqRatio, numSamples, -cycles );
+    complex<double> factor = polar( 1.0, -2.0 * M_PI * ((cycles - floor( cycles )) + cyclesError) );
+
+    return (REINSCH_PI == recurrence) ? -factor : factor;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: WindowSum
+//
+// Purpose: Apply a cosine sum window to a bin in the frequency domain
+//
+// Parameters: [in] coefficients - the window coefficients
+//             [in] numTerms - number of window coefficients
+//             [in] centre - true DTFT of the bin being windowed
+//             [in] sideBins - true DTFTs of the side bins, ordered -1, +1, -2, +2, ...
+//             [out] return - the windowed DTFT
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static complex<double> WindowSum( const double* coefficients, uint8_t numTerms, complex<double> centre, const complex<double>* sideBins )
+{
+    complex<double> sum = coefficients[0] * centre;
+    double sign = -1.0;
+
+    for (uint8_t k = 1; k < numTerms; k++, sign = -sign)
+    {
+        sum += (sign * coefficients[k] / 2.0) * (sideBins[2*(k-1)] + sideBins[2*(k-1)+1]);
+    }
+
+    return sum;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GeometricSum
+//
+// Purpose: Compute the sum of e^(j*2*pi*freqRatio*n) for n = 0 .. N-1
+//
+// Parameters: [in] freqRatio - frequency / sampling frequency
+//             [in] N - number of terms
+//             [out] return - the sum
+//
+// Notes: Uses the closed form e^(j*pi*r*(N-1)) * sin(pi*r*N) / sin(pi*r), with the large angles
+//        reduced exactly as in DtftPhaseFactor
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static complex<double> GeometricSum( double freqRatio, uint32_t N )
+{
+    double halfCycles, halfCyclesError, sinRatio;
+
+    if (0.0 == freqRatio - floor( freqRatio ))
+    {
+        return (double)N;
+    }
+
+    // sin(pi*r*N), reducing r*N mod 2
+    halfCycles = freqRatio * N;
+    halfCyclesError = fma( freqRatio, (double)N, -halfCycles );
+    sinRatio = sin( M_PI * ((halfCycles - 2.0 * floor( halfCycles / 2.0 )) + halfCyclesError) ) / sin( M_PI * freqRatio );
+
+    // e^(j*pi*r*(N-1)), reducing r*(N-1) mod 2
+    halfCycles = freqRatio * (N - 1.0);
+    halfCyclesError = fma( freqRatio, N - 1.0, -halfCycles );
+
+    return polar( sinRatio, M_PI * ((halfCycles - 2.0 * floor( halfCycles / 2.0 )) + halfCyclesError) );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: ReducedAngle
+//
+// Purpose: Compute pi*freqRatio*n, reduced modulo 2*pi
+//
+// Parameters: [in] freqRatio - frequency / sampling frequency
+//             [in] n - number of samples
+//             [out] return - the reduced angle, in radians
+//
+// Notes: Reduced as in GeometricSum.  Twice the result is 2*pi*freqRatio*n modulo 4*pi.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static double ReducedAngle( double freqRatio, double n )
+{
+    double halfCycles = freqRatio * n;
+    double halfCyclesError = fma( freqRatio, n, -halfCycles );
+
+    return M_PI * ((halfCycles - 2.0 * floor( halfCycles / 2.0 )) + halfCyclesError);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: RampSum
+//
+// Purpose: Compute the sum of n*e^(-j*2*pi*freqRatio*n) for n = 0 .. N-1
+//
+// Parameters: [in] freqRatio - frequency / sampling frequency
+//             [in] N - number of terms
+//             [out] return - the sum
+//
+// Notes: With phi = 2*pi*freqRatio and D(phi) = sin(phi*N/2)/sin(phi/2), the sum is
+//        e^(-j*phi*(N-1)/2) * ((N-1)/2 * D + j*dD/dphi): the ramp about its centre is odd, so
+//        contributes only the derivative of the (even) Dirichlet kernel.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static complex<double> RampSum( double freqRatio, uint32_t N )
+{
+    double sinHalfPhi = sin( M_PI * freqRatio );
+    double cosHalfPhi = cos( M_PI * freqRatio );
+    double halfAngle, D, dD;
+
+    if (0.0 == freqRatio - floor( freqRatio ))
+    {
+        return (double)N * (N - 1.0) / 2.0;
+    }
+
+    halfAngle = ReducedAngle( freqRatio, (double)N );
+    D = sin( halfAngle ) / sinHalfPhi;
+    dD = ((N / 2.0) * cos( halfAngle ) * sinHalfPhi - 0.5 * sin( halfAngle ) * cosHalfPhi ) / (sinHalfPhi * sinHalfPhi);
+
+    return polar( 1.0, -ReducedAngle( freqRatio, N - 1.0 ) ) * complex<double>( (N - 1.0) / 2.0 * D, dD );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: OneMinusExp
+//
+// Purpose: Compute 1 - e^(a+j*b) without cancellation when a+j*b is small
+//
+// Parameters: [in] a, b - real and imaginary parts of the exponent
+//             [out] return - the result
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static complex<double> OneMinusExp( double a, double b )
+{
+    double sinHalfB = sin( b / 2.0 );
+
+    return complex<double>( 2.0 * sinHalfB * sinHalfB - expm1( a ) * cos( b ), -exp( a ) * sin( b ) );
+}
+
+GoertzelDft::GoertzelDft(void)
+{
+    Kappa = 0.0;
+    a[0] = a[1] = b[0] = b[1] = 0.0;
+    sums.dcSum[0] = sums.dcSum[1] = 0;
+    sums.energySum[0] = sums.energySum[1] = 0;
+    sums.minSample[0] = sums.minSample[1] = 0;
+    sums.maxSample[0] = sums.maxSample[1] = 0;
+    dftRecurrence = REINSCH_0;
+    theta = 0.0;
+    freqRatio = 0.0;
+    samplesProcessed = 0;
+    N = 0;
+    goertzelKernel = SelectGoertzelKernel( dftRecurrence, GetSimdLevel() );
+    pDftThreadPool = NULL;
+    kernelTicks.QuadPart = 0;
+    magnitude.fill( 0.0 );
+    phase.fill( 0.0 );
+    amplitude.fill( 0.0 );
+    purity.fill( 0.0 );
+    signalEnergy.fill( 0.0 );
+    totalEnergy.fill( 0.0 );
+    dcEnergy.fill( 0.0 );
+
+    window = DFT_WINDOW_RECTANGULAR;
+    numWindowTerms = 1;
+    numHarmonics = 0;
+    numHarmonicsMeasured = 0;
+    numBankBins = 0;
+    numBins = 0;
+    fundamentalSideBins = dcSideBins = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        bankGroupStart[i] = bankGroupCount[i] = 0;
+        bankKernel[i] = NULL;
+    }
+    for (int i = 0; i < maxHarmonics; i++)
+    {
+        harmonicMagnitude[i].fill( 0.0 );
+        harmonicPhase[i].fill( 0.0 );
+        harmonicAmplitude[i].fill( 0.0 );
+    }
+    thd.fill( 0.0 );
+
+    numSubBlocksRequested = 0;
+    numSubBlocks = 0;
+    subBlocksCompleted = 0;
+    prefixX.fill( 0.0 );
+    prefixDcSum.fill( 0 );
+
+    trend = DFT_TREND_NONE;
+    trendFitted = false;
+    trendOffset.fill( 0.0 );
+    trendCoefficient.fill( 0.0 );
+    trendTimeConstant.fill( 0.0 );
+}
+
+void* GoertzelDft::operator new( size_t size )
+{
+    void* p = _aligned_malloc( size, 16 );
+    if (NULL == p)
+    {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+void GoertzelDft::operator delete( void* p )
+{
+    _aligned_free( p );
+}
+
+void GoertzelDft::SetThreadPool( DftThreadPool* pThreadPool )
+{
+    pDftThreadPool = pThreadPool;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::SetNumHarmonics
+//
+// Purpose: Set how many harmonics above the fundamental to measure, starting with the 2nd
+//
+// Parameters: [in] harmonics - number of harmonics; 0 to measure only the fundamental.  Limited to
+//                              maxHarmonics.
+//
+// Notes: Takes effect at the next Init
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void GoertzelDft::SetNumHarmonics( uint8_t harmonics )
+{
+    numHarmonics = (uint8_t)min( (int)harmonics, (int)maxHarmonics );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::SetWindow
+//
+// Purpose: Set the window applied to the fundamental, d.c. and harmonic measurements
+//
+// Parameters: [in] dftWindow - the window; DFT_WINDOW_RECTANGULAR (the default) for none
+//
+// Notes: Takes effect at the next Init.  Each window term adds two bins per measured frequency,
+//        computed in the same pass over the data.  A window's main lobe is as many bins wide, either
+//        side, as it has terms, so the capture should contain at least that many stimulus cycles for
+//        d.c. not to leak into the fundamental (Hann: 2, Blackman-Harris: 4, flat-top: 5), plus a few
+//        more for the sidelobes to fall away.  The captured cycles need not be whole.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void GoertzelDft::SetWindow( DftWindow_T dftWindow )
+{
+    window = (dftWindow < NUM_DFT_WINDOWS) ? dftWindow : DFT_WINDOW_RECTANGULAR;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::SetNumSubBlocks
+//
+// Purpose: Set how many sub-blocks the capture is divided into for the standard error estimate
+//
+// Parameters: [in] subBlocks - number of sub-blocks; 0 or 1 for none.  Limited to maxSubBlocks.
+//
+// Notes: Takes effect at the next Init.  Sub-blocks are a whole number of cycles long, so fewer are
+//        used if the capture holds fewer cycles than requested, and none if it holds less than 2.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void GoertzelDft::SetNumSubBlocks( uint8_t subBlocks )
+{
+    numSubBlocksRequested = (uint8_t)min( (int)subBlocks, (int)maxSubBlocks );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::SetTrendRemoval
+//
+// Purpose: Set what baseline, beyond d.c., is fitted and removed from the measurements
+//
+// Parameters: [in] dftTrend - the baseline model
+//
+// Notes: Takes effect at the next Init.  The baseline is fitted to the sub-block means, so at least
+//        minTrendSubBlocks sub-blocks are used while a trend is removed, capture length allowing.
+//        See FitTrend.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void GoertzelDft::SetTrendRemoval( DftTrend_T dftTrend )
+{
+    trend = (dftTrend < NUM_DFT_TRENDS) ? dftTrend : DFT_TREND_NONE;
+}
+
+const wchar_t* GoertzelDft::GetWindowName( DftWindow_T dftWindow )
+{
+    return windowNames[(dftWindow < NUM_DFT_WINDOWS) ? dftWindow : DFT_WINDOW_RECTANGULAR];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::AddBin
+//
+// Purpose: Request a bank bin
+//
+// Parameters: [in] binFreqRatio - bin frequency / sampling frequency, in (-0.5, 1.0)
+//             [out] return - the index of the request, for use in the results
+//
+// Notes: The frequency is folded into [0, 0.5]; since the samples are real the folded bin's result
+//        is conjugated.  Call BuildBank once all bins are requested.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint16_t GoertzelDft::AddBin( double binFreqRatio )
+{
+    bool conjugate = false;
+
+    if (binFreqRatio < 0.0)
+    {
+        binFreqRatio = -binFreqRatio;
+        conjugate = true;
+    }
+    if (binFreqRatio > 0.5)
+    {
+        binFreqRatio = 1.0 - binFreqRatio;
+        conjugate = !conjugate;
+    }
+
+    // Frequencies are held in request order until BuildBank
+    bankFreqRatio[numBins] = binFreqRatio;
+    binConjugate[numBins] = conjugate;
+
+    return numBins++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::BuildBank
+//
+// Purpose: Lay out the requested bins in the bank, grouped by recurrence so that each group can be
+//          run by one bank kernel
+//
+// Parameters: N/A
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void GoertzelDft::BuildBank( void )
+{
+    double requestFreqRatio[maxBankBins];
+    double requestKappa[maxBankBins];
+    DftRecurrence_T requestRecurrence[maxBankBins];
+
+    for (uint16_t i = 0; i < numBins; i++)
+    {
+        requestFreqRatio[i] = bankFreqRatio[i];
+        SelectRecurrence( requestFreqRatio[i], requestRecurrence[i], requestKappa[i] );
+    }
+
+    numBankBins = 0;
+    for (int r = 0; r < 3; r++)
+    {
+        bankGroupStart[r] = numBankBins;
+        bankGroupCount[r] = 0;
+        bankKernel[r] = SelectGoertzelBankKernel( (DftRecurrence_T)r, GetSimdLevel() );
+
+        for (uint16_t i = 0; i < numBins; i++)
+        {
+            if (r == requestRecurrence[i])
+            {
+                binSlot[i] = numBankBins;
+                bankFreqRatio[numBankBins] = requestFreqRatio[i];
+                bankKappa[numBankBins] = requestKappa[i];
+                bankRecurrence[numBankBins] = requestRecurrence[i];
+                bankA[2*numBankBins] = bankA[2*numBankBins+1] = 0.0;
+                bankB[2*numBankBins] = bankB[2*numBankBins+1] = 0.0;
+                bankGroupCount[r]++;
+                numBankBins++;
+            }
+        }
+    }
+}
+
+void GoertzelDft::Init( uint32_t totalSamples, double fSamp, double fDetect )
+{
+    a[0] = a[1] = b[0] = b[1] = 0.0;
+    sums.dcSum[0] = sums.dcSum[1] = 0;
+    sums.energySum[0] = sums.energySum[1] = 0;
+    sums.minSample[0] = sums.minSample[1] = 0;
+    sums.maxSample[0] = sums.maxSample[1] = 0;
+    samplesProcessed = 0;
+    kernelTicks.QuadPart = 0;
+
+    N = totalSamples;
+
+    freqRatio = fDetect / fSamp;
+    theta = 2.0 * M_PI * freqRatio;
+
+    SelectRecurrence( freqRatio, dftRecurrence, Kappa );
+
+    goertzelKernel = SelectGoertzelKernel( dftRecurrence, GetSimdLevel() );
+
+    // Request the bank bins: the window's side bins for the fundamental and d.c., then each harmonic
+    // below Nyquist with its side bins
+    numWindowTerms = windowTerms[window];
+    numBins = 0;
+
+    fundamentalSideBins = numBins;
+    for (uint8_t k = 1; k < numWindowTerms; k++)
+    {
+        (void)AddBin( freqRatio - (double)k / N );
+        (void)AddBin( freqRatio + (double)k / N );
+    }
+
+    dcSideBins = numBins;
+    for (uint8_t k = 1; k < numWindowTerms; k++)
+    {
+        (void)AddBin( (double)k / N );
+    }
+
+    for (numHarmonicsMeasured = 0; numHarmonicsMeasured < numHarmonics; numHarmonicsMeasured++)
+    {
+        double binFreqRatio = (numHarmonicsMeasured + 2) * freqRatio;
+
+        if (binFreqRatio >= 0.5)
+        {
+            break;
+        }
+
+        harmonicBins[numHarmonicsMeasured] = AddBin( binFreqRatio );
+        for (uint8_t k = 1; k < numWindowTerms; k++)
+        {
+            (void)AddBin( binFreqRatio - (double)k / N );
+            (void)AddBin( binFreqRatio + (double)k / N );
+        }
+    }
+
+    BuildBank();
+
+    // Sub-block boundaries, at whole cycles; the last sub-block takes any remainder
+    numSubBlocks = (uint8_t)min( (double)max( numSubBlocksRequested, (uint8_t)(DFT_TREND_NONE == trend ? 0 : minTrendSubBlocks) ),
+                                 floor( freqRatio * N ) );
+    if (numSubBlocks < 2)
+    {
+        numSubBlocks = 0;
+    }
+    else
+    {
+        double cyclesPerSubBlock = floor( freqRatio * N / numSubBlocks );
+        for (uint8_t k = 0; k < numSubBlocks - 1; k++)
+        {
+            subBlockEnd[k] = (uint32_t)((k + 1) * cyclesPerSubBlock / freqRatio + 0.5);
+        }
+        subBlockEnd[numSubBlocks-1] = N;
+    }
+    subBlocksCompleted = 0;
+    prefixX.fill( 0.0 );
+    prefixDcSum.fill( 0 );
+    trendFitted = false;
+
+    for (int i = 0; i < maxHarmonics; i++)
+    {
+        harmonicMagnitude[i].fill( 0.0 );
+        harmonicPhase[i].fill( 0.0 );
+        harmonicAmplitude[i].fill( 0.0 );
+    }
+    thd.fill( 0.0 );
+}
+
+bool GoertzelDft::Feed( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n )
+{
+    bool lastBlock = false;
+
+    LARGE_INTEGER kernelStart, kernelEnd;
+
+    // Determine if this is the last block.  If it is, there is special processing.
+    lastBlock = ((samplesProcessed + n) == N);
+
+    // Execute the filters, stopping at each sub-block boundary to take the sub-block's DTFT
+    QueryPerformanceCounter( &kernelStart );
+    while (n)
+    {
+        uint32_t run = n;
+
+        if (subBlocksCompleted < numSubBlocks)
+        {
+            run = min( n, subBlockEnd[subBlocksCompleted] - samplesProcessed );
+        }
+
+        RunKernels( inputSamples, outputSamples, run );
+
+        inputSamples += run;
+        outputSamples += run;
+        n -= run;
+        samplesProcessed += run;
+
+        if (subBlocksCompleted < numSubBlocks && samplesProcessed == subBlockEnd[subBlocksCompleted])
+        {
+            EndSubBlock();
+        }
+    }
+    QueryPerformanceCounter( &kernelEnd );
+    kernelTicks.QuadPart += kernelEnd.QuadPart - kernelStart.QuadPart;
+
+    if (lastBlock)
+    {
+        ComputeResults();
+    }
+
+    return lastBlock;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::RunKernels
+//
+// Purpose: Run the fundamental's recurrence, with the d.c. and Parseval energy sums, and the bank
+//          over a block of samples
+//
+// Parameters: [in] inputSamples, outputSamples, n - as for Feed
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void GoertzelDft::RunKernels( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n )
+{
+    // Vectors
+    __m128d KappaVec, aVec, bVec;
+
+    // Load vectors
+    KappaVec = _mm_load1_pd(&Kappa);
+    aVec = _mm_load_pd(a);
+    bVec = _mm_load_pd(b);
+
+    // Execute the filter, d.c. Energy and Parseval energy time domain calculation
+    if (NULL != pDftThreadPool)
+    {
+        pDftThreadPool->FeedGoertzel( goertzelKernel, dftRecurrence, freqRatio, inputSamples, outputSamples, n,
+                                      KappaVec, aVec, bVec, sums );
+    }
+    else
+    {
+        goertzelKernel( inputSamples, outputSamples, n, KappaVec, aVec, bVec, sums );
+    }
+
+    // Execute the harmonic bank
+    for (int i = 0; i < 3; i++)
+    {
+        if (bankGroupCount[i])
+        {
+            uint16_t start = bankGroupStart[i];
+            bankKernel[i]( inputSamples, outputSamples, n, bankGroupCount[i], &bankKappa[start], &bankA[2*start], &bankB[2*start] );
+        }
+    }
+
+    // Unvectorize
+    _mm_store_pd(a, aVec);
+    _mm_store_pd(b, bVec);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::EndSubBlock
+//
+// Purpose: Record the fundamental's DTFT over the sub-block just completed
+//
+// Parameters: N/A
+//
+// Notes: The running DTFT over samples 0 .. m-1 is the state after m samples, finished and phase
+//        corrected as if m were the total.  The sub-block's d.c. leaks into its DTFT by
+//        dc * sum of e^(-j*theta*n) over the sub-block.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void GoertzelDft::EndSubBlock( void )
+{
+    uint32_t start = subBlocksCompleted ? subBlockEnd[subBlocksCompleted-1] : 0;
+    complex<double> factor = DtftPhaseFactor( dftRecurrence, freqRatio, samplesProcessed );
+    complex<double> leakage = conj( GeometricSum( freqRatio, samplesProcessed ) - GeometricSum( freqRatio, start ) ) /
+                              (double)(samplesProcessed - start);
+
+    for (int c = 0; c < 2; c++)
+    {
+        complex<double> X = factor * FinishBin( dftRecurrence, Kappa, theta, a[c], b[c] );
+        subBlockX[subBlocksCompleted][c] = (X - prefixX[c]) - (double)(sums.dcSum[c] - prefixDcSum[c]) * leakage;
+        subBlockDcSum[subBlocksCompleted][c] = sums.dcSum[c] - prefixDcSum[c];
+        prefixX[c] = X;
+        prefixDcSum[c] = sums.dcSum[c];
+    }
+
+    subBlocksCompleted++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::ComputeResults
+//
+// Purpose: Compute the results from the state after the last sample
+//
+// Parameters: N/A
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void GoertzelDft::ComputeResults( void )
+{
+    array<complex<double>, 2> y;
+    array<double, 2> dcSum;
+    complex<double> binX[2][maxBankBins];
+    const double* coefficients = windowCoefficients[window];
+    bool windowed = (numWindowTerms > 1);
+
+    // Compute the complex output
+    y[0] = FinishBin( dftRecurrence, Kappa, theta, a[0], b[0] );
+    y[1] = FinishBin( dftRecurrence, Kappa, theta, a[1], b[1] );
+
+    // Bank bin outputs in request order; when windowing these must be true DTFTs so they can be summed
+    for (uint16_t i = 0; i < numBins; i++)
+    {
+        uint16_t slot = binSlot[i];
+        complex<double> factor = windowed ? DtftPhaseFactor( bankRecurrence[slot], bankFreqRatio[slot], N ) : 1.0;
+        for (int c = 0; c < 2; c++)
+        {
+            binX[c][i] = factor * FinishBin( bankRecurrence[slot], bankKappa[slot], 2.0 * M_PI * bankFreqRatio[slot],
+                                             bankA[2*slot+c], bankB[2*slot+c] );
+            if (binConjugate[i])
+            {
+                binX[c][i] = conj( binX[c][i] );
+            }
+        }
+    }
+
+    // Remove the fitted baseline's leakage into the bins
+    array<double, 2> baselineSum = {{ 0.0, 0.0 }};
+    array<double, 2> baselineEnergy = {{ 0.0, 0.0 }};
+    trendFitted = FitTrend();
+    if (trendFitted)
+    {
+        RemoveBaseline( binX, y, baselineSum, baselineEnergy );
+    }
+
+    // The sums are exact; the conversions to double are the first rounding
+    dcSum[0] = (double)sums.dcSum[0] - baselineSum[0];
+    dcSum[1] = (double)sums.dcSum[1] - baselineSum[1];
+
+    if (windowed)
+    {
+        // Scale so that amplitude = 2 * magnitude / (N+1) holds as for the rectangular window
+        double scale = (N+1) / (coefficients[0] * N);
+        complex<double> factor = DtftPhaseFactor( dftRecurrence, freqRatio, N );
+        for (int c = 0; c < 2; c++)
+        {
+            y[c] = scale * WindowSum( coefficients, numWindowTerms, factor * y[c], &binX[c][fundamentalSideBins] );
+
+            // Windowed sum of the samples, divided by the window's coherent gain
+            double sign = -1.0;
+            for (uint8_t k = 1; k < numWindowTerms; k++, sign = -sign)
+            {
+                dcSum[c] += sign * coefficients[k] / coefficients[0] * binX[c][dcSideBins+k-1].real();
+            }
+        }
+    }
+
+    magnitude[0] = abs(y[0]);
+    magnitude[1] = abs(y[1]);
+    phase[0] = arg(y[0]);
+    phase[1] = arg(y[1]);
+
+    // Using N+1 because this form of the Goertzel iterates N+1 times, with x[N] = 0, thus effectively using N+1 samples.
+    // The x[N]=0 sample has no effect on the time domain Parseval's energy calculation.
+    amplitude[0] = 2.0 * magnitude[0] / (N+1);
+    amplitude[1] = 2.0 * magnitude[1] / (N+1);
+    signalEnergy[0] = 2.0 * (magnitude[0] * magnitude[0]) / (N+1);
+    signalEnergy[1] = 2.0 * (magnitude[1] * magnitude[1]) / (N+1);
+    totalEnergy[0] = (double)sums.energySum[0];
+    totalEnergy[1] = (double)sums.energySum[1];
+    dcEnergy[0] = (dcSum[0] * dcSum[0]) / (N+1);
+    dcEnergy[1] = (dcSum[1] * dcSum[1]) / (N+1);
+
+    // Harmonics
+    array<double, 2> harmonicEnergy = {{ 0.0, 0.0 }};
+    array<array<complex<double>, maxHarmonics>, 2> harmonicY;
+    for (uint8_t i = 0; i < numHarmonicsMeasured; i++)
+    {
+        for (int c = 0; c < 2; c++)
+        {
+            complex<double> yh = binX[c][harmonicBins[i]];
+            if (windowed)
+            {
+                yh = (N+1) / (coefficients[0] * N) * WindowSum( coefficients, numWindowTerms, yh, &binX[c][harmonicBins[i]+1] );
+            }
+            harmonicY[c][i] = yh;
+            harmonicMagnitude[i][c] = abs(yh);
+            harmonicPhase[i][c] = arg(yh);
+            harmonicAmplitude[i][c] = 2.0 * harmonicMagnitude[i][c] / (N+1);
+            harmonicEnergy[c] += harmonicAmplitude[i][c] * harmonicAmplitude[i][c];
+        }
+    }
+    thd[0] = amplitude[0] > 0.0 ? sqrt( harmonicEnergy[0] ) / amplitude[0] : 0.0;
+    thd[1] = amplitude[1] > 0.0 ? sqrt( harmonicEnergy[1] ) / amplitude[1] : 0.0;
+
+    if (windowed)
+    {
+        // Without whole cycles, the record's energy is not simply the d.c. energy plus the tones' average
+        // powers: there are cross terms between d.c. and the tones, and between the tones.  So model the
+        // record as the measured d.c. plus the fundamental and harmonics, x[n] = dc + sum of Re(C*e^(j*theta*n)),
+        // and compute its energy terms exactly.  The tones' own energies are kept as signal; the rest of
+        // the model's energy is charged to d.c., so that purity = fundamental energy / (tone energies +
+        // residual energy).
+        for (int c = 0; c < 2; c++)
+        {
+            complex<double> toneC[maxHarmonics+1];
+            double dc = dcSum[c] / N;
+            double modelEnergy = N * dc * dc;
+            double tonesEnergy = 0.0;
+
+            toneC[0] = 2.0 * y[c] / (double)(N+1);
+            for (uint8_t i = 0; i < numHarmonicsMeasured; i++)
+            {
+                toneC[i+1] = 2.0 * harmonicY[c][i] / (double)(N+1);
+            }
+
+            for (uint8_t i = 0; i <= numHarmonicsMeasured; i++)
+            {
+                modelEnergy += 2.0 * dc * (toneC[i] * GeometricSum( (i+1) * freqRatio, N )).real();
+                for (uint8_t k = 0; k <= i; k++)
+                {
+                    double crossEnergy = (toneC[i] * toneC[k] * GeometricSum( (i+k+2) * freqRatio, N ) +
+                                          toneC[i] * conj( toneC[k] ) * GeometricSum( (i-k) * freqRatio, N )).real() / 2.0;
+                    if (k == i)
+                    {
+                        tonesEnergy += crossEnergy;
+                        if (0 == i)
+                        {
+                            signalEnergy[c] = crossEnergy;
+                        }
+                    }
+                    else
+                    {
+                        crossEnergy *= 2.0;
+                    }
+                    modelEnergy += crossEnergy;
+                }
+            }
+
+            dcEnergy[c] = modelEnergy - tonesEnergy;
+        }
+    }
+
+    // With a baseline removed, d.c. above is only what's left of it; the baseline itself is not noise either
+    dcEnergy[0] += baselineEnergy[0];
+    dcEnergy[1] += baselineEnergy[1];
+
+    purity[0] = signalEnergy[0] / (totalEnergy[0] - dcEnergy[0]);
+    purity[1] = signalEnergy[1] / (totalEnergy[1] - dcEnergy[1]);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::FitTrend
+//
+// Purpose: Fit the baseline, offset + coefficient * shape(n), to the sub-block means of each channel
+//
+// Parameters: [out] return - whether a baseline was fitted
+//
+// Notes: Sub-blocks are whole cycles, so the stimulus contributes (almost) nothing to their means,
+//        which therefore sample the baseline alone; no extra work per sample is needed.  The mean
+//        of a sub-block is compared with the mean of the model over the same samples, so unequal
+//        sub-blocks are handled exactly.  The fit is least squares, weighted by sub-block length.
+//        For the exponential, the time constant is found by a search (a coarse logarithmic grid,
+//        then golden section), the offset and coefficient being linear for any time constant.
+//        Time constants are searched from a quarter of a sub-block, below which the transient is
+//        over within the first sub-block, to many captures, beyond which it is a linear drift.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool GoertzelDft::FitTrend( void )
+{
+    const int gridPoints = 32;
+    const int goldenSectionIterations = 40;
+    double means[maxSubBlocks], weights[maxSubBlocks];
+    uint32_t start;
+
+    if (DFT_TREND_NONE == trend || numSubBlocks < (DFT_TREND_LINEAR == trend ? 3 : 4) || subBlocksCompleted < numSubBlocks)
+    {
+        return false;
+    }
+
+    for (int c = 0; c < 2; c++)
+    {
+        // Weighted least squares fit of the means to offset + coefficient * (shape mean), returning
+        // the weighted residual
+        auto fitAndResidual = [&]( void ) -> double
+        {
+            double shapeMeans[maxSubBlocks];
+            double sumW = 0.0, sumX = 0.0, sumY = 0.0, sxx = 0.0, sxy = 0.0, residual = 0.0;
+
+            start = 0;
+            for (uint8_t k = 0; k < numSubBlocks; k++)
+            {
+                shapeMeans[k] = TrendShapeMean( c, start, subBlockEnd[k] );
+                sumW += weights[k];
+                sumX += weights[k] * shapeMeans[k];
+                sumY += weights[k] * means[k];
+                start = subBlockEnd[k];
+            }
+            for (uint8_t k = 0; k < numSubBlocks; k++)
+            {
+                sxx += weights[k] * (shapeMeans[k] - sumX / sumW) * (shapeMeans[k] - sumX / sumW);
+                sxy += weights[k] * (shapeMeans[k] - sumX / sumW) * (means[k] - sumY / sumW);
+            }
+            trendCoefficient[c] = sxx > 0.0 ? sxy / sxx : 0.0;
+            trendOffset[c] = (sumY - trendCoefficient[c] * sumX) / sumW;
+            for (uint8_t k = 0; k < numSubBlocks; k++)
+            {
+                double error = means[k] - trendOffset[c] - trendCoefficient[c] * shapeMeans[k];
+                residual += weights[k] * error * error;
+            }
+            return residual;
+        };
+
+        start = 0;
+        for (uint8_t k = 0; k < numSubBlocks; k++)
+        {
+            weights[k] = (double)(subBlockEnd[k] - start);
+            means[k] = (double)subBlockDcSum[k][c] / weights[k];
+            start = subBlockEnd[k];
+        }
+
+        if (DFT_TREND_LINEAR == trend)
+        {
+            trendTimeConstant[c] = numeric_limits<double>::quiet_NaN();
+            (void)fitAndResidual();
+        }
+        else
+        {
+            double logMin = log( (double)N / (4.0 * numSubBlocks) );
+            double logMax = log( 64.0 * (double)N );
+            double logStep = (logMax - logMin) / (gridPoints - 1);
+            double bestResidual = (numeric_limits<double>::max)(), residual, lo, hi, x1, x2, r1, r2;
+            const double invPhi = (sqrt( 5.0 ) - 1.0) / 2.0;
+            int best = 0;
+
+            for (int i = 0; i < gridPoints; i++)
+            {
+                trendTimeConstant[c] = exp( logMin + i * logStep );
+                residual = fitAndResidual();
+                if (residual < bestResidual)
+                {
+                    bestResidual = residual;
+                    best = i;
+                }
+            }
+
+            lo = logMin + max( 0, best - 1 ) * logStep;
+            hi = logMin + min( gridPoints - 1, best + 1 ) * logStep;
+            x1 = hi - invPhi * (hi - lo);
+            x2 = lo + invPhi * (hi - lo);
+            trendTimeConstant[c] = exp( x1 );
+            r1 = fitAndResidual();
+            trendTimeConstant[c] = exp( x2 );
+            r2 = fitAndResidual();
+            for (int i = 0; i < goldenSectionIterations; i++)
+            {
+                if (r1 < r2)
+                {
+                    hi = x2;
+                    x2 = x1;
+                    r2 = r1;
+                    x1 = hi - invPhi * (hi - lo);
+                    trendTimeConstant[c] = exp( x1 );
+                    r1 = fitAndResidual();
+                }
+                else
+                {
+                    lo = x1;
+                    x1 = x2;
+                    r1 = r2;
+                    x2 = lo + invPhi * (hi - lo);
+                    trendTimeConstant[c] = exp( x2 );
+                    r2 = fitAndResidual();
+                }
+            }
+            trendTimeConstant[c] = exp( (lo + hi) / 2.0 );
+            (void)fitAndResidual();
+        }
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::TrendShapeMean
+//
+// Purpose: Compute the mean of the baseline shape over samples start .. end-1
+//
+// Parameters: [in] c - channel
+//             [in] start, end - the samples
+//             [out] return - the mean
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+double GoertzelDft::TrendShapeMean( int c, uint32_t start, uint32_t end )
+{
+    double L = (double)(end - start);
+
+    if (DFT_TREND_LINEAR == trend)
+    {
+        return ((double)start + (double)end - 1.0) / 2.0;
+    }
+    else
+    {
+        double tau = trendTimeConstant[c];
+        return exp( -(double)start / tau ) * expm1( -L / tau ) / (L * expm1( -1.0 / tau ));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::TrendShapeDtft
+//
+// Purpose: Compute the DTFT of the baseline shape over samples start .. end-1
+//
+// Parameters: [in] c - channel
+//             [in] binFreqRatio - bin frequency / sampling frequency
+//             [in] start, end - the samples
+//             [out] return - the sum of shape(n)*e^(-j*2*pi*binFreqRatio*n) over the samples
+//
+// Notes: For the linear shape, the sum over n = start + m is e^(-j*2*pi*r*start) * (start *
+//        (geometric sum) + (ramp sum)).  For the exponential, it's a geometric series in
+//        w = e^(-1/timeConstant - j*2*pi*r): w^start * (1 - w^L) / (1 - w).
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+complex<double> GoertzelDft::TrendShapeDtft( int c, double binFreqRatio, uint32_t start, uint32_t end )
+{
+    uint32_t L = end - start;
+    complex<double> startPhase = polar( 1.0, -2.0 * ReducedAngle( binFreqRatio, (double)start ) );
+
+    if (DFT_TREND_LINEAR == trend)
+    {
+        return startPhase * ((double)start * conj( GeometricSum( binFreqRatio, L ) ) + RampSum( binFreqRatio, L ));
+    }
+    else
+    {
+        double tau = trendTimeConstant[c];
+        return exp( -(double)start / tau ) * startPhase *
+               OneMinusExp( -(double)L / tau, -2.0 * ReducedAngle( binFreqRatio, (double)L ) ) /
+               OneMinusExp( -1.0 / tau, -2.0 * M_PI * binFreqRatio );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::BaselineDtft
+//
+// Purpose: Compute the DTFT of the fitted baseline over samples start .. end-1
+//
+// Parameters: [in] c - channel
+//             [in] binFreqRatio - bin frequency / sampling frequency
+//             [in] start, end - the samples
+//             [out] return - the DTFT
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+complex<double> GoertzelDft::BaselineDtft( int c, double binFreqRatio, uint32_t start, uint32_t end )
+{
+    complex<double> startPhase = polar( 1.0, -2.0 * ReducedAngle( binFreqRatio, (double)start ) );
+
+    return trendOffset[c] * startPhase * conj( GeometricSum( binFreqRatio, end - start ) ) +
+           trendCoefficient[c] * TrendShapeDtft( c, binFreqRatio, start, end );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::RemoveBaseline
+//
+// Purpose: Subtract the fitted baseline's DTFT from the fundamental, the bank bins and the sub-block
+//          DTFTs
+//
+// Parameters: [in/out] binX - bank bin outputs, as computed in ComputeResults
+//             [in/out] y - fundamental outputs, as computed in ComputeResults
+//             [out] baselineSum - sum of the baseline over the record, for each channel
+//             [out] baselineEnergy - energy the baseline adds to the record, for each channel
+//
+// Notes: Outputs not already true DTFTs are converted to them to subtract the baseline, and back.
+//        The baseline's energy includes its cross term with the fundamental, which is not small
+//        for a drift (e.g. a ramp against a sine is a sawtooth's worth of correlation); cross terms
+//        with harmonics are neglected.  The sub-blocks already have their own d.c. removed, so
+//        only the shape's deviation from its sub-block mean is subtracted from them.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void GoertzelDft::RemoveBaseline( complex<double> binX[2][maxBankBins], array<complex<double>,2>& y,
+                                  array<double,2>& baselineSum, array<double,2>& baselineEnergy )
+{
+    bool windowed = (numWindowTerms > 1);
+    complex<double> factor = DtftPhaseFactor( dftRecurrence, freqRatio, N );
+    uint32_t start;
+
+    for (int c = 0; c < 2; c++)
+    {
+        complex<double> baselineY = BaselineDtft( c, freqRatio, 0, N );
+        double shapeSum, shapeSumSquares;
+
+        y[c] = (factor * y[c] - baselineY) / factor;
+
+        for (uint16_t i = 0; i < numBins; i++)
+        {
+            uint16_t slot = binSlot[i];
+            complex<double> binFactor = windowed ? 1.0 : DtftPhaseFactor( bankRecurrence[slot], bankFreqRatio[slot], N );
+            complex<double> baseline = BaselineDtft( c, bankFreqRatio[slot], 0, N );
+
+            if (binConjugate[i])
+            {
+                binFactor = conj( binFactor );
+                baseline = conj( baseline );
+            }
+            binX[c][i] = (binFactor * binX[c][i] - baseline) / binFactor;
+        }
+
+        start = 0;
+        for (uint8_t k = 0; k < subBlocksCompleted; k++)
+        {
+            uint32_t end = subBlockEnd[k];
+            complex<double> startPhase = polar( 1.0, -2.0 * ReducedAngle( freqRatio, (double)start ) );
+            subBlockX[k][c] -= trendCoefficient[c] * (TrendShapeDtft( c, freqRatio, start, end ) -
+                                                      TrendShapeMean( c, start, end ) * startPhase * conj( GeometricSum( freqRatio, end - start ) ));
+            start = end;
+        }
+
+        if (DFT_TREND_LINEAR == trend)
+        {
+            shapeSum = (double)N * (N - 1.0) / 2.0;
+            shapeSumSquares = (double)N * (N - 1.0) * (2.0 * N - 1.0) / 6.0;
+        }
+        else
+        {
+            double tau = trendTimeConstant[c];
+            shapeSum = expm1( -(double)N / tau ) / expm1( -1.0 / tau );
+            shapeSumSquares = expm1( -2.0 * N / tau ) / expm1( -2.0 / tau );
+        }
+
+        baselineSum[c] = trendOffset[c] * N + trendCoefficient[c] * shapeSum;
+        baselineEnergy[c] = trendOffset[c] * trendOffset[c] * N + 2.0 * trendOffset[c] * trendCoefficient[c] * shapeSum +
+                            trendCoefficient[c] * trendCoefficient[c] * shapeSumSquares +
+                            2.0 * (2.0 * factor * y[c] / (double)(N+1) * conj( baselineY )).real();
+    }
+}
+
+void GoertzelDft::GetResults( double& inputMagnitude, double& inputPhase, double& inputAmplitude, double& inputPurity,
+                              double& outputMagnitude, double& outputPhase, double& outputAmplitude, double& outputPurity )
+{
+    inputMagnitude = magnitude[0];
+    inputPhase = phase[0];
+    inputAmplitude = amplitude[0];
+    inputPurity = purity[0];
+
+    outputMagnitude = magnitude[1];
+    outputPhase = phase[1];
+    outputAmplitude = amplitude[1];
+    outputPurity = purity[1];
+}
+
+DftRecurrence_T GoertzelDft::GetRecurrence( void )
+{
+    return dftRecurrence;
+}
+
+DftWindow_T GoertzelDft::GetWindow( void )
+{
+    return window;
+}
+
+DftTrend_T GoertzelDft::GetTrendRemoval( void )
+{
+    return trend;
+}
+
+uint32_t GoertzelDft::GetTotalSamples( void )
+{
+    return N;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::GetEquivalentNoiseBandwidthBins
+//
+// Purpose: Get the equivalent noise bandwidth of the current window, in bins (fSamp / N)
+//
+// Parameters: [out] return - the equivalent noise bandwidth; 1.0 for the rectangular window
+//
+// Notes: For a cosine sum window this is (a0^2 + (a1^2 + a2^2 + ...)/2) / a0^2
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+double GoertzelDft::GetEquivalentNoiseBandwidthBins( void )
+{
+    const double* coefficients = windowCoefficients[window];
+    double sumSquares = coefficients[0] * coefficients[0];
+
+    for (uint8_t k = 1; k < windowTerms[window]; k++)
+    {
+        sumSquares += coefficients[k] * coefficients[k] / 2.0;
+    }
+
+    return sumSquares / (coefficients[0] * coefficients[0]);
+}
+
+double GoertzelDft::GetKernelSeconds( void )
+{
+    LARGE_INTEGER ticksPerSecond;
+    QueryPerformanceFrequency( &ticksPerSecond );
+    return (double)kernelTicks.QuadPart / (double)ticksPerSecond.QuadPart;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::GetEnergies
+//
+// Purpose: Get the energy terms used in the purity calculation, for diagnostics
+//
+// Parameters: [out] [in/out]putDcEnergy - energy of the d.c. component
+//             [out] [in/out]putSignalEnergy - energy of the detected frequency component
+//             [out] [in/out]putTotalEnergy - total (Parseval) energy of the signal
+//
+// Notes: Only valid once the last block has been fed
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void GoertzelDft::GetEnergies( double& inputDcEnergy, double& inputSignalEnergy, double& inputTotalEnergy,
+                               double& outputDcEnergy, double& outputSignalEnergy, double& outputTotalEnergy )
+{
+    inputDcEnergy = dcEnergy[0];
+    inputSignalEnergy = signalEnergy[0];
+    inputTotalEnergy = totalEnergy[0];
+
+    outputDcEnergy = dcEnergy[1];
+    outputSignalEnergy = signalEnergy[1];
+    outputTotalEnergy = totalEnergy[1];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::GetNumHarmonicsMeasured
+//
+// Purpose: Get the number of harmonics measured, which may be fewer than requested because
+//          harmonics at or above the Nyquist frequency are not measured
+//
+// Parameters: [out] return - number of harmonics measured, starting with the 2nd
+//
+// Notes: Valid from Init onward
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint8_t GoertzelDft::GetNumHarmonicsMeasured( void )
+{
+    return numHarmonicsMeasured;
+}
+
+void GoertzelDft::GetHarmonicResults( uint8_t harmonicIndex, double& inputMagnitude, double& inputPhase, double& inputAmplitude,
+                                      double& outputMagnitude, double& outputPhase, double& outputAmplitude )
+{
+    inputMagnitude = harmonicMagnitude[harmonicIndex][0];
+    inputPhase = harmonicPhase[harmonicIndex][0];
+    inputAmplitude = harmonicAmplitude[harmonicIndex][0];
+
+    outputMagnitude = harmonicMagnitude[harmonicIndex][1];
+    outputPhase = harmonicPhase[harmonicIndex][1];
+    outputAmplitude = harmonicAmplitude[harmonicIndex][1];
+}
+
+void GoertzelDft::GetThd( double& inputThd, double& outputThd )
+{
+    inputThd = thd[0];
+    outputThd = thd[1];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::GetStandardErrors
+//
+// Purpose: Estimate the standard error of the gain and phase (output relative to input) from the
+//          scatter of the sub-block measurements
+//
+// Parameters: [out] gainStdErrDb - standard error of the gain, in dB
+//             [out] phaseStdErrDeg - standard error of the phase, in degrees
+//
+// Notes: Uses the sub-blocks completed so far, so may be called between Feeds.  NaN if fewer than 2
+//        sub-blocks are complete or the input has no signal.  The sub-blocks are rectangular; a
+//        windowed measurement over the whole capture has ENBW times the noise power of a rectangular
+//        one, so the estimate is scaled accordingly.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void GoertzelDft::GetStandardErrors( double& gainStdErrDb, double& phaseStdErrDeg )
+{
+    complex<double> sumInput = 0.0, sumOutput = 0.0, reference;
+    double sumGain = 0.0, sumGainSquared = 0.0, sumPhase = 0.0, sumPhaseSquared = 0.0;
+    double K = (double)subBlocksCompleted;
+    double scale;
+
+    gainStdErrDb = phaseStdErrDeg = numeric_limits<double>::quiet_NaN();
+
+    if (subBlocksCompleted < 2)
+    {
+        return;
+    }
+
+    for (uint8_t k = 0; k < subBlocksCompleted; k++)
+    {
+        if (0.0 == abs( subBlockX[k][0] ))
+        {
+            return;
+        }
+        sumInput += subBlockX[k][0];
+        sumOutput += subBlockX[k][1];
+    }
+    if (0.0 == abs( sumInput ) || 0.0 == abs( sumOutput ))
+    {
+        return;
+    }
+    reference = sumOutput / sumInput;
+
+    // Gains and phases relative to the overall result, so the phases don't wrap
+    for (uint8_t k = 0; k < subBlocksCompleted; k++)
+    {
+        complex<double> h = subBlockX[k][1] / subBlockX[k][0] / reference;
+        double gain = 20.0 * log10( abs( h ) );
+        double phaseDeg = arg( h ) * 180.0 / M_PI;
+        sumGain += gain;
+        sumGainSquared += gain * gain;
+        sumPhase += phaseDeg;
+        sumPhaseSquared += phaseDeg * phaseDeg;
+    }
+
+    scale = sqrt( (numWindowTerms > 1 ? GetEquivalentNoiseBandwidthBins() : 1.0) / (K * (K - 1.0)) );
+    gainStdErrDb = sqrt( max( 0.0, sumGainSquared - sumGain * sumGain / K ) ) * scale;
+    phaseStdErrDeg = sqrt( max( 0.0, sumPhaseSquared - sumPhase * sumPhase / K ) ) * scale;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::EstimateFrequencyOffset
+//
+// Purpose: Estimate how far the signal's actual frequency is from fDetect, from the progression of
+//          the sub-block phases
+//
+// Parameters: [out] freqRatioOffset - (actual frequency - fDetect) / fSamp
+//             [out] return - whether there was an estimate; false if fewer than 2 sub-blocks are
+//                            complete or there is no signal
+//
+// Notes: The sub-block DTFTs are referenced to the first sample, so a signal offset by dTheta
+//        radians/sample advances each sub-block's phase by dTheta times the distance between the
+//        sub-blocks' centres.  Both channels carry the stimulus frequency, so the phase steps of
+//        the two are pooled (weighted by their magnitudes, via the cross products); pooling the
+//        steps rather than the phases means the channels' own phases don't matter.  The offset must
+//        be less than half a cycle per sub-block to be unambiguous; generator rounding is far less.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool GoertzelDft::EstimateFrequencyOffset( double& freqRatioOffset )
+{
+    double sumWeightedSteps = 0.0, sumWeights = 0.0;
+    double centre, nextCentre;
+
+    freqRatioOffset = 0.0;
+
+    if (subBlocksCompleted < 2)
+    {
+        return false;
+    }
+
+    centre = (double)(subBlockEnd[0] - 1) / 2.0;
+    for (uint8_t k = 0; k + 1 < subBlocksCompleted; k++)
+    {
+        complex<double> step = subBlockX[k+1][0] * conj( subBlockX[k][0] ) + subBlockX[k+1][1] * conj( subBlockX[k][1] );
+        nextCentre = (double)(subBlockEnd[k] + subBlockEnd[k+1] - 1) / 2.0;
+        sumWeightedSteps += abs( step ) * arg( step ) / (nextCentre - centre);
+        sumWeights += abs( step );
+        centre = nextCentre;
+    }
+
+    if (0.0 == sumWeights)
+    {
+        return false;
+    }
+
+    freqRatioOffset = sumWeightedSteps / sumWeights / (2.0 * M_PI);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::GetPeaks
+//
+// Purpose: Get the absolute peaks of the samples fed since Init
+//
+// Parameters: [out] inputPeak, outputPeak - the largest absolute sample value of each channel
+//
+// Notes: Tracked by the kernels in the same pass as the DFT, so a capture's range can be checked
+//        without scanning it again.  A re-Init (e.g. to refine the frequency) starts them over.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void GoertzelDft::GetPeaks( uint16_t& inputPeak, uint16_t& outputPeak )
+{
+    inputPeak = (uint16_t)max( -(int32_t)sums.minSample[0], (int32_t)sums.maxSample[0] );
+    outputPeak = (uint16_t)max( -(int32_t)sums.minSample[1], (int32_t)sums.maxSample[1] );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::GetTrend
+//
+// Purpose: Get the baseline removed from the last measurement
+//
+// Parameters: [out] inputChange, outputChange - change of the baseline from the first sample to
+//                                               the last, in counts
+//             [out] inputTimeConstant, outputTimeConstant - time constants of the exponential
+//                                                           baselines, in samples; NaN for linear
+//             [out] return - whether a baseline was removed
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool GoertzelDft::GetTrend( double& inputChange, double& outputChange, double& inputTimeConstant, double& outputTimeConstant )
+{
+    array<double,2> change;
+
+    for (int c = 0; c < 2; c++)
+    {
+        if (DFT_TREND_LINEAR == trend)
+        {
+            change[c] = trendCoefficient[c] * (N - 1.0);
+        }
+        else
+        {
+            change[c] = trendCoefficient[c] * expm1( -(N - 1.0) / trendTimeConstant[c] );
+        }
+    }
+    inputChange = change[0];
+    outputChange = change[1];
+    inputTimeConstant = trendTimeConstant[0];
+    outputTimeConstant = trendTimeConstant[1];
+
+    return trendFitted;
+}
+
+uint8_t GoertzelDft::GetNumSubBlocks( void )
+{
+    return numSubBlocks;
+}
+
+uint8_t GoertzelDft::GetSubBlocksCompleted( void )
+{
+    return subBlocksCompleted;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::GetSamplesToSubBlockEnd
+//
+// Purpose: Get how many samples remain until the end of the current sub-block
+//
+// Parameters: [out] return - the number of samples; those remaining in the capture if there are no
+//                            sub-blocks
+//
+// Notes: A caller which may Truncate should feed no further than this at a time
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t GoertzelDft::GetSamplesToSubBlockEnd( void )
+{
+    return (subBlocksCompleted < numSubBlocks ? subBlockEnd[subBlocksCompleted] : N) - samplesProcessed;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelDft::Truncate
+//
+// Purpose: End the measurement early, at the end of the last completed sub-block, and compute the
+//          results from the samples fed so far
+//
+// Parameters: [out] return - true if the results were computed; false if truncating isn't possible
+//
+// Notes: Only for the rectangular window, since the window's side bins are tuned to the full length.
+//        Since sub-blocks are whole cycles, so is the truncated measurement.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool GoertzelDft::Truncate( void )
+{
+    if (numWindowTerms > 1 || 0 == subBlocksCompleted || samplesProcessed >= N ||
+        samplesProcessed != subBlockEnd[subBlocksCompleted-1])
+    {
+        return false;
+    }
+
+    N = samplesProcessed;
+    numSubBlocks = subBlocksCompleted;
+    ComputeResults();
+
+    return true;
+}
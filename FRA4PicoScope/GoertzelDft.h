@@ -0,0 +1,174 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: GoertzelDft.h
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "FRA4PicoScopeInterfaceTypes.h"
+#include "GoertzelKernels.h"
+#include "DftThreadPool.h"
+#include <array>
+#include <complex>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: class GoertzelDft
+//
+// Purpose: Computes a single point DFT of the input and output channels, along with amplitude and
+//          purity, using the generalized Goertzel algorithm.  See GoertzelDft.cpp for details.
+//
+// Parameters: N/A
+//
+// Notes: All coefficient and state data is held in the object, so any number of objects may be
+//        used concurrently from any threads.  The state is accessed with aligned SIMD loads, so
+//        heap instances are allocated aligned by the class operator new.  Do not embed instances
+//        in other heap allocated objects; hold them by pointer instead.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+class GoertzelDft
+{
+    public:
+        GoertzelDft(void);
+        void* operator new( size_t size );
+        void operator delete( void* p );
+
+        void SetThreadPool( DftThreadPool* pThreadPool );
+        void SetNumHarmonics( uint8_t harmonics );
+        void SetWindow( DftWindow_T dftWindow );
+        void SetNumSubBlocks( uint8_t subBlocks );
+        void SetTrendRemoval( DftTrend_T dftTrend );
+        void Init( uint32_t totalSamples, double fSamp, double fDetect );
+        bool Feed( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n );
+        void GetResults( double& inputMagnitude, double& inputPhase, double& inputAmplitude, double& inputPurity,
+                         double& outputMagnitude, double& outputPhase, double& outputAmplitude, double& outputPurity );
+        uint8_t GetNumHarmonicsMeasured( void );
+        void GetHarmonicResults( uint8_t harmonicIndex, double& inputMagnitude, double& inputPhase, double& inputAmplitude,
+                                 double& outputMagnitude, double& outputPhase, double& outputAmplitude );
+        void GetThd( double& inputThd, double& outputThd );
+        void GetStandardErrors( double& gainStdErrDb, double& phaseStdErrDeg );
+        bool EstimateFrequencyOffset( double& freqRatioOffset );
+        void GetPeaks( uint16_t& inputPeak, uint16_t& outputPeak );
+        uint8_t GetNumSubBlocks( void );
+        uint8_t GetSubBlocksCompleted( void );
+        uint32_t GetSamplesToSubBlockEnd( void );
+        bool Truncate( void );
+
+        static const uint8_t maxHarmonics = 15; // i.e. up to the 16th harmonic
+        static const uint8_t maxWindowTerms = 5;
+        static const uint8_t maxSubBlocks = 64;
+        static const uint8_t minTrendSubBlocks = 8;
+
+        static const wchar_t* GetWindowName( DftWindow_T dftWindow );
+
+        // Diagnostic accessors
+        DftRecurrence_T GetRecurrence( void );
+        DftWindow_T GetWindow( void );
+        DftTrend_T GetTrendRemoval( void );
+        bool GetTrend( double& inputChange, double& outputChange, double& inputTimeConstant, double& outputTimeConstant );
+        double GetEquivalentNoiseBandwidthBins( void );
+        uint32_t GetTotalSamples( void );
+        double GetKernelSeconds( void );
+        void GetEnergies( double& inputDcEnergy, double& inputSignalEnergy, double& inputTotalEnergy,
+                          double& outputDcEnergy, double& outputSignalEnergy, double& outputTotalEnergy );
+
+    private:
+        static const double recurrenceThreshold1;
+        static const double recurrenceThreshold2;
+        static void SelectRecurrence( double binFreqRatio, DftRecurrence_T& recurrence, double& binKappa );
+        void RunKernels( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n );
+        void EndSubBlock( void );
+        void ComputeResults( void );
+
+        // Coefficient and state data
+        alignas(16) double Kappa;
+        alignas(16) double a[2];
+        alignas(16) double b[2];
+        SAMPLE_SUMS_T sums;
+        DftRecurrence_T dftRecurrence;
+        double theta;
+        double freqRatio;
+        uint32_t samplesProcessed;
+        uint32_t N;
+        GoertzelKernel_T goertzelKernel;
+        DftThreadPool* pDftThreadPool;
+        LARGE_INTEGER kernelTicks;
+
+        // Window; its coefficients are in windowCoefficients in GoertzelDft.cpp
+        DftWindow_T window;
+        uint8_t numWindowTerms;
+
+        // Bank coefficient and state data.  The bank holds the harmonic bins and, when windowing, the
+        // bins either side of the fundamental, d.c. and each harmonic.  Bins are grouped by recurrence.
+        static const uint16_t maxBankBins = (maxHarmonics + 2) * (2 * maxWindowTerms - 1);
+        uint16_t numBankBins;
+        double bankKappa[maxBankBins];
+        double bankFreqRatio[maxBankBins];
+        DftRecurrence_T bankRecurrence[maxBankBins];
+        double bankA[2*maxBankBins];
+        double bankB[2*maxBankBins];
+        uint16_t bankGroupStart[3], bankGroupCount[3]; // Indexed by DftRecurrence_T
+        GoertzelBankKernel_T bankKernel[3];
+
+        // Bins in the order they were requested, each mapped to a bank slot
+        uint16_t numBins;
+        uint16_t binSlot[maxBankBins];
+        bool binConjugate[maxBankBins]; // Requested frequency was folded into [0, 0.5]; conjugate the result
+        uint16_t AddBin( double binFreqRatio );
+        void BuildBank( void );
+
+        // First bin of each window sum; side bins are ordered -1, +1, -2, +2, ...  (d.c.: +1, +2, ...)
+        uint8_t numHarmonics;
+        uint8_t numHarmonicsMeasured;
+        uint16_t fundamentalSideBins;
+        uint16_t dcSideBins;
+        uint16_t harmonicBins[maxHarmonics]; // Harmonic bin followed by its side bins
+
+        // Sub-blocks of whole cycles, each with its own (rectangular) fundamental DTFT, for the
+        // standard error estimate.  The prefix values are at the end of the last completed sub-block.
+        uint8_t numSubBlocksRequested;
+        uint8_t numSubBlocks;
+        uint8_t subBlocksCompleted;
+        uint32_t subBlockEnd[maxSubBlocks];
+        array<complex<double>,2> subBlockX[maxSubBlocks];
+        array<int64_t,2> subBlockDcSum[maxSubBlocks];
+        array<complex<double>,2> prefixX;
+        array<int64_t,2> prefixDcSum;
+
+        // Trend (baseline) removal: the baseline offset + coefficient * shape(n) is fitted to the
+        // sub-block means, where shape(n) is n, or e^(-n/timeConstant), and its DTFT removed from the bins
+        DftTrend_T trend;
+        bool trendFitted;
+        array<double,2> trendOffset, trendCoefficient, trendTimeConstant;
+        bool FitTrend( void );
+        double TrendShapeMean( int c, uint32_t start, uint32_t end );
+        complex<double> TrendShapeDtft( int c, double binFreqRatio, uint32_t start, uint32_t end );
+        complex<double> BaselineDtft( int c, double binFreqRatio, uint32_t start, uint32_t end );
+        void RemoveBaseline( complex<double> binX[2][maxBankBins], array<complex<double>,2>& y,
+                             array<double,2>& baselineSum, array<double,2>& baselineEnergy );
+
+        // Outputs
+        array<double,2> magnitude, phase, amplitude, purity, signalEnergy, totalEnergy, dcEnergy;
+        array<array<double,2>,maxHarmonics> harmonicMagnitude, harmonicPhase, harmonicAmplitude;
+        array<double,2> thd;
+};
@@ -0,0 +1,393 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: GoertzelKernels.cpp
+//
+// Purpose: Baseline (SSE2) DFT kernels, CPU feature detection and kernel selection.  The wider
+//          kernels live in modules compiled with the matching instruction set enabled, so that the
+//          code in this module remains safe to run on any x86 CPU.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "GoertzelKernels.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <vector>
+
+template <DftRecurrence_T R>
+static __forceinline void IterateFourSse2( __m128d& aVec, __m128d& bVec, const __m128d& KappaVec,
+                                           const __m128i& in32, const __m128i& out32 )
+{
+    // { in0, out0, in1, out1 } and { in2, out2, in3, out3 }
+    __m128i pairs01 = _mm_unpacklo_epi32( in32, out32 );
+    __m128i pairs23 = _mm_unpackhi_epi32( in32, out32 );
+
+    GoertzelIterate<R, false>( aVec, bVec, KappaVec, _mm_cvtepi32_pd( pairs01 ) );
+    GoertzelIterate<R, false>( aVec, bVec, KappaVec, _mm_cvtepi32_pd( _mm_srli_si128( pairs01, 8 ) ) );
+    GoertzelIterate<R, false>( aVec, bVec, KappaVec, _mm_cvtepi32_pd( pairs23 ) );
+    GoertzelIterate<R, false>( aVec, bVec, KappaVec, _mm_cvtepi32_pd( _mm_srli_si128( pairs23, 8 ) ) );
+}
+
+template <DftRecurrence_T R>
+static void FeedGoertzelSse2( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n, const __m128d& KappaVec,
+                              __m128d& aVec, __m128d& bVec, SAMPLE_SUMS_T& sums )
+{
+    // Work on local copies so the state stays in registers
+    __m128d a = aVec, b = bVec;
+    __m128i inEnergyAcc = _mm_setzero_si128(), outEnergyAcc = _mm_setzero_si128();
+    __m128i inDcAcc = _mm_setzero_si128(), outDcAcc = _mm_setzero_si128();
+    __m128i inMinAcc = _mm_setzero_si128(), inMaxAcc = _mm_setzero_si128();
+    __m128i outMinAcc = _mm_setzero_si128(), outMaxAcc = _mm_setzero_si128();
+    uint32_t accumulations = 0;
+    uint32_t i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        __m128i in16 = _mm_loadu_si128( (const __m128i*)&inputSamples[i] );
+        __m128i out16 = _mm_loadu_si128( (const __m128i*)&outputSamples[i] );
+
+        AccumulateSums( in16, inEnergyAcc, inDcAcc );
+        AccumulateSums( out16, outEnergyAcc, outDcAcc );
+        AccumulateExtremes( in16, inMinAcc, inMaxAcc );
+        AccumulateExtremes( out16, outMinAcc, outMaxAcc );
+        if (++accumulations == maxSumAccumulations)
+        {
+            FlushSums( inEnergyAcc, inDcAcc, sums.dcSum[0], sums.energySum[0] );
+            FlushSums( outEnergyAcc, outDcAcc, sums.dcSum[1], sums.energySum[1] );
+            accumulations = 0;
+        }
+
+        // Sign extend to 32 bits by placing each sample in the upper half and shifting down
+        IterateFourSse2<R>( a, b, KappaVec, _mm_srai_epi32( _mm_unpacklo_epi16( in16, in16 ), 16 ),
+                                            _mm_srai_epi32( _mm_unpacklo_epi16( out16, out16 ), 16 ) );
+        IterateFourSse2<R>( a, b, KappaVec, _mm_srai_epi32( _mm_unpackhi_epi16( in16, in16 ), 16 ),
+                                            _mm_srai_epi32( _mm_unpackhi_epi16( out16, out16 ), 16 ) );
+    }
+
+    FlushSums( inEnergyAcc, inDcAcc, sums.dcSum[0], sums.energySum[0] );
+    FlushSums( outEnergyAcc, outDcAcc, sums.dcSum[1], sums.energySum[1] );
+    FlushExtremes( inMinAcc, inMaxAcc, sums.minSample[0], sums.maxSample[0] );
+    FlushExtremes( outMinAcc, outMaxAcc, sums.minSample[1], sums.maxSample[1] );
+
+    FeedGoertzelScalar<R, false>( &inputSamples[i], &outputSamples[i], n - i, KappaVec, a, b, sums );
+
+    aVec = a;
+    bVec = b;
+}
+
+GoertzelKernel_T SelectGoertzelKernelSse2( DftRecurrence_T recurrence )
+{
+    switch (recurrence)
+    {
+        case REINSCH_0:
+            return FeedGoertzelSse2<REINSCH_0>;
+        case GOERTZEL:
+            return FeedGoertzelSse2<GOERTZEL>;
+        default:
+            return FeedGoertzelSse2<REINSCH_PI>;
+    }
+}
+
+template <DftRecurrence_T R>
+static void FeedGoertzelBankSse2( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n,
+                                  uint32_t numBins, const double* Kappa, double* a, double* b )
+{
+    uint32_t k = 0;
+
+    for (; k + 4 <= numBins; k += 4)
+    {
+        FeedGoertzelBankChunk<R, false, 4>( inputSamples, outputSamples, n, &Kappa[k], &a[2*k], &b[2*k] );
+    }
+
+    switch (numBins - k)
+    {
+        case 3:
+            FeedGoertzelBankChunk<R, false, 3>( inputSamples, outputSamples, n, &Kappa[k], &a[2*k], &b[2*k] );
+            break;
+        case 2:
+            FeedGoertzelBankChunk<R, false, 2>( inputSamples, outputSamples, n, &Kappa[k], &a[2*k], &b[2*k] );
+            break;
+        case 1:
+            FeedGoertzelBankChunk<R, false, 1>( inputSamples, outputSamples, n, &Kappa[k], &a[2*k], &b[2*k] );
+            break;
+        default:
+            break;
+    }
+}
+
+GoertzelBankKernel_T SelectGoertzelBankKernelSse2( DftRecurrence_T recurrence )
+{
+    switch (recurrence)
+    {
+        case REINSCH_0:
+            return FeedGoertzelBankSse2<REINSCH_0>;
+        case GOERTZEL:
+            return FeedGoertzelBankSse2<GOERTZEL>;
+        default:
+            return FeedGoertzelBankSse2<REINSCH_PI>;
+    }
+}
+
+#if defined(GOERTZEL_AVX512_AVAILABLE)
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Avx512IsFaster
+//
+// Purpose: Time the AVX2 and AVX-512 kernels on a synthetic block and report whether AVX-512 wins
+//
+// Parameters: [out] return - true if the AVX-512 kernel processed the block faster
+//
+// Notes: The recurrence is latency bound, so AVX-512 only helps by cheapening the loads and
+//        conversions.  On many parts 512 bit instructions lower the core clock, which more than
+//        cancels that gain, and CPUID cannot tell us which kind of part we're running on.  The
+//        block is long enough (a few ms) for any clock change to have taken effect.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool Avx512IsFaster( void )
+{
+    const uint32_t calibrationSamples = 1 << 20;
+    std::vector<int16_t> samples( calibrationSamples );
+    LARGE_INTEGER start, end;
+    long long elapsed[2];
+    GoertzelKernel_T kernels[2] = { SelectGoertzelKernelAvx2( REINSCH_0 ), SelectGoertzelKernelAvx512( REINSCH_0 ) };
+
+    for (uint32_t i = 0; i < calibrationSamples; i++)
+    {
+        samples[i] = (int16_t)((i * 2654435761u) >> 16);
+    }
+
+    for (int k = 0; k < 2; k++)
+    {
+        // Run twice, timing the second to exclude warm up and any clock transition
+        for (int pass = 0; pass < 2; pass++)
+        {
+            __m128d KappaVec = _mm_set1_pd( -1.0e-6 );
+            __m128d aVec = _mm_setzero_pd(), bVec = _mm_setzero_pd();
+            SAMPLE_SUMS_T sums = {};
+
+            QueryPerformanceCounter( &start );
+            kernels[k]( samples.data(), samples.data(), calibrationSamples, KappaVec, aVec, bVec, sums );
+            QueryPerformanceCounter( &end );
+
+            elapsed[k] = end.QuadPart - start.QuadPart;
+        }
+    }
+
+    return (elapsed[1] < elapsed[0]);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: DetectSimdLevel
+//
+// Purpose: Determine the widest instruction set supported by both the CPU and the OS
+//
+// Parameters: [out] return - the SIMD level
+//
+// Notes: The OS must be saving the YMM (and for AVX-512, opmask and ZMM) register state, which is
+//        checked with XGETBV.  The wide kernels also use FMA, which every AVX2 CPU to date provides,
+//        but it is checked anyway.  AVX-512 requires both the Foundation and Byte/Word extensions, and
+//        is only chosen when it measures faster than AVX2.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static SimdLevel_T DetectSimdLevel( void )
+{
+    int cpuInfo[4];
+    int maxLeaf;
+    SimdLevel_T simdLevel = SIMD_SSE2;
+
+    __cpuid( cpuInfo, 0 );
+    maxLeaf = cpuInfo[0];
+
+    if (maxLeaf >= 7)
+    {
+        __cpuid( cpuInfo, 1 );
+
+        // FMA (bit 12), OSXSAVE (bit 27) and AVX (bit 28)
+        if ((cpuInfo[2] & (1 << 12)) && (cpuInfo[2] & (1 << 27)) && (cpuInfo[2] & (1 << 28)))
+        {
+            unsigned long long xcr0 = _xgetbv( 0 );
+
+            __cpuidex( cpuInfo, 7, 0 );
+
+            // XMM and YMM state (XCR0 bits 1,2) and AVX2 (bit 5)
+            if ((xcr0 & 0x06) == 0x06 && (cpuInfo[1] & (1 << 5)))
+            {
+                simdLevel = SIMD_AVX2;
+#if defined(GOERTZEL_AVX512_AVAILABLE)
+                // Opmask, ZMM_Hi256 and Hi16_ZMM state (XCR0 bits 5,6,7), AVX512F (bit 16) and AVX512BW (bit 30)
+                if ((xcr0 & 0xE6) == 0xE6 && (cpuInfo[1] & (1 << 16)) && (cpuInfo[1] & (1 << 30)) && Avx512IsFaster())
+                {
+                    simdLevel = SIMD_AVX512;
+                }
+#endif
+            }
+        }
+    }
+
+    return simdLevel;
+}
+
+SimdLevel_T GetSimdLevel( void )
+{
+    static const SimdLevel_T simdLevel = DetectSimdLevel();
+    return simdLevel;
+}
+
+const wchar_t* GetSimdLevelName( SimdLevel_T simdLevel )
+{
+    switch (simdLevel)
+    {
+        case SIMD_AVX512:
+            return L"AVX-512";
+        case SIMD_AVX2:
+            return L"AVX2";
+        default:
+            return L"SSE2";
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SelectGoertzelKernel
+//
+// Purpose: Choose the kernel for a recurrence and SIMD level
+//
+// Parameters: [in] recurrence - the DFT recurrence to run
+//             [in] simdLevel - the SIMD level to use, normally from GetSimdLevel
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+GoertzelKernel_T SelectGoertzelKernel( DftRecurrence_T recurrence, SimdLevel_T simdLevel )
+{
+    switch (simdLevel)
+    {
+#if defined(GOERTZEL_AVX512_AVAILABLE)
+        case SIMD_AVX512:
+            return SelectGoertzelKernelAvx512( recurrence );
+#endif
+        case SIMD_AVX2:
+            return SelectGoertzelKernelAvx2( recurrence );
+        default:
+            return SelectGoertzelKernelSse2( recurrence );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SelectGoertzelBankKernel
+//
+// Purpose: Choose the bin bank kernel for a recurrence and SIMD level
+//
+// Parameters: [in] recurrence - the DFT recurrence to run
+//             [in] simdLevel - the SIMD level to use, normally from GetSimdLevel
+//
+// Notes: There is no AVX-512 bank kernel; with at most a few tens of bins, 8 bins per 256 bit chunk
+//        already keeps the FMA units busy.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+GoertzelBankKernel_T SelectGoertzelBankKernel( DftRecurrence_T recurrence, SimdLevel_T simdLevel )
+{
+    if (simdLevel >= SIMD_AVX2)
+    {
+        return SelectGoertzelBankKernelAvx2( recurrence );
+    }
+    else
+    {
+        return SelectGoertzelBankKernelSse2( recurrence );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: CombineGoertzelState
+//
+// Purpose: Merge the state of a block which was run from zero state into the running state of the
+//          samples preceding it, giving the state the recurrence would have had if the samples had
+//          been processed serially.
+//
+// Parameters: [in] recurrence - the DFT recurrence used for both states
+//             [in] freqRatio - detection frequency / sampling frequency
+//             [in] blockLength - number of samples in the block
+//             [in/out] aVec, bVec - running state, updated to include the block
+//             [in] blockAVec, blockBVec - state of the block, run from zero state
+//
+// Notes: The recurrences are linear, so the running state just needs to be advanced blockLength
+//        steps with zero input (multiplied by the transition matrix raised to blockLength) and the
+//        block state added.  In Goertzel form (s[n], s[n-1]) that matrix power is
+//        [U(L), -U(L-1); U(L-1), -U(L-2)], with U the Chebyshev polynomials of the second kind,
+//        U(m) = sin((m+1)*theta)/sin(theta).  Reinsch(0) state is (s[n], s[n]-s[n-1]) and
+//        Reinsch(PI) state is (s[n], s[n]+s[n-1]), so their matrices follow by similarity transform.
+//        The entries are written in closed forms that don't suffer cancellation near theta = 0 or PI,
+//        preserving the accuracy the Reinsch forms were chosen for.
+//
+//        L*theta is reduced modulo 2*PI using an error free product, so that very long blocks don't
+//        lose phase accuracy in the argument reduction.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CombineGoertzelState( DftRecurrence_T recurrence, double freqRatio, uint32_t blockLength,
+                           __m128d& aVec, __m128d& bVec, const __m128d& blockAVec, const __m128d& blockBVec )
+{
+    double m11, m12, m21, m22;
+    double cycles, cyclesError, Ltheta;
+    double halfTheta = M_PI * freqRatio;
+    double theta = 2.0 * halfTheta;
+
+    cycles = (double)blockLength * freqRatio;
+    cyclesError = fma( (double)blockLength, freqRatio, -cycles );
+    Ltheta = 2.0 * M_PI * ((cycles - floor( cycles )) + cyclesError);
+
+    if (REINSCH_0 == recurrence)
+    {
+        m11 = cos( Ltheta + halfTheta ) / cos( halfTheta );
+        m12 = sin( Ltheta ) / sin( theta );
+        m21 = -2.0 * sin( Ltheta ) * tan( halfTheta );
+        m22 = cos( Ltheta - halfTheta ) / cos( halfTheta );
+    }
+    else if (GOERTZEL == recurrence)
+    {
+        m11 = sin( Ltheta + theta ) / sin( theta );
+        m12 = -sin( Ltheta ) / sin( theta );
+        m21 = -m12;
+        m22 = -sin( Ltheta - theta ) / sin( theta );
+    }
+    else // REINSCH_PI
+    {
+        m11 = sin( Ltheta + halfTheta ) / sin( halfTheta );
+        m12 = -sin( Ltheta ) / sin( theta );
+        m21 = 2.0 * sin( Ltheta ) / tan( halfTheta );
+        m22 = -sin( Ltheta - halfTheta ) / sin( halfTheta );
+    }
+
+    __m128d a = _mm_add_pd( _mm_add_pd( _mm_mul_pd( _mm_set1_pd( m11 ), aVec ), _mm_mul_pd( _mm_set1_pd( m12 ), bVec ) ), blockAVec );
+    __m128d b = _mm_add_pd( _mm_add_pd( _mm_mul_pd( _mm_set1_pd( m21 ), aVec ), _mm_mul_pd( _mm_set1_pd( m22 ), bVec ) ), blockBVec );
+
+    aVec = a;
+    bVec = b;
+}
@@ -0,0 +1,388 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: GoertzelKernels.h
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <stdint.h>
+#include <intrin.h>
+
+// AVX-512 intrinsics are only available from VS2017 15.3 onward
+#if defined(_MSC_VER) && (_MSC_VER >= 1911)
+#define GOERTZEL_AVX512_AVAILABLE
+#elif !defined(_MSC_VER)
+#define GOERTZEL_AVX512_AVAILABLE
+#endif
+
+typedef enum
+{
+    REINSCH_0,
+    GOERTZEL,
+    REINSCH_PI
+} DftRecurrence_T;
+
+typedef enum
+{
+    SIMD_SSE2,
+    SIMD_AVX2,
+    SIMD_AVX512
+} SimdLevel_T;
+
+// Exact running sums of the samples, for the d.c. and Parseval energy calculations.  Element 0 is
+// the input channel, element 1 the output channel.  A 32 bit sample count can't overflow these.
+// The extremes start at zero rather than the first sample, which leaves the absolute peak, the
+// larger of -minSample and maxSample, unchanged; so zero initialization serves for them too.
+typedef struct
+{
+    int64_t dcSum[2];       // Sum of samples
+    uint64_t energySum[2];  // Sum of squared samples
+    int16_t minSample[2];   // Least of the samples and zero
+    int16_t maxSample[2];   // Greatest of the samples and zero
+} SAMPLE_SUMS_T;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelKernel_T
+//
+// Purpose: Signature of a kernel which runs the DFT recurrence, d.c. and Parseval energy calculations,
+//          and the peak detection, over a block of samples.  Lane 0 of each vector is the input channel, lane 1 the output
+//          channel.  The state vectors are updated in place so that blocks can be fed one after another.
+//
+// Parameters: [in] inputSamples - input channel data sample points
+//             [in] outputSamples - output channel data sample points
+//             [in] n - number of samples in this block of samples
+//             [in] KappaVec - recurrence coefficient, broadcast to both lanes
+//             [in/out] aVec, bVec - recurrence state
+//             [in/out] sums - running sums of samples and squared samples
+//
+// Notes: Vector parameters are passed by reference because 32 bit MSVC cannot pass aligned
+//        types by value.
+//
+//        The sums are accumulated with integer arithmetic on the 16 bit samples, fused into the
+//        loads which feed the recurrence.  This is exact, where summing in doubles loses precision
+//        over a billion samples, and it is cheaper than the two double adds per sample it replaces.
+//        The extremes are tracked the same way, so the range checks need no pass of their own.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef void (*GoertzelKernel_T)( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n, const __m128d& KappaVec,
+                                  __m128d& aVec, __m128d& bVec, SAMPLE_SUMS_T& sums );
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelBankKernel_T
+//
+// Purpose: Signature of a kernel which runs the DFT recurrence for a bank of bins (e.g. harmonics)
+//          over a block of samples.  All bins in the bank must use the same recurrence.
+//
+// Parameters: [in] inputSamples - input channel data sample points
+//             [in] outputSamples - output channel data sample points
+//             [in] n - number of samples in this block of samples
+//             [in] numBins - number of bins in the bank
+//             [in] Kappa - recurrence coefficient of each bin; numBins entries
+//             [in/out] a, b - recurrence state; 2*numBins entries, input then output channel for each bin
+//
+// Notes: The bank does not compute energies; those come from the fundamental's GoertzelKernel_T.
+//        The arrays need not be aligned.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef void (*GoertzelBankKernel_T)( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n,
+                                      uint32_t numBins, const double* Kappa, double* a, double* b );
+
+SimdLevel_T GetSimdLevel( void );
+const wchar_t* GetSimdLevelName( SimdLevel_T simdLevel );
+GoertzelKernel_T SelectGoertzelKernel( DftRecurrence_T recurrence, SimdLevel_T simdLevel );
+GoertzelBankKernel_T SelectGoertzelBankKernel( DftRecurrence_T recurrence, SimdLevel_T simdLevel );
+
+void CombineGoertzelState( DftRecurrence_T recurrence, double freqRatio, uint32_t blockLength,
+                           __m128d& aVec, __m128d& bVec, const __m128d& blockAVec, const __m128d& blockBVec );
+
+// Per instruction set selectors, each implemented in a module compiled for that instruction set
+GoertzelKernel_T SelectGoertzelKernelSse2( DftRecurrence_T recurrence );
+GoertzelKernel_T SelectGoertzelKernelAvx2( DftRecurrence_T recurrence );
+GoertzelBankKernel_T SelectGoertzelBankKernelSse2( DftRecurrence_T recurrence );
+GoertzelBankKernel_T SelectGoertzelBankKernelAvx2( DftRecurrence_T recurrence );
+#if defined(GOERTZEL_AVX512_AVAILABLE)
+GoertzelKernel_T SelectGoertzelKernelAvx512( DftRecurrence_T recurrence );
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: GoertzelIterate
+//
+// Purpose: Run one step of the selected recurrence on both channels
+//
+// Parameters: [in/out] aVec, bVec - recurrence state
+//             [in] KappaVec - recurrence coefficient
+//             [in] sampleVec - input and output channel samples
+//
+// Notes: Declared static so each instruction set module gets its own copy, encoded for
+//        that instruction set.
+//
+//        The recurrence is latency bound, so the fused forms move the sample addition off the
+//        a -> K*a dependency chain and fold the multiply into the remaining addition.  This
+//        shortens the loop carried chain by roughly a third to a half, at the cost of results that
+//        differ from the unfused form in the last bits.  Only modules compiled with AVX2 may
+//        instantiate the fused forms.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <DftRecurrence_T R, bool fused>
+static __forceinline void GoertzelIterate( __m128d& aVec, __m128d& bVec, const __m128d& KappaVec, const __m128d& sampleVec )
+{
+    if (REINSCH_0 == R)
+    {
+        //b = b + K*a + samples[i]
+        //a = a + b
+        if (fused)
+        {
+            bVec = _mm_fmadd_pd( KappaVec, aVec, _mm_add_pd( bVec, sampleVec ) );
+        }
+        else
+        {
+            bVec = _mm_add_pd( _mm_add_pd( bVec, _mm_mul_pd( KappaVec, aVec ) ), sampleVec );
+        }
+        aVec = _mm_add_pd( aVec, bVec );
+    }
+    else if (GOERTZEL == R)
+    {
+        //tau = K*a - b + samples[i];
+        //b = a;
+        //a = tau;
+        __m128d tauVec;
+        if (fused)
+        {
+            tauVec = _mm_fmadd_pd( KappaVec, aVec, _mm_sub_pd( sampleVec, bVec ) );
+        }
+        else
+        {
+            tauVec = _mm_add_pd( _mm_sub_pd( _mm_mul_pd( KappaVec, aVec ), bVec ), sampleVec );
+        }
+        bVec = aVec;
+        aVec = tauVec;
+    }
+    else // REINSCH_PI
+    {
+        //b = K*a - b + samples[i]
+        //a = b - a
+        if (fused)
+        {
+            bVec = _mm_fmadd_pd( KappaVec, aVec, _mm_sub_pd( sampleVec, bVec ) );
+        }
+        else
+        {
+            bVec = _mm_add_pd( _mm_sub_pd( _mm_mul_pd( KappaVec, aVec ), bVec ), sampleVec );
+        }
+        aVec = _mm_sub_pd( bVec, aVec );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: FeedGoertzelScalar
+//
+// Purpose: Process samples one at a time; used by the SSE2 kernel and for the tails of the wider kernels
+//
+// Parameters: See GoertzelKernel_T
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <DftRecurrence_T R, bool fused>
+static __forceinline void FeedGoertzelScalar( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n, const __m128d& KappaVec,
+                                              __m128d& aVec, __m128d& bVec, SAMPLE_SUMS_T& sums )
+{
+    __m128d sampleVec;
+    int32_t inputSample, outputSample;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        inputSample = inputSamples[i];
+        outputSample = outputSamples[i];
+
+        sums.dcSum[0] += inputSample;
+        sums.dcSum[1] += outputSample;
+        sums.minSample[0] = (int16_t)min( (int32_t)sums.minSample[0], inputSample );
+        sums.maxSample[0] = (int16_t)max( (int32_t)sums.maxSample[0], inputSample );
+        sums.minSample[1] = (int16_t)min( (int32_t)sums.minSample[1], outputSample );
+        sums.maxSample[1] = (int16_t)max( (int32_t)sums.maxSample[1], outputSample );
+        // The square of a 16 bit value fits in 31 bits, except for (-32768)^2 which fits unsigned 32 bits
+        sums.energySum[0] += (uint32_t)(inputSample * inputSample);
+        sums.energySum[1] += (uint32_t)(outputSample * outputSample);
+
+        // Convert samples to packed doubles
+        sampleVec = _mm_cvtepi32_pd( _mm_set_epi32( 0, 0, outputSample, inputSample ) );
+
+        GoertzelIterate<R, fused>( aVec, bVec, KappaVec, sampleVec );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: AccumulateSums
+//
+// Purpose: Add eight samples of one channel into that channel's integer sum accumulators
+//
+// Parameters: [in] samples - eight 16 bit samples
+//             [in/out] energyAcc - two 64 bit lanes of squared sample sums
+//             [in/out] dcAcc - four 32 bit lanes of sample sums
+//
+// Notes: PMADDWD forms the pairwise sums of squares, each at most 2*32768^2 = 2^31, which is exact
+//        when read as unsigned and zero extended to 64 bits.  The pairwise sample sums are at most
+//        2^16 in magnitude, so dcAcc can take maxSumAccumulations calls before it must be flushed
+//        into 64 bits with FlushSums.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const uint32_t maxSumAccumulations = 1 << 14;
+
+static __forceinline void AccumulateSums( const __m128i& samples, __m128i& energyAcc, __m128i& dcAcc )
+{
+    __m128i squares = _mm_madd_epi16( samples, samples );
+    energyAcc = _mm_add_epi64( energyAcc, _mm_unpacklo_epi32( squares, _mm_setzero_si128() ) );
+    energyAcc = _mm_add_epi64( energyAcc, _mm_unpackhi_epi32( squares, _mm_setzero_si128() ) );
+    dcAcc = _mm_add_epi32( dcAcc, _mm_madd_epi16( samples, _mm_set1_epi16( 1 ) ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: FlushSums
+//
+// Purpose: Add a channel's sum accumulators into its running sums and clear them
+//
+// Parameters: [in/out] energyAcc, dcAcc - the accumulators, see AccumulateSums
+//             [in/out] dcSum, energySum - the channel's running sums
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static __forceinline void FlushSums( __m128i& energyAcc, __m128i& dcAcc, int64_t& dcSum, uint64_t& energySum )
+{
+    int32_t dcLanes[4];
+    uint64_t energyLanes[2];
+
+    _mm_storeu_si128( (__m128i*)dcLanes, dcAcc );
+    _mm_storeu_si128( (__m128i*)energyLanes, energyAcc );
+
+    dcSum += (int64_t)dcLanes[0] + dcLanes[1] + dcLanes[2] + dcLanes[3];
+    energySum += energyLanes[0] + energyLanes[1];
+
+    dcAcc = _mm_setzero_si128();
+    energyAcc = _mm_setzero_si128();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: AccumulateExtremes
+//
+// Purpose: Fold eight samples of one channel into that channel's extreme accumulators
+//
+// Parameters: [in] samples - eight 16 bit samples
+//             [in/out] minAcc, maxAcc - eight 16 bit lanes of least and greatest samples
+//
+// Notes: Unlike the sums, these can't overflow, so are only flushed (FlushExtremes) at the end
+//        of a block.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static __forceinline void AccumulateExtremes( const __m128i& samples, __m128i& minAcc, __m128i& maxAcc )
+{
+    minAcc = _mm_min_epi16( minAcc, samples );
+    maxAcc = _mm_max_epi16( maxAcc, samples );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: FlushExtremes
+//
+// Purpose: Fold a channel's extreme accumulators into its running extremes
+//
+// Parameters: [in] minAcc, maxAcc - the accumulators, see AccumulateExtremes
+//             [in/out] minSample, maxSample - the channel's running extremes
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static __forceinline void FlushExtremes( const __m128i& minAcc, const __m128i& maxAcc, int16_t& minSample, int16_t& maxSample )
+{
+    int16_t minLanes[8], maxLanes[8];
+
+    _mm_storeu_si128( (__m128i*)minLanes, minAcc );
+    _mm_storeu_si128( (__m128i*)maxLanes, maxAcc );
+
+    for (int i = 0; i < 8; i++)
+    {
+        minSample = (int16_t)min( (int32_t)minSample, (int32_t)minLanes[i] );
+        maxSample = (int16_t)max( (int32_t)maxSample, (int32_t)maxLanes[i] );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: FeedGoertzelBankChunk
+//
+// Purpose: Run B bins of a bank over a block of samples, holding their state in registers
+//
+// Parameters: See GoertzelBankKernel_T; Kappa, a and b point at the first bin of the chunk
+//
+// Notes: The bins' recurrences are independent dependency chains, so running several per sample
+//        lets them overlap in the pipeline.  B is kept small enough that the state fits the
+//        16 XMM registers of x64.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <DftRecurrence_T R, bool fused, uint32_t B>
+static void FeedGoertzelBankChunk( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n,
+                                   const double* Kappa, double* a, double* b )
+{
+    __m128d KappaVec[B], aVec[B], bVec[B];
+    __m128d sampleVec;
+    uint32_t k;
+
+    for (k = 0; k < B; k++)
+    {
+        KappaVec[k] = _mm_set1_pd( Kappa[k] );
+        aVec[k] = _mm_loadu_pd( &a[2*k] );
+        bVec[k] = _mm_loadu_pd( &b[2*k] );
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        sampleVec = _mm_cvtepi32_pd( _mm_set_epi32( 0, 0, outputSamples[i], inputSamples[i] ) );
+
+        for (k = 0; k < B; k++)
+        {
+            GoertzelIterate<R, fused>( aVec[k], bVec[k], KappaVec[k], sampleVec );
+        }
+    }
+
+    for (k = 0; k < B; k++)
+    {
+        _mm_storeu_pd( &a[2*k], aVec[k] );
+        _mm_storeu_pd( &b[2*k], bVec[k] );
+    }
+}
@@ -0,0 +1,235 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: GoertzelKernelsAvx2.cpp
+//
+// Purpose: AVX2 DFT kernels.  This module is compiled with /arch:AVX2 and must only be entered
+//          when GetSimdLevel reports at least SIMD_AVX2.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "GoertzelKernels.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: IterateFour
+//
+// Purpose: Run the recurrence over four consecutive sample pairs held in wide registers
+//
+// Parameters: [in/out] aVec, bVec - recurrence state
+//             [in] KappaVec - recurrence coefficient
+//             [in] inSamples, outSamples - four consecutive samples from each channel
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <DftRecurrence_T R>
+static __forceinline void IterateFour( __m128d& aVec, __m128d& bVec, const __m128d& KappaVec,
+                                       const __m256d& inSamples, const __m256d& outSamples )
+{
+    // { in0, out0, in2, out2 } and { in1, out1, in3, out3 }
+    __m256d evenPairs = _mm256_unpacklo_pd( inSamples, outSamples );
+    __m256d oddPairs = _mm256_unpackhi_pd( inSamples, outSamples );
+
+    GoertzelIterate<R, true>( aVec, bVec, KappaVec, _mm256_castpd256_pd128( evenPairs ) );
+    GoertzelIterate<R, true>( aVec, bVec, KappaVec, _mm256_castpd256_pd128( oddPairs ) );
+    GoertzelIterate<R, true>( aVec, bVec, KappaVec, _mm256_extractf128_pd( evenPairs, 1 ) );
+    GoertzelIterate<R, true>( aVec, bVec, KappaVec, _mm256_extractf128_pd( oddPairs, 1 ) );
+}
+
+template <DftRecurrence_T R>
+static void FeedGoertzelAvx2( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n, const __m128d& KappaVec,
+                              __m128d& aVec, __m128d& bVec, SAMPLE_SUMS_T& sums )
+{
+    __m128d a = aVec, b = bVec;
+    __m128i inEnergyAcc = _mm_setzero_si128(), outEnergyAcc = _mm_setzero_si128();
+    __m128i inDcAcc = _mm_setzero_si128(), outDcAcc = _mm_setzero_si128();
+    __m128i inMinAcc = _mm_setzero_si128(), inMaxAcc = _mm_setzero_si128();
+    __m128i outMinAcc = _mm_setzero_si128(), outMaxAcc = _mm_setzero_si128();
+    uint32_t accumulations = 0;
+    uint32_t i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        // Load eight samples per channel, accumulate the sums and widen to 32 bits
+        __m128i in16 = _mm_loadu_si128( (const __m128i*)&inputSamples[i] );
+        __m128i out16 = _mm_loadu_si128( (const __m128i*)&outputSamples[i] );
+
+        AccumulateSums( in16, inEnergyAcc, inDcAcc );
+        AccumulateSums( out16, outEnergyAcc, outDcAcc );
+        AccumulateExtremes( in16, inMinAcc, inMaxAcc );
+        AccumulateExtremes( out16, outMinAcc, outMaxAcc );
+        if (++accumulations == maxSumAccumulations)
+        {
+            FlushSums( inEnergyAcc, inDcAcc, sums.dcSum[0], sums.energySum[0] );
+            FlushSums( outEnergyAcc, outDcAcc, sums.dcSum[1], sums.energySum[1] );
+            accumulations = 0;
+        }
+
+        __m256i in32 = _mm256_cvtepi16_epi32( in16 );
+        __m256i out32 = _mm256_cvtepi16_epi32( out16 );
+
+        __m256d inLo = _mm256_cvtepi32_pd( _mm256_castsi256_si128( in32 ) );
+        __m256d inHi = _mm256_cvtepi32_pd( _mm256_extracti128_si256( in32, 1 ) );
+        __m256d outLo = _mm256_cvtepi32_pd( _mm256_castsi256_si128( out32 ) );
+        __m256d outHi = _mm256_cvtepi32_pd( _mm256_extracti128_si256( out32, 1 ) );
+
+        IterateFour<R>( a, b, KappaVec, inLo, outLo );
+        IterateFour<R>( a, b, KappaVec, inHi, outHi );
+    }
+
+    FlushSums( inEnergyAcc, inDcAcc, sums.dcSum[0], sums.energySum[0] );
+    FlushSums( outEnergyAcc, outDcAcc, sums.dcSum[1], sums.energySum[1] );
+    FlushExtremes( inMinAcc, inMaxAcc, sums.minSample[0], sums.maxSample[0] );
+    FlushExtremes( outMinAcc, outMaxAcc, sums.minSample[1], sums.maxSample[1] );
+
+    FeedGoertzelScalar<R, true>( &inputSamples[i], &outputSamples[i], n - i, KappaVec, a, b, sums );
+
+    aVec = a;
+    bVec = b;
+
+    _mm256_zeroupper();
+}
+
+GoertzelKernel_T SelectGoertzelKernelAvx2( DftRecurrence_T recurrence )
+{
+    switch (recurrence)
+    {
+        case REINSCH_0:
+            return FeedGoertzelAvx2<REINSCH_0>;
+        case GOERTZEL:
+            return FeedGoertzelAvx2<GOERTZEL>;
+        default:
+            return FeedGoertzelAvx2<REINSCH_PI>;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: IterateTwoBins
+//
+// Purpose: Run one step of the recurrence for two bins of a bank, on both channels
+//
+// Parameters: [in/out] aVec, bVec - recurrence state { in0, out0, in1, out1 } for bins 0 and 1
+//             [in] KappaVec - recurrence coefficients { K0, K0, K1, K1 }
+//             [in] sampleVec - input and output channel samples, repeated for both bins
+//
+// Notes: The fused forms of GoertzelIterate, widened to 256 bits
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <DftRecurrence_T R>
+static __forceinline void IterateTwoBins( __m256d& aVec, __m256d& bVec, const __m256d& KappaVec, const __m256d& sampleVec )
+{
+    if (REINSCH_0 == R)
+    {
+        bVec = _mm256_fmadd_pd( KappaVec, aVec, _mm256_add_pd( bVec, sampleVec ) );
+        aVec = _mm256_add_pd( aVec, bVec );
+    }
+    else if (GOERTZEL == R)
+    {
+        __m256d tauVec = _mm256_fmadd_pd( KappaVec, aVec, _mm256_sub_pd( sampleVec, bVec ) );
+        bVec = aVec;
+        aVec = tauVec;
+    }
+    else // REINSCH_PI
+    {
+        bVec = _mm256_fmadd_pd( KappaVec, aVec, _mm256_sub_pd( sampleVec, bVec ) );
+        aVec = _mm256_sub_pd( bVec, aVec );
+    }
+}
+
+// Runs 2*V bins over the block, holding their state in V wide registers each for a and b
+template <DftRecurrence_T R, uint32_t V>
+static void FeedGoertzelBankChunkAvx2( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n,
+                                       const double* Kappa, double* a, double* b )
+{
+    __m256d KappaVec[V], aVec[V], bVec[V];
+    __m256d sampleVec;
+    uint32_t v;
+
+    for (v = 0; v < V; v++)
+    {
+        KappaVec[v] = _mm256_set_pd( Kappa[2*v+1], Kappa[2*v+1], Kappa[2*v], Kappa[2*v] );
+        aVec[v] = _mm256_loadu_pd( &a[4*v] );
+        bVec[v] = _mm256_loadu_pd( &b[4*v] );
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        // { in, out, in, out }
+        sampleVec = _mm256_cvtepi32_pd( _mm_set_epi32( outputSamples[i], inputSamples[i], outputSamples[i], inputSamples[i] ) );
+
+        for (v = 0; v < V; v++)
+        {
+            IterateTwoBins<R>( aVec[v], bVec[v], KappaVec[v], sampleVec );
+        }
+    }
+
+    for (v = 0; v < V; v++)
+    {
+        _mm256_storeu_pd( &a[4*v], aVec[v] );
+        _mm256_storeu_pd( &b[4*v], bVec[v] );
+    }
+}
+
+template <DftRecurrence_T R>
+static void FeedGoertzelBankAvx2( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n,
+                                  uint32_t numBins, const double* Kappa, double* a, double* b )
+{
+    uint32_t k = 0;
+
+    for (; k + 8 <= numBins; k += 8)
+    {
+        FeedGoertzelBankChunkAvx2<R, 4>( inputSamples, outputSamples, n, &Kappa[k], &a[2*k], &b[2*k] );
+    }
+    if (k + 4 <= numBins)
+    {
+        FeedGoertzelBankChunkAvx2<R, 2>( inputSamples, outputSamples, n, &Kappa[k], &a[2*k], &b[2*k] );
+        k += 4;
+    }
+    if (k + 2 <= numBins)
+    {
+        FeedGoertzelBankChunkAvx2<R, 1>( inputSamples, outputSamples, n, &Kappa[k], &a[2*k], &b[2*k] );
+        k += 2;
+    }
+    if (k < numBins)
+    {
+        FeedGoertzelBankChunk<R, true, 1>( inputSamples, outputSamples, n, &Kappa[k], &a[2*k], &b[2*k] );
+    }
+
+    _mm256_zeroupper();
+}
+
+GoertzelBankKernel_T SelectGoertzelBankKernelAvx2( DftRecurrence_T recurrence )
+{
+    switch (recurrence)
+    {
+        case REINSCH_0:
+            return FeedGoertzelBankAvx2<REINSCH_0>;
+        case GOERTZEL:
+            return FeedGoertzelBankAvx2<GOERTZEL>;
+        default:
+            return FeedGoertzelBankAvx2<REINSCH_PI>;
+    }
+}
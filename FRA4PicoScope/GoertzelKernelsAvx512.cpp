@@ -0,0 +1,142 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: GoertzelKernelsAvx512.cpp
+//
+// Purpose: AVX-512 DFT kernels.  This module is compiled with /arch:AVX2 (there is no AVX-512 arch
+//          option in the toolset), so all 512 bit operations are explicit intrinsics.  It must only
+//          be entered when GetSimdLevel reports SIMD_AVX512.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "GoertzelKernels.h"
+
+#if defined(GOERTZEL_AVX512_AVAILABLE)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: IterateEight
+//
+// Purpose: Run the recurrence over eight consecutive sample pairs held in wide registers
+//
+// Parameters: [in/out] aVec, bVec - recurrence state
+//             [in] KappaVec - recurrence coefficient
+//             [in] inSamples, outSamples - eight consecutive samples from each channel
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <DftRecurrence_T R>
+static __forceinline void IterateEight( __m128d& aVec, __m128d& bVec, const __m128d& KappaVec,
+                                        const __m512d& inSamples, const __m512d& outSamples )
+{
+    // Split into 256 bit halves first; shuffling within a half is cheaper than across the full register
+    __m256d inLo = _mm512_castpd512_pd256( inSamples ), inHi = _mm512_extractf64x4_pd( inSamples, 1 );
+    __m256d outLo = _mm512_castpd512_pd256( outSamples ), outHi = _mm512_extractf64x4_pd( outSamples, 1 );
+
+    // { in0, out0, in2, out2 } and { in1, out1, in3, out3 }
+    __m256d evenLo = _mm256_unpacklo_pd( inLo, outLo ), oddLo = _mm256_unpackhi_pd( inLo, outLo );
+    __m256d evenHi = _mm256_unpacklo_pd( inHi, outHi ), oddHi = _mm256_unpackhi_pd( inHi, outHi );
+
+    GoertzelIterate<R, true>( aVec, bVec, KappaVec, _mm256_castpd256_pd128( evenLo ) );
+    GoertzelIterate<R, true>( aVec, bVec, KappaVec, _mm256_castpd256_pd128( oddLo ) );
+    GoertzelIterate<R, true>( aVec, bVec, KappaVec, _mm256_extractf128_pd( evenLo, 1 ) );
+    GoertzelIterate<R, true>( aVec, bVec, KappaVec, _mm256_extractf128_pd( oddLo, 1 ) );
+    GoertzelIterate<R, true>( aVec, bVec, KappaVec, _mm256_castpd256_pd128( evenHi ) );
+    GoertzelIterate<R, true>( aVec, bVec, KappaVec, _mm256_castpd256_pd128( oddHi ) );
+    GoertzelIterate<R, true>( aVec, bVec, KappaVec, _mm256_extractf128_pd( evenHi, 1 ) );
+    GoertzelIterate<R, true>( aVec, bVec, KappaVec, _mm256_extractf128_pd( oddHi, 1 ) );
+}
+
+template <DftRecurrence_T R>
+static void FeedGoertzelAvx512( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n, const __m128d& KappaVec,
+                                __m128d& aVec, __m128d& bVec, SAMPLE_SUMS_T& sums )
+{
+    __m128d a = aVec, b = bVec;
+    __m128i inEnergyAcc = _mm_setzero_si128(), outEnergyAcc = _mm_setzero_si128();
+    __m128i inDcAcc = _mm_setzero_si128(), outDcAcc = _mm_setzero_si128();
+    __m128i inMinAcc = _mm_setzero_si128(), inMaxAcc = _mm_setzero_si128();
+    __m128i outMinAcc = _mm_setzero_si128(), outMaxAcc = _mm_setzero_si128();
+    uint32_t accumulations = 0;
+    uint32_t i;
+
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        // Load sixteen samples per channel, accumulate the sums and widen to 32 bits
+        __m256i in16 = _mm256_loadu_si256( (const __m256i*)&inputSamples[i] );
+        __m256i out16 = _mm256_loadu_si256( (const __m256i*)&outputSamples[i] );
+
+        AccumulateSums( _mm256_castsi256_si128( in16 ), inEnergyAcc, inDcAcc );
+        AccumulateSums( _mm256_extracti128_si256( in16, 1 ), inEnergyAcc, inDcAcc );
+        AccumulateSums( _mm256_castsi256_si128( out16 ), outEnergyAcc, outDcAcc );
+        AccumulateSums( _mm256_extracti128_si256( out16, 1 ), outEnergyAcc, outDcAcc );
+        AccumulateExtremes( _mm256_castsi256_si128( in16 ), inMinAcc, inMaxAcc );
+        AccumulateExtremes( _mm256_extracti128_si256( in16, 1 ), inMinAcc, inMaxAcc );
+        AccumulateExtremes( _mm256_castsi256_si128( out16 ), outMinAcc, outMaxAcc );
+        AccumulateExtremes( _mm256_extracti128_si256( out16, 1 ), outMinAcc, outMaxAcc );
+        if ((accumulations += 2) == maxSumAccumulations)
+        {
+            FlushSums( inEnergyAcc, inDcAcc, sums.dcSum[0], sums.energySum[0] );
+            FlushSums( outEnergyAcc, outDcAcc, sums.dcSum[1], sums.energySum[1] );
+            accumulations = 0;
+        }
+
+        __m512i in32 = _mm512_cvtepi16_epi32( in16 );
+        __m512i out32 = _mm512_cvtepi16_epi32( out16 );
+
+        __m512d inLo = _mm512_cvtepi32_pd( _mm512_castsi512_si256( in32 ) );
+        __m512d inHi = _mm512_cvtepi32_pd( _mm512_extracti64x4_epi64( in32, 1 ) );
+        __m512d outLo = _mm512_cvtepi32_pd( _mm512_castsi512_si256( out32 ) );
+        __m512d outHi = _mm512_cvtepi32_pd( _mm512_extracti64x4_epi64( out32, 1 ) );
+
+        IterateEight<R>( a, b, KappaVec, inLo, outLo );
+        IterateEight<R>( a, b, KappaVec, inHi, outHi );
+    }
+
+    FlushSums( inEnergyAcc, inDcAcc, sums.dcSum[0], sums.energySum[0] );
+    FlushSums( outEnergyAcc, outDcAcc, sums.dcSum[1], sums.energySum[1] );
+    FlushExtremes( inMinAcc, inMaxAcc, sums.minSample[0], sums.maxSample[0] );
+    FlushExtremes( outMinAcc, outMaxAcc, sums.minSample[1], sums.maxSample[1] );
+
+    FeedGoertzelScalar<R, true>( &inputSamples[i], &outputSamples[i], n - i, KappaVec, a, b, sums );
+
+    aVec = a;
+    bVec = b;
+
+    _mm256_zeroupper();
+}
+
+GoertzelKernel_T SelectGoertzelKernelAvx512( DftRecurrence_T recurrence )
+{
+    switch (recurrence)
+    {
+        case REINSCH_0:
+            return FeedGoertzelAvx512<REINSCH_0>;
+        case GOERTZEL:
+            return FeedGoertzelAvx512<GOERTZEL>;
+        default:
+            return FeedGoertzelAvx512<REINSCH_PI>;
+    }
+}
+
+#endif
@@ -0,0 +1,605 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: LockInDemodulator.cpp
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "LockInDemodulator.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <emmintrin.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: LockInDemodulator
+//
+// Purpose: Measures the amplitude and phase of the stimulus frequency component of the input and output signals the
+// way a lock-in amplifier does.  Each signal is mixed with e^(-j*omega*n) from a numerically controlled oscillator,
+// which moves the stimulus component to d.c., as z = (A/2)*e^(j*phi).  The mixer output is low pass filtered and
+// decimated by a CIC filter, then filtered again by a FIR filter which removes the mixing products.  The filtered I/Q
+// is averaged over the capture for the measurement, and also kept (decimated further) as a track of the signal's
+// amplitude and phase over the capture, which shows settling or drift.
+//
+// Parameters:
+//    Init
+//             [in] totalSamples - Total number of samples in the full signal
+//             [in] fSamp - frequency of the sampling
+//             [in] fDetect - frequency to detect
+//    Feed
+//             [in] inputSamples - input channel data sample points
+//             [in] outputSamples - output channel data sample points
+//             [in] n - number of samples in this block of samples
+//             [out] return - true when this was the last block and the results are available
+//    GetResults
+//             [output] [in/out]putMagnitude - Magnitude on the same scale as GoertzelDft's, (N+1)/2 times the amplitude
+//             [output] [in/out]putPhase - Phase of the cosine referenced to the first sample
+//             [output] [in/out]putAmplitude - The measured amplitude of the signal
+//             [output] [in/out]putPurity - The purity of the signal (signal power over a.c. power)
+//    GetTrack
+//             [in] channel - 0 for input, 1 for output
+//             [out] return - the I/Q track, each point the mean of consecutive filtered I/Q values
+//    GetDrift
+//             [output] [in/out]putAmplitudeChange - relative change in amplitude from the first quarter of the
+//                                                   track to the last
+//             [output] [in/out]putPhaseChange - change in phase (radians) from the first quarter to the last
+//
+// Notes:
+//
+// - The NCO is a phasor rotated each sample, and recomputed exactly (from the reduced phase) every anchorInterval
+//   samples, so its phase is accurate for any capture length.
+//
+// - The CIC decimator's response is sinc^cicOrder, with nulls at the multiples of the decimated rate, which protect
+//   the band around d.c. from aliasing.  A recursive CIC relies on wrap-around integer arithmetic, which the double
+//   precision mixer output doesn't have; in floating point the integrators grow without bound over a long capture and
+//   lose precision.  So the CIC is computed in its equivalent non-recursive polyphase form: each sample is weighted
+//   into the cicOrder outputs it contributes to, which costs cicOrder multiply-adds per sample and is exact.
+//
+// - The decimation is chosen so that there are at least minOutputSamplesPerCycle decimated samples per stimulus
+//   cycle.  The nearest mixing products to d.c. are at the stimulus frequency (from the d.c. and 2nd harmonic of the
+//   signal), so the FIR filter is a Blackman windowed sinc with its transition band between 1/8 and 1 times the
+//   stimulus frequency, giving ~74 dB rejection.
+//
+// - The CIC and FIR filter start-up outputs, computed from partial data, are discarded.  If the capture is too
+//   short for the FIR filter, it's bypassed.
+//
+// - A plain mean of the filtered I/Q is only exact over a whole number of cycles of what the filters leave of the
+//   mixing products; with the FIR filter bypassed, that's most of them.  For a sine plus d.c., the filtered I/Q is
+//   exactly a constant plus complex exponentials at -1 and -2 times the stimulus frequency, so the constant is found
+//   by least squares over all three instead (see FitMeanZ), which is exact for any span.  The purity's signal energy
+//   is likewise that of the fitted sine over the capture's actual samples, rather than N/2 times its power.
+//
+// - The mixer and CIC process the input and output signals together with SSE2, as in the Goertzel kernels.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+LockInDemodulator::LockInDemodulator(void)
+{
+    N = 0;
+    freqRatio = 0.0;
+    samplesProcessed = 0;
+    kernelTicks.QuadPart = 0;
+    cosStep = ncoCos = 1.0;
+    sinStep = ncoSin = 0.0;
+    samplesSinceAnchor = 0;
+    R = 1;
+    cicGain = 1.0;
+    blockPosition = 0;
+    cicOutputs = 0;
+    memset( accI, 0, sizeof(accI) );
+    memset( accQ, 0, sizeof(accQ) );
+    firIndex = 0;
+    firFilled = 0;
+    dcSum.fill( 0 );
+    energySum.fill( 0 );
+    sumZ.fill( 0.0 );
+    sumZRot1.fill( 0.0 );
+    sumZRot2.fill( 0.0 );
+    outputPhaseStep = 0.0;
+    numZ = 0;
+    trackGroupSize = 1;
+    groupSumZ.fill( 0.0 );
+    groupCount = 0;
+}
+
+void LockInDemodulator::Init( uint32_t totalSamples, double fSamp, double fDetect )
+{
+    double outputSamplesPerCycle;
+    uint32_t firLength, expectedCicOutputs, expectedFirOutputs;
+
+    N = totalSamples;
+    freqRatio = fDetect / fSamp;
+    samplesProcessed = 0;
+    kernelTicks.QuadPart = 0;
+
+    // NCO
+    cosStep = cos( 2.0 * M_PI * freqRatio );
+    sinStep = sin( 2.0 * M_PI * freqRatio );
+    samplesSinceAnchor = anchorInterval;
+
+    // CIC; the impulse response is a boxcar of length R convolved with itself cicOrder times
+    R = (uint32_t)max( 1.0, min( floor( 1.0 / (freqRatio * minOutputSamplesPerCycle) ), (double)maxDecimation ) );
+    cicGain = pow( (double)R, (double)cicOrder );
+
+    vector<double> impulse( cicOrder * R, 0.0 ), boxcar( cicOrder * R, 0.0 );
+    fill( impulse.begin(), impulse.begin() + R, 1.0 );
+    for (uint8_t stage = 1; stage < cicOrder; stage++)
+    {
+        double windowSum = 0.0;
+        boxcar = impulse;
+        for (uint32_t j = 0; j < cicOrder * R; j++)
+        {
+            // Sliding sum of the last R values; exact, since the values are integers below 2^53
+            windowSum += boxcar[j] - (j >= R ? boxcar[j-R] : 0.0);
+            impulse[j] = windowSum;
+        }
+    }
+
+    cicWeights.resize( cicOrder * R );
+    for (uint32_t p = 0; p < R; p++)
+    {
+        for (uint8_t k = 0; k < cicOrder; k++)
+        {
+            cicWeights[p*cicOrder+k] = impulse[k*R + R-1 - p];
+        }
+    }
+    blockPosition = 0;
+    cicOutputs = 0;
+    memset( accI, 0, sizeof(accI) );
+    memset( accQ, 0, sizeof(accQ) );
+
+    // FIR, unless the capture is too short for it
+    outputSamplesPerCycle = 1.0 / (freqRatio * R);
+    firLength = 2 * (uint32_t)ceil( 3.15 * outputSamplesPerCycle ) + 1;
+    expectedCicOutputs = N / R > (cicOrder - 1u) ? N / R - (cicOrder - 1u) : 0;
+    if (expectedCicOutputs < 2 * firLength)
+    {
+        firLength = 1;
+    }
+    expectedFirOutputs = max( 1u, expectedCicOutputs - (firLength - 1) );
+
+    firTaps.resize( firLength );
+    if (1 == firLength)
+    {
+        firTaps[0] = 1.0;
+    }
+    else
+    {
+        double cutoff = 0.5625 / outputSamplesPerCycle; // Cycles per decimated sample
+        double tapSum = 0.0;
+        for (uint32_t i = 0; i < firLength; i++)
+        {
+            double m = (double)i - (firLength - 1) / 2.0;
+            double window = 0.42 - 0.5 * cos( 2.0 * M_PI * i / (firLength - 1) ) + 0.08 * cos( 4.0 * M_PI * i / (firLength - 1) );
+            firTaps[i] = window * (0.0 == m ? 2.0 * cutoff : sin( 2.0 * M_PI * cutoff * m ) / (M_PI * m));
+            tapSum += firTaps[i];
+        }
+        for (uint32_t i = 0; i < firLength; i++)
+        {
+            firTaps[i] /= tapSum;
+        }
+    }
+    for (int ch = 0; ch < 2; ch++)
+    {
+        firHistory[ch].assign( firLength, 0.0 );
+    }
+    firIndex = 0;
+    firFilled = 0;
+
+    dcSum.fill( 0 );
+    energySum.fill( 0 );
+
+    sumZ.fill( 0.0 );
+    sumZRot1.fill( 0.0 );
+    sumZRot2.fill( 0.0 );
+    outputPhaseStep = 2.0 * M_PI * freqRatio * R;
+    numZ = 0;
+    trackGroupSize = (expectedFirOutputs + maxTrackPoints - 1) / maxTrackPoints;
+    groupSumZ.fill( 0.0 );
+    groupCount = 0;
+    for (int ch = 0; ch < 2; ch++)
+    {
+        track[ch].clear();
+        track[ch].reserve( maxTrackPoints + 1 );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: LockInDemodulator::Anchor
+//
+// Purpose: Recompute the NCO phasor exactly at the current sample
+//
+// Parameters: N/A
+//
+// Notes: The phase is reduced as in CombineGoertzelState, since the sample index can be up to 1G
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void LockInDemodulator::Anchor( void )
+{
+    double cycles = freqRatio * samplesProcessed;
+    double cyclesError = fma( freqRatio, (double)samplesProcessed, -cycles );
+    double phase = 2.0 * M_PI * ((cycles - floor( cycles )) + cyclesError);
+
+    ncoCos = cos( phase );
+    ncoSin = sin( phase );
+    samplesSinceAnchor = 0;
+}
+
+bool LockInDemodulator::Feed( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n )
+{
+    LARGE_INTEGER kernelStart, kernelEnd;
+    uint32_t i = 0;
+
+    QueryPerformanceCounter( &kernelStart );
+
+    while (i < n)
+    {
+        // Run up to the end of the CIC block
+        uint32_t run = min( n - i, R - blockPosition );
+
+        if (samplesSinceAnchor >= anchorInterval)
+        {
+            Anchor();
+        }
+
+        MixAndAccumulate( &inputSamples[i], &outputSamples[i], run );
+
+        i += run;
+        if (R == blockPosition)
+        {
+            EmitCicOutput();
+        }
+    }
+
+    QueryPerformanceCounter( &kernelEnd );
+    kernelTicks.QuadPart += kernelEnd.QuadPart - kernelStart.QuadPart;
+
+    return (samplesProcessed == N);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: LockInDemodulator::MixAndAccumulate
+//
+// Purpose: Mix samples to I/Q and accumulate them into the CIC outputs
+//
+// Parameters: [in] inputSamples, outputSamples - the samples
+//             [in] n - number of samples; must not cross the end of the current CIC block
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void LockInDemodulator::MixAndAccumulate( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n )
+{
+    __m128d I0 = _mm_loadu_pd( accI[0] ), I1 = _mm_loadu_pd( accI[1] ), I2 = _mm_loadu_pd( accI[2] );
+    __m128d Q0 = _mm_loadu_pd( accQ[0] ), Q1 = _mm_loadu_pd( accQ[1] ), Q2 = _mm_loadu_pd( accQ[2] );
+    const double* weights = &cicWeights[blockPosition * cicOrder];
+    double c = ncoCos, s = ncoSin;
+
+    for (uint32_t i = 0; i < n; i++, weights += cicOrder)
+    {
+        int16_t x0 = inputSamples[i], x1 = outputSamples[i];
+        __m128d xVec = _mm_setr_pd( (double)x0, (double)x1 );
+        __m128d iVec = _mm_mul_pd( xVec, _mm_set1_pd( c ) );
+        __m128d qVec = _mm_mul_pd( xVec, _mm_set1_pd( -s ) );
+        __m128d w0 = _mm_set1_pd( weights[0] ), w1 = _mm_set1_pd( weights[1] ), w2 = _mm_set1_pd( weights[2] );
+        double cNext;
+
+        I0 = _mm_add_pd( I0, _mm_mul_pd( w0, iVec ) );
+        I1 = _mm_add_pd( I1, _mm_mul_pd( w1, iVec ) );
+        I2 = _mm_add_pd( I2, _mm_mul_pd( w2, iVec ) );
+        Q0 = _mm_add_pd( Q0, _mm_mul_pd( w0, qVec ) );
+        Q1 = _mm_add_pd( Q1, _mm_mul_pd( w1, qVec ) );
+        Q2 = _mm_add_pd( Q2, _mm_mul_pd( w2, qVec ) );
+
+        dcSum[0] += x0;
+        dcSum[1] += x1;
+        energySum[0] += (uint32_t)(x0 * x0);
+        energySum[1] += (uint32_t)(x1 * x1);
+
+        // Advance the NCO
+        cNext = c * cosStep - s * sinStep;
+        s = s * cosStep + c * sinStep;
+        c = cNext;
+    }
+
+    _mm_storeu_pd( accI[0], I0 ); _mm_storeu_pd( accI[1], I1 ); _mm_storeu_pd( accI[2], I2 );
+    _mm_storeu_pd( accQ[0], Q0 ); _mm_storeu_pd( accQ[1], Q1 ); _mm_storeu_pd( accQ[2], Q2 );
+    ncoCos = c;
+    ncoSin = s;
+
+    blockPosition += n;
+    samplesProcessed += n;
+    samplesSinceAnchor += n;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: LockInDemodulator::EmitCicOutput
+//
+// Purpose: Complete a CIC output at the end of a block, and pass it on to the FIR filter
+//
+// Parameters: N/A
+//
+// Notes: The first cicOrder-1 outputs are missing earlier samples, so are discarded
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void LockInDemodulator::EmitCicOutput( void )
+{
+    array<complex<double>,2> z;
+
+    for (int ch = 0; ch < 2; ch++)
+    {
+        z[ch] = complex<double>( accI[0][ch], accQ[0][ch] ) / cicGain;
+        for (uint8_t k = 0; k < cicOrder - 1; k++)
+        {
+            accI[k][ch] = accI[k+1][ch];
+            accQ[k][ch] = accQ[k+1][ch];
+        }
+        accI[cicOrder-1][ch] = accQ[cicOrder-1][ch] = 0.0;
+    }
+
+    blockPosition = 0;
+
+    if (++cicOutputs < cicOrder)
+    {
+        return;
+    }
+
+    // FIR filter
+    uint32_t firLength = (uint32_t)firTaps.size();
+    for (int ch = 0; ch < 2; ch++)
+    {
+        firHistory[ch][firIndex] = z[ch];
+    }
+    firIndex = (firIndex + 1) % firLength;
+
+    if (++firFilled < firLength)
+    {
+        return;
+    }
+
+    for (int ch = 0; ch < 2; ch++)
+    {
+        complex<double> sum = 0.0;
+        for (uint32_t i = 0; i < firLength; i++)
+        {
+            sum += firTaps[i] * firHistory[ch][(firIndex + i) % firLength];
+        }
+        z[ch] = sum;
+    }
+
+    EmitFirOutput( z );
+}
+
+void LockInDemodulator::EmitFirOutput( const array<complex<double>,2>& z )
+{
+    double cycles = (outputPhaseStep / (2.0 * M_PI)) * numZ;
+    complex<double> rotation = polar( 1.0, 2.0 * M_PI * (cycles - floor( cycles )) );
+
+    for (int ch = 0; ch < 2; ch++)
+    {
+        sumZ[ch] += z[ch];
+        sumZRot1[ch] += z[ch] * rotation;
+        sumZRot2[ch] += z[ch] * rotation * rotation;
+        groupSumZ[ch] += z[ch];
+    }
+    numZ++;
+
+    if (++groupCount == trackGroupSize)
+    {
+        for (int ch = 0; ch < 2; ch++)
+        {
+            track[ch].push_back( groupSumZ[ch] / (double)groupCount );
+            groupSumZ[ch] = 0.0;
+        }
+        groupCount = 0;
+    }
+}
+
+void LockInDemodulator::GetResults( double& inputMagnitude, double& inputPhase, double& inputAmplitude, double& inputPurity,
+                                    double& outputMagnitude, double& outputPhase, double& outputAmplitude, double& outputPurity )
+{
+    array<double,2> magnitude, phase, amplitude, purity;
+
+    for (int ch = 0; ch < 2; ch++)
+    {
+        complex<double> meanZ = FitMeanZ( ch );
+        complex<double> sineSum, sineSquaredSum;
+        double signalEnergy, acEnergy;
+
+        amplitude[ch] = 2.0 * abs( meanZ );
+        phase[ch] = arg( meanZ );
+        magnitude[ch] = amplitude[ch] * (N+1) / 2.0;
+
+        // The sine is 2*Re(meanZ*e^(j*omega*n)), so its sum and sum of squares over the samples are closed form
+        sineSum = 2.0 * meanZ * PhasorSum( 2.0 * M_PI * freqRatio, N );
+        sineSquaredSum = 2.0 * norm( meanZ ) * (double)N + 2.0 * meanZ * meanZ * PhasorSum( 4.0 * M_PI * freqRatio, N );
+        signalEnergy = sineSquaredSum.real() - (N ? sineSum.real() * sineSum.real() / N : 0.0);
+        acEnergy = (double)energySum[ch] - ((double)dcSum[ch] * (double)dcSum[ch]) / N;
+        purity[ch] = acEnergy > 0.0 ? min( 1.0, signalEnergy / acEnergy ) : 0.0;
+    }
+
+    inputMagnitude = magnitude[0];
+    inputPhase = phase[0];
+    inputAmplitude = amplitude[0];
+    inputPurity = purity[0];
+
+    outputMagnitude = magnitude[1];
+    outputPhase = phase[1];
+    outputAmplitude = amplitude[1];
+    outputPurity = purity[1];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: LockInDemodulator::FitMeanZ
+//
+// Purpose: Find the stimulus component of a channel's filtered I/Q
+//
+// Parameters: [in] channel - 0 for input, 1 for output
+//             [out] return - the component, (A/2)*e^(j*phi)
+//
+// Notes: Least squares fit of the filtered I/Q to a constant plus exponentials at -1 and -2 times the stimulus
+//        phase advance per output, the d.c. and 2nd harmonic mixing products.  The normal equations' matrix
+//        elements are geometric sums (PhasorSum).  Falls back to the plain mean over less than a cycle, or when
+//        the decimated rate puts a product on d.c. or on the other, where the fit is singular.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+complex<double> LockInDemodulator::FitMeanZ( int channel )
+{
+    complex<double> meanZ = numZ ? sumZ[channel] / (double)numZ : 0.0;
+    complex<double> a[3][4], factor;
+    int row, col, pivot, k;
+
+    if ((double)numZ * outputPhaseStep < 2.0 * M_PI || fabs( sin( outputPhaseStep / 2.0 ) ) < 0.01 || fabs( sin( outputPhaseStep ) ) < 0.01)
+    {
+        return meanZ;
+    }
+
+    // Row k holds the sums of e^(j*k*theta*m) times each basis function e^(-j*l*theta*m), then the I/Q
+    for (row = 0; row < 3; row++)
+    {
+        for (col = 0; col < 3; col++)
+        {
+            a[row][col] = PhasorSum( (double)(row - col) * outputPhaseStep, numZ );
+        }
+    }
+    a[0][3] = sumZ[channel];
+    a[1][3] = sumZRot1[channel];
+    a[2][3] = sumZRot2[channel];
+
+    // Gaussian elimination with partial pivoting
+    for (col = 0; col < 3; col++)
+    {
+        pivot = col;
+        for (row = col + 1; row < 3; row++)
+        {
+            if (abs( a[row][col] ) > abs( a[pivot][col] ))
+            {
+                pivot = row;
+            }
+        }
+        if (abs( a[pivot][col] ) < 1.0e-9 * numZ)
+        {
+            return meanZ;
+        }
+        for (k = 0; k < 4; k++)
+        {
+            swap( a[col][k], a[pivot][k] );
+        }
+        for (row = 0; row < 3; row++)
+        {
+            if (row != col)
+            {
+                factor = a[row][col] / a[col][col];
+                for (k = col; k < 4; k++)
+                {
+                    a[row][k] -= factor * a[col][k];
+                }
+            }
+        }
+    }
+
+    return a[0][3] / a[0][0];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: LockInDemodulator::PhasorSum
+//
+// Purpose: Sum e^(j*step*m) for m from 0 to count-1
+//
+// Parameters: [in] step - phase step in radians
+//             [in] count - number of terms
+//             [out] return - the sum
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+complex<double> LockInDemodulator::PhasorSum( double step, double count )
+{
+    double halfStepSin = sin( step / 2.0 );
+    double halfSpan = fmod( step * (count - 1.0) / 2.0, 2.0 * M_PI );
+
+    // Every term is 1 when the step is a whole number of turns
+    if (fabs( halfStepSin ) < 1.0e-12)
+    {
+        return count;
+    }
+    return (sin( fmod( step * count / 2.0, 2.0 * M_PI ) ) / halfStepSin) * polar( 1.0, halfSpan );
+}
+
+const vector<complex<double>>& LockInDemodulator::GetTrack( int channel )
+{
+    return track[channel];
+}
+
+void LockInDemodulator::GetDrift( double& inputAmplitudeChange, double& inputPhaseChange,
+                                  double& outputAmplitudeChange, double& outputPhaseChange )
+{
+    array<double,2> amplitudeChange = {{ 0.0, 0.0 }}, phaseChange = {{ 0.0, 0.0 }};
+    size_t quarter = track[0].size() / 4;
+
+    if (quarter)
+    {
+        for (int ch = 0; ch < 2; ch++)
+        {
+            complex<double> first = 0.0, last = 0.0;
+            for (size_t i = 0; i < quarter; i++)
+            {
+                first += track[ch][i];
+                last += track[ch][track[ch].size() - quarter + i];
+            }
+            amplitudeChange[ch] = abs( first ) > 0.0 ? abs( last ) / abs( first ) - 1.0 : 0.0;
+            phaseChange[ch] = arg( last / first );
+        }
+    }
+
+    inputAmplitudeChange = amplitudeChange[0];
+    inputPhaseChange = phaseChange[0];
+    outputAmplitudeChange = amplitudeChange[1];
+    outputPhaseChange = phaseChange[1];
+}
+
+uint32_t LockInDemodulator::GetDecimation( void )
+{
+    return R;
+}
+
+uint32_t LockInDemodulator::GetFirLength( void )
+{
+    return (uint32_t)firTaps.size();
+}
+
+double LockInDemodulator::GetKernelSeconds( void )
+{
+    LARGE_INTEGER ticksPerSecond;
+    QueryPerformanceFrequency( &ticksPerSecond );
+    return (double)kernelTicks.QuadPart / (double)ticksPerSecond.QuadPart;
+}
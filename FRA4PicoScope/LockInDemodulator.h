@@ -0,0 +1,117 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: LockInDemodulator.h
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <array>
+#include <vector>
+#include <complex>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: class LockInDemodulator
+//
+// Purpose: Lock-in style measurement of the input and output channels: a quadrature mixer driven
+//          by a numerically controlled oscillator, a CIC decimator and a FIR low pass filter.  See
+//          LockInDemodulator.cpp for details.
+//
+// Parameters: N/A
+//
+// Notes: Besides the overall amplitude and phase, it keeps a decimated track of I/Q over the
+//        capture, which shows settling or drift.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+class LockInDemodulator
+{
+    public:
+        LockInDemodulator(void);
+
+        void Init( uint32_t totalSamples, double fSamp, double fDetect );
+        bool Feed( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n );
+        void GetResults( double& inputMagnitude, double& inputPhase, double& inputAmplitude, double& inputPurity,
+                         double& outputMagnitude, double& outputPhase, double& outputAmplitude, double& outputPurity );
+        const vector<complex<double>>& GetTrack( int channel );
+        void GetDrift( double& inputAmplitudeChange, double& inputPhaseChange,
+                       double& outputAmplitudeChange, double& outputPhaseChange );
+
+        static const uint8_t cicOrder = 3;
+        static const uint32_t maxDecimation = 1 << 16;
+        static const uint8_t minOutputSamplesPerCycle = 8;
+        static const uint32_t maxTrackPoints = 4096;
+
+        // Diagnostic accessors
+        uint32_t GetDecimation( void );
+        uint32_t GetFirLength( void );
+        double GetKernelSeconds( void );
+
+    private:
+        static const uint32_t anchorInterval = 1024;
+        void Anchor( void );
+        void MixAndAccumulate( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n );
+        void EmitCicOutput( void );
+        void EmitFirOutput( const array<complex<double>,2>& z );
+        complex<double> FitMeanZ( int channel );
+        static complex<double> PhasorSum( double step, double count );
+
+        uint32_t N;
+        double freqRatio;
+        uint32_t samplesProcessed;
+        LARGE_INTEGER kernelTicks;
+
+        // NCO
+        double cosStep, sinStep;
+        double ncoCos, ncoSin;
+        uint32_t samplesSinceAnchor;
+
+        // CIC decimator, in polyphase form.  cicWeights[p*cicOrder+k] is the weight of the sample at
+        // position p in a block for the output k blocks later.  Accumulators are { input, output } pairs.
+        uint32_t R;
+        double cicGain;
+        vector<double> cicWeights;
+        uint32_t blockPosition;
+        uint32_t cicOutputs;
+        double accI[cicOrder][2], accQ[cicOrder][2];
+
+        // FIR filter, on the decimated stream
+        vector<double> firTaps;
+        array<vector<complex<double>>,2> firHistory;
+        uint32_t firIndex;
+        uint32_t firFilled;
+
+        // Sample sums, for purity
+        array<int64_t,2> dcSum;
+        array<uint64_t,2> energySum;
+
+        // Filtered I/Q; summed over the whole capture, and over groups for the track.  sumZRot1/2
+        // are the sums rotated by once and twice the stimulus phase advance per output, for FitMeanZ.
+        array<complex<double>,2> sumZ;
+        array<complex<double>,2> sumZRot1, sumZRot2;
+        double outputPhaseStep;
+        uint32_t numZ;
+        uint32_t trackGroupSize;
+        array<complex<double>,2> groupSumZ;
+        uint32_t groupCount;
+        array<vector<complex<double>>,2> track;
+};
@@ -34,6 +34,9 @@
 #include <algorithm>
 #include <memory>
 #include <vector>
+#include <limits>
+#include <float.h>
+#include <malloc.h>
 #include <intrin.h>
 #include <sstream>
 #include <iomanip>
@@ -66,6 +69,13 @@ void __stdcall DataReady( short handle, PICO_STATUS status, void * pParameter)
 const double PicoScopeFRA::attenInfo[] = {1.0, 10.0, 20.0, 100.0, 200.0, 1000.0};
 const double PicoScopeFRA::stimulusBasedInitialRangeEstimateMargin = 0.95;
 const uint32_t PicoScopeFRA::timeDomainDiagnosticDataLengthLimit = 1024;
+const double PicoScopeFRA::maxBroadbandBandRatio = 100.0;
+const double PicoScopeFRA::frequencyRefinementThresholdBins = 0.005;
+const double PicoScopeFRA::maxStreamingSampFreqHz = 1.0e6;
+const double PicoScopeFRA::minProbedCaptureSec = 1.0;
+const double PicoScopeFRA::maxSweepStepCaptureSec = 0.01;
+const double PicoScopeFRA::minSweepWindowPurity = 0.9;
+const double PicoScopeFRA::rangePredictionMargin = 0.9;
 
 PICO_STATUS PicoScopeFRA::captureStatus;
 
@@ -93,11 +103,30 @@ PicoScopeFRA::PicoScopeFRA(FRA_STATUS_CALLBACK statusCB)
     mSamplingMode = LOW_NOISE;
 
     numSteps = latestCompletedNumSteps = freqStepCounter = freqStepIndex = 0;
-
-    pInputBuffer = pOutputBuffer = NULL;
+    latestCompletedNumHarmonics = 0;
 
     ovIn = ovOut = false;
     delayForAcCoupling = false;
+
+    for (uint8_t i = 0; i < PicoScope::numTransferBuffers; i++)
+    {
+        transferInputBuffers[i] = transferOutputBuffers[i] = NULL;
+    }
+    transferBufferSize = 0;
+    transferDownsampleRatio = 1;
+    streamingCapture = false;
+    segmentCapture = false;
+    segmentInputSamples = segmentOutputSamples = NULL;
+    segmentInputOv = segmentOutputOv = false;
+    segmentDelivered = false;
+    mPipelinedSweep = true;
+    stageTickMs = 0;
+    stimulusStaged = stimulusAhead = false;
+    mPredictiveAutorange = false;
+    inputRangeFloor = inputRangeCeiling = outputRangeFloor = outputRangeCeiling = (PS_RANGE)0;
+    rangesPredicted = false;
+    predictedInputRange = predictedOutputRange = unpredictedInputRange = unpredictedOutputRange = (PS_RANGE)0;
+    numRangePredictions = numInputRangeHits = numOutputRangeHits = rangePredictionTriesSaved = 0;
     inputChannelAutorangeStatus = outputChannelAutorangeStatus = OK;
 
     hCaptureEvent = CreateEventW( NULL, false, false, L"CaptureEvent" );
@@ -111,6 +140,7 @@ PicoScopeFRA::PicoScopeFRA(FRA_STATUS_CALLBACK statusCB)
     mOutputDcOffset = 0.0;
     actualSampFreqHz = 0.0;
     numSamples = 0;
+    captureTimebase = 0;
     timeIndisposedMs = 0;
     currentInputMagnitude = 0.0;
     currentOutputMagnitude = 0.0;
@@ -118,6 +148,16 @@ PicoScopeFRA::PicoScopeFRA(FRA_STATUS_CALLBACK statusCB)
     currentOutputPhase = 0.0;
     currentInputPurity = 0.0;
     currentOutputPurity = 0.0;
+    currentGainStdErrDb = currentPhaseStdErrDeg = numeric_limits<double>::quiet_NaN();
+    currentCoherence = numeric_limits<double>::quiet_NaN();
+    predictedCaptureSamples = 0;
+    shortenedCapture = false;
+    confidenceRecapture = false;
+    mProbeCapture = false;
+    probePending = probeCapture = probeSettled = false;
+    probeCaptureSec = fullCaptureSec = probeSavedSec = 0.0;
+    mHardwareSweep = false;
+    sweepBatchFailed = false;
     mPurityLowerLimit = 0.0;
     minAllowedAmplitudeRatio = 0.0;
     minAmplitudeRatioTolerance = 0.0;
@@ -135,6 +175,21 @@ PicoScopeFRA::PicoScopeFRA(FRA_STATUS_CALLBACK statusCB)
     mTargetResponseAmplitudeTolerance = 0.0;
     maxAdaptiveStimulusRetries = 0;
     mPhaseWrappingThreshold = 180.0;
+    mDftThreads = 1;
+    mNumHarmonics = 0;
+    mEstimator = GOERTZEL_DFT_ESTIMATOR;
+    mNumSubBlocks = 0;
+    mTargetGainStdErrDb = 0.0;
+    mTargetPhaseStdErrDeg = 0.0;
+    mAveragingCount = 1;
+    mStimulusType = STEPPED_SINE_STIMULUS;
+    mSpectrumDiagnostics = false;
+    mFrequencyRefinement = false;
+    mStreamingCapture = false;
+    bandPeriodSamples = 0;
+    bandRepeatFreqHz = 0.0;
+    pDft = new GoertzelDft;
+    pDft->SetThreadPool( &dftThreadPool );
     rangeCounts = 0.0;
     signalGeneratorPrecision = 0.0;
     autorangeRetryCounter = 0;
@@ -272,6 +327,337 @@ void PicoScopeFRA::SetFraTuning( double purityLowerLimit, uint16_t extraSettling
     mLowNoiseOversampling = lowNoiseOversampling;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetDftThreads
+//
+// Purpose: Set the number of threads used to compute the DFT
+//
+// Parameters: [in] dftThreads - Number of threads; 1 computes serially (the default) and 0 uses
+//                               one thread per logical processor
+//
+// Notes: If the worker threads can't be created, the DFT is computed serially and a warning logged
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetDftThreads( uint16_t dftThreads )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+
+    mDftThreads = dftThreads;
+
+    if (!dftThreadPool.Initialize( mDftThreads ))
+    {
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, L"Warning: Failed to create DFT worker threads; computing DFT serially.", FRA_WARNING );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetHarmonics
+//
+// Purpose: Set the number of harmonics to measure alongside the fundamental at each step
+//
+// Parameters: [in] numHarmonics - Number of harmonics above the fundamental, starting with the 2nd;
+//                                 0 (the default) measures only the fundamental.  Limited to
+//                                 GoertzelDft::maxHarmonics.
+//
+// Notes: The harmonics are computed in the same pass over the captured data as the fundamental, so
+//        they add no capture time.  Retrieve them with GetHarmonicResults.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetHarmonics( uint8_t numHarmonics )
+{
+    mNumHarmonics = (uint8_t)min( (int)numHarmonics, (int)GoertzelDft::maxHarmonics );
+    pDft->SetNumHarmonics( mNumHarmonics );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetDftWindow
+//
+// Purpose: Set the window applied in the DFT
+//
+// Parameters: [in] dftWindow - the window; DFT_WINDOW_RECTANGULAR (the default) for none
+//
+// Notes: With a window, captures need not contain whole stimulus cycles, and far fewer cycles are
+//        needed for good leakage rejection, so the minimum cycles captured (SetFraTuning) can be
+//        reduced.  See GoertzelDft::SetWindow for the least cycles each window needs.  In noise reject
+//        mode, the capture is lengthened to keep the window's noise bandwidth within the maximum.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetDftWindow( DftWindow_T dftWindow )
+{
+    pDft->SetWindow( dftWindow );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetDftTrend
+//
+// Purpose: Set what baseline, beyond d.c., the DFT fits and removes from each capture
+//
+// Parameters: [in] dftTrend - the baseline model; DFT_TREND_NONE (the default) for d.c. only
+//
+// Notes: With AC coupling, switching the signal generator leaves a decaying offset on the
+//        channels, which leaks into the DFT bins.  With a baseline removed, the progressive delay
+//        otherwise inserted before each capture to let it settle is skipped; the offset is
+//        measured out instead of waited out.  Applies to the DFT estimator.  The extra settling
+//        time (SetFraTuning) is still applied, as it's also for the DUT to settle.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetDftTrend( DftTrend_T dftTrend )
+{
+    pDft->SetTrendRemoval( dftTrend );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetEstimator
+//
+// Purpose: Set how the gain and phase are measured from the captured samples
+//
+// Parameters: [in] estimator - GOERTZEL_DFT_ESTIMATOR (the default), one of the sine fits, or
+//                               LOCK_IN_DEMODULATOR
+//
+// Notes: The sine fits tolerate captures of a few, non-whole cycles, so the minimum cycles captured
+//        (SetFraTuning) can be reduced to 2-4.  The 4 parameter fit also tracks any error in the
+//        stimulus frequency, at the cost of reading the captured samples from the scope once per
+//        iteration.  The lock-in demodulator also reports how much the amplitude and phase drift
+//        over the capture, which shows whether the DUT had settled.  The DFT still runs (on the
+//        first pass) to measure harmonics.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetEstimator( MeasurementEstimator_T estimator )
+{
+    mEstimator = (estimator < NUM_MEASUREMENT_ESTIMATORS) ? estimator : GOERTZEL_DFT_ESTIMATOR;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetSubBlocks
+//
+// Purpose: Set how many sub-blocks the DFT divides each capture into, to estimate the standard
+//          error of the gain and phase
+//
+// Parameters: [in] numSubBlocks - number of sub-blocks; 0 (the default) or 1 for no estimate.
+//                                 Limited to GoertzelDft::maxSubBlocks.
+//
+// Notes: The sub-blocks are computed in the same pass as the DFT, and are whole stimulus cycles
+//        long, so captures need at least as many cycles as sub-blocks.  Retrieve the estimates with
+//        GetUncertaintyResults.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetSubBlocks( uint8_t numSubBlocks )
+{
+    mNumSubBlocks = (uint8_t)min( (int)numSubBlocks, (int)GoertzelDft::maxSubBlocks );
+    pDft->SetNumSubBlocks( mNumSubBlocks );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetConfidenceTarget
+//
+// Purpose: Set the standard errors at which a step has enough data
+//
+// Parameters: [in] gainStdErrDb - gain standard error target in dB; 0 (the default) for none
+//             [in] phaseStdErrDeg - phase standard error target in degrees; 0 (the default) for none
+//
+// Notes: Needs sub-blocks (SetSubBlocks).  When a target is set, a step stops transferring and
+//        processing samples once every target set is met, with at least minSubBlocksForEarlyStop
+//        sub-blocks done; this needs the DFT estimator with the rectangular window.  In noise
+//        reject mode, each step's capture is also shortened to the samples the previous step
+//        predicts will meet the targets (with a margin, and never longer than the bandwidth
+//        requires).  If a shortened capture falls short, the step is captured again at full length.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetConfidenceTarget( double gainStdErrDb, double phaseStdErrDeg )
+{
+    mTargetGainStdErrDb = max( 0.0, gainStdErrDb );
+    mTargetPhaseStdErrDeg = max( 0.0, phaseStdErrDeg );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetAveraging
+//
+// Purpose: Set how many captures are averaged at each step
+//
+// Parameters: [in] averagingCount - number of captures; 0 or 1 (the default) for no averaging
+//
+// Notes: The repeats reuse the step's signal generator, channel and timebase setup, so are much
+//        cheaper than repeating the sweep.  See AverageCaptures.  With a confidence target
+//        (SetConfidenceTarget), averaging stops once the target is met, and noise reject captures
+//        aren't shortened.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetAveraging( uint16_t averagingCount )
+{
+    mAveragingCount = max( (uint16_t)1, averagingCount );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetStimulusType
+//
+// Purpose: Choose between stepping a sine through the frequencies and measuring bands of them at
+//          once with a broadband stimulus
+//
+// Parameters: [in] stimulusType - the stimulus
+//
+// Notes: The broadband stimuli need an arbitrary waveform generator; without one the FRA falls
+//        back to the stepped sine.  See ExecuteBroadbandSweep.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetStimulusType( StimulusType_T stimulusType )
+{
+    mStimulusType = stimulusType;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetSpectrumDiagnostics
+//
+// Purpose: Enable or disable the per-step spectrum diagnostics
+//
+// Parameters: [in] enable - whether to compute the spectrum diagnostics
+//
+// Notes: The spectra are computed on a background thread (see SpectrumDiagnostics), and reported
+//        at the end of the sweep.  They are only computed for stepped sine sweeps.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetSpectrumDiagnostics( bool enable )
+{
+    mSpectrumDiagnostics = enable;
+    if (enable)
+    {
+        // On failure the spectra are computed on the FRA thread
+        (void)spectrumDiagnostics.Initialize();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetFrequencyRefinement
+//
+// Purpose: Enable or disable measuring the stimulus frequency from each capture and re-tuning the
+//          DFT to it
+//
+// Parameters: [in] enable - whether to refine the frequency
+//
+// Notes: The signal generator's output differs slightly from the frequency requested of it, which
+//        on long captures leaks energy out of the DFT bin.  See RefineGoertzelFrequency.  Applies
+//        to the DFT estimator; the DFT is given at least minFrequencyRefinementSubBlocks sub-blocks
+//        to measure the frequency with.  Retrieve the measurements with GetMeasuredFrequencies.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetFrequencyRefinement( bool enable )
+{
+    mFrequencyRefinement = enable;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetStreamingCapture
+//
+// Purpose: Set whether captures may use the scope's streaming mode
+//
+// Parameters: [in] enable - whether to allow streaming captures
+//
+// Notes: A streamed capture is analyzed while it is still in progress, so the step finishes soon
+//        after the last sample arrives, and its length isn't limited by the scope's buffer, which
+//        lowers the minimum frequency.  See StreamingCaptureAvailable for when it's used.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetStreamingCapture( bool enable )
+{
+    mStreamingCapture = enable;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetProbeCapture
+//
+// Purpose: Set whether long captures are preceded by short probe captures
+//
+// Parameters: [in] enable - whether to probe
+//
+// Notes: A probe captures probeCycles cycles, which is enough to settle the range and the adaptive
+//        stimulus, so that a wrong range costs a probe rather than a full length capture.  Steps
+//        whose full capture takes less than minProbedCaptureSec aren't probed.  The time saved is
+//        reported with the autorange diagnostics.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetProbeCapture( bool enable )
+{
+    mProbeCapture = enable;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetHardwareSweep
+//
+// Purpose: Enable or disable measuring short steps in batches swept by the signal generator
+//
+// Parameters: [in] enable - whether to batch
+//
+// Notes: Only used where the scope supports it, and with the settings a batch can honour (see
+//        SweepBatchAvailable and MeasureSweepBatch).  Batched steps are moved slightly to fit the
+//        generator's linear sweep.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetHardwareSweep( bool enable )
+{
+    mHardwareSweep = enable;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetPipelinedSweep
+//
+// Purpose: Enable or disable setting up the next step's stimulus while a capture is processed
+//
+// Parameters: [in] enable - whether to pipeline
+//
+// Notes: See StageStimulus
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetPipelinedSweep( bool enable )
+{
+    mPipelinedSweep = enable;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetPredictiveAutorange
+//
+// Purpose: Enable or disable predicting each step's starting ranges from the response trend
+//
+// Parameters: [in] enable - whether to predict
+//
+// Notes: See PredictStepRanges
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetPredictiveAutorange( bool enable )
+{
+    mPredictiveAutorange = enable;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //
 // Name: PicoScopeFRA::EnableDiagnostics
@@ -329,6 +715,11 @@ double PicoScopeFRA::GetMinFrequency(void)
         {
             double minSamplingFrequency;
             ps->GetFrequencyFromTimebase(ps->GetMaxTimebase(), minSamplingFrequency);
+            if (StreamingCaptureAvailable())
+            {
+                // Streamed captures are only limited by the 32 bit sample count
+                return (max( (mMinCyclesCaptured * minSamplingFrequency / (double)UINT32_MAX), ps->GetMinFuncGenFreq() ));
+            }
             return (max( (mMinCyclesCaptured * minSamplingFrequency / maxScopeSamplesPerChannel), ps->GetMinFuncGenFreq() ));
         }
         else
@@ -502,8 +893,8 @@ bool PicoScopeFRA::ExecuteFRA(double startFreqHz, double stopFreqHz, int stepsPe
     mStartFreqHz = startFreqHz;
     mStopFreqHz = stopFreqHz;
     mStepsPerDecade = stepsPerDecade;
+    bool broadbandSweep = false;
 
-    DWORD dwWaitResult;
     DWORD winError;
 
     FRA_STATUS_MESSAGE_T fraStatusMsg;
@@ -522,6 +913,27 @@ bool PicoScopeFRA::ExecuteFRA(double startFreqHz, double stopFreqHz, int stepsPe
 
         GenerateFrequencyPoints();
         AllocateFraData();
+        if (mSpectrumDiagnostics)
+        {
+            spectrumDiagnostics.Reset( numSteps );
+        }
+
+        // The broadband stimuli need the arbitrary waveform generator
+        if (STEPPED_SINE_STIMULUS != mStimulusType)
+        {
+            if (ps->GetMaxArbitraryWaveformSize() >= minBroadbandWaveformSize)
+            {
+                broadbandSweep = true;
+                if (mAdaptiveStimulus)
+                {
+                    UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, L"WARNING: Adaptive stimulus not supported with a broadband stimulus; using the initial stimulus amplitude", FRA_WARNING );
+                }
+            }
+            else
+            {
+                UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, L"WARNING: Scope has no arbitrary waveform generator; using stepped sine stimulus", FRA_WARNING );
+            }
+        }
 
         cancel = false;
         if (TRUE != (ResetEvent( hCaptureEvent )))
@@ -535,175 +947,34 @@ bool PicoScopeFRA::ExecuteFRA(double startFreqHz, double stopFreqHz, int stepsPe
         // Update the status to indicate the FRA has started
         UpdateStatus( fraStatusMsg, FRA_STATUS_IN_PROGRESS, 0, numSteps );
 
-        freqStepIndex = mSweepDescending ? numSteps-1 : 0;
-        while ((mSweepDescending && freqStepIndex >= 0) || (!mSweepDescending && freqStepIndex < numSteps))
-        {
-            totalRetryCounter[freqStepIndex] = 0;
-            currentFreqHz = freqsHz[freqStepIndex];
+        predictedCaptureSamples = 0;
 
-            swprintf(fraStatusText, 128, L"Status: Starting frequency step %d (%0.3lf Hz)", freqStepCounter, currentFreqHz);
-            UpdateStatus(fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, FRA_PROGRESS);
+        if (broadbandSweep)
+        {
+            ExecuteBroadbandSweep();
+        }
+        else
+        {
+            ExecuteSteppedSweep();
 
-            for (autorangeRetryCounter = 0, adaptiveStimulusRetryCounter = 0;
-                 autorangeRetryCounter < maxAutorangeRetries && adaptiveStimulusRetryCounter < maxAdaptiveStimulusRetries;)
+            if (mSpectrumDiagnostics)
             {
-                try
-                {
-                    if (mAdaptiveStimulus)
-                    {
-                        wsprintf(fraStatusText, L"Status: Starting frequency step %d, range try %d, adaptive stimulus try %d", freqStepCounter, autorangeRetryCounter + 1, adaptiveStimulusRetryCounter + 1);
-                    }
-                    else
-                    {
-                        wsprintf(fraStatusText, L"Status: Starting frequency step %d, range try %d", freqStepCounter, autorangeRetryCounter + 1);
-                    }
-                    UpdateStatus(fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, STEP_TRIAL_PROGRESS);
-                    if (true != StartCapture(currentFreqHz))
-                    {
-                        throw FraFault();
-                    }
-                    // Adjust the delay time for a safety factor of 1.5x and never let it go less than 3 seconds
-                    timeIndisposedMs = max(3000, (timeIndisposedMs * 3) / 2);
-                    dwWaitResult = WaitForSingleObject(hCaptureEvent, timeIndisposedMs);
-
-                    if (cancel)
-                    {
-                        // Notify of cancellation
-                        UpdateStatus(fraStatusMsg, FRA_STATUS_CANCELED, freqStepCounter, numSteps);
-                        ps->CancelCapture();
-                        throw FraFault();
-                    }
+                ReportSpectrumDiagnostics();
+            }
+        }
 
-                    if (dwWaitResult == WAIT_OBJECT_0)
-                    {
-                        if (PICO_OK == PicoScopeFRA::captureStatus)
-                        {
-                            if (false == ProcessData())
-                            {
-                                // At least one of the channels needs adjustment
-                                totalRetryCounter[freqStepIndex]++; // record the attempt
-                                continue; // Try again on a different range
-                            }
-                            else // Data is good, calculate and move on to next frequency
-                            {
-                                // Currently no error is possible so just cast to void
-                                (void)CalculateGainAndPhase(&gainsDb[freqStepIndex], &phasesDeg[freqStepIndex]);
+        // Generate any alternate forms
+        UnwrapPhases();
 
-                                // Notify progress
-                                UpdateStatus(fraStatusMsg, FRA_STATUS_IN_PROGRESS, freqStepCounter, numSteps);
+        TransferLatestResults();
 
-                                totalRetryCounter[freqStepIndex]++; // record the attempt
-                                break;
-                            }
-                        }
-                        else if (PICO_POWER_SUPPLY_CONNECTED == PicoScopeFRA::captureStatus ||
-                                 PICO_POWER_SUPPLY_NOT_CONNECTED == PicoScopeFRA::captureStatus)
-                        {
-                            throw PicoScope::PicoPowerChange(PicoScopeFRA::captureStatus);
-                        }
-                        else
-                        {
-                            wstringstream wssError;
-                            wssError << L"Fatal Error: Data capture error: " << PicoScopeFRA::captureStatus;
-                            UpdateStatus(fraStatusMsg, FRA_STATUS_FATAL_ERROR, wssError.str().c_str());
-                            throw FraFault();
-                        }
-                    }
-                    else
-                    {
-                        UpdateStatus(fraStatusMsg, FRA_STATUS_FATAL_ERROR, L"Fatal Error: Data capture wait timed out");
-                        throw FraFault();
-                    }
-                }
-                catch (const PicoScope::PicoPowerChange& ex)
-                {
-                    UpdateStatus( fraStatusMsg, FRA_STATUS_POWER_CHANGED, ex.GetState() == PICO_POWER_SUPPLY_CONNECTED );
-                    // Change the power state regardless of whether the user wants to continue FRA execution.
-                    ps->ChangePower(ex.GetState());
-                    ps->CancelCapture();
-                    if (true == fraStatusMsg.responseData.proceed)
-                    {
-                        // Start the step over again
-                        autorangeRetryCounter = 0;
-                        adaptiveStimulusRetryCounter = 0;
-                        totalRetryCounter[freqStepIndex] = 0;
-                        continue;
-                    }
-                    else
-                    {
-                        throw FraFault();
-                    }
-                }
-            }
+        UpdateStatus(fraStatusMsg, FRA_STATUS_COMPLETE, freqStepCounter, numSteps);
 
-            if (mDiagnosticsOn)
-            {
-                // Make records for diagnostics
-                if (LOW_NOISE == mSamplingMode)
-                {
-                    sampleInterval[freqStepIndex] = 1.0 / actualSampFreqHz;
-                }
-                else
-                {
-                    // The data for plotting is downsampled (aggregated)
-                    sampleInterval[freqStepIndex] = ((double)numSamples / (double)timeDomainDiagnosticDataLengthLimit) / actualSampFreqHz;
-                }
-                diagNumSamplesToPlot[freqStepIndex] = inputMinData[freqStepIndex][0].size();
-                diagNumSamplesCaptured[freqStepIndex] = numSamples;
-            }
-
-            if (autorangeRetryCounter == maxAutorangeRetries ||
-                adaptiveStimulusRetryCounter == maxAdaptiveStimulusRetries)
-            {
-                // This is a temporary solution until we implement a fully interactive one.
-                UpdateStatus( fraStatusMsg, FRA_STATUS_RETRY_LIMIT, inputChannelAutorangeStatus, outputChannelAutorangeStatus );
-                if (true == fraStatusMsg.responseData.proceed)
-                {
-                    if (fraStatusMsg.responseData.retry)
-                    {
-                        // Start the step over again
-                        continue; // bypasses step index and counter updates
-                    }
-                    else // continue to next step
-                    {
-                        gainsDb[freqStepIndex] = 0.0;
-                        phasesDeg[freqStepIndex] = 0.0;
-                        // TODO - mark as invalid;
-                        // Notify progress
-                        UpdateStatus( fraStatusMsg, FRA_STATUS_IN_PROGRESS, freqStepCounter, numSteps );
-                    }
-                }
-                else
-                {
-                    // Notify of cancellation
-                    UpdateStatus( fraStatusMsg, FRA_STATUS_CANCELED, freqStepCounter, numSteps );
-                    throw FraFault();
-                }
-            }
-
-            // Step index and counter updates
-            if (mSweepDescending)
-            {
-                freqStepIndex--;
-            }
-            else
-            {
-                freqStepIndex++;
-            }
-            freqStepCounter++;
-        }
-
-        // Generate any alternate forms
-        UnwrapPhases();
-
-        TransferLatestResults();
-
-        UpdateStatus(fraStatusMsg, FRA_STATUS_COMPLETE, freqStepCounter, numSteps);
-
-        if (mDiagnosticsOn)
-        {
-            // Don't let failure to generate diagnostic plots be fatal.
-            try
+        // The diagnostic records are per step, which broadband captures don't fill
+        if (mDiagnosticsOn && !broadbandSweep)
+        {
+            // Don't let failure to generate diagnostic plots be fatal.
+            try
             {
                 GenerateDiagnosticOutput();
             }
@@ -759,419 +1030,1826 @@ bool PicoScopeFRA::ExecuteFRA(double startFreqHz, double stopFreqHz, int stepsPe
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //
-// Name: PicoScopeFRA::CancelFRA
+// Name: PicoScopeFRA::ExecuteSteppedSweep
 //
-// Purpose: Cancels the FRA execution
+// Purpose: Measures the frequency steps one at a time with the built-in sine generator
 //
-// Parameters: [out] return - Whether the function was successful.
+// Parameters: N/A
 //
-// Notes: 
+// Notes: Called by ExecuteFRA; failures are thrown as FraFault.  While a capture is processed,
+//        the next step's stimulus is set up and settles (see StageStimulus).
 //
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool PicoScopeFRA::CancelFRA()
+void PicoScopeFRA::ExecuteSteppedSweep( void )
 {
-    cancel = true;
-    SetEvent( hCaptureEvent ); // To break it out of waiting to capture data in case
-    // there are several seconds of data to capture
-    return true; // bool return reserved for possible future event based signalling that may fail
-}
+    DWORD dwWaitResult;
 
-////////////////////////////////////////////////////////////////////////////////////////////////////
-//
-// Name: PicoScopeFRA::SetCaptureStatus
-//
-// Purpose: Communicate the status value from the capture callback
-//
-// Parameters: [in] status - the status value from the capture callback
-//
-// Notes:
-//
-///////////////////////////////////////////////////////////////////////////////////////////////////
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
+    int batchStart, batchEnd;
+    int nextStepIndex;
+    bool staging, stepProcessed;
+
+    sweepBatchFailed = false;
+    stimulusStaged = stimulusAhead = false;
+    rangesPredicted = false;
+    rangeHistoryLogFreqs.clear();
+    rangeHistoryLogInputs.clear();
+    rangeHistoryLogOutputs.clear();
+    numRangePredictions = numInputRangeHits = numOutputRangeHits = rangePredictionTriesSaved = 0;
+
+    freqStepIndex = mSweepDescending ? numSteps-1 : 0;
+    while ((mSweepDescending && freqStepIndex >= 0) || (!mSweepDescending && freqStepIndex < numSteps))
+    {
+        // Once a step measured singly has settled the ranges, short steps may be measured a batch
+        // at a time by a signal generator sweep
+        if (freqStepIndex > 0 && SweepBatchAvailable())
+        {
+            batchStart = freqStepIndex;
+            try
+            {
+                batchEnd = MeasureSweepBatch( batchStart );
+            }
+            catch (const PicoScope::PicoPowerChange& ex)
+            {
+                UpdateStatus( fraStatusMsg, FRA_STATUS_POWER_CHANGED, ex.GetState() == PICO_POWER_SUPPLY_CONNECTED );
+                // Change the power state regardless of whether the user wants to continue FRA execution.
+                ps->ChangePower(ex.GetState());
+                ps->CancelCapture();
+                if (true == fraStatusMsg.responseData.proceed)
+                {
+                    // Measure the step singly
+                    batchEnd = batchStart;
+                }
+                else
+                {
+                    throw FraFault();
+                }
+            }
+            freqStepCounter += batchEnd - batchStart;
+            freqStepIndex = batchEnd;
+            if (freqStepIndex == numSteps)
+            {
+                break;
+            }
+        }
 
-void PicoScopeFRA::SetCaptureStatus(PICO_STATUS status)
-{
-    PicoScopeFRA::captureStatus = status;
-}
+        totalRetryCounter[freqStepIndex] = 0;
+        confidenceRecapture = false;
+        probePending = mProbeCapture;
+        probeSettled = false;
+        probeSavedSec = 0.0;
+        currentCoherence = numeric_limits<double>::quiet_NaN();
+        currentFreqHz = freqsHz[freqStepIndex];
 
-////////////////////////////////////////////////////////////////////////////////////////////////////
-//
-// Name: PicoScopeFRA::CheckSignalOverflows
-//
-// Purpose: Makes auto-ranging decisions based on channel over-voltage info.
-//
-// Parameters: [out] return: whether to proceed with further computation, based on whether both
-//                           channels are over-voltage
-//
-// Notes: 
-//
-///////////////////////////////////////////////////////////////////////////////////////////////////
+        swprintf(fraStatusText, 128, L"Status: Starting frequency step %d (%0.3lf Hz)", freqStepCounter, currentFreqHz);
+        UpdateStatus(fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, FRA_PROGRESS);
 
-bool PicoScopeFRA::CheckSignalOverflows(void)
-{
-    bool retVal = true;
-    FRA_STATUS_MESSAGE_T fraStatusMsg;
-    wchar_t fraStatusText[128];
+        for (autorangeRetryCounter = 0, adaptiveStimulusRetryCounter = 0;
+             autorangeRetryCounter < maxAutorangeRetries && adaptiveStimulusRetryCounter < maxAdaptiveStimulusRetries;)
+        {
+            try
+            {
+                if (mAdaptiveStimulus)
+                {
+                    wsprintf(fraStatusText, L"Status: Starting frequency step %d, range try %d, adaptive stimulus try %d", freqStepCounter, autorangeRetryCounter + 1, adaptiveStimulusRetryCounter + 1);
+                }
+                else
+                {
+                    wsprintf(fraStatusText, L"Status: Starting frequency step %d, range try %d", freqStepCounter, autorangeRetryCounter + 1);
+                }
+                UpdateStatus(fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, STEP_TRIAL_PROGRESS);
+                if (true != StartCapture(currentFreqHz))
+                {
+                    throw FraFault();
+                }
+                // Adjust the delay time for a safety factor of 1.5x and never let it go less than 3 seconds
+                timeIndisposedMs = max(3000, (timeIndisposedMs * 3) / 2);
+                dwWaitResult = WaitForSingleObject(hCaptureEvent, timeIndisposedMs);
 
-    // Reset to default
-    inputChannelAutorangeStatus = OK;
-    outputChannelAutorangeStatus = OK;
+                if (cancel)
+                {
+                    // Notify of cancellation
+                    UpdateStatus(fraStatusMsg, FRA_STATUS_CANCELED, freqStepCounter, numSteps);
+                    ps->CancelCapture();
+                    throw FraFault();
+                }
 
-    // Make records for diagnostics
-    inOV[freqStepIndex][totalRetryCounter[freqStepIndex]] = ovIn;
-    outOV[freqStepIndex][totalRetryCounter[freqStepIndex]] = ovOut;
-    inRange[freqStepIndex][totalRetryCounter[freqStepIndex]] = currentInputChannelRange;
-    outRange[freqStepIndex][totalRetryCounter[freqStepIndex]] = currentOutputChannelRange;
+                if (dwWaitResult == WAIT_OBJECT_0)
+                {
+                    if (PICO_OK == PicoScopeFRA::captureStatus)
+                    {
+                        // Set up and settle the next step's stimulus while this capture is transferred and processed
+                        nextStepIndex = mSweepDescending ? freqStepIndex - 1 : freqStepIndex + 1;
+                        staging = StagingAvailable() && !probeCapture && nextStepIndex >= 0 && nextStepIndex < numSteps;
+                        if (staging)
+                        {
+                            // The generator has left this step's frequency, whatever happens next
+                            stimulusStaged = StageStimulus( freqsHz[nextStepIndex] );
+                            stimulusAhead = true;
+                        }
+                        stepProcessed = ProcessData();
 
-    if (ovIn)
-    {
-        if (currentInputChannelRange < inputMaxRange)
+                        if (false == stepProcessed)
+                        {
+                            // At least one of the channels needs adjustment
+                            if (probeCapture)
+                            {
+                                probeSavedSec += fullCaptureSec - probeCaptureSec;
+                            }
+                            totalRetryCounter[freqStepIndex]++; // record the attempt
+                            continue; // Try again on a different range
+                        }
+                        else if (probeCapture)
+                        {
+                            // Range and stimulus are settled; the full length capture replaces the probe's records
+                            probePending = false;
+                            probeSettled = true;
+                            probeSavedSec -= probeCaptureSec;
+                            swprintf(fraStatusText, 128, L"Status: Probe settled range and stimulus; capture time saved: %.1lf sec", probeSavedSec);
+                            UpdateStatus(fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, AUTORANGE_DIAGNOSTICS);
+                            continue;
+                        }
+                        else if (shortenedCapture && ConfidenceRatio( currentGainStdErrDb, currentPhaseStdErrDeg ) > 1.0)
+                        {
+                            // The shortened capture missed the confidence target
+                            UpdateStatus(fraStatusMsg, FRA_STATUS_MESSAGE, L"Status: Confidence target not met; capturing again at full length", SAMPLE_PROCESSING_DIAGNOSTICS);
+                            confidenceRecapture = true;
+                            totalRetryCounter[freqStepIndex]++; // record the attempt
+                            continue;
+                        }
+                        else // Data is good, calculate and move on to next frequency
+                        {
+                            // Any staged stimulus is for the next step
+                            stimulusAhead = false;
+
+                            if (mAveragingCount > 1)
+                            {
+                                AverageCaptures();
+                            }
+
+                            // Currently no error is possible so just cast to void
+                            (void)CalculateGainAndPhase(&gainsDb[freqStepIndex], &phasesDeg[freqStepIndex]);
+                            CalculateHarmonics(freqStepIndex);
+                            RecordUncertainty(freqStepIndex);
+                            if (mPredictiveAutorange)
+                            {
+                                RecordStepRanges( totalRetryCounter[freqStepIndex] );
+                            }
+
+                            // Notify progress
+                            UpdateStatus(fraStatusMsg, FRA_STATUS_IN_PROGRESS, freqStepCounter, numSteps);
+
+                            totalRetryCounter[freqStepIndex]++; // record the attempt
+                            break;
+                        }
+                    }
+                    else if (PICO_POWER_SUPPLY_CONNECTED == PicoScopeFRA::captureStatus ||
+                             PICO_POWER_SUPPLY_NOT_CONNECTED == PicoScopeFRA::captureStatus)
+                    {
+                        throw PicoScope::PicoPowerChange(PicoScopeFRA::captureStatus);
+                    }
+                    else
+                    {
+                        wstringstream wssError;
+                        wssError << L"Fatal Error: Data capture error: " << PicoScopeFRA::captureStatus;
+                        UpdateStatus(fraStatusMsg, FRA_STATUS_FATAL_ERROR, wssError.str().c_str());
+                        throw FraFault();
+                    }
+                }
+                else
+                {
+                    UpdateStatus(fraStatusMsg, FRA_STATUS_FATAL_ERROR, L"Fatal Error: Data capture wait timed out");
+                    throw FraFault();
+                }
+            }
+            catch (const PicoScope::PicoPowerChange& ex)
+            {
+                UpdateStatus( fraStatusMsg, FRA_STATUS_POWER_CHANGED, ex.GetState() == PICO_POWER_SUPPLY_CONNECTED );
+                // Change the power state regardless of whether the user wants to continue FRA execution.
+                ps->ChangePower(ex.GetState());
+                ps->CancelCapture();
+                if (true == fraStatusMsg.responseData.proceed)
+                {
+                    // Start the step over again
+                    autorangeRetryCounter = 0;
+                    adaptiveStimulusRetryCounter = 0;
+                    totalRetryCounter[freqStepIndex] = 0;
+                    stimulusStaged = false;
+                    probePending = mProbeCapture;
+                    probeSettled = false;
+                    probeSavedSec = 0.0;
+                    continue;
+                }
+                else
+                {
+                    throw FraFault();
+                }
+            }
+        }
+
+        if (mDiagnosticsOn)
         {
-            inputChannelAutorangeStatus = CHANNEL_OVERFLOW;
-            currentInputChannelRange = (PS_RANGE)((int)currentInputChannelRange + 1);
+            // Make records for diagnostics
+            if (LOW_NOISE == mSamplingMode)
+            {
+                sampleInterval[freqStepIndex] = 1.0 / actualSampFreqHz;
+            }
+            else
+            {
+                // The data for plotting is downsampled (aggregated)
+                sampleInterval[freqStepIndex] = ((double)numSamples / (double)timeDomainDiagnosticDataLengthLimit) / actualSampFreqHz;
+            }
+            diagNumSamplesToPlot[freqStepIndex] = inputMinData[freqStepIndex][0].size();
+            diagNumSamplesCaptured[freqStepIndex] = numSamples;
         }
-        else
+
+        if (autorangeRetryCounter == maxAutorangeRetries ||
+            adaptiveStimulusRetryCounter == maxAdaptiveStimulusRetries)
         {
-            inputChannelAutorangeStatus = HIGHEST_RANGE_LIMIT_REACHED;
+            // This is a temporary solution until we implement a fully interactive one.
+            UpdateStatus( fraStatusMsg, FRA_STATUS_RETRY_LIMIT, inputChannelAutorangeStatus, outputChannelAutorangeStatus );
+            if (true == fraStatusMsg.responseData.proceed)
+            {
+                if (fraStatusMsg.responseData.retry)
+                {
+                    // Start the step over again
+                    continue; // bypasses step index and counter updates
+                }
+                else // continue to next step
+                {
+                    gainsDb[freqStepIndex] = 0.0;
+                    phasesDeg[freqStepIndex] = 0.0;
+                    // TODO - mark as invalid;
+                    // Notify progress
+                    UpdateStatus( fraStatusMsg, FRA_STATUS_IN_PROGRESS, freqStepCounter, numSteps );
+                }
+            }
+            else
+            {
+                // Notify of cancellation
+                UpdateStatus( fraStatusMsg, FRA_STATUS_CANCELED, freqStepCounter, numSteps );
+                throw FraFault();
+            }
         }
-        wsprintf( fraStatusText, L"Status: Measured input signal over-range" );
-        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, AUTORANGE_DIAGNOSTICS );
-    }
-    if (ovOut)
-    {
-        if (currentOutputChannelRange < outputMaxRange)
+
+        // Step index and counter updates
+        if (mSweepDescending)
         {
-            outputChannelAutorangeStatus = CHANNEL_OVERFLOW;
-            currentOutputChannelRange = (PS_RANGE)((int)currentOutputChannelRange + 1);
+            freqStepIndex--;
         }
         else
         {
-            outputChannelAutorangeStatus = HIGHEST_RANGE_LIMIT_REACHED;
+            freqStepIndex++;
         }
-        wsprintf( fraStatusText, L"Status: Measured output signal over-range" );
-        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, AUTORANGE_DIAGNOSTICS );
+        freqStepCounter++;
     }
 
-    if (ovIn && ovOut) // If both are over-range, signal to skip further processing.
+    if (numRangePredictions > 0)
     {
-        retVal = false;
-        // Initialize the diagnostic record since CheckSignalRanges will not run
-        inAmps[freqStepIndex][totalRetryCounter[freqStepIndex]] = 0.0;
-        outAmps[freqStepIndex][totalRetryCounter[freqStepIndex]] = 0.0;
+        swprintf( fraStatusText, 128, L"Status: Range predictions: %d steps, %d input and %d output hits, about %d tries saved",
+                  numRangePredictions, numInputRangeHits, numOutputRangeHits, rangePredictionTriesSaved );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, AUTORANGE_DIAGNOSTICS );
     }
-
-    // Clear overflow
-    ovIn = ovOut = false;
-
-    return retVal;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //
-// Name: PicoScopeFRA::CheckSignalRanges
+// Name: PicoScopeFRA::ExecuteBroadbandSweep
 //
-// Purpose: Makes auto-ranging decisions based on signal max amplitude info.
+// Purpose: Measures the frequency steps a band at a time with a broadband stimulus from the
+//          arbitrary waveform generator
 //
-// Parameters: [out] return: whether to proceed with further computation, based on whether both
-//                           in-range
+// Parameters: N/A
 //
-// Notes: 
+// Notes: Called by ExecuteFRA; failures are thrown as FraFault.  Each band is excited by one
+//        periodic waveform (see BroadbandStimulus) holding whole cycles of every step's frequency,
+//        captured once, and analyzed with an FFT (see AnalyzeBroadbandCapture).  So a sweep takes
+//        a capture per band rather than one per step, and each band's steps settle together.
+//        The steps are moved to the nearest frequencies the waveform period can hold; the results
+//        report the frequencies actually measured.  Bands are measured in ascending order whatever
+//        the sweep direction, and harmonics aren't measured.
 //
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool PicoScopeFRA::CheckSignalRanges(void)
+void PicoScopeFRA::ExecuteBroadbandSweep( void )
 {
-
-    bool retVal = true;
     FRA_STATUS_MESSAGE_T fraStatusMsg;
     wchar_t fraStatusText[128];
 
-    // Want amplitude to be above a lower threshold to avoid excessive quantization noise.
-    // Want the signal to be below an upper threshold to avoid being close to overflow.
+    uint32_t waveformSize = Fft::PreviousPowerOfTwo( min( ps->GetMaxArbitraryWaveformSize(), (uint32_t)maxBroadbandWaveformSize ) );
+    uint32_t timebase, numPeriods;
+    double awgRepeatFreqHz;
+    int bandStart = 0, bandEnd;
 
-    // Check Input
-    if (inputChannelAutorangeStatus == OK)
+    while (bandStart < numSteps)
     {
-        if (((double)inputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts) > maxAmplitudeRatio)
+        bandEnd = PlanBroadbandBand( bandStart, waveformSize, timebase );
+        freqStepIndex = bandStart;
+        totalRetryCounter[bandStart] = 0;
+
+        swprintf( fraStatusText, 128, L"Status: Starting band of steps %d to %d (%0.3lf Hz to %0.3lf Hz)", bandStart+1, bandEnd,
+                  freqsHz[bandStart], freqsHz[bandEnd-1] );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, FRA_PROGRESS );
+
+        if (!broadbandStimulus.Design( mStimulusType, waveformSize, bandToneCycles ))
         {
-            if (currentInputChannelRange < inputMaxRange)
-            {
-                currentInputChannelRange = (PS_RANGE)((int)currentInputChannelRange + 1);
-                inputChannelAutorangeStatus = AMPLITUDE_TOO_HIGH;
-            }
-            else
-            {
-                inputChannelAutorangeStatus = OK; // Can't go any higher, but OK to stay here
-            }
-            retVal = false;
+            UpdateStatus( fraStatusMsg, FRA_STATUS_FATAL_ERROR, L"Fatal error: Failed to design broadband stimulus" );
+            throw FraFault();
         }
-        else if (((double)inputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts) <
-                 (maxAmplitudeRatio/rangeInfo[currentInputChannelRange].ratioDown - minAmplitudeRatioTolerance))
+        awgRepeatFreqHz = bandRepeatFreqHz;
+        if (!(ps->SetArbitrarySignalGenerator( broadbandStimulus.GetWaveform(), currentStimulusVpp, currentStimulusOffset, awgRepeatFreqHz )))
         {
-            if (currentInputChannelRange > inputMinRange)
-            {
-                currentInputChannelRange = (PS_RANGE)((int)currentInputChannelRange - 1);
-                inputChannelAutorangeStatus = AMPLITUDE_TOO_LOW;
-                retVal = false;
-            }
-            else
-            {
-                if (((double)inputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts) < minAllowedAmplitudeRatio)
-                {
-                    inputChannelAutorangeStatus = LOWEST_RANGE_LIMIT_REACHED;
-                    retVal = false;
-                }
-                else
-                {
-                    // Do nothing
-                }
-            }
+            throw FraFault();
         }
-        else
+        swprintf( fraStatusText, 128, L"Status: Broadband stimulus of %u tones repeating at %0.6lg Hz; crest factor %0.3lf",
+                  (uint32_t)bandToneCycles.size(), awgRepeatFreqHz, broadbandStimulus.GetCrestFactor() );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, SIGNAL_GENERATOR_DIAGNOSTICS );
+
+        // Report the frequencies the generator actually produces
+        for (int idx = bandStart; idx < bandEnd; idx++)
         {
-            // Do nothing
+            freqsHz[idx] = (double)bandToneCycles[idx-bandStart] * awgRepeatFreqHz;
+            freqsLogHz[idx] = log10( freqsHz[idx] );
         }
-        swprintf( fraStatusText, 128, L"Status: Measured input absolute peak: %hu counts", inputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]] );
-        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, AUTORANGE_DIAGNOSTICS );
-    }
-    else
-    {
-        retVal = false; // Still need to adjust for the overflow on this channel
-    }
 
-    // Check Output
-    if (outputChannelAutorangeStatus == OK)
-    {
-        if (((double)outputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts) > maxAmplitudeRatio)
+        // Settle for a couple of periods of the waveform, plus any extra
+        Sleep( mExtraSettlingTimeMs + (DWORD)ceil( 2000.0 / awgRepeatFreqHz ) );
+
+        // Whole periods: enough for the minimum cycles of the lowest step, and in noise reject
+        // mode, few enough to keep each tone's bandwidth within the limit
+        numPeriods = (uint32_t)ceil( (double)mMinCyclesCaptured / (double)bandToneCycles.front() );
+        if (HIGH_NOISE == mSamplingMode)
         {
-            if (currentOutputChannelRange < outputMaxRange)
-            {
-                currentOutputChannelRange = (PS_RANGE)((int)currentOutputChannelRange + 1);
-                outputChannelAutorangeStatus = AMPLITUDE_TOO_HIGH;
-            }
-            else
-            {
-                outputChannelAutorangeStatus = OK; // Can't go any higher, but OK to stay here
-            }
-            retVal = false;
+            numPeriods = max( numPeriods, (uint32_t)ceil( bandRepeatFreqHz / mMaxDftBw ) );
         }
-        else if (((double)outputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts) <
-                 (maxAmplitudeRatio/rangeInfo[currentOutputChannelRange].ratioDown - minAmplitudeRatioTolerance))
+        numPeriods = max( (uint32_t)1, min( numPeriods, maxScopeSamplesPerChannel / bandPeriodSamples ) );
+        numSamples = numPeriods * bandPeriodSamples;
+
+        for (autorangeRetryCounter = 0; autorangeRetryCounter < maxAutorangeRetries;)
         {
-            if (currentOutputChannelRange > outputMinRange)
+            try
             {
-                currentOutputChannelRange = (PS_RANGE)((int)currentOutputChannelRange - 1);
-                outputChannelAutorangeStatus = AMPLITUDE_TOO_LOW;
-                retVal = false;
+                autoRangeTries[bandStart] = autorangeRetryCounter+1;
+
+                if( !(ps->SetupChannel((PS_CHANNEL)mInputChannel, (PS_COUPLING)mInputChannelCoupling, currentInputChannelRange, (float)mInputDcOffset)) ||
+                    !(ps->SetupChannel((PS_CHANNEL)mOutputChannel, (PS_COUPLING)mOutputChannelCoupling, currentOutputChannelRange, (float)mOutputDcOffset)) ||
+                    !(ps->DisableChannelTriggers()) )
+                {
+                    throw FraFault();
+                }
+
+                captureTimebase = timebase;
+                if (!(ps->RunBlock(numSamples, timebase, &timeIndisposedMs, DataReady, &hCaptureEvent)))
+                {
+                    throw FraFault();
+                }
+#if defined(WORKAROUND_PS_TIMEINDISPOSED_BUG)
+                timeIndisposedMs = (int32_t)(((double)numSamples / actualSampFreqHz)*1000.0);
+#endif
+                swprintf( fraStatusText, 128, L"Status: Capturing %d samples (%d periods) at %.3lg Hz takes %0.1lf sec.", numSamples, numPeriods, actualSampFreqHz, (double)timeIndisposedMs/1000.0 );
+                UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, SAMPLE_PROCESSING_DIAGNOSTICS );
+
+                WaitForCapture();
+
+                if (!(ps->GetPeakValues( inputAbsMax[bandStart][totalRetryCounter[bandStart]], outputAbsMax[bandStart][totalRetryCounter[bandStart]], ovIn, ovOut )))
+                {
+                    throw FraFault();
+                }
+                else if (false == CheckSignalOverflows() || false == CheckSignalRanges())
+                {
+                    totalRetryCounter[bandStart]++;
+                    autorangeRetryCounter++;
+                    continue; // Try again on a different range
+                }
+
+                AnalyzeBroadbandCapture( bandStart, bandEnd );
+                totalRetryCounter[bandStart]++;
+                break;
             }
-            else
+            catch (const PicoScope::PicoPowerChange& ex)
             {
-                if (((double)outputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts) < minAllowedAmplitudeRatio)
+                UpdateStatus( fraStatusMsg, FRA_STATUS_POWER_CHANGED, ex.GetState() == PICO_POWER_SUPPLY_CONNECTED );
+                // Change the power state regardless of whether the user wants to continue FRA execution.
+                ps->ChangePower(ex.GetState());
+                ps->CancelCapture();
+                if (true == fraStatusMsg.responseData.proceed)
                 {
-                    outputChannelAutorangeStatus = LOWEST_RANGE_LIMIT_REACHED;
-                    retVal = false;
+                    // Start the band over again
+                    autorangeRetryCounter = 0;
+                    totalRetryCounter[bandStart] = 0;
+                    continue;
                 }
                 else
                 {
-                    // Do nothing
+                    throw FraFault();
                 }
             }
         }
-        else
+
+        if (autorangeRetryCounter == maxAutorangeRetries)
         {
-            // Do nothing
+            UpdateStatus( fraStatusMsg, FRA_STATUS_RETRY_LIMIT, inputChannelAutorangeStatus, outputChannelAutorangeStatus );
+            if (true == fraStatusMsg.responseData.proceed)
+            {
+                if (fraStatusMsg.responseData.retry)
+                {
+                    continue; // Start the band over again
+                }
+                else // continue to next band
+                {
+                    for (int idx = bandStart; idx < bandEnd; idx++)
+                    {
+                        gainsDb[idx] = 0.0;
+                        phasesDeg[idx] = 0.0;
+                    }
+                }
+            }
+            else
+            {
+                // Notify of cancellation
+                UpdateStatus( fraStatusMsg, FRA_STATUS_CANCELED, bandStart+1, numSteps );
+                throw FraFault();
+            }
         }
-        swprintf( fraStatusText, 128, L"Status: Measured output absolute peak: %hu counts", outputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]] );
-        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, AUTORANGE_DIAGNOSTICS );
-    }
-    else
-    {
-        retVal = false; // Still need to adjust for the overflow on this channel
-    }
 
-    return retVal;
+        // Notify progress
+        UpdateStatus( fraStatusMsg, FRA_STATUS_IN_PROGRESS, bandEnd, numSteps );
+        freqStepCounter = bandEnd + 1;
+        bandStart = bandEnd;
+    }
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //
-// Name: PicoScopeFRA::GetResults
+// Name: PicoScopeFRA::PlanBroadbandBand
 //
-// Purpose: To get the results from the the most recently executed Frequency Response Analysis
+// Purpose: Choose the steps, sampling, waveform period and tones for a broadband band
 //
-// Parameters:
-//    [out] numSteps - the number of frequency steps taken (also the size of the other arrays}
-//    [out] freqsLogHz - array of frequency points taken, expressed in log base 10 Hz
-//    [out] gainsDb - array of gains at each frequency point of freqsLogHz, expressed in dB
-//    [out] phasesDeg - array of phase shifts at each frequency point of freqsLogHz, expressed in degrees
-//    [out] unwrappedPhasesDeg - array of unwrapped phase shifts at each frequency point of freqsLogHz, 
-//          expressed in degrees
+// Parameters: [in] bandStart - index of the band's first step
+//             [in] waveformSize - arbitrary waveform size (samples)
+//             [out] timebase - the timebase for the band's capture
+//             [out] return - index one past the band's last step
 //
-// Notes: The memory returned in the pointers is only valid until the next FRA execution or
-//        destruction of the PicoScope FRA object.  If there is no valid data, numSteps
-//        is set to 0.
+// Notes: Sets actualSampFreqHz, bandPeriodSamples, bandRepeatFreqHz and bandToneCycles.  The
+//        waveform period is a power of 2 samples, for the FFT, and holds at least
+//        minBroadbandToneCycles cycles of the lowest step, so that rounding the steps to whole
+//        cycles moves them little and adjacent steps stay distinct.  A band spans at most
+//        maxBroadbandBandRatio, and its highest tone must have at least minAwgSamplesPerCycle
+//        generator samples per cycle, counting both the waveform size and the generator's DAC
+//        rate.  A band always has at least one step.
 //
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-void PicoScopeFRA::GetResults( int* numSteps, double** freqsLogHz, double** gainsDb, double** phasesDeg, double** unwrappedPhasesDeg )
+int PicoScopeFRA::PlanBroadbandBand( int bandStart, uint32_t waveformSize, uint32_t& timebase )
 {
-    if (numSteps && freqsLogHz && gainsDb && phasesDeg && unwrappedPhasesDeg )
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
+
+    double stepRatio = pow( 10.0, 1.0 / (double)mStepsPerDecade );
+    uint32_t minToneCycles = max( (uint32_t)minBroadbandToneCycles, (uint32_t)ceil( 1.0 / (stepRatio - 1.0) ) );
+    double dacFrequency = ps->GetSignalGeneratorPrecision() * (double)UINT32_MAX;
+    uint32_t maxToneCycles, toneCycles;
+    int bandEnd = bandStart + 1;
+
+    while (bandEnd < numSteps && freqsHz[bandEnd] <= freqsHz[bandStart] * maxBroadbandBandRatio)
     {
-        *numSteps = latestCompletedNumSteps;
-        *freqsLogHz = latestCompletedFreqsLogHz.data();
-        *gainsDb = latestCompletedGainsDb.data();
-        *phasesDeg = latestCompletedPhasesDeg.data();
-        *unwrappedPhasesDeg = latestCompletedUnwrappedPhasesDeg.data();
+        bandEnd++;
     }
-}
 
-////////////////////////////////////////////////////////////////////////////////////////////////////
-//
-// Name: PicoScopeFRA::TransferLatestResults
-//
-// Purpose: Transfers the latest results into storage.  Used at the completion of the FRA to
-//          facilitate not writing over the old results until we have to.
-//
-// Parameters: N/A
-//
-// Notes: 
-//
-///////////////////////////////////////////////////////////////////////////////////////////////////
+    // Sample fast enough for the highest step
+    if (!(ps->GetTimebase( freqsHz[bandEnd-1] * (double)broadbandOversampling, &actualSampFreqHz, &timebase )))
+    {
+        UpdateStatus( fraStatusMsg, FRA_STATUS_FATAL_ERROR, L"Fatal error: Failed to get a timebase for the broadband capture" );
+        throw FraFault();
+    }
 
-void PicoScopeFRA::TransferLatestResults(void)
-{
-    latestCompletedNumSteps = numSteps;
-    latestCompletedFreqsLogHz = freqsLogHz;
-    latestCompletedGainsDb = gainsDb;
-    latestCompletedPhasesDeg = phasesDeg;
-    latestCompletedUnwrappedPhasesDeg = unwrappedPhasesDeg;
+    bandPeriodSamples = Fft::NextPowerOfTwo( (uint32_t)ceil( actualSampFreqHz * (double)minToneCycles / freqsHz[bandStart] ) );
+    bandPeriodSamples = min( bandPeriodSamples, Fft::PreviousPowerOfTwo( maxScopeSamplesPerChannel ) );
+    bandRepeatFreqHz = actualSampFreqHz / (double)bandPeriodSamples;
+
+    maxToneCycles = (uint32_t)(min( (double)waveformSize, dacFrequency / bandRepeatFreqHz ) / (double)minAwgSamplesPerCycle);
+    maxToneCycles = min( maxToneCycles, bandPeriodSamples / 2 - 1 );
+
+    bandToneCycles.clear();
+    for (int idx = bandStart; idx < bandEnd; idx++)
+    {
+        toneCycles = max( (uint32_t)1, (uint32_t)floor( freqsHz[idx] / bandRepeatFreqHz + 0.5 ) );
+        if (!bandToneCycles.empty())
+        {
+            toneCycles = max( toneCycles, bandToneCycles.back() + 1 );
+        }
+        if (toneCycles > maxToneCycles && !bandToneCycles.empty())
+        {
+            break;
+        }
+        bandToneCycles.push_back( toneCycles );
+    }
+
+    if (bandToneCycles.front() > maxToneCycles)
+    {
+        swprintf( fraStatusText, 128, L"WARNING: Arbitrary waveform generator resolution too low for %0.3lf Hz", freqsHz[bandStart] );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, FRA_WARNING );
+    }
+
+    return bandStart + (int)bandToneCycles.size();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //
-// Name: PicoScopeFRA::GenerateFrequencyPoints
+// Name: PicoScopeFRA::AnalyzeBroadbandCapture
 //
-// Purpose: Given the user's selection of start frequency, stop frequency, and steps per decade,
-//          compute the frequency step points.
+// Purpose: Transfer a broadband capture from the scope and compute the gain and phase at each of
+//          the band's steps
 //
-// Parameters: N/A
+// Parameters: [in] bandStart - index of the band's first step
+//             [in] bandEnd - index one past the band's last step
 //
-// Notes: Because the scopes have output frequency precision limits, this function also 
-//        "patches up" the results to align to frequencies the scope is capable of
+// Notes: The capture holds whole periods of the stimulus, so summing them into one period loses
+//        nothing at the tones, and averages down everything else.  Both channels are transformed
+//        with one complex FFT, input as the real part and output as the imaginary part, and
+//        separated using the symmetry of real signals' spectra.  Purity is the fraction of each
+//        channel's a.c. energy at the tones.
 //
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-void PicoScopeFRA::GenerateFrequencyPoints(void)
+void PicoScopeFRA::AnalyzeBroadbandCapture( int bandStart, int bandEnd )
 {
-    double logStartFreqHz, logStopFreqHz;
-
     FRA_STATUS_MESSAGE_T fraStatusMsg;
     wchar_t fraStatusText[128];
 
-    if (HIGH_NOISE == mSamplingMode && mStartFreqHz < GetMinFrequency())
+    uint32_t chunkStartIndex, chunkNumSamples, periodMask = bandPeriodSamples - 1;
+    int16_t *pInputSamples, *pOutputSamples;
+    bool chunkInputOv, chunkOutputOv;
+    double inputToneEnergy = 0.0, outputToneEnergy = 0.0, inputEnergy = 0.0, outputEnergy = 0.0;
+    complex<double> inputX, outputX;
+
+    broadbandRecord.assign( bandPeriodSamples, complex<double>( 0.0, 0.0 ) );
+    StartDataTransfer( numSamples, 1 );
+    try
     {
-        swprintf( fraStatusText, 128, L"Fatal error: Start frequency cannot be less than %lg Hz", GetMinFrequency() );
-        UpdateStatus( fraStatusMsg, FRA_STATUS_FATAL_ERROR, fraStatusText );
-        throw FraFault();
+        do
+        {
+            if (false == ps->GetNextDataChunk( chunkStartIndex, chunkNumSamples, &pInputSamples, &pOutputSamples, chunkInputOv, chunkOutputOv ))
+            {
+                throw FraFault();
+            }
+            for (uint32_t i = 0; i < chunkNumSamples; i++)
+            {
+                broadbandRecord[(chunkStartIndex + i) & periodMask] += complex<double>( pInputSamples[i], pOutputSamples[i] );
+            }
+        } while (chunkNumSamples);
     }
+    catch (...)
+    {
+        ps->EndDataTransfer();
+        throw;
+    }
+    ps->EndDataTransfer();
 
-    logStartFreqHz = log10(mStartFreqHz);
-    logStopFreqHz = log10(mStopFreqHz);
-    double logStepSize;
-
-    // ceil to account for the fractional leftover and thus allow reaching the stop frequency
-    // +1 to account for the start frequency
-    numSteps = (int)(ceil((logStopFreqHz - logStartFreqHz)*mStepsPerDecade)) + 1;
-    logStepSize = 1.0 / mStepsPerDecade;
-
-    freqsHz.resize(numSteps);
-    freqsLogHz.resize(numSteps);
-    gainsDb.resize(numSteps);
-    phasesDeg.resize(numSteps);
-    unwrappedPhasesDeg.resize(numSteps);
+    broadbandFft.Init( bandPeriodSamples );
+    broadbandFft.Forward( broadbandRecord );
 
-    // Loop up to the second-to-last frequency point and
-    // fill in the last one as the end frequency
-    for (int i = 0; i < numSteps-1; i++)
+    for (uint32_t k = 1; k < bandPeriodSamples / 2; k++)
     {
-        freqsLogHz[i] = logStartFreqHz + i*logStepSize;
-        freqsHz[i] = pow( 10.0, freqsLogHz[i] );
+        inputX = 0.5 * (broadbandRecord[k] + conj( broadbandRecord[bandPeriodSamples-k] ));
+        outputX = complex<double>( 0.0, -0.5 ) * (broadbandRecord[k] - conj( broadbandRecord[bandPeriodSamples-k] ));
+        inputEnergy += norm( inputX );
+        outputEnergy += norm( outputX );
     }
-    freqsLogHz[numSteps-1] = logStopFreqHz;
-    freqsHz[numSteps-1] = mStopFreqHz;
 
-    // Now "patch-up" the frequencies to account for the precision
-    // limitations of the signal generator
-    for (int i = 0; i < numSteps; i++)
+    for (int idx = bandStart; idx < bandEnd; idx++)
     {
-        freqsHz[i] = ps->GetClosestSignalGeneratorFrequency( freqsHz[i] );
-        freqsLogHz[i] = log10( freqsHz[i] );
+        uint32_t k = bandToneCycles[idx-bandStart];
+        inputX = 0.5 * (broadbandRecord[k] + conj( broadbandRecord[bandPeriodSamples-k] ));
+        outputX = complex<double>( 0.0, -0.5 ) * (broadbandRecord[k] - conj( broadbandRecord[bandPeriodSamples-k] ));
+        inputToneEnergy += norm( inputX );
+        outputToneEnergy += norm( outputX );
+
+        currentInputMagnitude = abs( inputX );
+        currentInputPhase = arg( inputX );
+        currentOutputMagnitude = abs( outputX );
+        currentOutputPhase = arg( outputX );
+
+        // Currently no error is possible so just cast to void
+        (void)CalculateGainAndPhase( &gainsDb[idx], &phasesDeg[idx] );
     }
+
+    currentInputPurity = inputEnergy > 0.0 ? inputToneEnergy / inputEnergy : 0.0;
+    currentOutputPurity = outputEnergy > 0.0 ? outputToneEnergy / outputEnergy : 0.0;
+    swprintf( fraStatusText, 128, L"Status: Broadband input purity: %0.3lf; output purity: %0.3lf", currentInputPurity, currentOutputPurity );
+    UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, SAMPLE_PROCESSING_DIAGNOSTICS );
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //
-// Name: PicoScopeFRA::AllocateFraData
+// Name: PicoScopeFRA::SweepBatchAvailable
 //
-// Purpose: Allocates data that the FRA will use to store input data, intermediate results, and 
-//          diagnotic data.
+// Purpose: Determine whether the stepped sweep may measure steps in batches swept by the signal
+//          generator
 //
-// Parameters: N/A
+// Parameters: [out] return - true if batches may be used
 //
-// Notes: 
+// Notes: Batching must be enabled and supported by the scope.  A batch is captured at one range
+//        and stimulus amplitude, and each step once, so it's only used in low noise mode, without
+//        the adaptive stimulus, averaging or time domain diagnostics.  The generator sweeps up, so
+//        descending sweeps aren't batched.  Batching is given up for the rest of the sweep once a
+//        batch's first step fails to show a clean stimulus (see MeasureSweepBatch).
 //
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-void PicoScopeFRA::AllocateFraData(void)
+bool PicoScopeFRA::SweepBatchAvailable( void )
 {
-    int i;
-    int maxTotalStepTries = maxAutorangeRetries + (mAdaptiveStimulus ? maxAdaptiveStimulusRetries : 0);
+    return (mHardwareSweep && ps && ps->SignalGeneratorSweepSupported() && LOW_NOISE == mSamplingMode &&
+            STEPPED_SINE_STIMULUS == mStimulusType && !mAdaptiveStimulus && mAveragingCount <= 1 &&
+            !mDiagnosticsOn && !mSweepDescending && !sweepBatchFailed);
+}
 
-    idealStimulusVpp.resize(numSteps);
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::MeasureSweepBatch
+//
+// Purpose: Measure a batch of steps with one capture of a signal generator sweep
+//
+// Parameters: [in] batchStart - index of the batch's first step
+//             [out] return - index one past the last step measured; batchStart if none were
+//
+// Notes: Aimed at the high frequencies, where a step's capture is far shorter than the time spent
+//        setting up the generator and driving the capture over USB; steps whose capture takes more
+//        than maxSweepStepCaptureSec aren't batched.  The generator steps through the batch's
+//        frequencies, dwelling at each long enough to settle for sweepSettleCycles cycles (or the
+//        extra settling time, if longer) and then hold a full step's capture.  The sweep starts
+//        on the scope trigger, which with no channel trigger conditions is the capture's start,
+//        so each step's samples are at a known offset in the capture, and are analyzed in place,
+//        like a rapid block segment.  No channel trigger is used: the input is the stimulus, which
+//        wouldn't start until the scope triggered, so the capture would wait for the auto trigger.
+//
+//        The generator's sweep is linear, so the batch's steps are moved onto a line through its
+//        first and last; a batch has as many steps as that moves by less than a quarter step.  The
+//        results report the frequencies actually measured.  Steps are accepted in order until one
+//        is out of range or its input purity is below minSweepWindowPurity; the range checks
+//        adjust the ranges as for a stepped capture, and the steps from there on are measured
+//        singly.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
 
-    inAmps.resize(numSteps);
-    for (i = 0; i < numSteps; i++)
-    {
-        inAmps[i].resize(maxTotalStepTries);
-    }
+int PicoScopeFRA::MeasureSweepBatch( int batchStart )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
 
-    outAmps.resize(numSteps);
-    for (i = 0; i < numSteps; i++)
+    double stepRatio = pow( 10.0, 1.0 / (double)mStepsPerDecade );
+    double maxDeviation = (stepRatio - 1.0) / 4.0;
+    double precision = ps->GetSignalGeneratorPrecision();
+    double startFreqHz, incrementHz, settleSec, dwellSec;
+    double inputAmplitude, outputAmplitude;
+    uint32_t timebase, dwellSamples, maxSamples, windowStart;
+    int batchEnd, end, idx;
+    bool onLine;
+    int16_t* pInputSamples = NULL;
+    int16_t* pOutputSamples = NULL;
+    vector<bool> captureInputOv, captureOutputOv;
+
+    if ((double)mMinCyclesCaptured / freqsHz[batchStart] > maxSweepStepCaptureSec)
     {
-        outAmps[i].resize(maxTotalStepTries);
+        return batchStart;
     }
 
-    inOV.resize(numSteps);
-    for (i = 0; i < numSteps; i++)
+    // The longest batch from here whose steps all lie close enough to a line
+    batchEnd = batchStart + 1;
+    for (end = batchStart + 2; end <= min( numSteps, batchStart + (int)maxSweepBatchSteps ); end++)
     {
-        inOV[i].resize(maxTotalStepTries);
+        incrementHz = (freqsHz[end-1] - freqsHz[batchStart]) / (double)(end - 1 - batchStart);
+        onLine = true;
+        for (idx = batchStart + 1; idx < end - 1 && onLine; idx++)
+        {
+            onLine = fabs( freqsHz[batchStart] + (double)(idx - batchStart) * incrementHz - freqsHz[idx] ) <= maxDeviation * freqsHz[idx];
+        }
+        if (!onLine)
+        {
+            break;
+        }
+        batchEnd = end;
     }
 
-    outOV.resize(numSteps);
-    for (i = 0; i < numSteps; i++)
+    // Sample fast enough for the highest step
+    if (!(ps->GetTimebase( freqsHz[batchEnd-1] * (double)mLowNoiseOversampling, &actualSampFreqHz, &timebase )))
     {
-        outOV[i].resize(maxTotalStepTries);
+        throw FraFault();
     }
-
-    inRange.resize(numSteps);
-    for (i = 0; i < numSteps; i++)
+    transferDownsampleRatio = 1;
+    if (0 == mNumHarmonics && !mSpectrumDiagnostics)
     {
-        inRange[i].resize(maxTotalStepTries);
+        transferDownsampleRatio = (uint32_t)max( 1.0, min( floor( actualSampFreqHz / freqsHz[batchEnd-1] / (double)minAveragedSamplesPerCycle ),
+                                                           (double)ps->GetMaxTransferDownsampleRatio() ) );
     }
 
-    outRange.resize(numSteps);
-    for (i = 0; i < numSteps; i++)
+    // Each dwell settles, then holds a full capture of the lowest step
+    settleSec = max( (double)mExtraSettlingTimeMs / 1000.0, (double)sweepSettleCycles / freqsHz[batchStart] );
+    dwellSec = settleSec + ((double)mMinCyclesCaptured + 1.0) / freqsHz[batchStart];
+    dwellSamples = (uint32_t)ceil( dwellSec * actualSampFreqHz );
+    maxSamples = (uint32_t)min( (uint64_t)maxScopeSamplesPerChannel, (uint64_t)ps->GetMaxDataRequestSize() * transferDownsampleRatio );
+    batchEnd = batchStart + min( batchEnd - batchStart, (int)(maxSamples / dwellSamples) );
+    if (batchEnd - batchStart < 2)
     {
-        outRange[i].resize(maxTotalStepTries);
+        return batchStart;
     }
 
-    stimVpp.resize(numSteps);
-    for (i = 0; i < numSteps; i++)
+    // Frequencies the generator can step through exactly
+    startFreqHz = freqsHz[batchStart];
+    incrementHz = max( precision, floor( (freqsHz[batchEnd-1] - startFreqHz) / (double)(batchEnd - 1 - batchStart) / precision + 0.5 ) * precision );
+
+    // The sweep replaces any staged stimulus
+    stimulusStaged = false;
+
+    swprintf( fraStatusText, 128, L"Status: Sweeping steps %d to %d (%0.3lf Hz to %0.3lf Hz) in %0.3lf ms dwells", freqStepCounter, freqStepCounter + batchEnd - batchStart - 1,
+              startFreqHz, startFreqHz + (double)(batchEnd - 1 - batchStart) * incrementHz, dwellSec * 1000.0 );
+    UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, FRA_PROGRESS );
+
+    if( !(ps->SetupChannel((PS_CHANNEL)mInputChannel, (PS_COUPLING)mInputChannelCoupling, currentInputChannelRange, (float)mInputDcOffset)) ||
+        !(ps->SetupChannel((PS_CHANNEL)mOutputChannel, (PS_COUPLING)mOutputChannelCoupling, currentOutputChannelRange, (float)mOutputDcOffset)) ||
+        !(ps->SetSignalGeneratorSweep( currentStimulusVpp, currentStimulusOffset, startFreqHz, startFreqHz + (double)(batchEnd - 1 - batchStart) * incrementHz,
+                                       incrementHz, dwellSec )) ||
+        !(ps->DisableChannelTriggers()) )
     {
-        stimVpp[i].resize(maxTotalStepTries);
+        throw FraFault();
     }
 
-    inputMinData.resize(numSteps);
-    for (i = 0; i < numSteps; i++)
+    numSamples = dwellSamples * (batchEnd - batchStart);
+    captureTimebase = timebase;
+    if (!(ps->RunBlock( numSamples, timebase, &timeIndisposedMs, DataReady, &hCaptureEvent )))
+    {
+        throw FraFault();
+    }
+#if defined(WORKAROUND_PS_TIMEINDISPOSED_BUG)
+    timeIndisposedMs = (int32_t)(((double)numSamples / actualSampFreqHz)*1000.0);
+#endif
+    WaitForCapture();
+
+    if (!(ps->GetSegmentData( numSamples, 1, transferDownsampleRatio, &pInputSamples, &pOutputSamples, captureInputOv, captureOutputOv )))
+    {
+        throw FraFault();
+    }
+
+    // Analyze each step's samples in place
+    segmentCapture = true;
+    segmentInputOv = captureInputOv[0];
+    segmentOutputOv = captureOutputOv[0];
+    try
+    {
+        for (idx = batchStart; idx < batchEnd; idx++)
+        {
+            freqStepIndex = idx;
+            currentFreqHz = startFreqHz + (double)(idx - batchStart) * incrementHz;
+            currentCoherence = numeric_limits<double>::quiet_NaN();
+            totalRetryCounter[idx] = 0;
+            autorangeRetryCounter = adaptiveStimulusRetryCounter = 0;
+            autoRangeTries[idx] = adaptiveStimulusTries[idx] = 1;
+            stimVpp[idx][0] = currentStimulusVpp;
+            probeCapture = shortenedCapture = false;
+
+            windowStart = (uint32_t)((double)(idx - batchStart) * dwellSamples + settleSec * actualSampFreqHz) / transferDownsampleRatio;
+            segmentInputSamples = pInputSamples + windowStart;
+            segmentOutputSamples = pOutputSamples + windowStart;
+            numSamples = (uint32_t)(actualSampFreqHz / currentFreqHz * (double)mMinCyclesCaptured) + 1;
+
+            AnalyzeCapture( inputAmplitude, outputAmplitude, inputAbsMax[idx][0], outputAbsMax[idx][0], ovIn, ovOut );
+
+            if (false == CheckSignalOverflows() || false == CheckSignalRanges())
+            {
+                break;
+            }
+            if (currentInputPurity < minSweepWindowPurity)
+            {
+                swprintf( fraStatusText, 128, L"WARNING: Swept step %d input purity %0.3lf too low; measuring singly", freqStepCounter + idx - batchStart, currentInputPurity );
+                UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, FRA_WARNING );
+                if (idx == batchStart)
+                {
+                    // The sweep didn't line up with the capture; probably won't ever
+                    sweepBatchFailed = true;
+                }
+                break;
+            }
+
+            freqsHz[idx] = currentFreqHz;
+            freqsLogHz[idx] = log10( currentFreqHz );
+
+            // Currently no error is possible so just cast to void
+            (void)CalculateGainAndPhase( &gainsDb[idx], &phasesDeg[idx] );
+            CalculateHarmonics( idx );
+            RecordUncertainty( idx );
+            if (mPredictiveAutorange)
+            {
+                RecordStepRanges( 0 );
+            }
+
+            // Notify progress
+            UpdateStatus( fraStatusMsg, FRA_STATUS_IN_PROGRESS, freqStepCounter + idx - batchStart, numSteps );
+
+            totalRetryCounter[idx]++; // record the attempt
+        }
+    }
+    catch (...)
+    {
+        segmentCapture = false;
+        throw;
+    }
+    segmentCapture = false;
+
+    return idx;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::StreamingCaptureAvailable
+//
+// Purpose: Determine whether the stepped sweep's captures may be streamed
+//
+// Parameters: [out] return - true if captures may be streamed
+//
+// Notes: Streaming must be enabled and supported by the scope, and is only used in low noise mode.
+//        A streamed capture can only be read once as it arrives, which rules out the multiple
+//        passes of the 4 parameter sine fit, and the time domain diagnostics, which read the
+//        capture back from the scope.  The rate limit is checked per step (see StartCapture).
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool PicoScopeFRA::StreamingCaptureAvailable( void )
+{
+    return (mStreamingCapture && ps && ps->StreamingSupported() && LOW_NOISE == mSamplingMode && !mDiagnosticsOn &&
+            STEPPED_SINE_STIMULUS == mStimulusType && SINE_FIT_4_PARAMETER != mEstimator);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::RunCapture
+//
+// Purpose: Start the step's capture of numSamples samples, streamed or in block mode
+//
+// Parameters: [out] return - Whether the function was successful.
+//
+// Notes: Completion is signalled on hCaptureEvent for both, so WaitForCapture and the sweep can
+//        treat them alike; a streamed capture is "complete" as soon as it starts, its samples being
+//        delivered during analysis (see GetNextCaptureChunk).  Sets timeIndisposedMs.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool PicoScopeFRA::RunCapture( void )
+{
+    if (streamingCapture)
+    {
+        if (!(ps->RunStreaming( numSamples, actualSampFreqHz, transferDownsampleRatio, actualSampFreqHz )))
+        {
+            return false;
+        }
+        timeIndisposedMs = (int32_t)min( ((double)numSamples / actualSampFreqHz)*1000.0, (double)INT32_MAX );
+        PicoScopeFRA::SetCaptureStatus( PICO_OK );
+        SetEvent( hCaptureEvent );
+    }
+    else
+    {
+        if (!(ps->RunBlock(numSamples, captureTimebase, &timeIndisposedMs, DataReady, &hCaptureEvent)))
+        {
+            return false;
+        }
+#if defined(WORKAROUND_PS_TIMEINDISPOSED_BUG)
+        timeIndisposedMs = (int32_t)(((double)numSamples / actualSampFreqHz)*1000.0);
+#endif
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::GetNextCaptureChunk
+//
+// Purpose: Get the next chunk of the step's capture, from the pipelined transfer, the stream, or
+//          the rapid block segment being analyzed
+//
+// Parameters: See PicoScope::GetNextDataChunk
+//
+// Notes: For a streamed capture, waits for samples to arrive, checking for cancellation, which is
+//        thrown as FraFault.  A segment is already in memory, so is delivered as one chunk; clear
+//        segmentDelivered to deliver it again.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool PicoScopeFRA::GetNextCaptureChunk( uint32_t& startIndex, uint32_t& numSamples, int16_t** inputSamples, int16_t** outputSamples,
+                                        bool& inputOv, bool& outputOv )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    bool complete = false;
+
+    if (segmentCapture)
+    {
+        startIndex = 0;
+        numSamples = segmentDelivered ? 0 : PicoScopeFRA::numSamples / transferDownsampleRatio;
+        *inputSamples = segmentInputSamples;
+        *outputSamples = segmentOutputSamples;
+        inputOv = segmentInputOv;
+        outputOv = segmentOutputOv;
+        segmentDelivered = true;
+        return true;
+    }
+    else if (!streamingCapture)
+    {
+        return ps->GetNextDataChunk( startIndex, numSamples, inputSamples, outputSamples, inputOv, outputOv );
+    }
+
+    do
+    {
+        if (cancel)
+        {
+            // Notify of cancellation
+            UpdateStatus(fraStatusMsg, FRA_STATUS_CANCELED, freqStepCounter, numSteps);
+            throw FraFault();
+        }
+        if (!(ps->GetNextStreamingChunk( startIndex, numSamples, inputSamples, outputSamples, inputOv, outputOv, complete )))
+        {
+            return false;
+        }
+    } while (0 == numSamples && !complete);
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::WaitForCapture
+//
+// Purpose: Wait for a capture started with RunBlock to complete
+//
+// Parameters: N/A
+//
+// Notes: Failures, including cancellation, are thrown as FraFault; a power source change is thrown
+//        as PicoPowerChange
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::WaitForCapture( void )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    DWORD dwWaitResult;
+
+    // Adjust the delay time for a safety factor of 1.5x and never let it go less than 3 seconds
+    timeIndisposedMs = max(3000, (timeIndisposedMs * 3) / 2);
+    dwWaitResult = WaitForSingleObject(hCaptureEvent, timeIndisposedMs);
+
+    if (cancel)
+    {
+        // Notify of cancellation
+        UpdateStatus(fraStatusMsg, FRA_STATUS_CANCELED, freqStepCounter, numSteps);
+        ps->CancelCapture();
+        throw FraFault();
+    }
+
+    if (dwWaitResult != WAIT_OBJECT_0)
+    {
+        UpdateStatus(fraStatusMsg, FRA_STATUS_FATAL_ERROR, L"Fatal Error: Data capture wait timed out");
+        throw FraFault();
+    }
+    else if (PICO_POWER_SUPPLY_CONNECTED == PicoScopeFRA::captureStatus ||
+             PICO_POWER_SUPPLY_NOT_CONNECTED == PicoScopeFRA::captureStatus)
+    {
+        throw PicoScope::PicoPowerChange(PicoScopeFRA::captureStatus);
+    }
+    else if (PICO_OK != PicoScopeFRA::captureStatus)
+    {
+        wstringstream wssError;
+        wssError << L"Fatal Error: Data capture error: " << PicoScopeFRA::captureStatus;
+        UpdateStatus(fraStatusMsg, FRA_STATUS_FATAL_ERROR, wssError.str().c_str());
+        throw FraFault();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Methods associated with stimulus staging
+//
+// Notes: Once a step's capture has completed, nothing more is needed of the signal generator for
+//        it (unless it's captured again), so the sweep thread sets the generator to the next step's
+//        frequency before transferring and processing the capture, and the extra settling time
+//        runs out during processing.  The next step's capture then starts with only what's left
+//        of the settling time.  If the step is captured again instead, StartCapture returns the
+//        generator to its frequency.  The generator is set up before the transfer begins so that
+//        only one thread drives the scope at a time.
+//
+//        Only the generator is staged, not the channels.  The next step's ranges depend on this
+//        step's capture: they are what its autorange checks settle on, or with range prediction,
+//        an extrapolation that includes its peaks (see PredictStepRanges).  So they aren't known
+//        until it's processed.  The channels also can't be set up before the transfer, as changing
+//        them may discard the capture still held in the scope.  When the ranges carry over, as
+//        they usually do, StartCapture's channel setup changes nothing.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::StagingAvailable
+//
+// Purpose: Determine whether the next step's stimulus may be staged during processing
+//
+// Parameters: [out] return - true if staging may be used
+//
+// Notes: Staging must be enabled.  The next step's stimulus must be known before this step is
+//        processed, which rules out the adaptive stimulus; and averaging repeats this step's
+//        capture after processing.  A streamed capture is still in progress when processing
+//        starts (its samples arrive during processing), so its stimulus can't be changed then.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool PicoScopeFRA::StagingAvailable( void )
+{
+    return (mPipelinedSweep && !mAdaptiveStimulus && mAveragingCount <= 1 && !streamingCapture);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::StageStimulus
+//
+// Purpose: Set up the signal generator at a frequency, and start its settling time
+//
+// Parameters: [in] freqHz - the frequency
+//             [out] return - whether the signal generator was set up
+//
+// Notes: Uses the current stimulus amplitude and offset.  Call once the capture is complete, and
+//        before its data is transferred.  SettleStagedStimulus waits out any settling time left.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool PicoScopeFRA::StageStimulus( double freqHz )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
+
+    swprintf( fraStatusText, 128, L"Status: Staging signal generator frequency of %0.3lf Hz during processing", freqHz );
+    UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, SIGNAL_GENERATOR_DIAGNOSTICS );
+
+    stageTickMs = GetTickCount();
+    return ps->SetSignalGenerator( (float)currentStimulusVpp, currentStimulusOffset, (float)freqHz );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SettleStagedStimulus
+//
+// Purpose: Wait out whatever is left of the staged stimulus' extra settling time
+//
+// Parameters: N/A
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SettleStagedStimulus( void )
+{
+    DWORD elapsedMs = GetTickCount() - stageTickMs;
+
+    if (elapsedMs < (DWORD)mExtraSettlingTimeMs)
+    {
+        Sleep( (DWORD)mExtraSettlingTimeMs - elapsedMs );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::ReportSpectrumDiagnostics
+//
+// Purpose: Collect and log the spectrum diagnostic results of the sweep
+//
+// Parameters: N/A
+//
+// Notes: Waits for the background spectrum computations to finish, which they usually have by
+//        the end of the sweep
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::ReportSpectrumDiagnostics( void )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
+
+    spectrumDiagnostics.WaitForIdle();
+
+    for (int idx = 0; idx < numSteps; idx++)
+    {
+        const SpectrumDiagnostics::SPECTRUM_RESULT_T& result = spectrumDiagnostics.GetResult( idx );
+
+        if (!result.valid)
+        {
+            continue;
+        }
+
+        inputNoiseFloorsDbcPerHz[idx] = result.noiseFloorDbcPerHz[0];
+        outputNoiseFloorsDbcPerHz[idx] = result.noiseFloorDbcPerHz[1];
+        inputSpurFreqsHz[idx] = result.spurFreqHz[0];
+        inputSpursDbc[idx] = result.spurDbc[0];
+        outputSpurFreqsHz[idx] = result.spurFreqHz[1];
+        outputSpursDbc[idx] = result.spurDbc[1];
+
+        swprintf( fraStatusText, 128, L"Status: Step %d spectrum (%0.3lg Hz bins); noise floor: input %0.1lf dBc/Hz, output %0.1lf dBc/Hz",
+                  idx+1, result.binWidthHz, result.noiseFloorDbcPerHz[0], result.noiseFloorDbcPerHz[1] );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, DFT_DIAGNOSTICS );
+        swprintf( fraStatusText, 128, L"Status: Step %d strongest spur: input %0.1lf dBc at %0.4lg Hz, output %0.1lf dBc at %0.4lg Hz",
+                  idx+1, result.spurDbc[0], result.spurFreqHz[0], result.spurDbc[1], result.spurFreqHz[1] );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, DFT_DIAGNOSTICS );
+        for (int channel = 0; channel < 2; channel++)
+        {
+            swprintf( fraStatusText, 128, L"Status: Step %d %s harmonics (dBc): %0.1lf, %0.1lf, %0.1lf, %0.1lf",
+                      idx+1, channel ? L"output" : L"input", result.harmonicsDbc[channel][0], result.harmonicsDbc[channel][1],
+                      result.harmonicsDbc[channel][2], result.harmonicsDbc[channel][3] );
+            UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, DFT_DIAGNOSTICS );
+        }
+    }
+
+    if (spectrumDiagnostics.GetNumDropped())
+    {
+        swprintf( fraStatusText, 128, L"WARNING: Spectrum diagnostics skipped %u captures to keep up with the sweep", spectrumDiagnostics.GetNumDropped() );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, FRA_WARNING );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::CancelFRA
+//
+// Purpose: Cancels the FRA execution
+//
+// Parameters: [out] return - Whether the function was successful.
+//
+// Notes: 
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool PicoScopeFRA::CancelFRA()
+{
+    cancel = true;
+    SetEvent( hCaptureEvent ); // To break it out of waiting to capture data in case
+    // there are several seconds of data to capture
+    return true; // bool return reserved for possible future event based signalling that may fail
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::SetCaptureStatus
+//
+// Purpose: Communicate the status value from the capture callback
+//
+// Parameters: [in] status - the status value from the capture callback
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::SetCaptureStatus(PICO_STATUS status)
+{
+    PicoScopeFRA::captureStatus = status;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::CheckSignalOverflows
+//
+// Purpose: Makes auto-ranging decisions based on channel over-voltage info.
+//
+// Parameters: [out] return: whether to proceed with further computation, based on whether both
+//                           channels are over-voltage
+//
+// Notes: An over-voltage channel's peak is unknown, so its range is found by bisecting the ranges
+//        between the one that overflowed and the lowest seen not to (see BracketOverflowRange).
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool PicoScopeFRA::CheckSignalOverflows(void)
+{
+    bool retVal = true;
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
+
+    // Reset to default
+    inputChannelAutorangeStatus = OK;
+    outputChannelAutorangeStatus = OK;
+
+    // Make records for diagnostics
+    inOV[freqStepIndex][totalRetryCounter[freqStepIndex]] = ovIn;
+    outOV[freqStepIndex][totalRetryCounter[freqStepIndex]] = ovOut;
+    inRange[freqStepIndex][totalRetryCounter[freqStepIndex]] = currentInputChannelRange;
+    outRange[freqStepIndex][totalRetryCounter[freqStepIndex]] = currentOutputChannelRange;
+
+    if (0 == totalRetryCounter[freqStepIndex])
+    {
+        inputRangeFloor = inputMinRange;
+        inputRangeCeiling = inputMaxRange;
+        outputRangeFloor = outputMinRange;
+        outputRangeCeiling = outputMaxRange;
+    }
+    if (!ovIn)
+    {
+        inputRangeCeiling = min( inputRangeCeiling, currentInputChannelRange );
+    }
+    if (!ovOut)
+    {
+        outputRangeCeiling = min( outputRangeCeiling, currentOutputChannelRange );
+    }
+
+    if (ovIn)
+    {
+        if (currentInputChannelRange < inputMaxRange)
+        {
+            inputChannelAutorangeStatus = CHANNEL_OVERFLOW;
+            currentInputChannelRange = BracketOverflowRange( currentInputChannelRange, inputRangeFloor, inputRangeCeiling, inputMaxRange );
+        }
+        else
+        {
+            inputChannelAutorangeStatus = HIGHEST_RANGE_LIMIT_REACHED;
+        }
+        wsprintf( fraStatusText, L"Status: Measured input signal over-range" );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, AUTORANGE_DIAGNOSTICS );
+    }
+    if (ovOut)
+    {
+        if (currentOutputChannelRange < outputMaxRange)
+        {
+            outputChannelAutorangeStatus = CHANNEL_OVERFLOW;
+            currentOutputChannelRange = BracketOverflowRange( currentOutputChannelRange, outputRangeFloor, outputRangeCeiling, outputMaxRange );
+        }
+        else
+        {
+            outputChannelAutorangeStatus = HIGHEST_RANGE_LIMIT_REACHED;
+        }
+        wsprintf( fraStatusText, L"Status: Measured output signal over-range" );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, AUTORANGE_DIAGNOSTICS );
+    }
+
+    if (ovIn && ovOut) // If both are over-range, signal to skip further processing.
+    {
+        retVal = false;
+        // Initialize the diagnostic record since CheckSignalRanges will not run
+        inAmps[freqStepIndex][totalRetryCounter[freqStepIndex]] = 0.0;
+        outAmps[freqStepIndex][totalRetryCounter[freqStepIndex]] = 0.0;
+    }
+
+    // Clear overflow
+    ovIn = ovOut = false;
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::CheckSignalRanges
+//
+// Purpose: Makes auto-ranging decisions based on signal max amplitude info.
+//
+// Parameters: [out] return: whether to proceed with further computation, based on whether both
+//                           in-range
+//
+// Notes: A channel out of the amplitude window moves straight to the range the measured peak will
+//        fit (see FittingRange), rather than a range per try; but no lower than a range that has
+//        overflowed this step (see BracketOverflowRange).
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool PicoScopeFRA::CheckSignalRanges(void)
+{
+
+    bool retVal = true;
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
+
+    // After an overflow, don't return to ranges this step has seen overflow
+    PS_RANGE inputLowestRange = totalRetryCounter[freqStepIndex] > 0 ? inputRangeFloor : inputMinRange;
+    PS_RANGE outputLowestRange = totalRetryCounter[freqStepIndex] > 0 ? outputRangeFloor : outputMinRange;
+
+    // Want amplitude to be above a lower threshold to avoid excessive quantization noise.
+    // Want the signal to be below an upper threshold to avoid being close to overflow.
+
+    // Check Input
+    if (inputChannelAutorangeStatus == OK)
+    {
+        if (((double)inputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts) > maxAmplitudeRatio)
+        {
+            if (currentInputChannelRange < inputMaxRange)
+            {
+                currentInputChannelRange = FittingRange( (double)inputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts,
+                                                         currentInputChannelRange, inputLowestRange, inputMaxRange );
+                inputChannelAutorangeStatus = AMPLITUDE_TOO_HIGH;
+            }
+            else
+            {
+                inputChannelAutorangeStatus = OK; // Can't go any higher, but OK to stay here
+            }
+            retVal = false;
+        }
+        else if (((double)inputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts) <
+                 (maxAmplitudeRatio/rangeInfo[currentInputChannelRange].ratioDown - minAmplitudeRatioTolerance))
+        {
+            if (currentInputChannelRange > inputLowestRange)
+            {
+                currentInputChannelRange = FittingRange( (double)inputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts,
+                                                         currentInputChannelRange, inputLowestRange, inputMaxRange );
+                inputChannelAutorangeStatus = AMPLITUDE_TOO_LOW;
+                retVal = false;
+            }
+            else if (currentInputChannelRange > inputMinRange)
+            {
+                // The range below overflowed this step, so OK to stay here
+            }
+            else
+            {
+                if (((double)inputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts) < minAllowedAmplitudeRatio)
+                {
+                    inputChannelAutorangeStatus = LOWEST_RANGE_LIMIT_REACHED;
+                    retVal = false;
+                }
+                else
+                {
+                    // Do nothing
+                }
+            }
+        }
+        else
+        {
+            // Do nothing
+        }
+        swprintf( fraStatusText, 128, L"Status: Measured input absolute peak: %hu counts", inputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]] );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, AUTORANGE_DIAGNOSTICS );
+    }
+    else
+    {
+        retVal = false; // Still need to adjust for the overflow on this channel
+    }
+
+    // Check Output
+    if (outputChannelAutorangeStatus == OK)
+    {
+        if (((double)outputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts) > maxAmplitudeRatio)
+        {
+            if (currentOutputChannelRange < outputMaxRange)
+            {
+                currentOutputChannelRange = FittingRange( (double)outputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts,
+                                                          currentOutputChannelRange, outputLowestRange, outputMaxRange );
+                outputChannelAutorangeStatus = AMPLITUDE_TOO_HIGH;
+            }
+            else
+            {
+                outputChannelAutorangeStatus = OK; // Can't go any higher, but OK to stay here
+            }
+            retVal = false;
+        }
+        else if (((double)outputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts) <
+                 (maxAmplitudeRatio/rangeInfo[currentOutputChannelRange].ratioDown - minAmplitudeRatioTolerance))
+        {
+            if (currentOutputChannelRange > outputLowestRange)
+            {
+                currentOutputChannelRange = FittingRange( (double)outputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts,
+                                                          currentOutputChannelRange, outputLowestRange, outputMaxRange );
+                outputChannelAutorangeStatus = AMPLITUDE_TOO_LOW;
+                retVal = false;
+            }
+            else if (currentOutputChannelRange > outputMinRange)
+            {
+                // The range below overflowed this step, so OK to stay here
+            }
+            else
+            {
+                if (((double)outputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]]/rangeCounts) < minAllowedAmplitudeRatio)
+                {
+                    outputChannelAutorangeStatus = LOWEST_RANGE_LIMIT_REACHED;
+                    retVal = false;
+                }
+                else
+                {
+                    // Do nothing
+                }
+            }
+        }
+        else
+        {
+            // Do nothing
+        }
+        swprintf( fraStatusText, 128, L"Status: Measured output absolute peak: %hu counts", outputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]] );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, AUTORANGE_DIAGNOSTICS );
+    }
+    else
+    {
+        retVal = false; // Still need to adjust for the overflow on this channel
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::FittingRange
+//
+// Purpose: Finds the range a channel's measured peak will fit
+//
+// Parameters: [in] amplitudeRatio - measured peak, as a fraction of full scale on range
+//             [in] range - range the peak was measured on
+//             [in] minRange, maxRange - the channel's range limits
+//             [out] return - the range to use
+//
+// Notes: Projects the peak through the range table's scale ratios, applying the same window as
+//        the single range steps of CheckSignalRanges, so the result is where repeated steps would
+//        have settled.  Clamped to the channel's limits; the caller reports reaching them.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+PS_RANGE PicoScopeFRA::FittingRange( double amplitudeRatio, PS_RANGE range, PS_RANGE minRange, PS_RANGE maxRange )
+{
+    while (amplitudeRatio > maxAmplitudeRatio && range < maxRange)
+    {
+        amplitudeRatio *= rangeInfo[range].ratioUp;
+        range = (PS_RANGE)((int)range + 1);
+    }
+    while (range > minRange && amplitudeRatio < (maxAmplitudeRatio/rangeInfo[range].ratioDown - minAmplitudeRatioTolerance))
+    {
+        amplitudeRatio *= rangeInfo[range].ratioDown;
+        range = (PS_RANGE)((int)range - 1);
+    }
+    return range;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::BracketOverflowRange
+//
+// Purpose: Chooses the range to try after a channel overflows
+//
+// Parameters: [in] range - range that overflowed; must be below maxRange
+//             [in/out] rangeFloor - lowest range that might not overflow
+//             [in/out] rangeCeiling - lowest range seen not to overflow this step
+//             [in] maxRange - the channel's upper range limit
+//             [out] return - the range to try
+//
+// Notes: Bisects between the floor and ceiling.  If the ceiling has since overflowed too (e.g. the
+//        stimulus was raised), the bracket is reopened to maxRange.  Once a try doesn't overflow,
+//        its peak is known and FittingRange finishes the search.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+PS_RANGE PicoScopeFRA::BracketOverflowRange( PS_RANGE range, PS_RANGE& rangeFloor, PS_RANGE& rangeCeiling, PS_RANGE maxRange )
+{
+    rangeFloor = (PS_RANGE)((int)range + 1);
+    if (rangeCeiling < rangeFloor)
+    {
+        rangeCeiling = maxRange;
+    }
+    return (PS_RANGE)((int)rangeFloor + ((int)rangeCeiling - (int)rangeFloor) / 2);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::GetResults
+//
+// Purpose: To get the results from the the most recently executed Frequency Response Analysis
+//
+// Parameters:
+//    [out] numSteps - the number of frequency steps taken (also the size of the other arrays}
+//    [out] freqsLogHz - array of frequency points taken, expressed in log base 10 Hz
+//    [out] gainsDb - array of gains at each frequency point of freqsLogHz, expressed in dB
+//    [out] phasesDeg - array of phase shifts at each frequency point of freqsLogHz, expressed in degrees
+//    [out] unwrappedPhasesDeg - array of unwrapped phase shifts at each frequency point of freqsLogHz, 
+//          expressed in degrees
+//
+// Notes: The memory returned in the pointers is only valid until the next FRA execution or
+//        destruction of the PicoScope FRA object.  If there is no valid data, numSteps
+//        is set to 0.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::GetResults( int* numSteps, double** freqsLogHz, double** gainsDb, double** phasesDeg, double** unwrappedPhasesDeg )
+{
+    if (numSteps && freqsLogHz && gainsDb && phasesDeg && unwrappedPhasesDeg )
+    {
+        *numSteps = latestCompletedNumSteps;
+        *freqsLogHz = latestCompletedFreqsLogHz.data();
+        *gainsDb = latestCompletedGainsDb.data();
+        *phasesDeg = latestCompletedPhasesDeg.data();
+        *unwrappedPhasesDeg = latestCompletedUnwrappedPhasesDeg.data();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::GetHarmonicResults
+//
+// Purpose: To get the harmonic results from the the most recently executed Frequency Response Analysis
+//
+// Parameters:
+//    [out] numSteps - the number of frequency steps taken (see GetResults)
+//    [out] numHarmonics - the number of harmonics measured per step, starting with the 2nd
+//    [out] inputHarmonicsDbc - array of input channel harmonic magnitudes relative to the fundamental,
+//          expressed in dBc; numHarmonics entries per step
+//    [out] outputHarmonicsDbc - array of output channel harmonic magnitudes relative to the fundamental,
+//          expressed in dBc; numHarmonics entries per step
+//    [out] harmonicPhasesDeg - array of phase shifts (output minus input) at each harmonic, expressed in
+//          degrees; numHarmonics entries per step
+//    [out] inputThdPercent - array of input channel THD at each step, expressed in percent
+//    [out] outputThdPercent - array of output channel THD at each step, expressed in percent
+//
+// Notes: The memory returned in the pointers is only valid until the next FRA execution or
+//        destruction of the PicoScope FRA object.  If there is no valid data, numSteps is set to 0.
+//        If harmonics were not enabled, numHarmonics is set to 0.  Harmonics at or above the Nyquist
+//        frequency for a step can't be measured and are NaN; THD includes only measured harmonics.
+//        The gain at a harmonic is the step's gain plus outputHarmonicsDbc minus inputHarmonicsDbc.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::GetHarmonicResults( int* numSteps, int* numHarmonics, double** inputHarmonicsDbc, double** outputHarmonicsDbc,
+                                       double** harmonicPhasesDeg, double** inputThdPercent, double** outputThdPercent )
+{
+    if (numSteps && numHarmonics && inputHarmonicsDbc && outputHarmonicsDbc && harmonicPhasesDeg && inputThdPercent && outputThdPercent)
+    {
+        *numSteps = latestCompletedNumSteps;
+        *numHarmonics = latestCompletedNumHarmonics;
+        *inputHarmonicsDbc = latestCompletedInputHarmonicsDbc.data();
+        *outputHarmonicsDbc = latestCompletedOutputHarmonicsDbc.data();
+        *harmonicPhasesDeg = latestCompletedHarmonicPhasesDeg.data();
+        *inputThdPercent = latestCompletedInputThdPercent.data();
+        *outputThdPercent = latestCompletedOutputThdPercent.data();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::GetUncertaintyResults
+//
+// Purpose: To get the standard errors of the gain and phase from the the most recently executed
+//          Frequency Response Analysis
+//
+// Parameters:
+//    [out] numSteps - the number of frequency steps taken (see GetResults)
+//    [out] gainsStdErrDb - array of gain standard errors at each step, expressed in dB
+//    [out] phasesStdErrDeg - array of phase standard errors at each step, expressed in degrees
+//    [out] coherences - array of the coherence (0 to 1) between input and output at each step
+//
+// Notes: The memory returned in the pointers is only valid until the next FRA execution or
+//        destruction of the PicoScope FRA object.  If there is no valid data, numSteps is set to 0.
+//        Steps without an estimate (see SetSubBlocks and SetAveraging) are NaN.  Coherence needs
+//        averaging.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::GetUncertaintyResults( int* numSteps, double** gainsStdErrDb, double** phasesStdErrDeg, double** coherences )
+{
+    if (numSteps && gainsStdErrDb && phasesStdErrDeg && coherences)
+    {
+        *numSteps = latestCompletedNumSteps;
+        *gainsStdErrDb = latestCompletedGainsStdErrDb.data();
+        *phasesStdErrDeg = latestCompletedPhasesStdErrDeg.data();
+        *coherences = latestCompletedCoherences.data();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::GetMeasuredFrequencies
+//
+// Purpose: To get the stimulus frequencies measured from the captures of the the most recently
+//          executed Frequency Response Analysis
+//
+// Parameters:
+//    [out] numSteps - the number of frequency steps taken (see GetResults)
+//    [out] measuredFreqsHz - array of the stimulus frequency measured at each step, in Hz
+//
+// Notes: The memory returned in the pointers is only valid until the next FRA execution or
+//        destruction of the PicoScope FRA object.  If there is no valid data, numSteps is set to 0.
+//        Steps without a measurement (see SetFrequencyRefinement) are NaN.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::GetMeasuredFrequencies( int* numSteps, double** measuredFreqsHz )
+{
+    if (numSteps && measuredFreqsHz)
+    {
+        *numSteps = latestCompletedNumSteps;
+        *measuredFreqsHz = latestCompletedMeasuredFreqsHz.data();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::GetSpectrumResults
+//
+// Purpose: To get the spectrum diagnostic results from the the most recently executed Frequency
+//          Response Analysis
+//
+// Parameters:
+//    [out] numSteps - the number of frequency steps taken (see GetResults)
+//    [out] inputNoiseFloorsDbcPerHz - array of the input noise floor at each step, relative to the
+//                                     input fundamental, in a 1 Hz bandwidth
+//    [out] outputNoiseFloorsDbcPerHz - array of the output noise floor at each step
+//    [out] inputSpurFreqsHz - array of the frequency of the strongest input spur at each step
+//    [out] inputSpursDbc - array of the level of the strongest input spur at each step, relative
+//                          to the input fundamental
+//    [out] outputSpurFreqsHz - array of the frequency of the strongest output spur at each step
+//    [out] outputSpursDbc - array of the level of the strongest output spur at each step
+//
+// Notes: The memory returned in the pointers is only valid until the next FRA execution or
+//        destruction of the PicoScope FRA object.  If there is no valid data, numSteps is set to 0.
+//        Steps without results (see SetSpectrumDiagnostics) are NaN.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::GetSpectrumResults( int* numSteps, double** inputNoiseFloorsDbcPerHz, double** outputNoiseFloorsDbcPerHz,
+                                       double** inputSpurFreqsHz, double** inputSpursDbc, double** outputSpurFreqsHz, double** outputSpursDbc )
+{
+    if (numSteps && inputNoiseFloorsDbcPerHz && outputNoiseFloorsDbcPerHz && inputSpurFreqsHz && inputSpursDbc && outputSpurFreqsHz && outputSpursDbc)
+    {
+        *numSteps = latestCompletedNumSteps;
+        *inputNoiseFloorsDbcPerHz = latestCompletedInputNoiseFloorsDbcPerHz.data();
+        *outputNoiseFloorsDbcPerHz = latestCompletedOutputNoiseFloorsDbcPerHz.data();
+        *inputSpurFreqsHz = latestCompletedInputSpurFreqsHz.data();
+        *inputSpursDbc = latestCompletedInputSpursDbc.data();
+        *outputSpurFreqsHz = latestCompletedOutputSpurFreqsHz.data();
+        *outputSpursDbc = latestCompletedOutputSpursDbc.data();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::TransferLatestResults
+//
+// Purpose: Transfers the latest results into storage.  Used at the completion of the FRA to
+//          facilitate not writing over the old results until we have to.
+//
+// Parameters: N/A
+//
+// Notes: 
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::TransferLatestResults(void)
+{
+    latestCompletedNumSteps = numSteps;
+    latestCompletedFreqsLogHz = freqsLogHz;
+    latestCompletedGainsDb = gainsDb;
+    latestCompletedPhasesDeg = phasesDeg;
+    latestCompletedUnwrappedPhasesDeg = unwrappedPhasesDeg;
+    latestCompletedNumHarmonics = mNumHarmonics;
+    latestCompletedInputHarmonicsDbc = inputHarmonicsDbc;
+    latestCompletedOutputHarmonicsDbc = outputHarmonicsDbc;
+    latestCompletedHarmonicPhasesDeg = harmonicPhasesDeg;
+    latestCompletedInputThdPercent = inputThdPercent;
+    latestCompletedOutputThdPercent = outputThdPercent;
+    latestCompletedGainsStdErrDb = gainsStdErrDb;
+    latestCompletedPhasesStdErrDeg = phasesStdErrDeg;
+    latestCompletedCoherences = coherences;
+    latestCompletedMeasuredFreqsHz = measuredFreqsHz;
+    latestCompletedInputNoiseFloorsDbcPerHz = inputNoiseFloorsDbcPerHz;
+    latestCompletedOutputNoiseFloorsDbcPerHz = outputNoiseFloorsDbcPerHz;
+    latestCompletedInputSpurFreqsHz = inputSpurFreqsHz;
+    latestCompletedInputSpursDbc = inputSpursDbc;
+    latestCompletedOutputSpurFreqsHz = outputSpurFreqsHz;
+    latestCompletedOutputSpursDbc = outputSpursDbc;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::GenerateFrequencyPoints
+//
+// Purpose: Given the user's selection of start frequency, stop frequency, and steps per decade,
+//          compute the frequency step points.
+//
+// Parameters: N/A
+//
+// Notes: Because the scopes have output frequency precision limits, this function also 
+//        "patches up" the results to align to frequencies the scope is capable of
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::GenerateFrequencyPoints(void)
+{
+    double logStartFreqHz, logStopFreqHz;
+
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
+
+    if (HIGH_NOISE == mSamplingMode && mStartFreqHz < GetMinFrequency())
+    {
+        swprintf( fraStatusText, 128, L"Fatal error: Start frequency cannot be less than %lg Hz", GetMinFrequency() );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_FATAL_ERROR, fraStatusText );
+        throw FraFault();
+    }
+
+    logStartFreqHz = log10(mStartFreqHz);
+    logStopFreqHz = log10(mStopFreqHz);
+    double logStepSize;
+
+    // ceil to account for the fractional leftover and thus allow reaching the stop frequency
+    // +1 to account for the start frequency
+    numSteps = (int)(ceil((logStopFreqHz - logStartFreqHz)*mStepsPerDecade)) + 1;
+    logStepSize = 1.0 / mStepsPerDecade;
+
+    freqsHz.resize(numSteps);
+    freqsLogHz.resize(numSteps);
+    gainsDb.resize(numSteps);
+    phasesDeg.resize(numSteps);
+    unwrappedPhasesDeg.resize(numSteps);
+    inputHarmonicsDbc.assign(numSteps*mNumHarmonics, numeric_limits<double>::quiet_NaN());
+    outputHarmonicsDbc.assign(numSteps*mNumHarmonics, numeric_limits<double>::quiet_NaN());
+    harmonicPhasesDeg.assign(numSteps*mNumHarmonics, numeric_limits<double>::quiet_NaN());
+    inputThdPercent.assign(numSteps, 0.0);
+    outputThdPercent.assign(numSteps, 0.0);
+    gainsStdErrDb.assign(numSteps, numeric_limits<double>::quiet_NaN());
+    phasesStdErrDeg.assign(numSteps, numeric_limits<double>::quiet_NaN());
+    coherences.assign(numSteps, numeric_limits<double>::quiet_NaN());
+    measuredFreqsHz.assign(numSteps, numeric_limits<double>::quiet_NaN());
+    inputNoiseFloorsDbcPerHz.assign(numSteps, numeric_limits<double>::quiet_NaN());
+    outputNoiseFloorsDbcPerHz.assign(numSteps, numeric_limits<double>::quiet_NaN());
+    inputSpurFreqsHz.assign(numSteps, numeric_limits<double>::quiet_NaN());
+    inputSpursDbc.assign(numSteps, numeric_limits<double>::quiet_NaN());
+    outputSpurFreqsHz.assign(numSteps, numeric_limits<double>::quiet_NaN());
+    outputSpursDbc.assign(numSteps, numeric_limits<double>::quiet_NaN());
+
+    // Loop up to the second-to-last frequency point and
+    // fill in the last one as the end frequency
+    for (int i = 0; i < numSteps-1; i++)
+    {
+        freqsLogHz[i] = logStartFreqHz + i*logStepSize;
+        freqsHz[i] = pow( 10.0, freqsLogHz[i] );
+    }
+    freqsLogHz[numSteps-1] = logStopFreqHz;
+    freqsHz[numSteps-1] = mStopFreqHz;
+
+    // Now "patch-up" the frequencies to account for the precision
+    // limitations of the signal generator
+    for (int i = 0; i < numSteps; i++)
+    {
+        freqsHz[i] = ps->GetClosestSignalGeneratorFrequency( freqsHz[i] );
+        freqsLogHz[i] = log10( freqsHz[i] );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::AllocateFraData
+//
+// Purpose: Allocates data that the FRA will use to store input data, intermediate results, and 
+//          diagnotic data.
+//
+// Parameters: N/A
+//
+// Notes: 
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::AllocateFraData(void)
+{
+    int i;
+    // Plus one for a full length recapture when a shortened capture misses the confidence target
+    int maxTotalStepTries = maxAutorangeRetries + (mAdaptiveStimulus ? maxAdaptiveStimulusRetries : 0) + (ConfidenceTargetEnabled() ? 1 : 0);
+
+    idealStimulusVpp.resize(numSteps);
+
+    inAmps.resize(numSteps);
+    for (i = 0; i < numSteps; i++)
+    {
+        inAmps[i].resize(maxTotalStepTries);
+    }
+
+    outAmps.resize(numSteps);
+    for (i = 0; i < numSteps; i++)
+    {
+        outAmps[i].resize(maxTotalStepTries);
+    }
+
+    inOV.resize(numSteps);
+    for (i = 0; i < numSteps; i++)
+    {
+        inOV[i].resize(maxTotalStepTries);
+    }
+
+    outOV.resize(numSteps);
+    for (i = 0; i < numSteps; i++)
+    {
+        outOV[i].resize(maxTotalStepTries);
+    }
+
+    inRange.resize(numSteps);
+    for (i = 0; i < numSteps; i++)
+    {
+        inRange[i].resize(maxTotalStepTries);
+    }
+
+    outRange.resize(numSteps);
+    for (i = 0; i < numSteps; i++)
+    {
+        outRange[i].resize(maxTotalStepTries);
+    }
+
+    stimVpp.resize(numSteps);
+    for (i = 0; i < numSteps; i++)
+    {
+        stimVpp[i].resize(maxTotalStepTries);
+    }
+
+    inputMinData.resize(numSteps);
+    for (i = 0; i < numSteps; i++)
     {
         inputMinData[i].resize(maxTotalStepTries);
     }
@@ -1461,12 +3139,23 @@ bool PicoScopeFRA::StartCapture( double measFreqHz )
     FRA_STATUS_MESSAGE_T fraStatusMsg;
     wchar_t fraStatusText[128];
 
+    shortenedCapture = false;
+
     // Record these here as a means to keep track of the actual tries attempted
     // Because of the way the retry counters are managed, it's not possible to do it later
     autoRangeTries[freqStepIndex] = autorangeRetryCounter+1;
     adaptiveStimulusTries[freqStepIndex] = adaptiveStimulusRetryCounter+1;
 
-    if (autorangeRetryCounter == 0)
+    // After a probe, or when staged during the last step's processing, the signal generator is
+    // already set up, and the stimulus settled.  If staged for the next step instead, return it.
+    bool setupStimulus = (autorangeRetryCounter == 0 && !probeSettled && !stimulusStaged) || stimulusAhead;
+    if (stimulusStaged && !stimulusAhead)
+    {
+        SettleStagedStimulus();
+    }
+    stimulusStaged = stimulusAhead = false;
+
+    if (setupStimulus)
     {
         swprintf( fraStatusText, 128, L"Status: Setting signal generator frequency to %0.3lf Hz", measFreqHz );
         UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, SIGNAL_GENERATOR_DIAGNOSTICS );
@@ -1474,7 +3163,7 @@ bool PicoScopeFRA::StartCapture( double measFreqHz )
 
     if (mAdaptiveStimulus)
     {
-        if (0 == adaptiveStimulusRetryCounter)
+        if (0 == adaptiveStimulusRetryCounter && !probeSettled)
         {
             // Compute the initial stimulus Vpp since this is the first attempt at this frequency
             CalculateStepInitialStimulusVpp();
@@ -1484,7 +3173,7 @@ bool PicoScopeFRA::StartCapture( double measFreqHz )
         UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, ADAPTIVE_STIMULUS_DIAGNOSTICS );
     }
 
-    if (autorangeRetryCounter == 0 || (mAdaptiveStimulus && stimulusChanged))
+    if (setupStimulus || (mAdaptiveStimulus && stimulusChanged))
     {
         if (!(ps->SetSignalGenerator((float)currentStimulusVpp, mAdaptiveStimulus ? 0.0 : currentStimulusOffset, (float)measFreqHz)))
         {
@@ -1499,6 +3188,11 @@ bool PicoScopeFRA::StartCapture( double measFreqHz )
 
     stimVpp[freqStepIndex][totalRetryCounter[freqStepIndex]] = currentStimulusVpp;
 
+    if (mPredictiveAutorange && 0 == totalRetryCounter[freqStepIndex] && !probeSettled)
+    {
+        PredictStepRanges();
+    }
+
     wsprintf( fraStatusText, L"Status: Setting input channel range to %s", rangeInfo[currentInputChannelRange].name );
     UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, AUTORANGE_DIAGNOSTICS );
     if( !(ps->SetupChannel((PS_CHANNEL)mInputChannel, (PS_COUPLING)mInputChannelCoupling, currentInputChannelRange, (float)mInputDcOffset)) )
@@ -1543,9 +3237,22 @@ bool PicoScopeFRA::StartCapture( double measFreqHz )
         // the least inaccuracy in hitting the integer periods criteria
         numSamples = (uint32_t)(samplesPerCycle * (double)numCycles) + 1;
 
+        // The estimators need far fewer samples per cycle than the oversampling gives, so have the
+        // scope average them down to minAveragedSamplesPerCycle, cutting the transfer by the ratio.
+        // Harmonics and the spectrum diagnostics need the full rate.
+        transferDownsampleRatio = 1;
+        if (0 == mNumHarmonics && !mSpectrumDiagnostics)
+        {
+            transferDownsampleRatio = (uint32_t)max( 1.0, min( floor( samplesPerCycle / (double)minAveragedSamplesPerCycle ),
+                                                               (double)ps->GetMaxTransferDownsampleRatio() ) );
+        }
+
+        // Stream the capture if allowed, and the rate is well within what the USB connection can carry
+        streamingCapture = StreamingCaptureAvailable() && actualSampFreqHz <= maxStreamingSampFreqHz;
+
         // Check whether the request will exceed the scope's buffer size.  It shouldn't becuase we limited
-        // the lowest stimulus frequency.
-        if (numSamples > maxScopeSamplesPerChannel)
+        // the lowest stimulus frequency.  Streamed captures aren't held in the buffer.
+        if (!streamingCapture && numSamples > maxScopeSamplesPerChannel)
         {
             swprintf( fraStatusText, 128, L"Error: Request exceeds scope sample buffer.  Try a higher starting frequency." );
             UpdateStatus( fraStatusMsg, FRA_STATUS_FATAL_ERROR, fraStatusText );
@@ -1559,21 +3266,64 @@ bool PicoScopeFRA::StartCapture( double measFreqHz )
 
         timebase = ps->GetNoiseRejectModeTimebase();
         actualSampFreqHz = ps->GetNoiseRejectModeSampleRate();
+        transferDownsampleRatio = 1;
+        streamingCapture = false;
 
-        // Calculate minimum number of samples required to stay <= maximum bandwidth
-        minBwSamples = min((uint32_t)ceil(actualSampFreqHz / mMaxDftBw), maxScopeSamplesPerChannel);
+        // Calculate minimum number of samples required to stay <= maximum bandwidth, which is widened
+        // by the DFT window's equivalent noise bandwidth
+        minBwSamples = min((uint32_t)ceil(pDft->GetEquivalentNoiseBandwidthBins() * actualSampFreqHz / mMaxDftBw), maxScopeSamplesPerChannel);
         // Calculate number of whole stimulus cycles required to have at least minBwSamples
         numCycles = max(mMinCyclesCaptured, (uint32_t)ceil((double)minBwSamples * measFreqHz / actualSampFreqHz));
         // Calculate actal number of samples to be taken
         numSamples = min((uint32_t)(((double)numCycles * ps->GetNoiseRejectModeSampleRate()) / measFreqHz) + 1, maxScopeSamplesPerChannel);
         // Calculate actual DFT bandwidth
-        actualDftBw = actualSampFreqHz / (double)numSamples;
+        actualDftBw = pDft->GetEquivalentNoiseBandwidthBins() * actualSampFreqHz / (double)numSamples;
 
         if (actualDftBw > mMaxDftBw)
         {
             swprintf( fraStatusText, 128, L"WARNING: Actual DFT bandwidth (%.3lg Hz) greater than requested (%.3lg Hz)", actualDftBw, mMaxDftBw );
             UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, FRA_WARNING );
         }
+
+        // If the last step predicts the confidence target will be met with fewer samples, capture
+        // only that many whole cycles, but no fewer than the minimum or one per sub-block
+        if (ConfidenceTargetEnabled() && predictedCaptureSamples && !confidenceRecapture && mAveragingCount <= 1)
+        {
+            uint32_t predictedCycles = (uint32_t)min( ceil( (double)predictedCaptureSamples * measFreqHz / actualSampFreqHz ), (double)numCycles );
+            predictedCycles = max( predictedCycles, max( (uint32_t)mMinCyclesCaptured, (uint32_t)mNumSubBlocks ) );
+
+            if (predictedCycles < numCycles)
+            {
+                numCycles = predictedCycles;
+                numSamples = (uint32_t)(((double)numCycles * actualSampFreqHz) / measFreqHz) + 1;
+                shortenedCapture = true;
+
+                swprintf( fraStatusText, 128, L"Status: Capture shortened to %u cycles to meet the confidence target", numCycles );
+                UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, SAMPLE_PROCESSING_DIAGNOSTICS );
+            }
+        }
+    }
+
+    // Probe the range and stimulus with a short capture first, if the full capture is long
+    probeCapture = false;
+    if (probePending)
+    {
+        fullCaptureSec = (double)numSamples / actualSampFreqHz;
+        if (fullCaptureSec >= minProbedCaptureSec && probeCycles < numCycles)
+        {
+            probeCapture = true;
+            shortenedCapture = false;
+            numCycles = probeCycles;
+            numSamples = (uint32_t)(((double)numCycles * actualSampFreqHz) / measFreqHz) + 1;
+            probeCaptureSec = (double)numSamples / actualSampFreqHz;
+
+            swprintf( fraStatusText, 128, L"Status: Probing range and stimulus with %u cycles before the %.1lf sec capture", numCycles, fullCaptureSec );
+            UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, AUTORANGE_DIAGNOSTICS );
+        }
+        else
+        {
+            probePending = false;
+        }
     }
 
     if (mDiagnosticsOn)
@@ -1582,24 +3332,26 @@ bool PicoScopeFRA::StartCapture( double measFreqHz )
     }
 
     // Insert a progressive delay to settle out DC offsets caused by
-    // discontinuities from switching the signal generator.
-    if (delayForAcCoupling)
+    // discontinuities from switching the signal generator.  Not needed when the DFT removes them.
+    if (delayForAcCoupling && !(GOERTZEL_DFT_ESTIMATOR == mEstimator && DFT_TREND_NONE != pDft->GetTrendRemoval()))
     {
         Sleep( 200*autorangeRetryCounter );
     }
 
-    // Setup block mode
-    if (!(ps->RunBlock(numSamples, timebase, &timeIndisposedMs, DataReady, &hCaptureEvent)))
-    {
-        return false;
-    }
-
-#if defined(WORKAROUND_PS_TIMEINDISPOSED_BUG)
-    timeIndisposedMs = (int32_t)(((double)numSamples / actualSampFreqHz)*1000.0);
-#endif
+    captureTimebase = timebase;
+    if (!RunCapture())
+    {
+        return false;
+    }
 
-    swprintf( fraStatusText, 128, L"Status: Capturing %d samples (%d cycles) at %.3lg Hz takes %0.1lf sec.", numSamples, numCycles, actualSampFreqHz, (double)timeIndisposedMs/1000.0 );
+    swprintf( fraStatusText, 128, L"Status: %s %d samples (%d cycles) at %.3lg Hz takes %0.1lf sec.", streamingCapture ? L"Streaming" : L"Capturing",
+              numSamples, numCycles, actualSampFreqHz, (double)timeIndisposedMs/1000.0 );
     UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, SAMPLE_PROCESSING_DIAGNOSTICS );
+    if (transferDownsampleRatio > 1)
+    {
+        swprintf( fraStatusText, 128, L"Status: Scope averaging samples by %u for transfer", transferDownsampleRatio );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, SAMPLE_PROCESSING_DIAGNOSTICS );
+    }
 
     return true;
 }
@@ -1621,15 +3373,28 @@ bool PicoScopeFRA::ProcessData(void)
     bool retVal = true;
     FRA_STATUS_MESSAGE_T fraStatusMsg;
     wchar_t fraStatusText[128];
+    double inputAmplitude, outputAmplitude;
+
+    // Unless this step has already needed a range change, the capture is probably in range, so
+    // transfer it once and take the peaks and overflow flags from the analysis pass.  Otherwise,
+    // probe the peaks first, so as not to transfer a capture that will be thrown away; unless the
+    // probe is itself a full transfer, or the capture is streamed, and so can only be read once.
+    bool fusedTransfer = (0 == autorangeRetryCounter) || ps->GetPeakValuesTransfersData() || streamingCapture;
 
     wsprintf( fraStatusText, L"Status: Transferring and processing %d samples", numSamples );
     UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, SAMPLE_PROCESSING_DIAGNOSTICS );
 
-    if (!(ps->GetPeakValues( inputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]], outputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]], ovIn, ovOut )))
+    if (fusedTransfer)
+    {
+        AnalyzeCapture( inputAmplitude, outputAmplitude,
+                        inputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]], outputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]], ovIn, ovOut );
+    }
+    else if (!(ps->GetPeakValues( inputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]], outputAbsMax[freqStepIndex][totalRetryCounter[freqStepIndex]], ovIn, ovOut )))
     {
         throw FraFault();
     }
-    else if (false == CheckSignalOverflows())
+
+    if (false == CheckSignalOverflows())
     {
         // Both channels are over-range, don't bother with further analysis.
         retVal = false; // Signal to try again on a different range
@@ -1652,30 +3417,13 @@ bool PicoScopeFRA::ProcessData(void)
                            (CHANNEL_OVERFLOW != inputChannelAutorangeStatus ||
                             CHANNEL_OVERFLOW != outputChannelAutorangeStatus)))
     {
-        uint32_t currentSampleIndex = 0;
-        uint32_t maxDataRequestSize = ps->GetMaxDataRequestSize();
-        uint32_t numSamplesToFeed;
-        double inputAmplitude, outputAmplitude;
-        
-        InitGoertzel( numSamples, actualSampFreqHz, currentFreqHz );
-        
-        for (currentSampleIndex = 0; currentSampleIndex < numSamples; currentSampleIndex+=numSamplesToFeed)
+        if (!fusedTransfer)
         {
-            numSamplesToFeed = min(maxDataRequestSize, numSamples-currentSampleIndex);
-
-            if (false == ps->GetData( numSamplesToFeed, currentSampleIndex, &pInputBuffer, &pOutputBuffer ))
-            {
-                throw FraFault();
-            }
-            else
-            {
-                FeedGoertzel(pInputBuffer->data(), pOutputBuffer->data(), numSamplesToFeed);
-            }
+            uint16_t inputPeak, outputPeak;
+            bool inputOv, outputOv;
+            AnalyzeCapture( inputAmplitude, outputAmplitude, inputPeak, outputPeak, inputOv, outputOv );
         }
 
-        GetGoertzelResults( currentInputMagnitude, currentInputPhase, inputAmplitude, currentInputPurity, 
-                            currentOutputMagnitude, currentOutputPhase, outputAmplitude, currentOutputPurity );
-
         if (mDiagnosticsOn)
         {
             // Make records for diagnostics
@@ -1711,16 +3459,542 @@ bool PicoScopeFRA::ProcessData(void)
             }
         }
     }
-    if (mDiagnosticsOn)
+    if (mDiagnosticsOn)
+    {
+        uint32_t compressedSize = mSamplingMode == LOW_NOISE ? 0 : timeDomainDiagnosticDataLengthLimit;
+        ps->GetCompressedData( compressedSize, inputMinData[freqStepIndex][totalRetryCounter[freqStepIndex]],
+                                               outputMinData[freqStepIndex][totalRetryCounter[freqStepIndex]],
+                                               inputMaxData[freqStepIndex][totalRetryCounter[freqStepIndex]],
+                                               outputMaxData[freqStepIndex][totalRetryCounter[freqStepIndex]] );
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::StartDataTransfer
+//
+// Purpose: Start the pipelined transfer of the capture from the scope, into this object's buffers
+//
+// Parameters: [in] numSamples - number of captured samples to transfer
+//             [in] downsampleRatio - number of captured samples the scope averages into each
+//                                    sample transferred
+//
+// Notes: The buffers are 64 byte aligned, and kept from capture to capture; they only grow when a
+//        capture needs larger chunks than any before.  The scope writes into them directly, and
+//        only re-registers them with its driver when they change.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::StartDataTransfer( uint32_t numSamples, uint32_t downsampleRatio )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    uint32_t chunkSize = ps->GetTransferChunkSize( numSamples / downsampleRatio );
+
+    if (chunkSize > transferBufferSize)
+    {
+        FreeTransferBuffers();
+        for (uint8_t i = 0; i < PicoScope::numTransferBuffers; i++)
+        {
+            transferInputBuffers[i] = (int16_t*)_aligned_malloc( chunkSize * sizeof(int16_t), transferBufferAlignment );
+            transferOutputBuffers[i] = (int16_t*)_aligned_malloc( chunkSize * sizeof(int16_t), transferBufferAlignment );
+            if (NULL == transferInputBuffers[i] || NULL == transferOutputBuffers[i])
+            {
+                FreeTransferBuffers();
+                UpdateStatus( fraStatusMsg, FRA_STATUS_FATAL_ERROR, L"Fatal error: Failed to allocate data transfer buffers" );
+                throw FraFault();
+            }
+        }
+        transferBufferSize = chunkSize;
+    }
+
+    if (!(ps->SetTransferBuffers( transferInputBuffers, transferOutputBuffers, transferBufferSize )) ||
+        !(ps->StartDataTransfer( numSamples, downsampleRatio )))
+    {
+        throw FraFault();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::FreeTransferBuffers
+//
+// Purpose: Free the data transfer buffers
+//
+// Parameters: N/A
+//
+// Notes: 
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::FreeTransferBuffers( void )
+{
+    for (uint8_t i = 0; i < PicoScope::numTransferBuffers; i++)
+    {
+        _aligned_free( transferInputBuffers[i] );
+        _aligned_free( transferOutputBuffers[i] );
+        transferInputBuffers[i] = transferOutputBuffers[i] = NULL;
+    }
+    transferBufferSize = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::AnalyzeCapture
+//
+// Purpose: Transfer the captured data from the scope and run the selected estimator (and the DFT)
+//          over it
+//
+// Parameters: [out] inputAmplitude - the measured amplitude of the input signal (counts)
+//             [out] outputAmplitude - the measured amplitude of the output signal (counts)
+//             [out] inputPeak, outputPeak - absolute peaks of the samples (counts)
+//             [out] inputOv, outputOv - whether the channels are over-voltage
+//
+// Notes: Sets the current magnitudes, phases, purities and standard errors.  The peaks are
+//        tracked by the DFT kernels in the same pass as the DFT, and the overflow flags come with
+//        the data, so they stand in for GetPeakValues without another transfer or pass.  If the
+//        DFT stops early, the peaks are of the samples it used.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::AnalyzeCapture( double& inputAmplitude, double& outputAmplitude,
+                                   uint16_t& inputPeak, uint16_t& outputPeak, bool& inputOv, bool& outputOv )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
+
+    uint32_t chunkStartIndex, chunkNumSamples, numSamplesToFeed;
+    int16_t *pInputSamples, *pOutputSamples;
+
+    // The estimators see the capture after any averaging by the scope
+    uint32_t analyzedSamples = numSamples / transferDownsampleRatio;
+    double analyzedSampFreqHz = actualSampFreqHz / (double)transferDownsampleRatio;
+    double averagingGain;
+
+    bool firstPass = true;
+    bool stoppedEarly;
+    bool sineFitSelected = (SINE_FIT_3_PARAMETER == mEstimator || SINE_FIT_4_PARAMETER == mEstimator);
+    bool earlyStopAllowed;
+    bool refineFrequency = mFrequencyRefinement && GOERTZEL_DFT_ESTIMATOR == mEstimator && !probeCapture;
+    bool blockInputOv, blockOutputOv;
+
+    inputOv = outputOv = false;
+
+    // Measuring the frequency needs sub-blocks; only for this capture, if none were asked for
+    if (refineFrequency && mNumSubBlocks < minFrequencyRefinementSubBlocks)
+    {
+        pDft->SetNumSubBlocks( minFrequencyRefinementSubBlocks );
+        InitGoertzel( analyzedSamples, analyzedSampFreqHz, currentFreqHz );
+        pDft->SetNumSubBlocks( mNumSubBlocks );
+    }
+    else
+    {
+        InitGoertzel( analyzedSamples, analyzedSampFreqHz, currentFreqHz );
+    }
+    if (sineFitSelected)
+    {
+        InitSineFit( analyzedSamples, analyzedSampFreqHz, currentFreqHz );
+    }
+    else if (LOCK_IN_DEMODULATOR == mEstimator)
+    {
+        InitLockIn( analyzedSamples, analyzedSampFreqHz, currentFreqHz );
+    }
+    if (mSpectrumDiagnostics)
+    {
+        spectrumDiagnostics.BeginRecord( analyzedSamples, analyzedSampFreqHz, currentFreqHz );
+    }
+
+    // Whether the DFT may stop at a sub-block boundary once the confidence target is met
+    earlyStopAllowed = ConfidenceTargetEnabled() && GOERTZEL_DFT_ESTIMATOR == mEstimator &&
+                       DFT_WINDOW_RECTANGULAR == pDft->GetWindow() && pDft->GetNumSubBlocks() >= minSubBlocksForEarlyStop;
+
+    // The 4 parameter sine fit needs more than one pass over the samples; the scope still holds them.
+    // The scope transfers the next chunk while this one is processed (see StartDataTransfer).  A
+    // streamed capture is processed as it arrives, in one pass (see StreamingCaptureAvailable).
+    try
+    {
+        do
+        {
+            if (segmentCapture)
+            {
+                segmentDelivered = false;
+            }
+            else if (!streamingCapture)
+            {
+                StartDataTransfer( numSamples, transferDownsampleRatio );
+            }
+
+            stoppedEarly = false;
+            while (!stoppedEarly)
+            {
+                if (false == GetNextCaptureChunk( chunkStartIndex, chunkNumSamples, &pInputSamples, &pOutputSamples, blockInputOv, blockOutputOv ))
+                {
+                    throw FraFault();
+                }
+                if (0 == chunkNumSamples)
+                {
+                    break;
+                }
+                if (firstPass)
+                {
+                    inputOv = inputOv || blockInputOv;
+                    outputOv = outputOv || blockOutputOv;
+                }
+
+                // Feed the chunk in pieces ending at sub-block boundaries, where the DFT can stop early
+                for (uint32_t offset = 0; offset < chunkNumSamples; offset += numSamplesToFeed)
+                {
+                    numSamplesToFeed = chunkNumSamples - offset;
+                    if (earlyStopAllowed)
+                    {
+                        numSamplesToFeed = min(numSamplesToFeed, pDft->GetSamplesToSubBlockEnd());
+                    }
+
+                    if (firstPass)
+                    {
+                        FeedGoertzel(pInputSamples + offset, pOutputSamples + offset, numSamplesToFeed);
+                        if (LOCK_IN_DEMODULATOR == mEstimator)
+                        {
+                            FeedLockIn(pInputSamples + offset, pOutputSamples + offset, numSamplesToFeed);
+                        }
+                        if (mSpectrumDiagnostics)
+                        {
+                            spectrumDiagnostics.Feed(pInputSamples + offset, pOutputSamples + offset, numSamplesToFeed);
+                        }
+                    }
+                    if (sineFitSelected)
+                    {
+                        FeedSineFit(pInputSamples + offset, pOutputSamples + offset, numSamplesToFeed);
+                    }
+
+                    if (earlyStopAllowed && pDft->GetSubBlocksCompleted() >= minSubBlocksForEarlyStop &&
+                        chunkStartIndex + offset + numSamplesToFeed < analyzedSamples)
+                    {
+                        double gainStdErrDb, phaseStdErrDeg;
+                        pDft->GetStandardErrors( gainStdErrDb, phaseStdErrDeg );
+                        if (ConfidenceRatio( gainStdErrDb, phaseStdErrDeg ) <= 1.0 && TruncateGoertzel())
+                        {
+                            stoppedEarly = true;
+                            break;
+                        }
+                    }
+                }
+            }
+            ps->EndDataTransfer();
+            firstPass = false;
+        } while (sineFitSelected && !sineFit.IsComplete());
+
+        // No need to capture the rest of the stream
+        if (streamingCapture && stoppedEarly)
+        {
+            ps->CancelCapture();
+        }
+    }
+    catch (...)
+    {
+        if (streamingCapture)
+        {
+            ps->CancelCapture();
+        }
+        ps->EndDataTransfer();
+        throw;
+    }
+
+    // Before a re-tune starts the DFT over
+    pDft->GetPeaks( inputPeak, outputPeak );
+
+    if (refineFrequency)
+    {
+        RefineGoertzelFrequency();
+    }
+
+    // The spectrum is computed in the background; a retry's replaces this one
+    if (mSpectrumDiagnostics)
+    {
+        spectrumDiagnostics.Submit( freqStepIndex );
+    }
+
+    if (sineFitSelected)
+    {
+        GetSineFitResults( currentInputMagnitude, currentInputPhase, inputAmplitude, currentInputPurity, 
+                           currentOutputMagnitude, currentOutputPhase, outputAmplitude, currentOutputPurity );
+    }
+    else if (LOCK_IN_DEMODULATOR == mEstimator)
+    {
+        GetLockInResults( currentInputMagnitude, currentInputPhase, inputAmplitude, currentInputPurity, 
+                          currentOutputMagnitude, currentOutputPhase, outputAmplitude, currentOutputPurity );
+    }
+    else
+    {
+        GetGoertzelResults( currentInputMagnitude, currentInputPhase, inputAmplitude, currentInputPurity, 
+                            currentOutputMagnitude, currentOutputPhase, outputAmplitude, currentOutputPurity );
+    }
+
+    // The scope's averaging is a boxcar filter, which attenuates the stimulus slightly (under 1% for
+    // minAveragedSamplesPerCycle).  Gain and phase don't need correcting, the filter being the same
+    // on both channels, but the amplitudes and peaks used for ranging and the adaptive stimulus do.
+    if (transferDownsampleRatio > 1)
+    {
+        double x = M_PI * currentFreqHz / actualSampFreqHz;
+        averagingGain = fabs( sin( (double)transferDownsampleRatio * x ) / ((double)transferDownsampleRatio * sin( x )) );
+        inputAmplitude /= averagingGain;
+        outputAmplitude /= averagingGain;
+        inputPeak = (uint16_t)min( (double)inputPeak / averagingGain, (double)UINT16_MAX );
+        outputPeak = (uint16_t)min( (double)outputPeak / averagingGain, (double)UINT16_MAX );
+    }
+
+    pDft->GetStandardErrors( currentGainStdErrDb, currentPhaseStdErrDeg );
+    if (pDft->GetNumSubBlocks())
+    {
+        swprintf( fraStatusText, 128, L"Status: Gain standard error: %.3lg dB; Phase standard error: %.3lg deg (%u sub-blocks)",
+                  currentGainStdErrDb, currentPhaseStdErrDeg, (uint32_t)pDft->GetSubBlocksCompleted() );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, DFT_DIAGNOSTICS );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::RefineGoertzelFrequency
+//
+// Purpose: Measure the stimulus frequency from the capture just analyzed by the DFT and, if it's
+//          far enough from the requested frequency to matter, run the DFT again at the measured
+//          frequency
+//
+// Parameters: N/A
+//
+// Notes: The frequency is measured from the progression of the sub-block phases (see
+//        GoertzelDft::EstimateFrequencyOffset).  The second pass covers the same samples as the
+//        first (which may have stopped early), transferring them from the scope again, so it's only
+//        run when the mismatch exceeds frequencyRefinementThresholdBins DFT bins; below that the
+//        leakage is negligible.  The sub-blocks of the second pass give the standard errors.  A
+//        streamed capture can't be transferred again, so is only measured.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::RefineGoertzelFrequency( void )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
+
+    uint32_t samplesUsed = pDft->GetTotalSamples();
+    double analyzedSampFreqHz = actualSampFreqHz / (double)transferDownsampleRatio;
+    uint32_t chunkStartIndex, chunkNumSamples;
+    int16_t *pInputSamples, *pOutputSamples;
+    bool chunkInputOv, chunkOutputOv;
+    double freqRatioOffset, measuredFreqHz, offsetBins;
+
+    if (!pDft->EstimateFrequencyOffset( freqRatioOffset ))
+    {
+        return;
+    }
+
+    measuredFreqHz = currentFreqHz + freqRatioOffset * analyzedSampFreqHz;
+    offsetBins = freqRatioOffset * (double)samplesUsed;
+    measuredFreqsHz[freqStepIndex] = measuredFreqHz;
+
+    swprintf( fraStatusText, 128, L"Status: Measured stimulus frequency: %.10lg Hz; requested: %.10lg Hz (%+.3lg ppm, %+.3lg bins)",
+              measuredFreqHz, currentFreqHz, freqRatioOffset * analyzedSampFreqHz / currentFreqHz * 1.0e6, offsetBins );
+    UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, DFT_DIAGNOSTICS );
+
+    if (fabs( offsetBins ) <= frequencyRefinementThresholdBins || measuredFreqHz <= 0.0 || measuredFreqHz >= analyzedSampFreqHz / 2.0)
+    {
+        return;
+    }
+
+    // A streamed capture is gone once analyzed
+    if (streamingCapture)
+    {
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, L"Status: Capture was streamed; DFT not re-tuned", DFT_DIAGNOSTICS );
+        return;
+    }
+
+    UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, L"Status: Re-tuning DFT to the measured stimulus frequency", DFT_DIAGNOSTICS );
+
+    InitGoertzel( samplesUsed, analyzedSampFreqHz, measuredFreqHz );
+    if (segmentCapture)
+    {
+        segmentDelivered = false;
+    }
+    else
+    {
+        StartDataTransfer( samplesUsed * transferDownsampleRatio, transferDownsampleRatio );
+    }
+    try
+    {
+        do
+        {
+            if (false == GetNextCaptureChunk( chunkStartIndex, chunkNumSamples, &pInputSamples, &pOutputSamples, chunkInputOv, chunkOutputOv ))
+            {
+                throw FraFault();
+            }
+            // A segment holds all the samples, not just those the first pass used
+            chunkNumSamples = min( chunkNumSamples, samplesUsed - min( chunkStartIndex, samplesUsed ) );
+            FeedGoertzel( pInputSamples, pOutputSamples, chunkNumSamples );
+        } while (chunkNumSamples);
+    }
+    catch (...)
+    {
+        ps->EndDataTransfer();
+        throw;
+    }
+    ps->EndDataTransfer();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::AverageCaptures
+//
+// Purpose: Repeat the step's capture and average the results in the frequency domain
+//
+// Parameters: N/A
+//
+// Notes: Called once a capture has passed the range checks.  The repeats reuse its signal
+//        generator, channel and timebase setup, so need no settling or autoranging.  Captures
+//        aren't synchronised to the stimulus, so the DFT outputs can't be averaged directly;
+//        instead the cross spectrum Sxy = conj(X)*Y and auto spectra Sxx, Syy are averaged.  The
+//        transfer function is the H1 estimate Sxy/Sxx, which noise on the output doesn't bias.  The
+//        coherence |Sxy|^2/(Sxx*Syy) measures how much of the output is explained by the input, and
+//        gives the standard errors of the gain and phase for the number of captures averaged [1].
+//        A repeat that overflows is discarded.  Harmonics are from the last capture analyzed.
+//
+//        Where the scope supports it, repeats are captured in rapid block mode: one arm fills a
+//        batch of memory segments, which are transferred together and then analyzed in turn, so
+//        the per capture round trips are paid once per batch.  Streamed captures repeat singly.
+//
+//        [1] Bendat, J.S.; Piersol, A.G. (2010), "Random Data: Analysis and Measurement
+//            Procedures", 4th ed., Wiley, section 9.2
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::AverageCaptures( void )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
+
+    complex<double> inputX, outputX, crossSpectrum, H1;
+    double inputAutoSpectrum, outputAutoSpectrum, randomError;
+    double inputAmplitude, outputAmplitude;
+    uint16_t inputPeak, outputPeak;
+    bool inputOv, outputOv;
+    uint16_t numAveraged = 1;
+    uint16_t numAttempts = 1;
+    uint32_t maxSegments, numSegments, segment;
+    int16_t* pInputSegments = NULL;
+    int16_t* pOutputSegments = NULL;
+    vector<bool> inputSegmentOv, outputSegmentOv;
+    uint32_t segmentSize = numSamples / transferDownsampleRatio;
+
+    // The capture already analyzed.  Magnitudes scale the same way for every capture of the step,
+    // so can stand in for amplitudes.
+    inputX = polar( currentInputMagnitude, currentInputPhase );
+    outputX = polar( currentOutputMagnitude, currentOutputPhase );
+    crossSpectrum = conj( inputX ) * outputX;
+    inputAutoSpectrum = norm( inputX );
+    outputAutoSpectrum = norm( outputX );
+
+    maxSegments = streamingCapture ? 1 : ps->GetMaxSegments( numSamples );
+
+    bool targetMet = false;
+    while (!targetMet && numAveraged < mAveragingCount && numAttempts < 2 * mAveragingCount)
+    {
+        numSegments = min( maxSegments, (uint32_t)min( mAveragingCount - numAveraged, 2 * mAveragingCount - numAttempts ) );
+
+        if (numSegments > 1)
+        {
+            if (!(ps->RunRapidBlock( numSamples, captureTimebase, numSegments, &timeIndisposedMs, DataReady, &hCaptureEvent )))
+            {
+                throw FraFault();
+            }
+#if defined(WORKAROUND_PS_TIMEINDISPOSED_BUG)
+            timeIndisposedMs = (int32_t)min( ((double)numSamples * numSegments / actualSampFreqHz)*1000.0, (double)INT32_MAX );
+#endif
+            WaitForCapture();
+
+            if (!(ps->GetSegmentData( numSamples, numSegments, transferDownsampleRatio, &pInputSegments, &pOutputSegments,
+                                      inputSegmentOv, outputSegmentOv )))
+            {
+                throw FraFault();
+            }
+            segmentCapture = true;
+        }
+        else
+        {
+            numSegments = 1;
+            if (!RunCapture())
+            {
+                throw FraFault();
+            }
+            WaitForCapture();
+        }
+
+        try
+        {
+            for (segment = 0; segment < numSegments; segment++)
+            {
+                numAttempts++;
+
+                if (segmentCapture)
+                {
+                    segmentInputSamples = pInputSegments + segment * segmentSize;
+                    segmentOutputSamples = pOutputSegments + segment * segmentSize;
+                    segmentInputOv = inputSegmentOv[segment];
+                    segmentOutputOv = outputSegmentOv[segment];
+                }
+
+                // Repeats are rarely out of range, so transfer and analyze in one pass, and check after
+                AnalyzeCapture( inputAmplitude, outputAmplitude, inputPeak, outputPeak, inputOv, outputOv );
+                if (inputOv || outputOv)
+                {
+                    UpdateStatus(fraStatusMsg, FRA_STATUS_MESSAGE, L"WARNING: Averaging capture overflowed; discarding it", FRA_WARNING);
+                    continue;
+                }
+
+                inputX = polar( currentInputMagnitude, currentInputPhase );
+                outputX = polar( currentOutputMagnitude, currentOutputPhase );
+                crossSpectrum += conj( inputX ) * outputX;
+                inputAutoSpectrum += norm( inputX );
+                outputAutoSpectrum += norm( outputX );
+                numAveraged++;
+
+                // Stop once the confidence target is met
+                if (ConfidenceTargetEnabled() && numAveraged >= minSubBlocksForEarlyStop)
+                {
+                    currentCoherence = norm( crossSpectrum ) / (inputAutoSpectrum * outputAutoSpectrum);
+                    randomError = sqrt( max( 0.0, 1.0 - currentCoherence ) / (2.0 * numAveraged * currentCoherence) );
+                    if (ConfidenceRatio( (20.0 / log( 10.0 )) * randomError, randomError * 180.0 / M_PI ) <= 1.0)
+                    {
+                        targetMet = true;
+                        break;
+                    }
+                }
+            }
+        }
+        catch (...)
+        {
+            segmentCapture = false;
+            throw;
+        }
+        segmentCapture = false;
+    }
+
+    // Results; the magnitudes only need to be in the right ratio
+    H1 = crossSpectrum / inputAutoSpectrum;
+    currentCoherence = norm( crossSpectrum ) / (inputAutoSpectrum * outputAutoSpectrum);
+    currentInputMagnitude = sqrt( inputAutoSpectrum / numAveraged );
+    currentInputPhase = 0.0;
+    currentOutputMagnitude = abs( H1 ) * currentInputMagnitude;
+    currentOutputPhase = arg( H1 );
+
+    if (numAveraged >= 2)
     {
-        uint32_t compressedSize = mSamplingMode == LOW_NOISE ? 0 : timeDomainDiagnosticDataLengthLimit;
-        ps->GetCompressedData( compressedSize, inputMinData[freqStepIndex][totalRetryCounter[freqStepIndex]],
-                                               outputMinData[freqStepIndex][totalRetryCounter[freqStepIndex]],
-                                               inputMaxData[freqStepIndex][totalRetryCounter[freqStepIndex]],
-                                               outputMaxData[freqStepIndex][totalRetryCounter[freqStepIndex]] );
+        randomError = sqrt( max( 0.0, 1.0 - currentCoherence ) / (2.0 * numAveraged * currentCoherence) );
+        currentGainStdErrDb = (20.0 / log( 10.0 )) * randomError;
+        currentPhaseStdErrDeg = randomError * 180.0 / M_PI;
     }
 
-    return retVal;
+    swprintf( fraStatusText, 128, L"Status: Averaged %u captures; coherence: %.6lg", (uint32_t)numAveraged, currentCoherence );
+    UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, SAMPLE_PROCESSING_DIAGNOSTICS );
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1897,6 +4171,267 @@ bool PicoScopeFRA::CalculateGainAndPhase( double* gain, double* phase)
     return true;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::CalculateHarmonics
+//
+// Purpose: Record the harmonic levels, phases and THD for a step from the latest DFT results
+//
+// Parameters: [in] stepIndex - the frequency step to record
+//
+// Notes: Levels are relative to each channel's own fundamental, so don't depend on channel range.
+//        Phases are wrapped to (-180, 180].
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::CalculateHarmonics( int stepIndex )
+{
+    double inputMagnitude, inputPhase, inputAmplitude, outputMagnitude, outputPhase, outputAmplitude;
+    uint8_t numMeasured = pDft->GetNumHarmonicsMeasured();
+
+    for (uint8_t i = 0; i < numMeasured; i++)
+    {
+        int idx = stepIndex*mNumHarmonics + i;
+
+        pDft->GetHarmonicResults( i, inputMagnitude, inputPhase, inputAmplitude, outputMagnitude, outputPhase, outputAmplitude );
+
+        inputHarmonicsDbc[idx] = 20.0 * log10( inputMagnitude / currentInputMagnitude );
+        outputHarmonicsDbc[idx] = 20.0 * log10( outputMagnitude / currentOutputMagnitude );
+        harmonicPhasesDeg[idx] = remainder( outputPhase - inputPhase, 2.0*M_PI ) * 180.0 / M_PI;
+    }
+
+    pDft->GetThd( inputThdPercent[stepIndex], outputThdPercent[stepIndex] );
+    inputThdPercent[stepIndex] *= 100.0;
+    outputThdPercent[stepIndex] *= 100.0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::ConfidenceTargetEnabled
+//
+// Purpose: Determine whether any standard error target is set
+//
+// Parameters: [out] return - true if a target is set
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool PicoScopeFRA::ConfidenceTargetEnabled( void )
+{
+    return (mTargetGainStdErrDb > 0.0 || mTargetPhaseStdErrDeg > 0.0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::ConfidenceRatio
+//
+// Purpose: Compare standard errors to the targets
+//
+// Parameters: [in] gainStdErrDb, phaseStdErrDeg - the standard errors
+//             [out] return - the largest ratio of standard error to target over the targets set;
+//                            at most 1.0 when all are met.  Infinite if a needed estimate is NaN.
+//
+// Notes: Since standard error falls as the square root of the samples, the square of the ratio is
+//        the factor by which the samples must change to just meet the targets.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+double PicoScopeFRA::ConfidenceRatio( double gainStdErrDb, double phaseStdErrDeg )
+{
+    double ratio = 0.0;
+
+    if (mTargetGainStdErrDb > 0.0)
+    {
+        ratio = _isnan( gainStdErrDb ) ? numeric_limits<double>::infinity() : max( ratio, gainStdErrDb / mTargetGainStdErrDb );
+    }
+    if (mTargetPhaseStdErrDeg > 0.0)
+    {
+        ratio = _isnan( phaseStdErrDeg ) ? numeric_limits<double>::infinity() : max( ratio, phaseStdErrDeg / mTargetPhaseStdErrDeg );
+    }
+
+    return ratio;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::RecordUncertainty
+//
+// Purpose: Record the standard errors for a step, and predict the samples the next step needs to
+//          meet the confidence target
+//
+// Parameters: [in] stepIndex - index of the step
+//
+// Notes: The prediction assumes the signal to noise ratio changes little between adjacent steps,
+//        and adds a margin of 2x, so that shortened captures rarely need to be repeated.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::RecordUncertainty( int stepIndex )
+{
+    double ratio;
+
+    gainsStdErrDb[stepIndex] = currentGainStdErrDb;
+    phasesStdErrDeg[stepIndex] = currentPhaseStdErrDeg;
+    coherences[stepIndex] = currentCoherence;
+
+    predictedCaptureSamples = 0;
+    if (ConfidenceTargetEnabled())
+    {
+        ratio = ConfidenceRatio( currentGainStdErrDb, currentPhaseStdErrDeg );
+        if (ratio < numeric_limits<double>::infinity())
+        {
+            predictedCaptureSamples = (uint32_t)max( 1.0, min( ceil( 2.0 * ratio * ratio * pDft->GetTotalSamples() * transferDownsampleRatio ), (double)UINT32_MAX ) );
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::PredictStepRanges
+//
+// Purpose: Choose the step's starting ranges from the response measured at the previous steps
+//
+// Parameters: N/A
+//
+// Notes: Called before the step's first capture.  Each channel's peak, per volt of stimulus, is
+//        fitted on a log-log scale to a line through the last rangePredictionPoints steps (see
+//        RecordStepRanges), and extrapolated to this step's frequency; so a resonance or roll-off
+//        is anticipated, rather than followed a range per capture.  The starting range is the
+//        smallest holding the predicted peak within rangePredictionMargin of the autorange limit.
+//        Needs at least two steps; until then the ranges carry over from the last step as before.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::PredictStepRanges( void )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
+
+    size_t n = rangeHistoryLogFreqs.size();
+    double meanX = 0.0, meanIn = 0.0, meanOut = 0.0, sxx = 0.0, sxIn = 0.0, sxOut = 0.0;
+    double dx, logFreq, inputPeakVolts, outputPeakVolts;
+
+    rangesPredicted = false;
+    unpredictedInputRange = currentInputChannelRange;
+    unpredictedOutputRange = currentOutputChannelRange;
+
+    if (n < 2)
+    {
+        return;
+    }
+
+    // Least squares line through the history
+    for (size_t i = 0; i < n; i++)
+    {
+        meanX += rangeHistoryLogFreqs[i];
+        meanIn += rangeHistoryLogInputs[i];
+        meanOut += rangeHistoryLogOutputs[i];
+    }
+    meanX /= (double)n;
+    meanIn /= (double)n;
+    meanOut /= (double)n;
+    for (size_t i = 0; i < n; i++)
+    {
+        dx = rangeHistoryLogFreqs[i] - meanX;
+        sxx += dx * dx;
+        sxIn += dx * (rangeHistoryLogInputs[i] - meanIn);
+        sxOut += dx * (rangeHistoryLogOutputs[i] - meanOut);
+    }
+    if (sxx <= 0.0)
+    {
+        return;
+    }
+
+    logFreq = log10( currentFreqHz );
+    inputPeakVolts = currentStimulusVpp * pow( 10.0, meanIn + (sxIn / sxx) * (logFreq - meanX) );
+    outputPeakVolts = currentStimulusVpp * pow( 10.0, meanOut + (sxOut / sxx) * (logFreq - meanX) );
+
+    for (predictedInputRange = inputMinRange; predictedInputRange < inputMaxRange; predictedInputRange = (PS_RANGE)((int)predictedInputRange + 1))
+    {
+        if (inputPeakVolts <= rangeInfo[predictedInputRange].rangeVolts * attenInfo[mInputChannelAttenuation] * maxAmplitudeRatio * rangePredictionMargin)
+        {
+            break;
+        }
+    }
+    for (predictedOutputRange = outputMinRange; predictedOutputRange < outputMaxRange; predictedOutputRange = (PS_RANGE)((int)predictedOutputRange + 1))
+    {
+        if (outputPeakVolts <= rangeInfo[predictedOutputRange].rangeVolts * attenInfo[mOutputChannelAttenuation] * maxAmplitudeRatio * rangePredictionMargin)
+        {
+            break;
+        }
+    }
+
+    rangesPredicted = true;
+    currentInputChannelRange = predictedInputRange;
+    currentOutputChannelRange = predictedOutputRange;
+
+    swprintf( fraStatusText, 128, L"Status: Predicted input peak %.3lg V, output peak %.3lg V", inputPeakVolts, outputPeakVolts );
+    UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, AUTORANGE_DIAGNOSTICS );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::RecordStepRanges
+//
+// Purpose: Add the step's measured peaks to the range prediction history, and score the step's
+//          prediction
+//
+// Parameters: [in] attempt - index of the step's accepted attempt
+//
+// Notes: Called when the step's capture is accepted, so the current ranges are the ones it
+//        settled on.  Also called for each step accepted from a sweep batch, so the history
+//        follows the batch rather than going stale across it.  The tries saved are estimated
+//        as one for each start that missed the settled ranges: CheckSignalRanges jumps straight
+//        to the fitting range, so a miss usually costs a single retry (more if a channel overflows).
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::RecordStepRanges( int attempt )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
+
+    double stimulusVpp = stimVpp[freqStepIndex][attempt];
+    double inputPeakVolts = ((double)inputAbsMax[freqStepIndex][attempt] / rangeCounts) *
+                            rangeInfo[currentInputChannelRange].rangeVolts * attenInfo[mInputChannelAttenuation];
+    double outputPeakVolts = ((double)outputAbsMax[freqStepIndex][attempt] / rangeCounts) *
+                             rangeInfo[currentOutputChannelRange].rangeVolts * attenInfo[mOutputChannelAttenuation];
+
+    if (rangesPredicted)
+    {
+        numRangePredictions++;
+        numInputRangeHits += (predictedInputRange == currentInputChannelRange) ? 1 : 0;
+        numOutputRangeHits += (predictedOutputRange == currentOutputChannelRange) ? 1 : 0;
+        rangePredictionTriesSaved += ((currentInputChannelRange != unpredictedInputRange ||
+                                       currentOutputChannelRange != unpredictedOutputRange) ? 1 : 0) -
+                                     ((currentInputChannelRange != predictedInputRange ||
+                                       currentOutputChannelRange != predictedOutputRange) ? 1 : 0);
+
+        wsprintf( fraStatusText, L"Status: Predicted input range %s, settled on %s; predicted output range %s, settled on %s",
+                  rangeInfo[predictedInputRange].name, rangeInfo[currentInputChannelRange].name,
+                  rangeInfo[predictedOutputRange].name, rangeInfo[currentOutputChannelRange].name );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, AUTORANGE_DIAGNOSTICS );
+        rangesPredicted = false;
+    }
+
+    // A silent channel says nothing about the trend
+    if (0.0 == inputPeakVolts || 0.0 == outputPeakVolts || 0.0 == stimulusVpp)
+    {
+        return;
+    }
+
+    if (rangeHistoryLogFreqs.size() == rangePredictionPoints)
+    {
+        rangeHistoryLogFreqs.erase( rangeHistoryLogFreqs.begin() );
+        rangeHistoryLogInputs.erase( rangeHistoryLogInputs.begin() );
+        rangeHistoryLogOutputs.erase( rangeHistoryLogOutputs.begin() );
+    }
+    rangeHistoryLogFreqs.push_back( log10( currentFreqHz ) );
+    rangeHistoryLogInputs.push_back( log10( inputPeakVolts / stimulusVpp ) );
+    rangeHistoryLogOutputs.push_back( log10( outputPeakVolts / stimulusVpp ) );
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //
 // Name: PicoScopeFRA::UnwrapPhases
@@ -1934,321 +4469,227 @@ void PicoScopeFRA::UnwrapPhases(void)
     }
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////
 //
 // Name: PicoScopeFRA::XXXXGoertzel
 //
-// Purpose: The Goertzel algorithm is a fast method of computing a single point DFT.  Both magnitude and phase
-// are returned.  The advantage of performing the Goertzel algorithm vs an FFT is that for our application we're only
-// interested in a single frequency per measurement, and thus Goertzel is faster than FFT.  Also, an FFT requires the
-// full sample buffer to be stored.  Without an additional decimation, storing the whole sample buffer would be highly
-// impractical for some PicoScopes (up to 4GB of RAM needed).  This implementation is a generalized Goertzel algorithm
-// which allows for a non-integer bin (k ∈ R) [1], and thus is really a single point DTFT.  An important advantage of
-// the generalized Goertzel is that we don't have to adjust the number of samples or sampling rate to maintain accuracy
-// of the frequency selection.  These functions also compute other useful parameters such as amplitude and purity, which
-// can be used for data quality decisions.
-//
-// Parameters: 
-//    InitGoertzel
-//             [in] totalSamples - Total number of samples in the full signal
-//             [in] fSamp - frequency of the sampling
-//             [in] fDetect - frequency to detect
-//    FeedGoertzel
-//             [in] inputSamples - input channel data sample points
-//             [in] outputSamples - output channel data sample points
-//             [in] n - number of samples in this block of samples
-//    GetGoertzelResults
-//             [output] [in/out]putMagnitude - The Goertzel magnitude
-//             [output] [in/out]putPhase - The Goertzel phase
-//             [output] [in/out]putAmplitude - The measured amplitude of the signal
-//             [output] [in/out]putPurity - The purity of the signal (signal power over total power)
+// Purpose: Wrappers around the DFT engine (see GoertzelDft.cpp) which add status diagnostics
+//
+// Parameters: See GoertzelDft::Init, GoertzelDft::Feed, GoertzelDft::GetResults
 //
 // Notes:
 //
-// - The standard recurrence used by the original Goertzel is known to have numerical accuracy
-//   issues [2] - i.e. O(N^2) error growth for theta near 0 or PI.  This can start to be a real problem for
-//   scopes with very large sample buffers (e.g. currently up to 1GS on the 6000 series).  The Reinsch
-//   modifications are a well known technique to deal with error at these extremes [2][3].  As theta approaches
-//   PI/2, the Reinsch recurrence numerical accuracy becomes worse than Goertzel [4].  To achieve the least
-//   error, the technique of Oliver [4] will be used to divide the domain into three regions, applying the
-//   best recurrence to each:
-//  (0.0 - 0.305*PI): REINSCH_0; (0.305*PI - 0.705*PI): GOERTZEL; (0.705*PI - PI): REINSCH_PI
-//
-// - The d.c. energy calculation can be seen as an execution of the Goertzel with Magic Circle Oscillator.
-//   When the tuning frequency is 0Hz, the tuning parameter is 0.  Thus the energy calculation is simplified.
-//    - The idea to use alternate oscillators comes from the work of Clay Turner on Oscillator theory and
-//      application to the Goertzel:
-//      Ref. http://www.claysturner.com/dsp/digital_resonators.pdf
-//      Ref. http://www.claysturner.com/dsp/ResonatorTable.pdf
-//
-// - In experimenting with different oscillators, it was found that the (k ∈ R) phase correction factor can
-//   differ from e^j*2pi*k, but it still remains dependent only on k.  However, since this application is only
-//   interested in phase shift between input and output signals, and these have the same frequency (k), we need
-//   not apply the (k ∈ R) phase correction factor.  So, this implementation does not produce a "mathematically
-//   correct" phase, but that's OK for our application.
-//
-// - The benefit of processing the input and output signals together is that we can take advantage of SIMD
-//   parallelism (SSE, AVX, etc);  However, since the MSVC auto-vectorizer seems unable to vectorize the core
-//   loop, we're going to code it with intrinsics.
-//
-//   [1] Goertzel algorithm generalized to non-integer multiples of fundamental frequency
-//       Petr Sysel and Pavel Rajmic
-//       EURASIP Journal on Advances in Signal Processing 2012 2012:56.
-//       doi:10.1186/1687-6180-2012-56
-//
-//   [2] An error analysis of Goertzel's (Watt's) method for computing Fourier coefficients
-//       W.M. Gentleman
-//       Comput. J., Vol. 12, 1969, pp. 160-165.
-//       doi:10.1093/comjnl/12.2.160
-//
-//   [3] Stoer, J.; Bulirsch, R. (2002), "Introduction to Numerical Analysis", Springer
-//
-//   [4] On the sensitivity to rounding errors of Chebyshev series approximations
-//       J. Oliver
-//       Journal of Computational and Applied Mathematics
-//       Volume 3, Issue 2, June 1977, Pages 89-98
-//
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-// Goertzel coefficient and state data
-// Making these non class members to help simplify alignment
-typedef enum
-{
-    REINSCH_0,
-    GOERTZEL,
-    REINSCH_PI
-} DftRecurrence_T;
-
-const double recurrenceThreshold1 = 0.305 * M_PI; // Oliver 77
-const double recurrenceThreshold2 = 0.705 * M_PI; // Oliver 77
-DftRecurrence_T dftRecurrence = REINSCH_0;
-double theta;
-alignas(16) static double Kappa;
-alignas(16) static double a[2], b[2], τ[2];
-alignas(16) static double totalEnergy[2];
-alignas(16) static double dcEnergy[2];
-static uint32_t samplesProcessed;
-static uint32_t N;
-// Goertzel outputs
-static array<double,2> magnitude, phase, amplitude, purity;
+///////////////////////////////////////////////////////////////////////////////////////////////////
 
 void PicoScopeFRA::InitGoertzel( uint32_t totalSamples, double fSamp, double fDetect )
 {
-    double halfTheta;
-    τ[0] = τ[1] = a[0] = a[1] = b[0] = b[1] = 0.0;
-    totalEnergy[0] = totalEnergy[1] = 0.0;
-    dcEnergy[0] = dcEnergy[1] = 0.0;
-    samplesProcessed = 0;
     FRA_STATUS_MESSAGE_T fraStatusMsg;
     wchar_t fraStatusText[128];
+    const wchar_t* recurrenceName;
 
-    N = totalSamples;
+    pDft->Init( totalSamples, fSamp, fDetect );
 
-    theta = 2.0 * M_PI * (fDetect / fSamp);
-
-    if (theta < recurrenceThreshold1)
-    {
-        dftRecurrence = REINSCH_0;
-        halfTheta = M_PI * (fDetect / fSamp);
-        Kappa = -4.0 * pow( sin( halfTheta ), 2.0 );
-        swprintf( fraStatusText, 128, L"Status: Computing DFT using Reinsch(0); actual BW: %.3lg Hz", fSamp / N );
-    }
-    else if (theta < recurrenceThreshold2)
-    {
-        dftRecurrence = GOERTZEL;
-        Kappa = 2.0 * cos( theta );
-        swprintf( fraStatusText, 128, L"Status: Computing DFT using Goertzel; actual BW: %.3lg Hz", fSamp / N );
-    }
-    else
+    switch (pDft->GetRecurrence())
     {
-        dftRecurrence = REINSCH_PI;
-        halfTheta = M_PI * (fDetect / fSamp);
-        Kappa = 4.0 * pow( cos( halfTheta ), 2.0 );
-        swprintf( fraStatusText, 128, L"Status: Computing DFT using Reinsch(PI); actual BW: %.3lg Hz", fSamp / N );
+        case REINSCH_0:
+            recurrenceName = L"Reinsch(0)";
+            break;
+        case GOERTZEL:
+            recurrenceName = L"Goertzel";
+            break;
+        default:
+            recurrenceName = L"Reinsch(PI)";
+            break;
     }
 
+    swprintf( fraStatusText, 128, L"Status: Computing DFT using %s (%s, %s window); actual BW: %.3lg Hz", recurrenceName, GetSimdLevelName( GetSimdLevel() ),
+              GoertzelDft::GetWindowName( pDft->GetWindow() ), pDft->GetEquivalentNoiseBandwidthBins() * fSamp / totalSamples );
     UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, DFT_DIAGNOSTICS );
 }
 
 void PicoScopeFRA::FeedGoertzel( int16_t* inputSamples, int16_t* outputSamples, uint32_t n )
 {
-    bool lastBlock = false;
+    if (pDft->Feed( inputSamples, outputSamples, n ))
+    {
+        ReportGoertzelResults();
+    }
+}
+
+bool PicoScopeFRA::TruncateGoertzel( void )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
+
+    if (pDft->Truncate())
+    {
+        swprintf( fraStatusText, 128, L"Status: Confidence target met; DFT stopped after %u of %u samples",
+                  pDft->GetTotalSamples(), numSamples / transferDownsampleRatio );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, SAMPLE_PROCESSING_DIAGNOSTICS );
+        ReportGoertzelResults();
+        return true;
+    }
 
-    // Vectors
-    __m128d KappaVec, τVec, aVec, bVec, totalEnergyVec, dcEnergyVec, sampleVec;
+    return false;
+}
 
+void PicoScopeFRA::ReportGoertzelResults( void )
+{
     FRA_STATUS_MESSAGE_T fraStatusMsg;
     wchar_t fraStatusText[1024];
+    array<double,2> magnitude, phase, amplitude, purity, dcEnergy, signalEnergy, totalEnergy;
+    array<double,2> trendChange, trendTimeConstant;
+    double kernelSeconds;
+    uint32_t N = pDft->GetTotalSamples();
+
+    pDft->GetResults( magnitude[0], phase[0], amplitude[0], purity[0], magnitude[1], phase[1], amplitude[1], purity[1] );
+    pDft->GetEnergies( dcEnergy[0], signalEnergy[0], totalEnergy[0], dcEnergy[1], signalEnergy[1], totalEnergy[1] );
 
-    // Determine if this is the last block.  If it is, there is special processing.
-    lastBlock = ((samplesProcessed + n) == N);
+    // Output diagnostics
+    swprintf( fraStatusText, 1024, L"Status: DFT results:\r\n"
+                                   L"   Input magnitude: %lg; Input amplitude: %lg; Input phase: %lg; Input purity: %lg; Input DC energy: %lg; Input signal energy: %lg, Input total energy: %lg\r\n"
+                                   L"   Output magnitude: %lg; Output amplitude: %lg; Output phase: %lg; Output purity: %lg; Output DC energy: %lg; Output signal energy: %lg, Output total energy: %lg",
+                                   magnitude[0], amplitude[0], phase[0], purity[0], dcEnergy[0], signalEnergy[0], totalEnergy[0],
+                                   magnitude[1], amplitude[1], phase[1], purity[1], dcEnergy[1], signalEnergy[1], totalEnergy[1] );
 
-    // Load vectors
-    KappaVec = _mm_load1_pd(&Kappa);
-    τVec = _mm_load_pd(τ);
-    aVec = _mm_load_pd(a);
-    bVec = _mm_load_pd(b);
-    totalEnergyVec = _mm_load_pd(totalEnergy);
-    dcEnergyVec = _mm_load_pd(dcEnergy);
+    UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, DFT_DIAGNOSTICS );
 
-    // Execute the filter, d.c. Energy and Parseval energy time domain calculation
-    if (REINSCH_0 == dftRecurrence)
+    if (pDft->GetTrend( trendChange[0], trendChange[1], trendTimeConstant[0], trendTimeConstant[1] ))
     {
-        for (uint32_t i = 0; i < n; i++)
+        if (DFT_TREND_LINEAR == pDft->GetTrendRemoval())
         {
-            // Load and convert samples to packed doubles
-            sampleVec = _mm_cvtepi32_pd( _mm_set_epi32( 0, 0, outputSamples[i], inputSamples[i] ) );
-
-            //totalEnergy += samples[i]*samples[i];
-            totalEnergyVec = _mm_add_pd( totalEnergyVec, _mm_mul_pd( sampleVec, sampleVec ) );
-
-            //dcEnergy += samples[i];
-            dcEnergyVec = _mm_add_pd( dcEnergyVec, sampleVec );
-
-            //b = b + K*a + samples[i]
-            //a = a + b
-            bVec = _mm_add_pd( _mm_add_pd(bVec, _mm_mul_pd(KappaVec, aVec)), sampleVec);
-            aVec = _mm_add_pd(aVec, bVec);
+            swprintf( fraStatusText, 1024, L"Status: DFT removed linear drift; Input change: %lg; Output change: %lg",
+                      trendChange[0], trendChange[1] );
         }
-    }
-    else if (GOERTZEL == dftRecurrence)
-    {
-        for (uint32_t i = 0; i < n; i++)
+        else
         {
-            // Load and convert samples to packed doubles
-            sampleVec = _mm_cvtepi32_pd( _mm_set_epi32( 0, 0, outputSamples[i], inputSamples[i] ) );
-
-            //totalEnergy += samples[i]*samples[i];
-            totalEnergyVec = _mm_add_pd( totalEnergyVec, _mm_mul_pd( sampleVec, sampleVec ) );
-
-            //dcEnergy += samples[i];
-            dcEnergyVec = _mm_add_pd( dcEnergyVec, sampleVec );
-
-            //τ = K*a - b + samples[i];
-            //b = a;
-            //a = τ;
-            τVec = _mm_add_pd( _mm_sub_pd( _mm_mul_pd( KappaVec, aVec ), bVec ), sampleVec );
-            bVec = aVec;
-            aVec = τVec;
+            swprintf( fraStatusText, 1024, L"Status: DFT removed exponential drift; Input change: %lg, time constant: %.4lg ms; Output change: %lg, time constant: %.4lg ms",
+                      trendChange[0], 1000.0 * trendTimeConstant[0] * transferDownsampleRatio / actualSampFreqHz,
+                      trendChange[1], 1000.0 * trendTimeConstant[1] * transferDownsampleRatio / actualSampFreqHz );
         }
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, DFT_DIAGNOSTICS );
     }
-    else // REINSCH_PI
+
+    kernelSeconds = pDft->GetKernelSeconds();
+    if (kernelSeconds > 0.0)
     {
-        for (uint32_t i = 0; i < n; i++)
-        {
-            // Load and convert samples to packed doubles
-            sampleVec = _mm_cvtepi32_pd( _mm_set_epi32( 0, 0, outputSamples[i], inputSamples[i] ) );
+        swprintf( fraStatusText, 1024, L"Status: DFT kernel (%s, %u thread(s)) processed %u samples in %.3lg ms (%.4lg MS/s)",
+                  GetSimdLevelName( GetSimdLevel() ), (uint32_t)dftThreadPool.GetNumThreads(), N, kernelSeconds * 1000.0, ((double)N / kernelSeconds) / 1.0e6 );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, DFT_DIAGNOSTICS );
+    }
+}
+
+void PicoScopeFRA::GetGoertzelResults( double& inputMagnitude, double& inputPhase, double& inputAmplitude, double& inputPurity,
+                                       double& outputMagnitude, double& outputPhase, double& outputAmplitude, double& outputPurity )
+{
+    pDft->GetResults( inputMagnitude, inputPhase, inputAmplitude, inputPurity,
+                      outputMagnitude, outputPhase, outputAmplitude, outputPurity );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::XXXXSineFit
+//
+// Purpose: Wrappers around the sine fit engine (see SineFit.cpp) which add status diagnostics
+//
+// Parameters: See SineFit::Init, SineFit::Feed, SineFit::GetResults
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
 
-            //totalEnergy += samples[i]*samples[i];
-            totalEnergyVec = _mm_add_pd( totalEnergyVec, _mm_mul_pd( sampleVec, sampleVec ) );
+void PicoScopeFRA::InitSineFit( uint32_t totalSamples, double fSamp, double fDetect )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
 
-            //dcEnergy += samples[i];
-            dcEnergyVec = _mm_add_pd( dcEnergyVec, sampleVec );
+    sineFit.Init( totalSamples, fSamp, fDetect, SINE_FIT_4_PARAMETER == mEstimator );
 
-            //b = K*a - b + samples[i]
-            //a = b - a
-            bVec = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(KappaVec, aVec), bVec), sampleVec);
-            aVec = _mm_sub_pd(bVec, aVec);
-        }
-    }
+    swprintf( fraStatusText, 128, L"Status: Computing %d parameter sine fit", SINE_FIT_4_PARAMETER == mEstimator ? 4 : 3 );
+    UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, DFT_DIAGNOSTICS );
+}
 
-    samplesProcessed += n;
+void PicoScopeFRA::FeedSineFit( int16_t* inputSamples, int16_t* outputSamples, uint32_t n )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[256];
 
-    if (lastBlock)
+    if (sineFit.Feed( inputSamples, outputSamples, n ) && sineFit.IsComplete())
     {
-        array<complex<double>, 2> y;
-        array<double, 2> signalEnergy;
+        double inputResidualRms, outputResidualRms;
 
-        // Iterate Goertzel once more with 0 input to get correct phase
-        if (REINSCH_0 == dftRecurrence)
-        {
-            bVec = _mm_add_pd(bVec, _mm_mul_pd(KappaVec, aVec));
-            aVec = _mm_add_pd(aVec, bVec);
-        }
-        else if (GOERTZEL == dftRecurrence)
-        {
-            τVec = _mm_sub_pd( _mm_mul_pd( KappaVec, aVec ), bVec );
-            bVec = aVec;
-            aVec = τVec;
-        }
-        else // REINSCH_PI
-        {
-            bVec = _mm_sub_pd(_mm_mul_pd(KappaVec, aVec), bVec);
-            aVec = _mm_sub_pd(bVec, aVec);
-        }
+        sineFit.GetResiduals( inputResidualRms, outputResidualRms );
 
-        // Unvectorize
-        _mm_store_pd(a, aVec);
-        _mm_store_pd(b, bVec);
-        _mm_store_pd(totalEnergy, totalEnergyVec);
-        _mm_store_pd(dcEnergy, dcEnergyVec);
+        swprintf( fraStatusText, 256, L"Status: Sine fit completed in %u pass(es); fitted frequency: %.9lg Hz; "
+                                      L"Input residual: %lg counts RMS; Output residual: %lg counts RMS",
+                  (uint32_t)sineFit.GetNumPasses(), sineFit.GetFrequency(), inputResidualRms, outputResidualRms );
+        UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, DFT_DIAGNOSTICS );
+    }
+}
 
-        // Compute the complex output
-        if (REINSCH_0 == dftRecurrence)
-        {
-            y[0] = std::complex<double>(b[0] + a[0] * Kappa/2.0, a[0] * sin(theta));
-            y[1] = std::complex<double>(b[1] + a[1] * Kappa/2.0, a[1] * sin(theta));
-        }
-        else if (GOERTZEL == dftRecurrence)
-        {
-            y[0] = std::complex<double>(a[0] - b[0] * cos(theta), b[0] * sin(theta));
-            y[1] = std::complex<double>(a[1] - b[1] * cos(theta), b[1] * sin(theta));
-        }
-        else // REINSCH_PI
-        {
-            y[0] = std::complex<double>(b[0] - a[0] * Kappa/2.0, -a[0] * sin(theta));
-            y[1] = std::complex<double>(b[1] - a[1] * Kappa/2.0, -a[1] * sin(theta));
-        }
+void PicoScopeFRA::GetSineFitResults( double& inputMagnitude, double& inputPhase, double& inputAmplitude, double& inputPurity,
+                                      double& outputMagnitude, double& outputPhase, double& outputAmplitude, double& outputPurity )
+{
+    sineFit.GetResults( inputMagnitude, inputPhase, inputAmplitude, inputPurity,
+                        outputMagnitude, outputPhase, outputAmplitude, outputPurity );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: PicoScopeFRA::XXXXLockIn
+//
+// Purpose: Wrappers around the lock-in demodulator (see LockInDemodulator.cpp) which add status
+//          diagnostics
+//
+// Parameters: See LockInDemodulator::Init, LockInDemodulator::Feed, LockInDemodulator::GetResults
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PicoScopeFRA::InitLockIn( uint32_t totalSamples, double fSamp, double fDetect )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[128];
+
+    lockIn.Init( totalSamples, fSamp, fDetect );
 
-        magnitude[0] = abs(y[0]);
-        magnitude[1] = abs(y[1]);
-        phase[0] = arg(y[0]);
-        phase[1] = arg(y[1]);
+    swprintf( fraStatusText, 128, L"Status: Computing lock-in; CIC decimation: %u; FIR length: %u",
+              lockIn.GetDecimation(), lockIn.GetFirLength() );
+    UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, DFT_DIAGNOSTICS );
+}
 
-        // Using N+1 because this form of the Goertzel iterates N+1 times, with x[N] = 0, thus effectively using N+1 samples.
-        // The x[N]=0 sample has no effect on the time domain Parseval's energy calculation.
-        amplitude[0] = 2.0 * magnitude[0] / (N+1);
-        amplitude[1] = 2.0 * magnitude[1] / (N+1);
-        signalEnergy[0] = 2.0 * (magnitude[0] * magnitude[0]) / (N+1);
-        signalEnergy[1] = 2.0 * (magnitude[1] * magnitude[1]) / (N+1);
-        dcEnergy[0] = (dcEnergy[0] * dcEnergy[0]) / (N+1);
-        dcEnergy[1] = (dcEnergy[1] * dcEnergy[1]) / (N+1);
+void PicoScopeFRA::FeedLockIn( int16_t* inputSamples, int16_t* outputSamples, uint32_t n )
+{
+    FRA_STATUS_MESSAGE_T fraStatusMsg;
+    wchar_t fraStatusText[256];
 
-        purity[0] = signalEnergy[0] / (totalEnergy[0] - dcEnergy[0]);
-        purity[1] = signalEnergy[1] / (totalEnergy[1] - dcEnergy[1]);
+    if (lockIn.Feed( inputSamples, outputSamples, n ))
+    {
+        double inputAmplitudeChange, inputPhaseChange, outputAmplitudeChange, outputPhaseChange;
+        double kernelSeconds;
 
-        // Output diagnostics
-        swprintf( fraStatusText, 1024, L"Status: DFT results:\r\n"
-                                       L"   Input magnitude: %lg; Input amplitude: %lg; Input phase: %lg; Input purity: %lg; Input DC energy: %lg; Input signal energy: %lg, Input total energy: %lg\r\n"
-                                       L"   Output magnitude: %lg; Output amplitude: %lg; Output phase: %lg; Output purity: %lg; Output DC energy: %lg; Output signal energy: %lg, Output total energy: %lg",
-                                       magnitude[0], amplitude[0], phase[0], purity[0], dcEnergy[0], signalEnergy[0], totalEnergy[0],
-                                       magnitude[1], amplitude[1], phase[1], purity[1], dcEnergy[1], signalEnergy[1], totalEnergy[1] );
+        lockIn.GetDrift( inputAmplitudeChange, inputPhaseChange, outputAmplitudeChange, outputPhaseChange );
 
+        swprintf( fraStatusText, 256, L"Status: Lock-in drift over capture: Input amplitude: %.3lg%%; Input phase: %.3lg deg; "
+                                      L"Output amplitude: %.3lg%%; Output phase: %.3lg deg",
+                  inputAmplitudeChange * 100.0, inputPhaseChange * 180.0 / M_PI, outputAmplitudeChange * 100.0, outputPhaseChange * 180.0 / M_PI );
         UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, DFT_DIAGNOSTICS );
-    }
-    else
-    {
-        // Unvectorize
-        _mm_store_pd(τ, τVec);
-        _mm_store_pd(a, aVec);
-        _mm_store_pd(b, bVec);
-        _mm_store_pd(totalEnergy, totalEnergyVec);
-        _mm_store_pd(dcEnergy, dcEnergyVec);
+
+        kernelSeconds = lockIn.GetKernelSeconds();
+        if (kernelSeconds > 0.0)
+        {
+            swprintf( fraStatusText, 256, L"Status: Lock-in kernel processed %u samples in %.3lg ms (%.4lg MS/s)",
+                      numSamples, kernelSeconds * 1000.0, ((double)numSamples / kernelSeconds) / 1.0e6 );
+            UpdateStatus( fraStatusMsg, FRA_STATUS_MESSAGE, fraStatusText, DFT_DIAGNOSTICS );
+        }
     }
 }
 
-void PicoScopeFRA::GetGoertzelResults( double& inputMagnitude, double& inputPhase, double& inputAmplitude, double& inputPurity,
-                                       double& outputMagnitude, double& outputPhase, double& outputAmplitude, double& outputPurity )
+void PicoScopeFRA::GetLockInResults( double& inputMagnitude, double& inputPhase, double& inputAmplitude, double& inputPurity,
+                                     double& outputMagnitude, double& outputPhase, double& outputAmplitude, double& outputPurity )
 {
-    inputMagnitude = magnitude[0];
-    inputPhase = phase[0];
-    inputAmplitude = amplitude[0];
-    inputPurity = purity[0];
-
-    outputMagnitude = magnitude[1];
-    outputPhase = phase[1];
-    outputAmplitude = amplitude[1];
-    outputPurity = purity[1];
+    lockIn.GetResults( inputMagnitude, inputPhase, inputAmplitude, inputPurity,
+                       outputMagnitude, outputPhase, outputAmplitude, outputPurity );
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -2265,6 +4706,8 @@ void PicoScopeFRA::GetGoertzelResults( double& inputMagnitude, double& inputPhas
 
 PicoScopeFRA::~PicoScopeFRA(void)
 {
+    delete pDft;
+    FreeTransferBuffers();
     if (NULL != hCaptureEvent)
     {
         (void)CloseHandle(hCaptureEvent);
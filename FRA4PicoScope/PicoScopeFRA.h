@@ -26,6 +26,12 @@
 #pragma once
 #include "FRA4PicoScopeInterfaceTypes.h"
 #include "PicoScopeInterface.h"
+#include "DftThreadPool.h"
+#include "GoertzelDft.h"
+#include "SineFit.h"
+#include "LockInDemodulator.h"
+#include "BroadbandStimulus.h"
+#include "SpectrumDiagnostics.h"
 #include <memory>
 #include <vector>
 #include <array>
@@ -66,6 +72,28 @@ class PicoScopeFRA
                             int outputChannel, int outputChannelCoupling, int outputChannelAttenuation, double outputDcOffset,
                             double initialSignalVpp, double maxSignalVpp, double stimulusDcOffset );
         void GetResults( int* numSteps, double** freqsLogHz, double** gainsDb, double** phasesDeg, double** unwrappedPhasesDeg );
+        void SetDftThreads( uint16_t dftThreads );
+        void SetHarmonics( uint8_t numHarmonics );
+        void SetDftWindow( DftWindow_T dftWindow );
+        void SetDftTrend( DftTrend_T dftTrend );
+        void SetEstimator( MeasurementEstimator_T estimator );
+        void SetSubBlocks( uint8_t numSubBlocks );
+        void SetConfidenceTarget( double gainStdErrDb, double phaseStdErrDeg );
+        void SetAveraging( uint16_t averagingCount );
+        void SetStimulusType( StimulusType_T stimulusType );
+        void SetSpectrumDiagnostics( bool enable );
+        void SetFrequencyRefinement( bool enable );
+        void SetStreamingCapture( bool enable );
+        void SetProbeCapture( bool enable );
+        void SetHardwareSweep( bool enable );
+        void SetPipelinedSweep( bool enable );
+        void SetPredictiveAutorange( bool enable );
+        void GetMeasuredFrequencies( int* numSteps, double** measuredFreqsHz );
+        void GetUncertaintyResults( int* numSteps, double** gainsStdErrDb, double** phasesStdErrDeg, double** coherences );
+        void GetHarmonicResults( int* numSteps, int* numHarmonics, double** inputHarmonicsDbc, double** outputHarmonicsDbc,
+                                 double** harmonicPhasesDeg, double** inputThdPercent, double** outputThdPercent );
+        void GetSpectrumResults( int* numSteps, double** inputNoiseFloorsDbcPerHz, double** outputNoiseFloorsDbcPerHz,
+                                 double** inputSpurFreqsHz, double** inputSpursDbc, double** outputSpurFreqsHz, double** outputSpursDbc );
         void EnableDiagnostics( wstring baseDataPath );
         void DisableDiagnostics( void );
 
@@ -109,8 +137,44 @@ class PicoScopeFRA
         vector<double> latestCompletedPhasesDeg;
         vector<double> latestCompletedUnwrappedPhasesDeg;
         vector<double> latestCompletedGainsDb;
+        // Harmonic results; harmonic arrays hold numHarmonics entries per step, starting with the 2nd harmonic
+        vector<double> inputHarmonicsDbc;
+        vector<double> outputHarmonicsDbc;
+        vector<double> harmonicPhasesDeg;
+        vector<double> inputThdPercent;
+        vector<double> outputThdPercent;
+        int latestCompletedNumHarmonics;
+        vector<double> latestCompletedInputHarmonicsDbc;
+        vector<double> latestCompletedOutputHarmonicsDbc;
+        vector<double> latestCompletedHarmonicPhasesDeg;
+        vector<double> latestCompletedInputThdPercent;
+        vector<double> latestCompletedOutputThdPercent;
+        // Uncertainty results; NaN where not measured
+        vector<double> gainsStdErrDb;
+        vector<double> phasesStdErrDeg;
+        vector<double> coherences;
+        vector<double> latestCompletedGainsStdErrDb;
+        vector<double> latestCompletedPhasesStdErrDeg;
+        vector<double> latestCompletedCoherences;
+        // Stimulus frequencies measured from the captures; NaN where not measured
+        vector<double> measuredFreqsHz;
+        vector<double> latestCompletedMeasuredFreqsHz;
+        // Spectrum diagnostic results; NaN where not measured
+        vector<double> inputNoiseFloorsDbcPerHz;
+        vector<double> outputNoiseFloorsDbcPerHz;
+        vector<double> inputSpurFreqsHz;
+        vector<double> inputSpursDbc;
+        vector<double> outputSpurFreqsHz;
+        vector<double> outputSpursDbc;
+        vector<double> latestCompletedInputNoiseFloorsDbcPerHz;
+        vector<double> latestCompletedOutputNoiseFloorsDbcPerHz;
+        vector<double> latestCompletedInputSpurFreqsHz;
+        vector<double> latestCompletedInputSpursDbc;
+        vector<double> latestCompletedOutputSpurFreqsHz;
+        vector<double> latestCompletedOutputSpursDbc;
         double actualSampFreqHz; // Scope sampling frequency
         uint32_t numSamples;
+        uint32_t captureTimebase;
         int32_t timeIndisposedMs;
         double currentInputMagnitude;
         double currentOutputMagnitude;
@@ -118,6 +182,51 @@ class PicoScopeFRA
         double currentOutputPhase;
         double currentInputPurity;
         double currentOutputPurity;
+        double currentGainStdErrDb;
+        double currentPhaseStdErrDeg;
+        double currentCoherence;
+        uint32_t predictedCaptureSamples;   // Samples the last step predicts will reach the confidence target; 0 for no prediction
+        bool shortenedCapture;              // Whether the current capture was shortened to predictedCaptureSamples
+        bool confidenceRecapture;           // Whether the current capture is a full length retry of a shortened one
+        bool mProbeCapture;                 // Whether long captures are preceded by short probe captures
+        bool probePending;                  // Whether the step's range and stimulus are still to be probed
+        bool probeCapture;                  // Whether the current capture is a probe
+        bool probeSettled;                  // Whether a probe has settled the step's range and stimulus
+        double probeCaptureSec;             // Duration of the step's probe captures
+        double fullCaptureSec;              // Duration of the step's full length capture
+        double probeSavedSec;               // Capture time the step's probes have saved so far
+        static const uint8_t probeCycles = 2;
+        static const double minProbedCaptureSec;
+        bool mHardwareSweep;                // Whether short steps may be measured in batches swept by the signal generator
+        bool sweepBatchFailed;              // Whether a batch's sweep failed to line up with its capture this sweep
+        static const uint8_t maxSweepBatchSteps = 16;
+        static const uint8_t sweepSettleCycles = 16;
+        static const double maxSweepStepCaptureSec;
+        static const double minSweepWindowPurity;
+
+        // Stimulus staging (see StageStimulus)
+        bool mPipelinedSweep;               // Whether the next step's stimulus is set up while a capture is processed
+        DWORD stageTickMs;                  // When the staged stimulus was set up
+        bool stimulusStaged;                // Whether the generator is set up and settled for the next capture's step
+        bool stimulusAhead;                 // Whether the generator was staged for a later step than the current one
+        bool StagingAvailable( void );
+        bool StageStimulus( double freqHz );
+        void SettleStagedStimulus( void );
+
+        // Range prediction (see PredictStepRanges)
+        bool mPredictiveAutorange;          // Whether each step's starting ranges are predicted from the response trend
+        static const size_t rangePredictionPoints = 3;
+        static const double rangePredictionMargin;
+        vector<double> rangeHistoryLogFreqs;    // log10 of the recent steps' frequencies
+        vector<double> rangeHistoryLogInputs;   // log10 of the recent steps' input peaks, per volt of stimulus
+        vector<double> rangeHistoryLogOutputs;  // log10 of the recent steps' output peaks, per volt of stimulus
+        bool rangesPredicted;               // Whether the current step started at predicted ranges
+        PS_RANGE predictedInputRange, predictedOutputRange;
+        PS_RANGE unpredictedInputRange, unpredictedOutputRange; // Where the step would have started otherwise
+        int numRangePredictions, numInputRangeHits, numOutputRangeHits;
+        int rangePredictionTriesSaved;
+        void PredictStepRanges( void );
+        void RecordStepRanges( int attempt );
         bool ovIn;
         bool ovOut;
         bool delayForAcCoupling;
@@ -128,6 +237,10 @@ class PicoScopeFRA
         AUTORANGE_STATUS_T inputChannelAutorangeStatus;
         AUTORANGE_STATUS_T outputChannelAutorangeStatus;
 
+        // Step's range bracket: lowest range that might not overflow, and lowest seen not to
+        PS_RANGE inputRangeFloor, inputRangeCeiling;
+        PS_RANGE outputRangeFloor, outputRangeCeiling;
+
         double mPurityLowerLimit;           // Lowest allowed purity before we warn the user and allow action
         double minAllowedAmplitudeRatio;    // Lowest amplitude we will tolerate for measurement on lowest range.
         double minAmplitudeRatioTolerance;  // Tolerance so that when we step up we're not over maxAmplitudeRatio
@@ -146,6 +259,56 @@ class PicoScopeFRA
         double mMaxStimulusVpp;             // Maximum allowed stimulus voltage in adaptive stimulus mode
         int maxAdaptiveStimulusRetries;     // Maximum number of tries to adapt stimulus before failing
         double mPhaseWrappingThreshold;     // Phase value to use as wrapping point (in degrees); absolute value should be less than 360
+        uint16_t mDftThreads;               // Threads used to compute the DFT; 0 means one per logical processor
+        uint8_t mNumHarmonics;              // Harmonics measured above the fundamental; 0 means none
+        MeasurementEstimator_T mEstimator;  // How gain and phase are measured from the captured samples
+        uint8_t mNumSubBlocks;              // Sub-blocks the DFT divides each capture into for the standard error estimate
+        double mTargetGainStdErrDb;         // Gain standard error at which to stop accumulating data; 0 means no target
+        double mTargetPhaseStdErrDeg;       // Phase standard error at which to stop accumulating data; 0 means no target
+        static const uint8_t minSubBlocksForEarlyStop = 4;
+        uint16_t mAveragingCount;           // Captures per step averaged in the frequency domain; 1 means no averaging
+        StimulusType_T mStimulusType;
+        bool mSpectrumDiagnostics;
+        bool mFrequencyRefinement;          // Whether the DFT is re-tuned to the stimulus frequency measured from the capture
+        static const uint8_t minFrequencyRefinementSubBlocks = 4;
+        static const double frequencyRefinementThresholdBins;
+        SpectrumDiagnostics spectrumDiagnostics;
+
+        // Broadband stimulus
+        BroadbandStimulus broadbandStimulus;
+        Fft broadbandFft;
+        vector<complex<double>> broadbandRecord; // One period of both channels, summed over the capture
+        vector<uint32_t> bandToneCycles;    // Cycles per waveform period of each step in the band
+        uint32_t bandPeriodSamples;         // Capture samples per waveform period
+        double bandRepeatFreqHz;            // Waveform repeat frequency
+        static const uint32_t minBroadbandWaveformSize = 1024;
+        static const uint32_t maxBroadbandWaveformSize = 16384;
+        static const uint8_t minBroadbandToneCycles = 16;
+        static const uint8_t minAwgSamplesPerCycle = 8;
+        static const uint8_t broadbandOversampling = 8;
+        static const double maxBroadbandBandRatio;
+
+        DftThreadPool dftThreadPool;
+        GoertzelDft* pDft;                  // DFT engine; held by pointer to keep its state aligned
+        SineFit sineFit;                    // Sine fit engine, used instead of the DFT's fundamental when selected
+        LockInDemodulator lockIn;           // Lock-in engine, used instead of the DFT's fundamental when selected
+
+        // Caller-owned buffers the scope transfers captures into (see StartDataTransfer)
+        int16_t* transferInputBuffers[PicoScope::numTransferBuffers];
+        int16_t* transferOutputBuffers[PicoScope::numTransferBuffers];
+        uint32_t transferBufferSize;
+        static const size_t transferBufferAlignment = 64;
+        uint32_t transferDownsampleRatio;   // Captured samples the scope averages into each sample transferred
+        static const uint8_t minAveragedSamplesPerCycle = 16;
+        bool mStreamingCapture;             // Whether captures may use the scope's streaming mode
+        bool streamingCapture;              // Whether the current capture is streamed
+        bool segmentCapture;                // Whether a rapid block segment is analyzed instead of a transfer
+        int16_t* segmentInputSamples;
+        int16_t* segmentOutputSamples;
+        bool segmentInputOv;
+        bool segmentOutputOv;
+        bool segmentDelivered;
+        static const double maxStreamingSampFreqHz;
 
         double rangeCounts; // Maximum ADC value
         double signalGeneratorPrecision;
@@ -159,8 +322,6 @@ class PicoScopeFRA
         bool stimulusChanged;
         int freqStepCounter;
         int freqStepIndex;
-        vector<int16_t>* pInputBuffer;
-        vector<int16_t>* pOutputBuffer;
         vector<vector<double>> inAmps;
         vector<vector<double>> outAmps;
         vector<vector<bool>> inOV;
@@ -213,12 +374,46 @@ class PicoScopeFRA
         bool CheckStimulusTarget(bool forceAdjust = false);
         bool CheckSignalRanges(void);
         bool CheckSignalOverflows(void);
+        PS_RANGE FittingRange( double amplitudeRatio, PS_RANGE range, PS_RANGE minRange, PS_RANGE maxRange );
+        PS_RANGE BracketOverflowRange( PS_RANGE range, PS_RANGE& rangeFloor, PS_RANGE& rangeCeiling, PS_RANGE maxRange );
+        void ExecuteSteppedSweep( void );
+        void ExecuteBroadbandSweep( void );
+        int PlanBroadbandBand( int bandStart, uint32_t waveformSize, uint32_t& timebase );
+        void AnalyzeBroadbandCapture( int bandStart, int bandEnd );
+        bool SweepBatchAvailable( void );
+        int MeasureSweepBatch( int batchStart );
+        bool StreamingCaptureAvailable( void );
+        bool RunCapture( void );
+        bool GetNextCaptureChunk( uint32_t& startIndex, uint32_t& numSamples, int16_t** inputSamples, int16_t** outputSamples,
+                                  bool& inputOv, bool& outputOv );
+        void WaitForCapture( void );
+        void StartDataTransfer( uint32_t numSamples, uint32_t downsampleRatio );
+        void FreeTransferBuffers( void );
+        void ReportSpectrumDiagnostics( void );
+        void AnalyzeCapture( double& inputAmplitude, double& outputAmplitude,
+                             uint16_t& inputPeak, uint16_t& outputPeak, bool& inputOv, bool& outputOv );
+        void RefineGoertzelFrequency( void );
+        void AverageCaptures( void );
         bool CalculateGainAndPhase( double* gain, double* phase );
+        void CalculateHarmonics( int stepIndex );
         void UnwrapPhases(void);
         void InitGoertzel( uint32_t N, double fSamp, double fDetect );
         void FeedGoertzel( int16_t* inputSamples, int16_t* outputSamples, uint32_t n );
+        bool TruncateGoertzel( void );
+        void ReportGoertzelResults( void );
         void GetGoertzelResults( double& inputMagnitude, double& inputPhase, double& inputAmplitude, double& inputPurity,
                                  double& outputMagnitude, double& outputPhase, double& outputAmplitude, double& outputPurity );
+        void InitSineFit( uint32_t N, double fSamp, double fDetect );
+        void FeedSineFit( int16_t* inputSamples, int16_t* outputSamples, uint32_t n );
+        void GetSineFitResults( double& inputMagnitude, double& inputPhase, double& inputAmplitude, double& inputPurity,
+                                double& outputMagnitude, double& outputPhase, double& outputAmplitude, double& outputPurity );
+        void InitLockIn( uint32_t N, double fSamp, double fDetect );
+        void FeedLockIn( int16_t* inputSamples, int16_t* outputSamples, uint32_t n );
+        void GetLockInResults( double& inputMagnitude, double& inputPhase, double& inputAmplitude, double& inputPurity,
+                               double& outputMagnitude, double& outputPhase, double& outputAmplitude, double& outputPurity );
+        bool ConfidenceTargetEnabled( void );
+        double ConfidenceRatio( double gainStdErrDb, double phaseStdErrDeg );
+        void RecordUncertainty( int stepIndex );
         void TransferLatestResults(void);
 
         // Utilities for sending a message via the callback
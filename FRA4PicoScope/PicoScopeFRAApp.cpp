@@ -33,6 +33,7 @@
 #include <delayimp.h>
 #include <iomanip>
 #include <fstream>
+#include <float.h>
 
 #include "PicoScopeFRA.h"
 #include "DependencyChecker.h"
@@ -366,6 +367,23 @@ void SelectNewScope( AvailableScopeDescription_T scope, bool mruScope = false )
                              pSettings->GetAdaptiveStimulusTriesPerStepAsUint8(), pSettings->GetTargetResponseAmplitudeToleranceAsFraction(),
                              pSettings->GetMinCyclesCapturedAsUint16(), pSettings->GetNoiseRejectBandwidthAsDouble(), pSettings->GetLowNoiseOversamplingAsUint16() );
 
+        psFRA->SetDftThreads( pSettings->GetDftThreadsAsUint16() );
+        psFRA->SetHarmonics( pSettings->GetHarmonicsAsUint8() );
+        psFRA->SetDftWindow( pSettings->GetDftWindow() );
+        psFRA->SetDftTrend( pSettings->GetDftTrend() );
+        psFRA->SetEstimator( pSettings->GetEstimator() );
+        psFRA->SetSubBlocks( pSettings->GetSubBlocksAsUint8() );
+        psFRA->SetConfidenceTarget( pSettings->GetTargetGainStdErrDbAsDouble(), pSettings->GetTargetPhaseStdErrDegAsDouble() );
+        psFRA->SetAveraging( pSettings->GetAveragingCountAsUint16() );
+        psFRA->SetStimulusType( pSettings->GetStimulusType() );
+        psFRA->SetSpectrumDiagnostics( pSettings->GetSpectrumDiagnostics() );
+        psFRA->SetFrequencyRefinement( pSettings->GetFrequencyRefinement() );
+        psFRA->SetStreamingCapture( pSettings->GetStreamingCapture() );
+        psFRA->SetProbeCapture( pSettings->GetProbeCapture() );
+        psFRA->SetHardwareSweep( pSettings->GetHardwareSweep() );
+        psFRA->SetPipelinedSweep( pSettings->GetPipelinedSweep() );
+        psFRA->SetPredictiveAutorange( pSettings->GetPredictiveAutorange() );
+
         if (!mruScope) // Don't unnecessarily dirty the settings file
         {
             pSettings->SetMostRecentScope(scope.driverFamily, scope.serialNumber);
@@ -798,6 +816,23 @@ BOOL CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                                              pSettings->GetAdaptiveStimulusTriesPerStepAsUint8(), pSettings->GetTargetResponseAmplitudeToleranceAsFraction(),
                                              pSettings->GetMinCyclesCapturedAsUint16(), pSettings->GetNoiseRejectBandwidthAsDouble(), pSettings->GetLowNoiseOversamplingAsUint16() );
 
+                        psFRA->SetDftThreads( pSettings->GetDftThreadsAsUint16() );
+                        psFRA->SetHarmonics( pSettings->GetHarmonicsAsUint8() );
+                        psFRA->SetDftWindow( pSettings->GetDftWindow() );
+                        psFRA->SetDftTrend( pSettings->GetDftTrend() );
+                        psFRA->SetEstimator( pSettings->GetEstimator() );
+                        psFRA->SetSubBlocks( pSettings->GetSubBlocksAsUint8() );
+                        psFRA->SetConfidenceTarget( pSettings->GetTargetGainStdErrDbAsDouble(), pSettings->GetTargetPhaseStdErrDegAsDouble() );
+                        psFRA->SetAveraging( pSettings->GetAveragingCountAsUint16() );
+                        psFRA->SetStimulusType( pSettings->GetStimulusType() );
+                        psFRA->SetSpectrumDiagnostics( pSettings->GetSpectrumDiagnostics() );
+                        psFRA->SetFrequencyRefinement( pSettings->GetFrequencyRefinement() );
+                        psFRA->SetStreamingCapture( pSettings->GetStreamingCapture() );
+                        psFRA->SetProbeCapture( pSettings->GetProbeCapture() );
+                        psFRA->SetHardwareSweep( pSettings->GetHardwareSweep() );
+                        psFRA->SetPipelinedSweep( pSettings->GetPipelinedSweep() );
+                        psFRA->SetPredictiveAutorange( pSettings->GetPredictiveAutorange() );
+
                         if (pScopeSelector->GetSelectedScope())
                         {
                             pScopeSelector->GetSelectedScope()->SetDesiredNoiseRejectModeTimebase(pSettings->GetNoiseRejectModeTimebaseAsInt());
@@ -2431,12 +2466,54 @@ INT_PTR CALLBACK ScopeSelectHandler(HWND hDlg, UINT message, WPARAM wParam, LPAR
 
 void SaveRawData( wstring dataFilePath )
 {
-    int numSteps;
+    int numSteps, numHarmonicSteps, numHarmonics;
     double *freqsLogHz, *phasesDeg, *unwrappedPhasesDeg, *gainsDb, *phases;
+    double *inputHarmonicsDbc, *outputHarmonicsDbc, *harmonicPhasesDeg, *inputThdPercent, *outputThdPercent;
+    int numUncertaintySteps;
+    double *gainsStdErrDb, *phasesStdErrDeg, *coherences;
+    bool haveUncertainty = false;
+    bool haveCoherence = false;
+    int numSpectrumSteps;
+    double *inputNoiseFloorsDbcPerHz, *outputNoiseFloorsDbcPerHz, *inputSpurFreqsHz, *inputSpursDbc, *outputSpurFreqsHz, *outputSpursDbc;
+    bool haveSpectrum = false;
+    int numMeasuredFreqSteps;
+    double *measuredFreqsHz;
+    bool haveMeasuredFreqs = false;
 
     ofstream dataFileOutputStream;
 
     psFRA->GetResults( &numSteps, &freqsLogHz, &gainsDb, &phasesDeg, &unwrappedPhasesDeg );
+    psFRA->GetHarmonicResults( &numHarmonicSteps, &numHarmonics, &inputHarmonicsDbc, &outputHarmonicsDbc,
+                               &harmonicPhasesDeg, &inputThdPercent, &outputThdPercent );
+    psFRA->GetUncertaintyResults( &numUncertaintySteps, &gainsStdErrDb, &phasesStdErrDeg, &coherences );
+    psFRA->GetSpectrumResults( &numSpectrumSteps, &inputNoiseFloorsDbcPerHz, &outputNoiseFloorsDbcPerHz,
+                               &inputSpurFreqsHz, &inputSpursDbc, &outputSpurFreqsHz, &outputSpursDbc );
+    psFRA->GetMeasuredFrequencies( &numMeasuredFreqSteps, &measuredFreqsHz );
+    for (int idx = 0; idx < numMeasuredFreqSteps; idx++)
+    {
+        if (!_isnan( measuredFreqsHz[idx] ))
+        {
+            haveMeasuredFreqs = true;
+        }
+    }
+    for (int idx = 0; idx < numSpectrumSteps; idx++)
+    {
+        if (!_isnan( inputNoiseFloorsDbcPerHz[idx] ))
+        {
+            haveSpectrum = true;
+        }
+    }
+    for (int idx = 0; idx < numUncertaintySteps; idx++)
+    {
+        if (!_isnan( gainsStdErrDb[idx] ))
+        {
+            haveUncertainty = true;
+        }
+        if (!_isnan( coherences[idx] ))
+        {
+            haveCoherence = true;
+        }
+    }
 
     if (numSteps == 0)
     {
@@ -2449,11 +2526,64 @@ void SaveRawData( wstring dataFilePath )
         if (dataFileOutputStream)
         {
             phases = pSettings->GetPlotUnwrappedPhase() ? unwrappedPhasesDeg : phasesDeg;
-            dataFileOutputStream << "Frequency Log(Hz), Gain (dB), Phase (deg)\n";
+            dataFileOutputStream << "Frequency Log(Hz), Gain (dB), Phase (deg)";
+            if (haveMeasuredFreqs)
+            {
+                dataFileOutputStream << ", Measured Frequency (Hz)";
+            }
+            if (haveUncertainty)
+            {
+                dataFileOutputStream << ", Gain Std Err (dB), Phase Std Err (deg)";
+            }
+            if (haveCoherence)
+            {
+                dataFileOutputStream << ", Coherence";
+            }
+            if (numHarmonics)
+            {
+                dataFileOutputStream << ", Input THD (%), Output THD (%)";
+                for (int h = 0; h < numHarmonics; h++)
+                {
+                    dataFileOutputStream << ", H" << h+2 << " Input (dBc), H" << h+2 << " Output (dBc), H" << h+2 << " Phase (deg)";
+                }
+            }
+            if (haveSpectrum)
+            {
+                dataFileOutputStream << ", Input Noise Floor (dBc/Hz), Output Noise Floor (dBc/Hz), Input Spur (Hz), Input Spur (dBc), Output Spur (Hz), Output Spur (dBc)";
+            }
+            dataFileOutputStream << "\n";
             dataFileOutputStream.precision(numeric_limits<double>::digits10);
             for (int idx = 0; idx < numSteps; idx++)
             {
-                dataFileOutputStream << freqsLogHz[idx] << ", " << gainsDb[idx] << ", " << phases[idx] << "\n";
+                dataFileOutputStream << freqsLogHz[idx] << ", " << gainsDb[idx] << ", " << phases[idx];
+                if (haveMeasuredFreqs)
+                {
+                    dataFileOutputStream << ", " << measuredFreqsHz[idx];
+                }
+                if (haveUncertainty)
+                {
+                    dataFileOutputStream << ", " << gainsStdErrDb[idx] << ", " << phasesStdErrDeg[idx];
+                }
+                if (haveCoherence)
+                {
+                    dataFileOutputStream << ", " << coherences[idx];
+                }
+                if (numHarmonics)
+                {
+                    dataFileOutputStream << ", " << inputThdPercent[idx] << ", " << outputThdPercent[idx];
+                    for (int h = 0; h < numHarmonics; h++)
+                    {
+                        dataFileOutputStream << ", " << inputHarmonicsDbc[idx*numHarmonics+h] << ", " << outputHarmonicsDbc[idx*numHarmonics+h]
+                                             << ", " << harmonicPhasesDeg[idx*numHarmonics+h];
+                    }
+                }
+                if (haveSpectrum)
+                {
+                    dataFileOutputStream << ", " << inputNoiseFloorsDbcPerHz[idx] << ", " << outputNoiseFloorsDbcPerHz[idx]
+                                         << ", " << inputSpurFreqsHz[idx] << ", " << inputSpursDbc[idx]
+                                         << ", " << outputSpurFreqsHz[idx] << ", " << outputSpursDbc[idx];
+                }
+                dataFileOutputStream << "\n";
             }
 
             dataFileOutputStream.close();
@@ -191,9 +191,12 @@ class PicoScope
         friend class ScopeSelector;
 
     public:
-        PicoScope() : initialized(false), model(PS_NO_MODEL), family(PS_NO_FAMILY), numAvailableChannels(2), minFuncGenFreq(0.0), maxFuncGenFreq(0.0), minFuncGenVpp(0.0), maxFuncGenVpp(0.0), signalGeneratorPrecision(0.0), compatible(false) {};
+        PicoScope() : initialized(false), model(PS_NO_MODEL), family(PS_NO_FAMILY), numAvailableChannels(2), minFuncGenFreq(0.0), maxFuncGenFreq(0.0), minFuncGenVpp(0.0), maxFuncGenVpp(0.0), signalGeneratorPrecision(0.0), maxArbitraryWaveformSize(0), compatible(false) {};
         virtual ~PicoScope() {};
 
+        // Number of buffers of each channel used by the pipelined data transfer
+        static const uint8_t numTransferBuffers = 2;
+
         class PicoPowerChange : public exception
         {
             public:
@@ -232,6 +235,11 @@ class PicoScope
         virtual bool DisableChannel( PS_CHANNEL channel ) = 0;
         virtual bool SetSignalGenerator( double vPP, double offset, double frequency ) = 0;
         virtual bool DisableSignalGenerator( void ) = 0;
+        virtual bool SignalGeneratorSweepSupported( void ) = 0;
+        virtual bool SetSignalGeneratorSweep( double vPP, double offset, double startFrequency, double stopFrequency,
+                                              double increment, double dwellTimeSec ) = 0;
+        virtual uint32_t GetMaxArbitraryWaveformSize( void ) = 0;
+        virtual bool SetArbitrarySignalGenerator( vector<int16_t>& waveform, double vPP, double offset, double& frequency ) = 0;
         virtual bool DisableChannelTriggers( void ) = 0;
         virtual bool GetMaxSamples( uint32_t* maxSamples ) = 0;
         virtual bool GetTimebase( double desiredFrequency, double* actualFrequency, uint32_t* timebase ) = 0;
@@ -239,10 +247,28 @@ class PicoScope
         virtual bool RunBlock( int32_t numSamples, uint32_t timebase, int32_t *timeIndisposedMs, psBlockReady lpReady, void *pParameter ) = 0;
         virtual void SetChannelDesignations( PS_CHANNEL inputChannel, PS_CHANNEL outputChannel ) = 0;
         virtual bool GetData( uint32_t numSamples, uint32_t startIndex, vector<int16_t>** inputBuffer, vector<int16_t>** outputBuffer ) = 0;
+        virtual bool GetData( uint32_t numSamples, uint32_t startIndex, vector<int16_t>** inputBuffer, vector<int16_t>** outputBuffer,
+                              bool& inputOv, bool& outputOv ) = 0;
         virtual bool GetCompressedData( uint32_t numSamples, 
                                         vector<int16_t>& inputCompressedMinBuffer, vector<int16_t>& outputCompressedMinBuffer,
                                         vector<int16_t>& inputCompressedMaxBuffer, vector<int16_t>& outputCompressedMaxBuffer ) = 0;
         virtual bool GetPeakValues( uint16_t& inputPeak, uint16_t& outputPeak, bool& inputOv, bool& outputOv ) = 0;
+        virtual bool GetPeakValuesTransfersData( void ) = 0;
+        virtual uint32_t GetTransferChunkSize( uint32_t numSamples ) = 0;
+        virtual bool SetTransferBuffers( int16_t* inputBuffers[], int16_t* outputBuffers[], uint32_t bufferSize ) = 0;
+        virtual uint32_t GetMaxTransferDownsampleRatio( void ) = 0;
+        virtual bool StartDataTransfer( uint32_t numSamples, uint32_t downsampleRatio ) = 0;
+        virtual bool GetNextDataChunk( uint32_t& startIndex, uint32_t& numSamples, int16_t** inputSamples, int16_t** outputSamples,
+                                       bool& inputOv, bool& outputOv ) = 0;
+        virtual void EndDataTransfer( void ) = 0;
+        virtual bool StreamingSupported( void ) = 0;
+        virtual bool RunStreaming( uint32_t numSamples, double desiredSampFreqHz, uint32_t downsampleRatio, double& actualSampFreqHz ) = 0;
+        virtual bool GetNextStreamingChunk( uint32_t& startIndex, uint32_t& numSamples, int16_t** inputSamples, int16_t** outputSamples,
+                                            bool& inputOv, bool& outputOv, bool& complete ) = 0;
+        virtual uint32_t GetMaxSegments( uint32_t numSamples ) = 0;
+        virtual bool RunRapidBlock( int32_t numSamples, uint32_t timebase, uint32_t& numSegments, int32_t *timeIndisposedMs, psBlockReady lpReady, void *pParameter ) = 0;
+        virtual bool GetSegmentData( uint32_t numSamples, uint32_t numSegments, uint32_t downsampleRatio, int16_t** inputSamples, int16_t** outputSamples,
+                                     vector<bool>& inputOv, vector<bool>& outputOv ) = 0;
         virtual bool ChangePower( PICO_STATUS powerState ) = 0;
         virtual bool CancelCapture( void ) = 0;
         virtual bool Close( void ) = 0;
@@ -263,5 +289,6 @@ class PicoScope
         double minFuncGenVpp;
         double maxFuncGenVpp;
         double signalGeneratorPrecision;
+        uint32_t maxArbitraryWaveformSize; // Samples; 0 if no arbitrary waveform generator
         bool compatible;
 };
\ No newline at end of file
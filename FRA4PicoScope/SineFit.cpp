@@ -0,0 +1,462 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: SineFit.cpp
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "SineFit.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <emmintrin.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SineFit
+//
+// Purpose: Least squares fit of x[n] = A*cos(omega*n) + B*sin(omega*n) + C to the input and output signals, per
+// IEEE Std 1057 [1].  Unlike the DFT, the fit doesn't leak when the capture holds a non-integer number of cycles, so
+// a few cycles suffice where the rectangular window DFT needs many.
+//
+// Parameters:
+//    Init
+//             [in] totalSamples - Total number of samples in the full signal
+//             [in] fSamp - frequency of the sampling
+//             [in] fDetect - frequency of the stimulus
+//             [in] fitFrequency - false for the 3 parameter fit (frequency known to be fDetect); true for
+//                                 the 4 parameter fit, which also fits the frequency
+//    Feed
+//             [in] inputSamples - input channel data sample points
+//             [in] outputSamples - output channel data sample points
+//             [in] n - number of samples in this block of samples
+//             [out] return - true when this was the last block of a pass
+//    IsComplete
+//             [out] return - true when the results are available; false if the samples must be fed again
+//    GetResults
+//             [output] [in/out]putMagnitude - Magnitude on the same scale as GoertzelDft's, (N+1)/2 times the amplitude
+//             [output] [in/out]putPhase - Phase of the cosine referenced to the first sample
+//             [output] [in/out]putAmplitude - The fitted amplitude, sqrt(A^2 + B^2)
+//             [output] [in/out]putPurity - Fitted sine energy over fitted sine energy plus residual energy
+//    GetFrequency
+//             [out] return - The fitted frequency (Hz); fDetect for the 3 parameter fit
+//
+// Notes:
+//
+// - The fit is computed from sums over the samples, so it streams like the DFT and needs no sample buffer.  With
+//   the basis c = cos(omega*n), s = sin(omega*n), the 3 parameter fit solves the normal equations
+//     | Scc Scs Sc | |A|   |Sxc|
+//     | Scs Sss Ss | |B| = |Sxs|
+//     | Sc  Ss  N  | |C|   |Sx |
+//   and the residual energy is Sxx - (A*Sxc + B*Sxs + C*Sx).
+//
+// - The 4 parameter fit is iterated by Gauss-Newton.  Since the stimulus is common to both channels, their
+//   frequency is fitted jointly: one iteration solves for both channels' A, B, C and a shared frequency
+//   correction, using the basis above plus d = t*(-A*s + B*c) per channel, where t = n/N.  d is built from the
+//   same pass's 3 parameter fit, so only sums weighted by t and t^2 are needed in addition.  Each iteration needs
+//   a pass over the samples at the new frequency, so the caller feeds the samples again, up to maxPasses times.
+//   It converges when the correction moves the phase at the end of the record by less than 1e-9 rad.  Since the
+//   stimulus frequency is known closely, the correction is limited to one DFT bin from fDetect, which prevents
+//   divergence on noisy captures.
+//
+// - The basis is recomputed exactly (from the reduced phase) at the start of every chunk of samples, and rotated
+//   within the chunk, so it's accurate for any number of samples.  The data sums for both channels are computed
+//   together with SSE2, as in the Goertzel kernels.
+//
+//   [1] IEEE Standard for Digitizing Waveform Recorders, IEEE Std 1057-2017, Section 4.1.3, Annex A.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SolveLinearSystem
+//
+// Purpose: Solve a small dense linear system by Gaussian elimination with partial pivoting
+//
+// Parameters: [in/out] M - n x n matrix, row major; destroyed
+//             [in/out] v - right hand side; replaced with the solution
+//             [in] n - size of the system
+//             [out] return - false if the system is singular
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool SolveLinearSystem( double* M, double* v, int n )
+{
+    for (int col = 0; col < n; col++)
+    {
+        int pivot = col;
+        for (int row = col + 1; row < n; row++)
+        {
+            if (fabs( M[row*n+col] ) > fabs( M[pivot*n+col] ))
+            {
+                pivot = row;
+            }
+        }
+        if (0.0 == M[pivot*n+col])
+        {
+            return false;
+        }
+        if (pivot != col)
+        {
+            for (int k = 0; k < n; k++)
+            {
+                swap( M[pivot*n+k], M[col*n+k] );
+            }
+            swap( v[pivot], v[col] );
+        }
+        for (int row = col + 1; row < n; row++)
+        {
+            double factor = M[row*n+col] / M[col*n+col];
+            for (int k = col; k < n; k++)
+            {
+                M[row*n+k] -= factor * M[col*n+k];
+            }
+            v[row] -= factor * v[col];
+        }
+    }
+
+    for (int row = n - 1; row >= 0; row--)
+    {
+        for (int k = row + 1; k < n; k++)
+        {
+            v[row] -= M[row*n+k] * v[k];
+        }
+        v[row] /= M[row*n+row];
+    }
+
+    return true;
+}
+
+SineFit::SineFit(void)
+{
+    estimateFrequency = false;
+    complete = false;
+    numPasses = 0;
+    N = 0;
+    samplingFrequency = 1.0;
+    nominalFreqRatio = freqRatio = 0.0;
+    samplesProcessed = 0;
+    cosAmplitude.fill( 0.0 );
+    sinAmplitude.fill( 0.0 );
+    offset.fill( 0.0 );
+    residualEnergy.fill( 0.0 );
+    signalEnergy.fill( 0.0 );
+    ClearSums();
+}
+
+void SineFit::ClearSums( void )
+{
+    sumCC = sumCS = sumSS = sumC = sumS = 0.0;
+    sumTCC = sumTCS = sumTSS = sumTC = sumTS = 0.0;
+    sumTTCC = sumTTCS = sumTTSS = 0.0;
+    sumXC.fill( 0.0 );
+    sumXS.fill( 0.0 );
+    sumX.fill( 0.0 );
+    sumXTC.fill( 0.0 );
+    sumXTS.fill( 0.0 );
+    sumXX.fill( 0.0 );
+}
+
+void SineFit::Init( uint32_t totalSamples, double fSamp, double fDetect, bool fitFrequency )
+{
+    estimateFrequency = fitFrequency;
+    samplingFrequency = fSamp;
+    N = totalSamples;
+    nominalFreqRatio = freqRatio = fDetect / fSamp;
+    complete = false;
+    numPasses = 0;
+    samplesProcessed = 0;
+    ClearSums();
+}
+
+bool SineFit::Feed( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n )
+{
+    for (uint32_t i = 0; i < n; i += chunkSize)
+    {
+        FeedChunk( &inputSamples[i], &outputSamples[i], min( (uint32_t)chunkSize, n - i ) );
+    }
+
+    if (samplesProcessed == N)
+    {
+        EndPass();
+        return true;
+    }
+
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SineFit::FeedChunk
+//
+// Purpose: Accumulate the sums over a chunk of samples
+//
+// Parameters: [in] inputSamples, outputSamples - the samples
+//             [in] n - number of samples; no more than chunkSize
+//
+// Notes: Sums are accumulated per chunk and then added to the pass totals, which limits rounding
+//        error growth over long captures
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void SineFit::FeedChunk( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n )
+{
+    double c[chunkSize], s[chunkSize];
+    double cosStep = cos( 2.0 * M_PI * freqRatio ), sinStep = sin( 2.0 * M_PI * freqRatio );
+    double t0 = (double)samplesProcessed / N, tStep = 1.0 / N;
+    double cycles, cyclesError, phase0;
+
+    // Compute the basis exactly at the first sample, reducing the phase as in CombineGoertzelState
+    cycles = freqRatio * samplesProcessed;
+    cyclesError = fma( freqRatio, (double)samplesProcessed, -cycles );
+    phase0 = 2.0 * M_PI * ((cycles - floor( cycles )) + cyclesError);
+    c[0] = cos( phase0 );
+    s[0] = sin( phase0 );
+
+    for (uint32_t i = 1; i < n; i++)
+    {
+        c[i] = c[i-1] * cosStep - s[i-1] * sinStep;
+        s[i] = s[i-1] * cosStep + c[i-1] * sinStep;
+    }
+
+    // Basis sums
+    double cc = 0.0, cs = 0.0, ss = 0.0, sc = 0.0, sS = 0.0;
+    double tcc = 0.0, tcs = 0.0, tss = 0.0, tc = 0.0, ts = 0.0;
+    double ttcc = 0.0, ttcs = 0.0, ttss = 0.0;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        cc += c[i] * c[i];
+        cs += c[i] * s[i];
+        ss += s[i] * s[i];
+        sc += c[i];
+        sS += s[i];
+    }
+
+    if (estimateFrequency)
+    {
+        for (uint32_t i = 0; i < n; i++)
+        {
+            double t = t0 + i * tStep;
+            double ci = t * c[i], si = t * s[i];
+            tcc += ci * c[i];
+            tcs += ci * s[i];
+            tss += si * s[i];
+            tc += ci;
+            ts += si;
+            ttcc += ci * ci;
+            ttcs += ci * si;
+            ttss += si * si;
+        }
+    }
+
+    // Data sums; the lanes are { input, output }
+    __m128d xc = _mm_setzero_pd(), xs = _mm_setzero_pd(), x = _mm_setzero_pd(), xx = _mm_setzero_pd();
+    __m128d xtc = _mm_setzero_pd(), xts = _mm_setzero_pd();
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        __m128d xVec = _mm_setr_pd( (double)inputSamples[i], (double)outputSamples[i] );
+        __m128d cVec = _mm_set1_pd( c[i] );
+        __m128d sVec = _mm_set1_pd( s[i] );
+
+        xc = _mm_add_pd( xc, _mm_mul_pd( xVec, cVec ) );
+        xs = _mm_add_pd( xs, _mm_mul_pd( xVec, sVec ) );
+        x = _mm_add_pd( x, xVec );
+        xx = _mm_add_pd( xx, _mm_mul_pd( xVec, xVec ) );
+
+        if (estimateFrequency)
+        {
+            __m128d xtVec = _mm_mul_pd( xVec, _mm_set1_pd( t0 + i * tStep ) );
+            xtc = _mm_add_pd( xtc, _mm_mul_pd( xtVec, cVec ) );
+            xts = _mm_add_pd( xts, _mm_mul_pd( xtVec, sVec ) );
+        }
+    }
+
+    sumCC += cc; sumCS += cs; sumSS += ss; sumC += sc; sumS += sS;
+    sumTCC += tcc; sumTCS += tcs; sumTSS += tss; sumTC += tc; sumTS += ts;
+    sumTTCC += ttcc; sumTTCS += ttcs; sumTTSS += ttss;
+
+    array<double,2> chunkSum;
+    _mm_storeu_pd( chunkSum.data(), xc );
+    sumXC[0] += chunkSum[0]; sumXC[1] += chunkSum[1];
+    _mm_storeu_pd( chunkSum.data(), xs );
+    sumXS[0] += chunkSum[0]; sumXS[1] += chunkSum[1];
+    _mm_storeu_pd( chunkSum.data(), x );
+    sumX[0] += chunkSum[0]; sumX[1] += chunkSum[1];
+    _mm_storeu_pd( chunkSum.data(), xx );
+    sumXX[0] += chunkSum[0]; sumXX[1] += chunkSum[1];
+    _mm_storeu_pd( chunkSum.data(), xtc );
+    sumXTC[0] += chunkSum[0]; sumXTC[1] += chunkSum[1];
+    _mm_storeu_pd( chunkSum.data(), xts );
+    sumXTS[0] += chunkSum[0]; sumXTS[1] += chunkSum[1];
+
+    samplesProcessed += n;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SineFit::EndPass
+//
+// Purpose: Solve the fit from the pass's sums and, for the 4 parameter fit, update the frequency
+//
+// Parameters: N/A
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void SineFit::EndPass( void )
+{
+    bool converged = true;
+
+    numPasses++;
+
+    // 3 parameter fit of each channel at the current frequency
+    for (int ch = 0; ch < 2; ch++)
+    {
+        double G[9] = { sumCC, sumCS, sumC,
+                        sumCS, sumSS, sumS,
+                        sumC,  sumS,  (double)N };
+        double p[3] = { sumXC[ch], sumXS[ch], sumX[ch] };
+
+        if (!SolveLinearSystem( G, p, 3 ))
+        {
+            // Too few samples to separate the sine from d.c.
+            p[0] = p[1] = 0.0;
+            p[2] = sumX[ch] / N;
+        }
+
+        cosAmplitude[ch] = p[0];
+        sinAmplitude[ch] = p[1];
+        offset[ch] = p[2];
+        signalEnergy[ch] = p[0] * p[0] * sumCC + 2.0 * p[0] * p[1] * sumCS + p[1] * p[1] * sumSS;
+        residualEnergy[ch] = max( 0.0, sumXX[ch] - (p[0] * sumXC[ch] + p[1] * sumXS[ch] + p[2] * sumX[ch]) );
+    }
+
+    // One Gauss-Newton iteration of the joint 4 parameter fit
+    if (estimateFrequency)
+    {
+        double G[49] = {};
+        double p[7];
+        double sumDD = 0.0, sumXD = 0.0;
+
+        for (int ch = 0; ch < 2; ch++)
+        {
+            double A = cosAmplitude[ch], B = sinAmplitude[ch];
+            int base = 3 * ch;
+            double basis[3][3] = { { sumCC, sumCS, sumC }, { sumCS, sumSS, sumS }, { sumC, sumS, (double)N } };
+            // Sums of d with c, s and 1
+            double cross[3] = { -A * sumTCS + B * sumTCC, -A * sumTSS + B * sumTCS, -A * sumTS + B * sumTC };
+
+            for (int i = 0; i < 3; i++)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    G[(base+i)*7+base+k] = basis[i][k];
+                }
+                G[(base+i)*7+6] = G[6*7+base+i] = cross[i];
+            }
+            p[base] = sumXC[ch];
+            p[base+1] = sumXS[ch];
+            p[base+2] = sumX[ch];
+
+            sumDD += A * A * sumTTSS - 2.0 * A * B * sumTTCS + B * B * sumTTCC;
+            sumXD += -A * sumXTS[ch] + B * sumXTC[ch];
+        }
+        G[6*7+6] = sumDD;
+        p[6] = sumXD;
+
+        if (SolveLinearSystem( G, p, 7 ))
+        {
+            // p[6] is the correction to omega*N; limit the frequency to one bin from nominal
+            double newFreqRatio = freqRatio + p[6] / (2.0 * M_PI * N);
+            newFreqRatio = min( max( newFreqRatio, nominalFreqRatio - 1.0 / N ), nominalFreqRatio + 1.0 / N );
+            converged = fabs( 2.0 * M_PI * N * (newFreqRatio - freqRatio) ) < 1.0e-9;
+            freqRatio = newFreqRatio;
+        }
+    }
+
+    complete = converged || numPasses >= maxPasses;
+
+    samplesProcessed = 0;
+    ClearSums();
+}
+
+bool SineFit::IsComplete( void )
+{
+    return complete;
+}
+
+void SineFit::GetResults( double& inputMagnitude, double& inputPhase, double& inputAmplitude, double& inputPurity,
+                          double& outputMagnitude, double& outputPhase, double& outputAmplitude, double& outputPurity )
+{
+    array<double,2> magnitude, phase, amplitude, purity;
+
+    for (int ch = 0; ch < 2; ch++)
+    {
+        // x = Re((A - jB) * e^(j*omega*n)), so the DFT at omega is ~N/2 * (A - jB)
+        amplitude[ch] = sqrt( cosAmplitude[ch] * cosAmplitude[ch] + sinAmplitude[ch] * sinAmplitude[ch] );
+        phase[ch] = atan2( -sinAmplitude[ch], cosAmplitude[ch] );
+        magnitude[ch] = amplitude[ch] * (N+1) / 2.0;
+        purity[ch] = signalEnergy[ch] > 0.0 ? signalEnergy[ch] / (signalEnergy[ch] + residualEnergy[ch]) : 0.0;
+    }
+
+    inputMagnitude = magnitude[0];
+    inputPhase = phase[0];
+    inputAmplitude = amplitude[0];
+    inputPurity = purity[0];
+
+    outputMagnitude = magnitude[1];
+    outputPhase = phase[1];
+    outputAmplitude = amplitude[1];
+    outputPurity = purity[1];
+}
+
+double SineFit::GetFrequency( void )
+{
+    return freqRatio * samplingFrequency;
+}
+
+uint8_t SineFit::GetNumPasses( void )
+{
+    return numPasses;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SineFit::GetResiduals
+//
+// Purpose: Get the RMS of the fit residuals, for diagnostics
+//
+// Parameters: [out] [in/out]putResidualRms - RMS residual, in ADC counts
+//
+// Notes: Only valid once complete
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void SineFit::GetResiduals( double& inputResidualRms, double& outputResidualRms )
+{
+    inputResidualRms = sqrt( residualEnergy[0] / N );
+    outputResidualRms = sqrt( residualEnergy[1] / N );
+}
@@ -0,0 +1,86 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: SineFit.h
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <array>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: class SineFit
+//
+// Purpose: Least squares sine fit (IEEE 1057) of the input and output channels, as an alternative
+//          to the DFT for short captures.  See SineFit.cpp for details.
+//
+// Parameters: N/A
+//
+// Notes: The samples are consumed in passes, in the same blocks as GoertzelDft.  The 3 parameter
+//        fit needs one pass; the 4 parameter fit needs a pass per iteration, so the caller must
+//        feed the samples again until IsComplete returns true.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+class SineFit
+{
+    public:
+        SineFit(void);
+
+        void Init( uint32_t totalSamples, double fSamp, double fDetect, bool fitFrequency );
+        bool Feed( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n );
+        bool IsComplete( void );
+        void GetResults( double& inputMagnitude, double& inputPhase, double& inputAmplitude, double& inputPurity,
+                         double& outputMagnitude, double& outputPhase, double& outputAmplitude, double& outputPurity );
+        double GetFrequency( void );
+
+        static const uint8_t maxPasses = 8;
+
+        // Diagnostic accessors
+        uint8_t GetNumPasses( void );
+        void GetResiduals( double& inputResidualRms, double& outputResidualRms );
+
+    private:
+        static const uint32_t chunkSize = 512;
+        void FeedChunk( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n );
+        void EndPass( void );
+        void ClearSums( void );
+
+        bool estimateFrequency;
+        bool complete;
+        uint8_t numPasses;
+        uint32_t N;
+        double samplingFrequency;
+        double nominalFreqRatio; // Stimulus frequency / sampling frequency
+        double freqRatio; // Fitted frequency / sampling frequency
+        uint32_t samplesProcessed;
+
+        // Sums over the current pass.  Basis sums are of products of c = cos(omega*n), s = sin(omega*n)
+        // and t = n/N; data sums are indexed by channel.
+        double sumCC, sumCS, sumSS, sumC, sumS;
+        double sumTCC, sumTCS, sumTSS, sumTC, sumTS;
+        double sumTTCC, sumTTCS, sumTTSS;
+        array<double,2> sumXC, sumXS, sumX, sumXTC, sumXTS, sumXX;
+
+        // Outputs
+        array<double,2> cosAmplitude, sinAmplitude, offset, residualEnergy, signalEnergy;
+};
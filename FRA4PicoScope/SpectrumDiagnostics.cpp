@@ -0,0 +1,613 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: SpectrumDiagnostics.cpp
+//
+// Spectrum diagnostics explain a step whose purity is low: whether the signal is buried in broadband
+// noise, or in a spur such as mains pickup or switching noise, or distorted.
+//
+// The capture is decimated by averaging blocks of samples, to a record long enough to hold the
+// whole capture at no fewer than minSamplesPerCycle samples per stimulus cycle, so the harmonics
+// up to maxHarmonic stay below the decimated Nyquist frequency.  Averaging (rather than keeping the
+// min/max pairs the diagnostic plots use) keeps the decimation linear, so it can't create spurs of
+// its own.  Its mild roll-off is corrected for the harmonics and spurs; the noise needs no
+// correction, since averaging white noise leaves it white.
+//
+// The worker computes a Hann windowed power spectrum of the record, averaging half overlapping
+// segments of up to maxFftSize samples (Welch's method), both channels at once with one complex
+// FFT.  Levels are relative to the
+// fundamental:
+//  - Harmonic and spur levels are the power in the window's main lobe about the component.
+//  - The noise floor is the median bin power of the bins away from d.c. and the harmonics, which
+//    spurs barely move, scaled to the mean and to a 1 Hz bandwidth.
+//  - The strongest spur is the largest bin away from d.c. and the harmonics.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "SpectrumDiagnostics.h"
+#include <algorithm>
+#include <float.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SpectrumDiagnostics::SpectrumDiagnostics
+//
+// Purpose: Constructor
+//
+// Parameters: N/A
+//
+// Notes: There is no worker thread until Initialize is called
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+SpectrumDiagnostics::SpectrumDiagnostics(void)
+{
+    hThread = NULL;
+    hWorkEvent = NULL;
+    hIdleEvent = NULL;
+    exitWorker = false;
+    numDropped = 0;
+    decimation = 1;
+    blockCount = 0;
+    blockSum.fill(0);
+    InitializeCriticalSection( &lock );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SpectrumDiagnostics::~SpectrumDiagnostics
+//
+// Purpose: Destructor
+//
+// Parameters: N/A
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+SpectrumDiagnostics::~SpectrumDiagnostics(void)
+{
+    Shutdown();
+    DeleteCriticalSection( &lock );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SpectrumDiagnostics::Initialize
+//
+// Purpose: Create the worker thread
+//
+// Parameters: [out] return - whether the function succeeded.  On failure the records are analyzed
+//                            on the calling thread when submitted.
+//
+// Notes: Does nothing if the worker already exists
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool SpectrumDiagnostics::Initialize( void )
+{
+    if (NULL != hThread)
+    {
+        return true;
+    }
+
+    Shutdown();
+    exitWorker = false;
+
+    hWorkEvent = CreateEventW( NULL, false, false, NULL );
+    hIdleEvent = CreateEventW( NULL, true, true, NULL );
+
+    if ((HANDLE)NULL == hWorkEvent || (HANDLE)NULL == hIdleEvent)
+    {
+        Shutdown();
+        return false;
+    }
+
+    hThread = CreateThread( NULL, 0, WorkerThread, this, 0, NULL );
+
+    if ((HANDLE)NULL == hThread)
+    {
+        Shutdown();
+        return false;
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SpectrumDiagnostics::Shutdown
+//
+// Purpose: Stop and release the worker thread
+//
+// Parameters: N/A
+//
+// Notes: Records still queued are discarded
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void SpectrumDiagnostics::Shutdown( void )
+{
+    EnterCriticalSection( &lock );
+    exitWorker = true;
+    queue.clear();
+    LeaveCriticalSection( &lock );
+
+    if (NULL != hThread)
+    {
+        (void)SetEvent( hWorkEvent );
+        (void)WaitForSingleObject( hThread, INFINITE );
+        (void)CloseHandle( hThread );
+        hThread = NULL;
+    }
+    if (NULL != hWorkEvent)
+    {
+        (void)CloseHandle( hWorkEvent );
+        hWorkEvent = NULL;
+    }
+    if (NULL != hIdleEvent)
+    {
+        (void)CloseHandle( hIdleEvent );
+        hIdleEvent = NULL;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SpectrumDiagnostics::Reset
+//
+// Purpose: Prepare for a new sweep
+//
+// Parameters: [in] numSteps - number of steps in the sweep
+//
+// Notes: Waits for the worker to finish any record from an earlier sweep
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void SpectrumDiagnostics::Reset( int numSteps )
+{
+    SPECTRUM_RESULT_T invalidResult;
+
+    WaitForIdle();
+
+    invalidResult.valid = false;
+    for (int channel = 0; channel < 2; channel++)
+    {
+        invalidResult.noiseFloorDbcPerHz[channel] = numeric_limits<double>::quiet_NaN();
+        invalidResult.spurFreqHz[channel] = numeric_limits<double>::quiet_NaN();
+        invalidResult.spurDbc[channel] = numeric_limits<double>::quiet_NaN();
+        for (int h = 0; h < maxHarmonic-1; h++)
+        {
+            invalidResult.harmonicsDbc[channel][h] = numeric_limits<double>::quiet_NaN();
+        }
+    }
+    invalidResult.binWidthHz = numeric_limits<double>::quiet_NaN();
+
+    EnterCriticalSection( &lock );
+    results.assign( numSteps, invalidResult );
+    numDropped = 0;
+    LeaveCriticalSection( &lock );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SpectrumDiagnostics::BeginRecord
+//
+// Purpose: Start a decimated record of a capture
+//
+// Parameters: [in] totalSamples - number of samples in the capture
+//             [in] fSamp - sampling frequency
+//             [in] fDetect - stimulus frequency
+//
+// Notes: The decimation is the least that fits the capture in one FFT, but no more than keeps
+//        minSamplesPerCycle samples per stimulus cycle
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void SpectrumDiagnostics::BeginRecord( uint32_t totalSamples, double fSamp, double fDetect )
+{
+    uint32_t maxDecimation = (uint32_t)max( 1.0, floor( fSamp / ((double)minSamplesPerCycle * fDetect) ) );
+
+    decimation = (totalSamples + maxFftSize - 1) / maxFftSize;
+    decimation = max( (uint32_t)1, min( decimation, maxDecimation ) );
+
+    currentRecord.fSamp = fSamp;
+    currentRecord.decimation = decimation;
+    currentRecord.fDetect = fDetect;
+    for (int channel = 0; channel < 2; channel++)
+    {
+        currentRecord.samples[channel].clear();
+        currentRecord.samples[channel].reserve( min( totalSamples / decimation, maxRecordLength ) );
+    }
+    blockCount = 0;
+    blockSum.fill(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SpectrumDiagnostics::Feed
+//
+// Purpose: Add capture samples to the decimated record
+//
+// Parameters: [in] inputSamples - input channel samples
+//             [in] outputSamples - output channel samples
+//             [in] n - number of samples
+//
+// Notes: Samples beyond maxRecordLength decimated samples are ignored
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void SpectrumDiagnostics::Feed( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n )
+{
+    for (uint32_t i = 0; i < n && currentRecord.samples[0].size() < maxRecordLength; i++)
+    {
+        blockSum[0] += inputSamples[i];
+        blockSum[1] += outputSamples[i];
+        if (++blockCount == decimation)
+        {
+            currentRecord.samples[0].push_back( (double)blockSum[0] / (double)decimation );
+            currentRecord.samples[1].push_back( (double)blockSum[1] / (double)decimation );
+            blockCount = 0;
+            blockSum.fill(0);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SpectrumDiagnostics::Submit
+//
+// Purpose: Queue the current record for analysis as a step's result
+//
+// Parameters: [in] stepIndex - the step the record belongs to
+//
+// Notes: A later record for the same step replaces the earlier one's result.  If the worker has
+//        fallen maxQueuedRecords behind, the record is dropped rather than holding up the sweep.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void SpectrumDiagnostics::Submit( int stepIndex )
+{
+    currentRecord.stepIndex = stepIndex;
+
+    if (NULL == hThread)
+    {
+        SPECTRUM_RESULT_T result;
+        Analyze( currentRecord, result );
+        if (stepIndex >= 0 && stepIndex < (int)results.size())
+        {
+            results[stepIndex] = result;
+        }
+        return;
+    }
+
+    EnterCriticalSection( &lock );
+    if (queue.size() >= maxQueuedRecords)
+    {
+        numDropped++;
+    }
+    else
+    {
+        queue.push_back( SPECTRUM_RECORD_T() );
+        queue.back().stepIndex = stepIndex;
+        queue.back().fSamp = currentRecord.fSamp;
+        queue.back().decimation = currentRecord.decimation;
+        queue.back().fDetect = currentRecord.fDetect;
+        queue.back().samples[0].swap( currentRecord.samples[0] );
+        queue.back().samples[1].swap( currentRecord.samples[1] );
+        (void)ResetEvent( hIdleEvent );
+    }
+    LeaveCriticalSection( &lock );
+
+    (void)SetEvent( hWorkEvent );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SpectrumDiagnostics::WaitForIdle
+//
+// Purpose: Wait for the worker to analyze all the submitted records
+//
+// Parameters: N/A
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void SpectrumDiagnostics::WaitForIdle( void )
+{
+    if (NULL != hThread)
+    {
+        (void)WaitForSingleObject( hIdleEvent, INFINITE );
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SpectrumDiagnostics::GetResult
+//
+// Purpose: Get a step's results
+//
+// Parameters: [in] stepIndex - the step
+//             [out] return - the results; valid is false if the step has none
+//
+// Notes: Call WaitForIdle first
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+const SpectrumDiagnostics::SPECTRUM_RESULT_T& SpectrumDiagnostics::GetResult( int stepIndex )
+{
+    return results[stepIndex];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SpectrumDiagnostics::GetNumDropped
+//
+// Purpose: Get the number of records dropped since Reset because the worker was behind
+//
+// Parameters: [out] return - the number of records dropped
+//
+// Notes:
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t SpectrumDiagnostics::GetNumDropped( void )
+{
+    return numDropped;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SpectrumDiagnostics::WorkerThread
+//
+// Purpose: Worker thread body; analyzes queued records until told to exit
+//
+// Parameters: [in] lpThreadParameter - the SpectrumDiagnostics object
+//
+// Notes: Signals the idle event when the queue is empty
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+DWORD WINAPI SpectrumDiagnostics::WorkerThread( LPVOID lpThreadParameter )
+{
+    SpectrumDiagnostics* pThis = (SpectrumDiagnostics*)lpThreadParameter;
+    SPECTRUM_RECORD_T record;
+    SPECTRUM_RESULT_T result;
+
+    for (;;)
+    {
+        (void)WaitForSingleObject( pThis->hWorkEvent, INFINITE );
+
+        for (;;)
+        {
+            EnterCriticalSection( &(pThis->lock) );
+            if (pThis->exitWorker)
+            {
+                LeaveCriticalSection( &(pThis->lock) );
+                return 0;
+            }
+            if (pThis->queue.empty())
+            {
+                (void)SetEvent( pThis->hIdleEvent );
+                LeaveCriticalSection( &(pThis->lock) );
+                break;
+            }
+            record = move( pThis->queue.front() );
+            pThis->queue.pop_front();
+            LeaveCriticalSection( &(pThis->lock) );
+
+            pThis->Analyze( record, result );
+
+            EnterCriticalSection( &(pThis->lock) );
+            if (record.stepIndex >= 0 && record.stepIndex < (int)pThis->results.size())
+            {
+                pThis->results[record.stepIndex] = result;
+            }
+            LeaveCriticalSection( &(pThis->lock) );
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: SpectrumDiagnostics::Analyze
+//
+// Purpose: Compute the spectrum of a record and its noise floor, spur and harmonic levels
+//
+// Parameters: [in] record - the decimated record
+//             [out] result - the results
+//
+// Notes: See the module notes.  A Hann window's main lobe is 2 bins either side of a component;
+//        a guard bin more is excluded from the noise, for leakage, and a spur's whole main lobe
+//        must be clear of the excluded bins.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void SpectrumDiagnostics::Analyze( SPECTRUM_RECORD_T& record, SPECTRUM_RESULT_T& result )
+{
+    const int mainLobeBins = 2;
+    const int excludedBins = mainLobeBins + 1;
+    uint32_t recordLength = (uint32_t)record.samples[0].size();
+    uint32_t segmentSize, numSegments, numBins;
+    double fSampDecimated = record.fSamp / (double)record.decimation;
+    double fundamentalBin, dof;
+    vector<double> window;
+    vector<complex<double>> z;
+    array<vector<double>,2> power;
+    vector<bool> excluded;
+    vector<double> noiseBins;
+
+    result.valid = false;
+    for (int channel = 0; channel < 2; channel++)
+    {
+        result.noiseFloorDbcPerHz[channel] = numeric_limits<double>::quiet_NaN();
+        result.spurFreqHz[channel] = numeric_limits<double>::quiet_NaN();
+        result.spurDbc[channel] = numeric_limits<double>::quiet_NaN();
+        for (int h = 0; h < maxHarmonic-1; h++)
+        {
+            result.harmonicsDbc[channel][h] = numeric_limits<double>::quiet_NaN();
+        }
+    }
+    result.binWidthHz = numeric_limits<double>::quiet_NaN();
+
+    if (recordLength < minFftSize)
+    {
+        return;
+    }
+
+    segmentSize = Fft::PreviousPowerOfTwo( min( recordLength, maxFftSize ) );
+    numSegments = (recordLength - segmentSize) / (segmentSize / 2) + 1;
+    numBins = segmentSize / 2 + 1;
+    result.binWidthHz = fSampDecimated / (double)segmentSize;
+    fundamentalBin = record.fDetect / result.binWidthHz;
+
+    if (fundamentalBin < (double)(excludedBins + 1) || fundamentalBin + (double)mainLobeBins >= (double)(numBins - 1))
+    {
+        return;
+    }
+
+    (void)fft.Init( segmentSize );
+    window.resize( segmentSize );
+    for (uint32_t n = 0; n < segmentSize; n++)
+    {
+        window[n] = 0.5 - 0.5 * cos( 2.0 * M_PI * (double)n / (double)segmentSize );
+    }
+
+    // Power spectra of both channels, averaged over the segments
+    power[0].assign( numBins, 0.0 );
+    power[1].assign( numBins, 0.0 );
+    z.resize( segmentSize );
+    for (uint32_t segment = 0; segment < numSegments; segment++)
+    {
+        const double* in = record.samples[0].data() + segment * (segmentSize / 2);
+        const double* out = record.samples[1].data() + segment * (segmentSize / 2);
+        double inMean = 0.0, outMean = 0.0;
+
+        for (uint32_t n = 0; n < segmentSize; n++)
+        {
+            inMean += in[n];
+            outMean += out[n];
+        }
+        inMean /= (double)segmentSize;
+        outMean /= (double)segmentSize;
+
+        for (uint32_t n = 0; n < segmentSize; n++)
+        {
+            z[n] = window[n] * complex<double>( in[n] - inMean, out[n] - outMean );
+        }
+        fft.Forward( z );
+
+        for (uint32_t k = 0; k < numBins; k++)
+        {
+            complex<double> zk = z[k];
+            complex<double> zmk = conj( z[(segmentSize - k) & (segmentSize - 1)] );
+            power[0][k] += norm( 0.5 * (zk + zmk) );
+            power[1][k] += norm( complex<double>( 0.0, -0.5 ) * (zk - zmk) );
+        }
+    }
+
+    // Bins near d.c. and the harmonics (to Nyquist) are excluded from the noise and spur searches
+    excluded.assign( numBins, false );
+    for (int k = 0; k <= excludedBins; k++)
+    {
+        excluded[k] = true;
+    }
+    for (double harmonicBin = fundamentalBin; harmonicBin < (double)numBins; harmonicBin += fundamentalBin)
+    {
+        int center = (int)floor( harmonicBin + 0.5 );
+        for (int k = max( 0, center - excludedBins ); k <= min( (int)numBins - 1, center + excludedBins ); k++)
+        {
+            excluded[k] = true;
+        }
+    }
+
+    // Median of the average of numSegments chi-squared(2) bins (ignoring the overlap); the
+    // chi-squared(dof) median per Wilson-Hilferty is dof*(1-2/(9*dof))^3
+    dof = 2.0 * (double)numSegments;
+
+    for (int channel = 0; channel < 2; channel++)
+    {
+        // Main lobe power of a component, undoing the roll-off of the block averaging decimation
+        auto bandPower = [&]( double bin ) -> double
+        {
+            int center = (int)floor( bin + 0.5 );
+            double sum = 0.0, x, response = 1.0;
+            for (int k = max( 1, center - mainLobeBins ); k <= min( (int)numBins - 1, center + mainLobeBins ); k++)
+            {
+                sum += power[channel][k];
+            }
+            if (record.decimation > 1)
+            {
+                x = M_PI * bin * result.binWidthHz / record.fSamp;
+                response = sin( x * (double)record.decimation ) / ((double)record.decimation * sin( x ));
+            }
+            return sum / (response * response);
+        };
+
+        double fundamentalPower = bandPower( fundamentalBin );
+        uint32_t spurBin = 0;
+
+        if (fundamentalPower <= 0.0)
+        {
+            continue;
+        }
+
+        for (int h = 2; h <= maxHarmonic; h++)
+        {
+            if ((double)h * fundamentalBin + (double)mainLobeBins < (double)(numBins - 1))
+            {
+                result.harmonicsDbc[channel][h-2] = 10.0 * log10( max( bandPower( (double)h * fundamentalBin ), DBL_MIN ) / fundamentalPower );
+            }
+        }
+
+        noiseBins.clear();
+        for (uint32_t k = 1; k < numBins - 1; k++)
+        {
+            if (!excluded[k])
+            {
+                noiseBins.push_back( power[channel][k] );
+                // A spur's main lobe mustn't take in the leakage of an excluded component
+                if ((0 == spurBin || power[channel][k] > power[channel][spurBin]) &&
+                    !excluded[k - min( k, (uint32_t)mainLobeBins )] && !excluded[min( k + mainLobeBins, numBins - 1 )])
+                {
+                    spurBin = k;
+                }
+            }
+        }
+
+        if (!noiseBins.empty())
+        {
+            nth_element( noiseBins.begin(), noiseBins.begin() + noiseBins.size() / 2, noiseBins.end() );
+            double meanNoise = noiseBins[noiseBins.size() / 2] / pow( 1.0 - 2.0 / (9.0 * dof), 3.0 );
+            // A bin's noise relative to the fundamental's main lobe power, per Hz
+            result.noiseFloorDbcPerHz[channel] = 10.0 * log10( max( meanNoise, DBL_MIN ) / (fundamentalPower * result.binWidthHz) );
+            if (spurBin)
+            {
+                result.spurFreqHz[channel] = (double)spurBin * result.binWidthHz;
+                result.spurDbc[channel] = 10.0 * log10( max( bandPower( (double)spurBin ), DBL_MIN ) / fundamentalPower );
+            }
+        }
+    }
+
+    result.valid = true;
+}
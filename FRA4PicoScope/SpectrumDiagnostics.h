@@ -0,0 +1,111 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Frequency Response Analyzer for PicoScope
+//
+// Copyright (c) 2014 by Aaron Hexamer
+//
+// This file is part of the Frequency Response Analyzer for PicoScope program.
+//
+// Frequency Response Analyzer for PicoScope is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// Frequency Response Analyzer for PicoScope is distributed in the hope that
+// it will be useful,but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Frequency Response Analyzer for PicoScope.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Module: SpectrumDiagnostics.h
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "Fft.h"
+#include <vector>
+#include <deque>
+#include <array>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: class SpectrumDiagnostics
+//
+// Purpose: Computes the spectra of decimated copies of the step captures on a background thread,
+//          and reports each channel's noise floor, strongest spur and harmonic levels.  See
+//          SpectrumDiagnostics.cpp for details.
+//
+// Parameters: N/A
+//
+// Notes: Decimation runs on the calling thread as the capture is transferred, and is cheap; the
+//        spectra are computed by the worker, so they don't hold up the sweep.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+class SpectrumDiagnostics
+{
+    public:
+        SpectrumDiagnostics(void);
+        ~SpectrumDiagnostics(void);
+
+        static const uint8_t maxHarmonic = 5;
+
+        typedef struct
+        {
+            bool valid;
+            // Indexed by channel: 0 for input, 1 for output.  Levels are relative to the fundamental.
+            double noiseFloorDbcPerHz[2];
+            double spurFreqHz[2];
+            double spurDbc[2];
+            double harmonicsDbc[2][maxHarmonic-1]; // 2nd harmonic first; NaN above the decimated Nyquist frequency
+            double binWidthHz;
+        } SPECTRUM_RESULT_T;
+
+        bool Initialize( void );
+        void Reset( int numSteps );
+        void BeginRecord( uint32_t totalSamples, double fSamp, double fDetect );
+        void Feed( const int16_t* inputSamples, const int16_t* outputSamples, uint32_t n );
+        void Submit( int stepIndex );
+        void WaitForIdle( void );
+        const SPECTRUM_RESULT_T& GetResult( int stepIndex );
+        uint32_t GetNumDropped( void );
+
+        static const uint32_t maxRecordLength = 1 << 18;
+        static const uint32_t maxFftSize = 1 << 14;
+        static const uint32_t minFftSize = 64;
+        static const uint8_t minSamplesPerCycle = 16;
+        static const uint8_t maxQueuedRecords = 8;
+
+    private:
+        typedef struct
+        {
+            int stepIndex;
+            double fSamp; // Before decimation
+            uint32_t decimation;
+            double fDetect;
+            array<vector<double>,2> samples;
+        } SPECTRUM_RECORD_T;
+
+        static DWORD WINAPI WorkerThread( LPVOID lpThreadParameter );
+        void Analyze( SPECTRUM_RECORD_T& record, SPECTRUM_RESULT_T& result );
+        void Shutdown( void );
+
+        // Record being built by the calling thread
+        SPECTRUM_RECORD_T currentRecord;
+        uint32_t decimation;
+        uint32_t blockCount;
+        array<int64_t,2> blockSum;
+
+        // Worker; the queue and results are guarded by the lock
+        HANDLE hThread;
+        HANDLE hWorkEvent;
+        HANDLE hIdleEvent;
+        bool exitWorker;
+        deque<SPECTRUM_RECORD_T> queue;
+        vector<SPECTRUM_RESULT_T> results;
+        uint32_t numDropped;
+        CRITICAL_SECTION lock;
+        Fft fft;
+};
@@ -149,6 +149,11 @@ bool ps2000Impl::InitializeScope(void)
 
     signalGeneratorPrecision = 48.0e6 / (double)UINT32_MAX;
 
+    if (model == PS2203 || model == PS2204 || model == PS2205 || model == PS2204A || model == PS2205A)
+    {
+        maxArbitraryWaveformSize = 4096;
+    }
+
     minRange = (PS_RANGE)PS2000_50MV;
     maxRange = (PS_RANGE)PS2000_20V;
 
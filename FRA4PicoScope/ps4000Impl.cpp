@@ -154,6 +154,7 @@ bool ps4000Impl::InitializeScope(void)
         timebaseNoiseRejectMode = defaultTimebaseNoiseRejectMode = 15; // for PS4262 => 625 kHz, approximately 3x HW BW limiter
         minTimebase = 0;
         signalGeneratorPrecision = 192.0e3 / (double)UINT32_MAX;
+        maxArbitraryWaveformSize = 4096;
     }
     else if (model == PS4226)
     {
@@ -161,6 +162,7 @@ bool ps4000Impl::InitializeScope(void)
         timebaseNoiseRejectMode = defaultTimebaseNoiseRejectMode = 1; // for PS4226 => 125 MHz
         minTimebase = 1;
         signalGeneratorPrecision = 20.0e6 / (double)UINT32_MAX;
+        maxArbitraryWaveformSize = 8192;
     }
     else if (model == PS4227)
     {
@@ -168,6 +170,7 @@ bool ps4000Impl::InitializeScope(void)
         timebaseNoiseRejectMode = defaultTimebaseNoiseRejectMode = 0; // for PS4227 => 250 MHz
         minTimebase = 0;
         signalGeneratorPrecision = 20.0e6 / (double)UINT32_MAX;
+        maxArbitraryWaveformSize = 8192;
     }
 
     maxTimebase = ((uint32_t)1<<30) - 1;
@@ -132,6 +132,7 @@ bool ps5000Impl::InitializeScope(void)
     minFuncGenFreq = PS5000_MIN_FREQUENCY;
 
     signalGeneratorPrecision = 125.0e6 / (double)UINT32_MAX;
+    maxArbitraryWaveformSize = 8192;
 
     minRange = (PS_RANGE)PS5000_100MV;
     maxRange = (PS_RANGE)PS5000_20V;
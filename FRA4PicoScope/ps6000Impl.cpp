@@ -136,6 +136,16 @@ bool ps6000Impl::InitializeScope(void)
 
     signalGeneratorPrecision = 200.0e6 / (double)UINT32_MAX;
 
+    // Only the B and D models have an arbitrary waveform generator
+    if (model == PS6402B || model == PS6403B || model == PS6404B)
+    {
+        maxArbitraryWaveformSize = 16384;
+    }
+    else if (model == PS6402D || model == PS6403D || model == PS6404D)
+    {
+        maxArbitraryWaveformSize = 65536;
+    }
+
     if (model == PS6407)
     {
         minRange = maxRange = PS6000_100MV;
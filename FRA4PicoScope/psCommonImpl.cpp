@@ -25,6 +25,7 @@
 
 #include <sstream>
 #include <algorithm>
+#include <malloc.h>
 #include <boost/math/special_functions/round.hpp>
 using namespace boost::math;
 
@@ -83,6 +84,7 @@ LogPicoApiCall(fraStatusText, __VA_ARGS__);
 #define GetUnitInfo _get_unit_info
 #define SetChannel _set_channel
 #define SetSigGenBuiltIn _set_sig_gen_built_in
+#define SetSigGenArbitrary _set_sig_gen_arbitrary
 #define GetTimebase _get_timebase
 #define SetTriggerChannelConditions _set_trigger
 #define Stop _stop
@@ -118,9 +120,15 @@ LogPicoApiCall(fraStatusText, __VA_ARGS__);
 #define CommonSigGenNone(FM) xCommonSigGenNone(FM)
 #define xCommonSigGenNone(FM) PS##FM##_##SIGGEN_NONE
 
+#define CommonSingle(FM) xCommonSingle(FM)
+#define xCommonSingle(FM) PS##FM##_##SINGLE
+
 #define CommonReadyCB(FM) xCommonReadyCB(FM)
 #define xCommonReadyCB(FM) ps##FM##BlockReady
 
+#define CommonStreamingReadyCB(FM) xCommonStreamingReadyCB(FM)
+#define xCommonStreamingReadyCB(FM) ps##FM##StreamingReady
+
 #define CommonErrorCode(FM) xCommonErrorCode(FM)
 #define xCommonErrorCode(FM) PS##FM##_ERROR_CODE
 
@@ -143,6 +151,15 @@ const RANGE_INFO_T CommonClass(SCOPE_FAMILY_LT)::rangeInfo[] =
 // scopes not implementing the new driver model.  Currently this is 1MB (PS3206)
 const uint32_t CommonClass(SCOPE_FAMILY_LT)::maxDataRequestSize = 16 * 1024 * 1024; // 16 MSamp (32 MB)
 
+// Pipelined transfer chunk sizing; see StartDataTransfer
+const uint32_t CommonClass(SCOPE_FAMILY_LT)::minTransferChunkSize = 256 * 1024;
+const uint32_t CommonClass(SCOPE_FAMILY_LT)::targetTransferChunks = 16;
+const uint32_t CommonClass(SCOPE_FAMILY_LT)::maxTransferDownsampleRatio = 4096;
+
+// Streaming capture; see RunStreaming
+const uint32_t CommonClass(SCOPE_FAMILY_LT)::maxStreamingRingSize = 1024 * 1024;
+const DWORD CommonClass(SCOPE_FAMILY_LT)::streamingPollIntervalMs = 20;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //
 // Name: Common Constructor
@@ -188,6 +205,45 @@ CommonCtor(SCOPE_FAMILY_LT)( int16_t _handle ) : PicoScope()
     mOutputBuffer.resize( bufferSize );
     mNumSamples = 0;
     buffersDirty = true;
+    lastOverflow = 0;
+    transferNumSamples = 0;
+    transferChunkSize = 0;
+    chunksConsumed = 0;
+#if defined(NEW_PS_DRIVER_MODEL)
+    hTransferThread = NULL;
+    transferThreadId = 0;
+    transferLogSlot = 0;
+    hSlotsFree = NULL;
+    hSlotsFilled = NULL;
+    for (uint8_t slot = 0; slot < numTransferSlots; slot++)
+    {
+        transferInputSlots[slot] = NULL;
+        transferOutputSlots[slot] = NULL;
+        transferOverflow[slot] = 0;
+        transferSucceeded[slot] = false;
+    }
+    transferSlotCapacity = 0;
+    callerOwnedSlots = false;
+    registeredBuffers[0] = registeredBuffers[1] = NULL;
+    registeredSizes[0] = registeredSizes[1] = 0;
+    registeredChannels[0] = registeredChannels[1] = PS_CHANNEL_INVALID;
+    registeredAveraging[0] = registeredAveraging[1] = false;
+    transferDownsampleRatio = 1;
+    slotHeld = false;
+    transferCancelled = false;
+    transferPowerChanged = false;
+    transferPowerState = PICO_OK;
+    streaming = false;
+    streamingNumSamples = 0;
+    streamingDelivered = 0;
+    streamingReadyCount = 0;
+    streamingReadyStart = 0;
+    streamingReadyOverflow = 0;
+    streamingAutoStopped = false;
+    streamingDeadline = 0;
+    segmentedMemory = false;
+    maxSegments = 0;
+#endif
 #if defined(PS3000A) || defined(PS4000A) || defined(PS5000A)
     numActualChannels = 0;
     initialPowerState = _initialPowerState;
@@ -221,6 +277,16 @@ CommonDtor(SCOPE_FAMILY_LT)()
     {
         CloseHandle(hCheckStatusThread);
     }
+#else
+    EndDataTransfer();
+    if (!callerOwnedSlots)
+    {
+        for (uint8_t slot = 0; slot < numTransferSlots; slot++)
+        {
+            _aligned_free( transferInputSlots[slot] );
+            _aligned_free( transferOutputSlots[slot] );
+        }
+    }
 #endif
 }
 
@@ -949,6 +1015,219 @@ bool CommonMethod(SCOPE_FAMILY_LT, DisableSignalGenerator)( void )
     return retVal;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Methods associated with signal generator sweeps
+//
+// Notes: SetSignalGeneratorSweep sets up the built-in generator to step through a range of
+//        frequencies, holding each for a dwell time, starting when the scope triggers.  With the
+//        channel triggers disabled, the scope triggers as soon as a block capture starts, so the
+//        capture starts the sweep, and holds the response at every frequency of the sweep at known
+//        offsets from its start.  Not relying on a channel trigger means no auto trigger delay, and
+//        no dependence on the stimulus crossing a level.  The sweep needs the scope's common
+//        segmented memory functions to read the capture back in one request, so is supported by
+//        the same families as rapid block capture.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(PS2000A) || defined(PS3000A) || defined(PS4000A) || defined(PS5000A) || defined(PS6000)
+#define SIGGEN_SWEEP_SUPPORTED
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method SignalGeneratorSweepSupported
+//
+// Purpose: Indicate whether the scope can run a triggered signal generator sweep
+//
+// Parameters: [out] return - true if SetSignalGeneratorSweep is supported
+//
+// Notes: The old driver model, and the PS4000 and PS5000 families, are not supported
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CommonMethod(SCOPE_FAMILY_LT, SignalGeneratorSweepSupported)( void )
+{
+#if defined(SIGGEN_SWEEP_SUPPORTED)
+    return true;
+#else
+    return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method SetSignalGeneratorSweep
+//
+// Purpose: Setup the signal generator to sweep a sine up through a range of frequencies once, when
+//          the scope triggers
+//
+// Parameters: [in] vPP - voltage peak-to-peak in volts
+//             [in] offset - offset in volts
+//             [in] startFrequency - first frequency of the sweep in Hz
+//             [in] stopFrequency - last frequency of the sweep in Hz
+//             [in] increment - frequency step in Hz
+//             [in] dwellTimeSec - time spent at each frequency in seconds
+//             [out] return - whether the function succeeded
+//
+// Notes: The generator switches frequency phase continuously.  Before the trigger it waits at the
+//        start of the sweep.  SetSignalGenerator returns it to a single untriggered frequency.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CommonMethod(SCOPE_FAMILY_LT, SetSignalGeneratorSweep)( double vPP, double offset, double startFrequency, double stopFrequency,
+                                                             double increment, double dwellTimeSec )
+{
+    wstringstream fraStatusText;
+#if defined(SIGGEN_SWEEP_SUPPORTED)
+    PICO_STATUS status;
+
+    LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, SetSigGenBuiltIn)), handle, (int32_t)(offset*1.0e6), (uint32_t)(vPP*1.0e6), CommonSine(SCOPE_FAMILY_UT),
+                                                                                         (float)startFrequency, (float)stopFrequency, (float)increment, (float)dwellTimeSec,
+                                                                                         CommonEnum(SCOPE_FAMILY_UT,UP), CommonEsOff(SCOPE_FAMILY_UT), 0, 1,
+                                                                                         CommonEnum(SCOPE_FAMILY_UT,SIGGEN_RISING), CommonEnum(SCOPE_FAMILY_UT,SIGGEN_SCOPE_TRIG), 0 );
+    if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, SetSigGenBuiltIn)( handle, (int32_t)(offset*1.0e6), (uint32_t)(vPP*1.0e6), CommonSine(SCOPE_FAMILY_UT),
+                                                                 (float)startFrequency, (float)stopFrequency, (float)increment, (float)dwellTimeSec,
+                                                                 CommonEnum(SCOPE_FAMILY_UT,UP), CommonEsOff(SCOPE_FAMILY_UT), 0, 1,
+                                                                 CommonEnum(SCOPE_FAMILY_UT,SIGGEN_RISING), CommonEnum(SCOPE_FAMILY_UT,SIGGEN_SCOPE_TRIG), 0 )))
+    {
+        fraStatusText << L"Fatal error: Failed to setup stimulus sweep: " << status;
+        LogMessage( fraStatusText.str() );
+        return false;
+    }
+
+    return true;
+#else
+    UNREFERENCED_PARAMETER(vPP);
+    UNREFERENCED_PARAMETER(offset);
+    UNREFERENCED_PARAMETER(startFrequency);
+    UNREFERENCED_PARAMETER(stopFrequency);
+    UNREFERENCED_PARAMETER(increment);
+    UNREFERENCED_PARAMETER(dwellTimeSec);
+    fraStatusText << L"Fatal error: Signal generator sweeps are not supported by this scope.";
+    LogMessage( fraStatusText.str() );
+    return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method GetMaxArbitraryWaveformSize
+//
+// Purpose: Gets the size of the arbitrary waveform generator's buffer
+//
+// Parameters: [out] return - the buffer size in samples; 0 if the scope has no arbitrary waveform
+//                            generator
+//
+// Notes: The newer drivers report it; for the others it's encoded in the scope object's
+//        implementation
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t CommonMethod(SCOPE_FAMILY_LT, GetMaxArbitraryWaveformSize)( void )
+{
+#if defined(PS2000A) || defined(PS3000A) || defined(PS4000A) || defined(PS5000A)
+    PICO_STATUS status;
+    wstringstream fraStatusText;
+    int16_t minArbitraryWaveformValue, maxArbitraryWaveformValue;
+    uint32_t minArbitraryWaveformSize, maxSize;
+
+    // Models with only a function generator fail this call
+    LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, SigGenArbitraryMinMaxValues)), handle, &minArbitraryWaveformValue, &maxArbitraryWaveformValue,
+                                                                                                   &minArbitraryWaveformSize, &maxSize );
+    if (PICO_OK != (status = CommonApi(SCOPE_FAMILY_LT, SigGenArbitraryMinMaxValues)( handle, &minArbitraryWaveformValue, &maxArbitraryWaveformValue,
+                                                                                       &minArbitraryWaveformSize, &maxSize )))
+    {
+        maxSize = 0;
+    }
+
+    return maxSize;
+#else
+    return maxArbitraryWaveformSize;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method SetArbitrarySignalGenerator
+//
+// Purpose: Setup the signal generator to repeat an arbitrary waveform
+//
+// Parameters: [in] waveform - one period of the waveform, full scale being -32767 to 32767
+//             [in] vPP - voltage peak-to-peak of full scale
+//             [in] offset - voltage offset
+//             [in/out] frequency - the requested waveform repeat frequency in Hz; returns the
+//                                  actual repeat frequency
+//             [out] return - whether the function succeeded
+//
+// Notes: The waveform size must not exceed GetMaxArbitraryWaveformSize.  The repeat frequency
+//        is set by the generator's phase accumulator step, so its precision is that of the
+//        built-in generator times the buffer size over the waveform size.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define PS4000_SINGLE SINGLE
+#define PS5000_SINGLE SINGLE
+
+bool CommonMethod(SCOPE_FAMILY_LT, SetArbitrarySignalGenerator)( vector<int16_t>& waveform, double vPP, double offset, double& frequency )
+{
+    PICO_STATUS status;
+    bool retVal = true;
+    wstringstream fraStatusText;
+    uint32_t bufferSize = GetMaxArbitraryWaveformSize();
+    double dacFrequency = signalGeneratorPrecision * (double)UINT32_MAX;
+    uint32_t deltaPhase;
+
+    if (0 == bufferSize || waveform.empty() || waveform.size() > bufferSize)
+    {
+        fraStatusText << L"Fatal error: Arbitrary waveform of " << waveform.size() << L" samples not supported";
+        LogMessage( fraStatusText.str() );
+        return false;
+    }
+
+    // Output frequency = dacFrequency * (deltaPhase / 2^32) * (bufferSize / waveform size)
+    deltaPhase = saturation_cast<uint32_t,double>(round( frequency * (double)waveform.size() * 4294967296.0 / (dacFrequency * (double)bufferSize) ));
+    deltaPhase = max( deltaPhase, (uint32_t)1 );
+    frequency = (double)deltaPhase * dacFrequency * (double)bufferSize / (4294967296.0 * (double)waveform.size());
+
+#if defined(PS2000)
+    // Samples are 8 bit unsigned
+    vector<uint8_t> waveform8( waveform.size() );
+    for (size_t i = 0; i < waveform.size(); i++)
+    {
+        waveform8[i] = (uint8_t)(((int32_t)waveform[i] + 32768) >> 8);
+    }
+    LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, SetSigGenArbitrary)), handle, (int32_t)(offset*1.0e6), (uint32_t)(vPP*1.0e6), deltaPhase, deltaPhase, 0, 0,
+                                                                                           waveform8.data(), (int32_t)waveform8.size(), (CommonEnum(SCOPE_FAMILY_UT,SWEEP_TYPE))0, 0 );
+    if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, SetSigGenArbitrary)( handle, (int32_t)(offset*1.0e6), (uint32_t)(vPP*1.0e6), deltaPhase, deltaPhase, 0, 0,
+                                                                   waveform8.data(), (int32_t)waveform8.size(), (CommonEnum(SCOPE_FAMILY_UT,SWEEP_TYPE))0, 0 )))
+#elif defined(PS3000)
+    // Not reached; these scopes have no arbitrary waveform generator, so bufferSize is 0
+    UNREFERENCED_PARAMETER(vPP);
+    UNREFERENCED_PARAMETER(offset);
+    status = 0;
+    if (0 == bufferSize)
+#else
+    LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, SetSigGenArbitrary)), handle, (int32_t)(offset*1.0e6), (uint32_t)(vPP*1.0e6), deltaPhase, deltaPhase, 0, 0,
+                                                                                           waveform.data(), (int32_t)waveform.size(), (CommonEnum(SCOPE_FAMILY_UT,SWEEP_TYPE))0,
+                                                                                           CommonEsOff(SCOPE_FAMILY_UT), CommonSingle(SCOPE_FAMILY_UT), 0, 0,
+                                                                                           (CommonEnum(SCOPE_FAMILY_UT,SIGGEN_TRIG_TYPE))0,
+                                                                                           (CommonEnum(SCOPE_FAMILY_UT,SIGGEN_TRIG_SOURCE))CommonSigGenNone(SCOPE_FAMILY_UT), 0 );
+    if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, SetSigGenArbitrary)( handle, (int32_t)(offset*1.0e6), (uint32_t)(vPP*1.0e6), deltaPhase, deltaPhase, 0, 0,
+                                                                   waveform.data(), (int32_t)waveform.size(), (CommonEnum(SCOPE_FAMILY_UT,SWEEP_TYPE))0,
+                                                                   CommonEsOff(SCOPE_FAMILY_UT), CommonSingle(SCOPE_FAMILY_UT), 0, 0,
+                                                                   (CommonEnum(SCOPE_FAMILY_UT,SIGGEN_TRIG_TYPE))0,
+                                                                   (CommonEnum(SCOPE_FAMILY_UT,SIGGEN_TRIG_SOURCE))CommonSigGenNone(SCOPE_FAMILY_UT), 0 )))
+#endif
+    {
+        fraStatusText << L"Fatal error: Failed to setup arbitrary stimulus signal: " << status;
+        LogMessage( fraStatusText.str() );
+        retVal = false;
+    }
+
+    return retVal;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //
 // Name: Common method GetMaxSamples
@@ -1069,6 +1348,17 @@ bool CommonMethod(SCOPE_FAMILY_LT, DisableChannelTriggers)( void )
     return retVal;
 }
 
+// Rapid block (segmented memory) capture is supported by the families with common segmented memory
+// functions.  The PS6000 sets the buffers of segments other than the first with SetDataBufferBulk.
+#if defined(PS2000A) || defined(PS3000A) || defined(PS4000A) || defined(PS5000A) || defined(PS6000)
+#define RAPID_BLOCK_SUPPORTED
+#endif
+#if defined(PS6000)
+#define SEGMENT_DATA_BUFFER_API SetDataBufferBulk
+#else
+#define SEGMENT_DATA_BUFFER_API SetDataBuffer
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //
 // Name: Common method RunBlock
@@ -1094,6 +1384,22 @@ bool CommonMethod(SCOPE_FAMILY_LT, RunBlock)( int32_t numSamples, uint32_t timeb
     bool retVal = true;
     wstringstream fraStatusText;
 
+    // A new capture replaces the data any transfer in progress is reading
+    EndDataTransfer();
+#if defined(NEW_PS_DRIVER_MODEL)
+    streaming = false;
+
+    // Back to a single capture after a rapid block capture
+    if (segmentedMemory)
+    {
+        uint32_t numSegments = 1;
+        if (!SetupSegments( numSegments, numSamples ))
+        {
+            return false;
+        }
+    }
+#endif
+
     // Setup block mode
 #if defined(NEW_PS_DRIVER_MODEL)
     LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, RunBlock)), handle, 0, numSamples, timebase, OVERSAMPLE_ARG timeIndisposedMs, 0,
@@ -1300,6 +1606,21 @@ void CommonMethod(SCOPE_FAMILY_LT, SetChannelDesignations)( PS_CHANNEL inputChan
 #define SEGMENT_ARG
 #endif
 
+// Hardware averaging of transferred data, for the families with an averaging ratio mode
+#if defined(PS2000A) || defined(PS3000A) || defined(PS4000A) || defined(PS5000A) || defined(PS6000)
+#define TRANSFER_AVERAGING_SUPPORTED
+#define TRANSFER_RATIO_MODE(averaging) ((averaging) ? CommonEnum(SCOPE_FAMILY_UT, RATIO_MODE_AVERAGE) : CommonEnum(SCOPE_FAMILY_UT, RATIO_MODE_NONE))
+#define TRANSFER_RATIO_MODE_ARG(averaging) , TRANSFER_RATIO_MODE(averaging)
+#else
+#define TRANSFER_RATIO_MODE(averaging) CommonEnum(SCOPE_FAMILY_UT, RATIO_MODE_NONE)
+#define TRANSFER_RATIO_MODE_ARG(averaging)
+#endif
+
+// Streaming is supported by the families with the common RunStreaming signature
+#if defined(PS2000A) || defined(PS3000A) || defined(PS4000A) || defined(PS5000A) || defined(PS6000)
+#define STREAMING_SUPPORTED
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //
 // Name: Common method GetData
@@ -1310,20 +1631,34 @@ void CommonMethod(SCOPE_FAMILY_LT, SetChannelDesignations)( PS_CHANNEL inputChan
 //             [in] startIndex - at what index to start retrieving
 //             [in] inputBuffer - buffer to store input samples
 //             [in] outputBuffer - buffer to store output samples
+//             [out] inputOv - whether the input channel is over-voltage (second form)
+//             [out] outputOv - whether the output channel is over-voltage (second form)
 //             [out] return - whether the function succeeded
 //
-// Notes:
+// Notes: The overflow flags let the caller do its peak/overvoltage detection on the transferred
+//        samples, instead of calling GetPeakValues, which for the new driver model is a transfer
+//        of its own.  For the new driver model they cover the samples retrieved; for the old, the
+//        whole capture.
 //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 // GetData
 bool CommonMethod(SCOPE_FAMILY_LT, GetData)( uint32_t numSamples, uint32_t startIndex,
                                              vector<int16_t>** inputBuffer, vector<int16_t>** outputBuffer )
+{
+    bool inputOv, outputOv;
+
+    return GetData( numSamples, startIndex, inputBuffer, outputBuffer, inputOv, outputOv );
+}
+
+bool CommonMethod(SCOPE_FAMILY_LT, GetData)( uint32_t numSamples, uint32_t startIndex,
+                                             vector<int16_t>** inputBuffer, vector<int16_t>** outputBuffer,
+                                             bool& inputOv, bool& outputOv )
 {
     PICO_STATUS status;
     bool retVal = true;
     wstringstream fraStatusText;
-    int16_t overflow;
+    int16_t overflow = 0;
 
     // First check for the programming error of not setting the channel designations
     if ( PS_CHANNEL_INVALID == mInputChannel ||
@@ -1334,42 +1669,7 @@ bool CommonMethod(SCOPE_FAMILY_LT, GetData)( uint32_t numSamples, uint32_t start
         return false;
     }
 #if defined(NEW_PS_DRIVER_MODEL)
-    uint32_t numSamplesInOut;
-
-    LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT,SetDataBuffer)), handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mInputChannel, mInputBuffer.data(),
-                                                                                     numSamples SEGMENT_ARG RATIO_MODE_NONE_ARG );
-    if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT,SetDataBuffer)( handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mInputChannel, mInputBuffer.data(),
-                                                             numSamples SEGMENT_ARG RATIO_MODE_NONE_ARG )))
-    {
-        fraStatusText.clear();
-        fraStatusText.str(L"");
-        fraStatusText << L"Fatal error: Failed to set input data capture buffer: " << status;
-        LogMessage( fraStatusText.str() );
-        retVal = false;
-    }
-
-    LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT,SetDataBuffer)), handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mOutputChannel, mOutputBuffer.data(),
-                                                                                     numSamples SEGMENT_ARG RATIO_MODE_NONE_ARG );
-    if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT,SetDataBuffer)( handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mOutputChannel, mOutputBuffer.data(),
-                                                                numSamples SEGMENT_ARG RATIO_MODE_NONE_ARG )))
-    {
-        fraStatusText.clear();
-        fraStatusText.str(L"");
-        fraStatusText << L"Fatal error: Failed to set output data capture buffer: " << status;
-        LogMessage( fraStatusText.str() );
-        retVal = false;
-    }
-
-    numSamplesInOut = numSamples;
-    LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, GetValues)), handle, startIndex, &numSamplesInOut, 1, CommonEnum(SCOPE_FAMILY_UT, RATIO_MODE_NONE), 0, &overflow );
-    if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, GetValues)( handle, startIndex, &numSamplesInOut, 1, CommonEnum(SCOPE_FAMILY_UT, RATIO_MODE_NONE), 0, &overflow )))
-    {
-        fraStatusText.clear();
-        fraStatusText.str(L"");
-        fraStatusText << L"Fatal error: Failed to retrieve data capture buffer(s): " << status;
-        LogMessage( fraStatusText.str() );
-        retVal = false;
-    }
+    retVal = TransferValues( numSamples, startIndex, mInputBuffer.data(), mOutputBuffer.data(), (uint32_t)mInputBuffer.size(), 1, overflow );
 #else // !defined(NEW_PS_DRIVER_MODEL)
     if (buffersDirty)
     {
@@ -1389,87 +1689,1263 @@ bool CommonMethod(SCOPE_FAMILY_LT, GetData)( uint32_t numSamples, uint32_t start
             LogMessage( fraStatusText.str() );
             retVal = false;
         }
+        else
+        {
+            lastOverflow = overflow;
+            buffersDirty = false;
+        }
     }
+    overflow = lastOverflow;
 #endif
     *inputBuffer = &mInputBuffer;
     *outputBuffer = &mOutputBuffer;
 
+    // Decode overflow
+    inputOv = ((overflow & 1<<mInputChannel) != 0);
+    outputOv = ((overflow & 1<<mOutputChannel) != 0);
+
     return retVal;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //
-// Name: Common method GetCompressedData
+// Name: Common method RegisterBuffers
 //
-// Purpose: Gets a compressed form of the data from the scope that was captured in block mode.
-//          The compressed form is an aggregation where a range of samples is provided as the min
-//          and max value in that range.
+// Purpose: Registers the buffers the driver writes the input and output channels' samples into
+//          (new driver model)
 //
-// Parameters: [in] downsampleTo - number of samples to store in a compressed aggregate buffer
-//                                 if 0, it means don't compress, just copy
-//             [in] inputCompressedMinBuffer - buffer to store aggregated min input samples
-//             [in] outputCompressedMinBuffer - buffer to store aggregated min ouput samples
-//             [in] inputCompressedMaxBuffer - buffer to store aggregated max input samples
-//             [in] outputCompressedMaxBuffer - buffer to store aggregated max ouput samples
+// Parameters: [in] inputBuffer - buffer for input samples
+//             [in] outputBuffer - buffer for output samples
+//             [in] bufferSize - size of the buffers
+//             [in] averaging - whether the driver averages the samples it writes
 //             [out] return - whether the function succeeded
 //
-// Notes: For old driver model, need to call GetData first for this to function correctly
+// Notes: A buffer is only registered when the buffer, its size, the channel or the ratio mode
+//        differs from what is already registered.  Used for both block mode transfers and
+//        streaming.
 //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// GetCompressedData
-bool CommonMethod(SCOPE_FAMILY_LT, GetCompressedData)( uint32_t downsampleTo,
-                                                       vector<int16_t>& inputCompressedMinBuffer, vector<int16_t>& outputCompressedMinBuffer,
-                                                       vector<int16_t>& inputCompressedMaxBuffer, vector<int16_t>& outputCompressedMaxBuffer )
+#if defined(NEW_PS_DRIVER_MODEL)
+bool CommonMethod(SCOPE_FAMILY_LT, RegisterBuffers)( int16_t* inputBuffer, int16_t* outputBuffer, uint32_t bufferSize, bool averaging )
 {
+    PICO_STATUS status;
     bool retVal = true;
     wstringstream fraStatusText;
-    uint32_t compressedBufferSize;
-    uint32_t initialAggregation;
 
-    // First check for the programming error of not setting the channel designations
-    if ( PS_CHANNEL_INVALID == mInputChannel ||
-         PS_CHANNEL_INVALID == mOutputChannel )
+    if (inputBuffer != registeredBuffers[0] || bufferSize != registeredSizes[0] || mInputChannel != registeredChannels[0] ||
+        averaging != registeredAveraging[0])
     {
-        fraStatusText << L"Fatal error: invalid internal state: input and/or output channel number invalid.";
-        LogMessage( fraStatusText.str() );
-        return false;
+        LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT,SetDataBuffer)), handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mInputChannel, inputBuffer,
+                                                                                         bufferSize SEGMENT_ARG TRANSFER_RATIO_MODE_ARG(averaging) );
+        if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT,SetDataBuffer)( handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mInputChannel, inputBuffer,
+                                                                 bufferSize SEGMENT_ARG TRANSFER_RATIO_MODE_ARG(averaging) )))
+        {
+            fraStatusText.clear();
+            fraStatusText.str(L"");
+            fraStatusText << L"Fatal error: Failed to set input data capture buffer: " << status;
+            LogTransferMessage( fraStatusText.str() );
+            registeredBuffers[0] = NULL;
+            retVal = false;
+        }
+        else
+        {
+            registeredBuffers[0] = inputBuffer;
+            registeredSizes[0] = bufferSize;
+            registeredChannels[0] = mInputChannel;
+            registeredAveraging[0] = averaging;
+        }
     }
 
-    // For NEW_PS_DRIVER_MODEL: Get the downsampled (compressed) buffer in one step by using the scope's aggregation function
-    // For non-NEW_PS_DRIVER_MODEL: We're calculating an aggregation parameter for our own manual aggregation 
-
-    // Determine the aggregation parameter, rounding up to ensure that the actual size of the compressed buffer is no more than requested
-    compressedBufferSize = (downsampleTo == 0 || mNumSamples <= downsampleTo) ? mNumSamples : downsampleTo;
-    initialAggregation = mNumSamples / compressedBufferSize;
-    if (mNumSamples % compressedBufferSize)
+    if (outputBuffer != registeredBuffers[1] || bufferSize != registeredSizes[1] || mOutputChannel != registeredChannels[1] ||
+        averaging != registeredAveraging[1])
     {
-        initialAggregation++;
+        LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT,SetDataBuffer)), handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mOutputChannel, outputBuffer,
+                                                                                         bufferSize SEGMENT_ARG TRANSFER_RATIO_MODE_ARG(averaging) );
+        if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT,SetDataBuffer)( handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mOutputChannel, outputBuffer,
+                                                                    bufferSize SEGMENT_ARG TRANSFER_RATIO_MODE_ARG(averaging) )))
+        {
+            fraStatusText.clear();
+            fraStatusText.str(L"");
+            fraStatusText << L"Fatal error: Failed to set output data capture buffer: " << status;
+            LogTransferMessage( fraStatusText.str() );
+            registeredBuffers[1] = NULL;
+            retVal = false;
+        }
+        else
+        {
+            registeredBuffers[1] = outputBuffer;
+            registeredSizes[1] = bufferSize;
+            registeredChannels[1] = mOutputChannel;
+            registeredAveraging[1] = averaging;
+        }
     }
-    // Now compute actual size of aggregate buffer
-    compressedBufferSize = mNumSamples / initialAggregation;
 
-    // And allocate the data for the compressed buffers
-    inputCompressedMinBuffer.resize(compressedBufferSize);
-    outputCompressedMinBuffer.resize(compressedBufferSize);
-    inputCompressedMaxBuffer.resize(compressedBufferSize);
-    outputCompressedMaxBuffer.resize(compressedBufferSize);
+    return retVal;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method TransferValues
+//
+// Purpose: Transfers a range of the block mode capture into the given buffers (new driver model)
+//
+// Parameters: [in] numSamples - number of samples to retrieve
+//             [in] startIndex - at what index to start retrieving
+//             [in] inputBuffer - buffer to store input samples
+//             [in] outputBuffer - buffer to store output samples
+//             [in] bufferSize - size of the buffers, which may be more than numSamples
+//             [in] downsampleRatio - if more than 1, the number of captured samples the driver
+//                                    averages into each sample retrieved
+//             [out] overflow - the driver's overflow flags
+//             [out] return - whether the function succeeded
+//
+// Notes: Shared by GetData and the pipelined transfer (TransferData).  The buffers are registered
+//        with the driver at their full size (see RegisterBuffers), so repeated transfers into the
+//        same buffers make just the GetValues call.  startIndex is in captured samples; numSamples
+//        is the number retrieved, after any averaging.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #if defined(NEW_PS_DRIVER_MODEL)
+bool CommonMethod(SCOPE_FAMILY_LT, TransferValues)( uint32_t numSamples, uint32_t startIndex,
+                                                    int16_t* inputBuffer, int16_t* outputBuffer, uint32_t bufferSize,
+                                                    uint32_t downsampleRatio, int16_t& overflow )
+{
     PICO_STATUS status;
+    bool retVal = true;
+    wstringstream fraStatusText;
     uint32_t numSamplesInOut;
-    int16_t overflow;
+    bool averaging = (downsampleRatio > 1);
 
-    LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, SetDataBuffers)), handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mInputChannel,
-                                                                                       inputCompressedMaxBuffer.data(), inputCompressedMinBuffer.data(), 
-                                                                                       compressedBufferSize SEGMENT_ARG RATIO_MODE_AGGREGATE_ARG );
-    if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, SetDataBuffers)( handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mInputChannel,
-                                                               inputCompressedMaxBuffer.data(), inputCompressedMinBuffer.data(), 
-                                                               compressedBufferSize SEGMENT_ARG RATIO_MODE_AGGREGATE_ARG )))
+    retVal = RegisterBuffers( inputBuffer, outputBuffer, bufferSize, averaging );
+
+    numSamplesInOut = numSamples;
+    LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, GetValues)), handle, startIndex, &numSamplesInOut, downsampleRatio, TRANSFER_RATIO_MODE(averaging), 0, &overflow );
+    if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, GetValues)( handle, startIndex, &numSamplesInOut, downsampleRatio, TRANSFER_RATIO_MODE(averaging), 0, &overflow )))
     {
         fraStatusText.clear();
         fraStatusText.str(L"");
-        fraStatusText << L"Fatal error: Failed to set input data capture aggregation buffers: " << status;
+        fraStatusText << L"Fatal error: Failed to retrieve data capture buffer(s): " << status;
+        LogTransferMessage( fraStatusText.str() );
+        retVal = false;
+    }
+
+    return retVal;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Methods associated with the pipelined data transfer
+//
+// Notes: StartDataTransfer, GetNextDataChunk and EndDataTransfer deliver a block mode capture in
+//        chunks.  For the new driver model a transfer thread fills one of two aligned slots while
+//        the caller processes the other, so that the transfer of chunk k+1 overlaps the processing
+//        of chunk k.  The old driver model can only transfer the whole capture at once, so there
+//        it is a single chunk, transferred synchronously into the GetData buffers.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method StartDataTransfer
+//
+// Purpose: Starts a chunked transfer of the block mode capture
+//
+// Parameters: [in] numSamples - number of captured samples to transfer, starting from index 0
+//             [in] downsampleRatio - number of captured samples the driver averages into each
+//                                    sample delivered; 1 for no averaging.  No more than
+//                                    GetMaxTransferDownsampleRatio.
+//             [out] return - whether the function succeeded
+//
+// Notes: numSamples / downsampleRatio samples are delivered; a partial group at the end is dropped.
+//        Chunks are sized by GetTransferChunkSize, limited to the size of the caller's buffers if
+//        it has set them with SetTransferBuffers.  Otherwise the buffers are allocated here, and
+//        kept for later transfers.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CommonMethod(SCOPE_FAMILY_LT, StartDataTransfer)( uint32_t numSamples, uint32_t downsampleRatio )
+{
+    wstringstream fraStatusText;
+
+    EndDataTransfer();
+
+    // First check for the programming error of not setting the channel designations
+    if ( PS_CHANNEL_INVALID == mInputChannel ||
+         PS_CHANNEL_INVALID == mOutputChannel )
+    {
+        fraStatusText << L"Fatal error: invalid internal state: input and/or output channel number invalid.";
+        LogMessage( fraStatusText.str() );
+        return false;
+    }
+
+    if (0 == downsampleRatio || downsampleRatio > GetMaxTransferDownsampleRatio())
+    {
+        fraStatusText << L"Fatal error: invalid data transfer downsampling ratio: " << downsampleRatio;
+        LogMessage( fraStatusText.str() );
+        return false;
+    }
+
+    numSamples /= downsampleRatio;
+    transferNumSamples = numSamples;
+    chunksConsumed = 0;
+
+#if defined(NEW_PS_DRIVER_MODEL)
+    transferDownsampleRatio = downsampleRatio;
+    transferChunkSize = GetTransferChunkSize( numSamples );
+
+    if (callerOwnedSlots)
+    {
+        transferChunkSize = min( transferChunkSize, transferSlotCapacity );
+        if (0 == transferChunkSize && numSamples)
+        {
+            fraStatusText << L"Fatal error: invalid internal state: data transfer buffers have no capacity.";
+            LogMessage( fraStatusText.str() );
+            return false;
+        }
+    }
+    else if (transferChunkSize > transferSlotCapacity)
+    {
+        bool allocated = true;
+        for (uint8_t slot = 0; slot < numTransferSlots; slot++)
+        {
+            _aligned_free( transferInputSlots[slot] );
+            _aligned_free( transferOutputSlots[slot] );
+            transferInputSlots[slot] = (int16_t*)_aligned_malloc( transferChunkSize * sizeof(int16_t), transferSlotAlignment );
+            transferOutputSlots[slot] = (int16_t*)_aligned_malloc( transferChunkSize * sizeof(int16_t), transferSlotAlignment );
+            allocated = allocated && (NULL != transferInputSlots[slot]) && (NULL != transferOutputSlots[slot]);
+        }
+        transferSlotCapacity = allocated ? transferChunkSize : 0;
+        if (!allocated)
+        {
+            fraStatusText << L"Fatal error: Failed to allocate data transfer buffers.";
+            LogMessage( fraStatusText.str() );
+            return false;
+        }
+    }
+
+    transferCancelled = false;
+    transferPowerChanged = false;
+    slotHeld = false;
+
+    if (NULL == (hSlotsFree = CreateSemaphore( NULL, numTransferSlots, numTransferSlots, NULL )) ||
+        NULL == (hSlotsFilled = CreateSemaphore( NULL, 0, numTransferSlots, NULL )) ||
+        NULL == (hTransferThread = CreateThread( NULL, 0, TransferData, this, CREATE_SUSPENDED, &transferThreadId )))
+    {
+        fraStatusText << L"Fatal error: Failed to start data transfer thread.";
+        LogMessage( fraStatusText.str() );
+        EndDataTransfer();
+        return false;
+    }
+    // Started once its ID is known, so its messages are deferred from the first (see LogTransferMessage)
+    ResumeThread( hTransferThread );
+#else
+    transferChunkSize = numSamples;
+#endif
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method GetMaxTransferDownsampleRatio
+//
+// Purpose: Gets the largest averaging ratio StartDataTransfer accepts
+//
+// Parameters: [out] return - the ratio; 1 if the scope can't average transferred data
+//
+// Notes: Averaging in the driver cuts the samples transferred by the ratio.  The old driver model,
+//        and the PS4000 and PS5000 families, have no averaging ratio mode.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t CommonMethod(SCOPE_FAMILY_LT, GetMaxTransferDownsampleRatio)( void )
+{
+#if defined(TRANSFER_AVERAGING_SUPPORTED)
+    return maxTransferDownsampleRatio;
+#else
+    return 1;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method GetTransferChunkSize
+//
+// Purpose: Gets the size of the chunks StartDataTransfer would use for a capture
+//
+// Parameters: [in] numSamples - number of samples delivered, after any averaging
+//             [out] return - chunk size in samples
+//
+// Notes: Chunks are sized so the capture takes about targetTransferChunks of them, but no smaller
+//        than minTransferChunkSize, where per-request overhead would dominate.  The old driver
+//        model transfers the capture as one chunk.  Callers size buffers for SetTransferBuffers
+//        with this.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t CommonMethod(SCOPE_FAMILY_LT, GetTransferChunkSize)( uint32_t numSamples )
+{
+#if defined(NEW_PS_DRIVER_MODEL)
+    uint32_t chunkSize = max( minTransferChunkSize, (numSamples + targetTransferChunks - 1) / targetTransferChunks );
+    return min( maxDataRequestSize, min( numSamples, chunkSize ) );
+#else
+    return numSamples;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method SetTransferBuffers
+//
+// Purpose: Gives the pipelined transfer caller-owned buffers to transfer into
+//
+// Parameters: [in] inputBuffers - numTransferBuffers input buffers, or NULL to go back to buffers
+//                                 allocated by the scope object
+//             [in] outputBuffers - numTransferBuffers output buffers
+//             [in] bufferSize - size of each buffer in samples
+//             [out] return - whether the function succeeded
+//
+// Notes: The driver writes directly into the buffers, which the caller may then process in place;
+//        aligning them to 64 bytes suits the DFT kernels.  The caller keeps them valid as long as
+//        it uses the transfer.  Registering the same buffers again costs nothing: the driver calls
+//        are made only when a buffer, its size or the channel changes (see TransferValues).  The old
+//        driver model transfers the whole capture into the scope object's own buffers, so ignores
+//        them.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CommonMethod(SCOPE_FAMILY_LT, SetTransferBuffers)( int16_t* inputBuffers[], int16_t* outputBuffers[], uint32_t bufferSize )
+{
+#if defined(NEW_PS_DRIVER_MODEL)
+    EndDataTransfer();
+
+    if (!callerOwnedSlots)
+    {
+        for (uint8_t slot = 0; slot < numTransferSlots; slot++)
+        {
+            _aligned_free( transferInputSlots[slot] );
+            _aligned_free( transferOutputSlots[slot] );
+        }
+    }
+
+    callerOwnedSlots = (NULL != inputBuffers);
+    for (uint8_t slot = 0; slot < numTransferSlots; slot++)
+    {
+        transferInputSlots[slot] = callerOwnedSlots ? inputBuffers[slot] : NULL;
+        transferOutputSlots[slot] = callerOwnedSlots ? outputBuffers[slot] : NULL;
+    }
+    transferSlotCapacity = callerOwnedSlots ? bufferSize : 0;
+#endif
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method GetNextDataChunk
+//
+// Purpose: Gets the next chunk of a transfer started with StartDataTransfer
+//
+// Parameters: [out] startIndex - index in the capture of the first sample of the chunk
+//             [out] numSamples - number of samples in the chunk; 0 when the transfer is complete
+//             [out] inputSamples - input samples of the chunk
+//             [out] outputSamples - output samples of the chunk
+//             [out] inputOv - whether the input channel is over-voltage in the chunk
+//             [out] outputOv - whether the output channel is over-voltage in the chunk
+//             [out] return - whether the function succeeded
+//
+// Notes: The sample pointers are valid until the next call to GetNextDataChunk or EndDataTransfer,
+//        which is when the chunk's slot is handed back to the transfer thread.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CommonMethod(SCOPE_FAMILY_LT, GetNextDataChunk)( uint32_t& startIndex, uint32_t& numSamples,
+                                                      int16_t** inputSamples, int16_t** outputSamples,
+                                                      bool& inputOv, bool& outputOv )
+{
+    startIndex = chunksConsumed * transferChunkSize;
+    numSamples = 0;
+    inputOv = outputOv = false;
+
+#if defined(NEW_PS_DRIVER_MODEL)
+    if (slotHeld)
+    {
+        ReleaseSemaphore( hSlotsFree, 1, NULL );
+        slotHeld = false;
+    }
+
+    if (startIndex >= transferNumSamples)
+    {
+        return true;
+    }
+    else if (NULL == hTransferThread)
+    {
+        return false;
+    }
+
+    uint8_t slot = chunksConsumed % numTransferSlots;
+    int16_t overflow;
+    WaitForSingleObject( hSlotsFilled, INFINITE );
+    slotHeld = true;
+    FlushTransferLog( slot );
+
+    if (!transferSucceeded[slot])
+    {
+        if (transferPowerChanged)
+        {
+            PICO_STATUS powerState = transferPowerState;
+            EndDataTransfer();
+            throw PicoPowerChange( powerState );
+        }
+        return false;
+    }
+
+    numSamples = min( transferChunkSize, transferNumSamples - startIndex );
+    *inputSamples = transferInputSlots[slot];
+    *outputSamples = transferOutputSlots[slot];
+    overflow = transferOverflow[slot];
+
+    // Decode overflow
+    inputOv = ((overflow & 1<<mInputChannel) != 0);
+    outputOv = ((overflow & 1<<mOutputChannel) != 0);
+#else
+    vector<int16_t>* inputBuffer;
+    vector<int16_t>* outputBuffer;
+
+    if (startIndex >= transferNumSamples)
+    {
+        return true;
+    }
+
+    if (!GetData( transferNumSamples, 0, &inputBuffer, &outputBuffer, inputOv, outputOv ))
+    {
+        return false;
+    }
+
+    numSamples = transferNumSamples;
+    *inputSamples = inputBuffer->data();
+    *outputSamples = outputBuffer->data();
+#endif
+
+    chunksConsumed++;
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method EndDataTransfer
+//
+// Purpose: Ends a transfer started with StartDataTransfer, whether or not all chunks were consumed
+//
+// Parameters: N/A
+//
+// Notes: Safe to call when no transfer is in progress
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CommonMethod(SCOPE_FAMILY_LT, EndDataTransfer)( void )
+{
+#if defined(NEW_PS_DRIVER_MODEL)
+    if (hTransferThread)
+    {
+        // Wake the thread if it is waiting for a free slot; it checks for cancellation after waiting
+        transferCancelled = true;
+        ReleaseSemaphore( hSlotsFree, 1, NULL );
+        WaitForSingleObject( hTransferThread, INFINITE );
+        CloseHandle( hTransferThread );
+        hTransferThread = NULL;
+
+        // Messages of chunks transferred but not consumed, in chunk order
+        for (uint8_t i = 0; i < numTransferSlots; i++)
+        {
+            FlushTransferLog( (chunksConsumed + i) % numTransferSlots );
+        }
+    }
+    if (hSlotsFree)
+    {
+        CloseHandle( hSlotsFree );
+        hSlotsFree = NULL;
+    }
+    if (hSlotsFilled)
+    {
+        CloseHandle( hSlotsFilled );
+        hSlotsFilled = NULL;
+    }
+    slotHeld = false;
+#endif
+    transferNumSamples = 0;
+    chunksConsumed = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method TransferData
+//
+// Purpose: Thread function of the pipelined transfer; fills the transfer slots in chunk order
+//
+// Parameters: [in] lpThreadParameter - parameter passed to the thread function.  Here it's a
+//                                      pointer to the object instance.
+//             [out] return - always 0
+//
+// Notes: A failure is recorded in the slot and ends the thread; GetNextDataChunk reports it, and
+//        re-throws a power change in the caller's thread.  Messages are kept with the slot, and
+//        logged by the caller's thread (see LogTransferMessage).
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(NEW_PS_DRIVER_MODEL)
+DWORD WINAPI CommonMethod(SCOPE_FAMILY_LT, TransferData)(LPVOID lpThreadParameter)
+{
+    CommonClass(SCOPE_FAMILY_LT)* inst = (CommonClass(SCOPE_FAMILY_LT)*)lpThreadParameter;
+    uint32_t chunk = 0;
+
+    for (uint32_t startIndex = 0; startIndex < inst->transferNumSamples; startIndex += inst->transferChunkSize, chunk++)
+    {
+        WaitForSingleObject( inst->hSlotsFree, INFINITE );
+        if (inst->transferCancelled)
+        {
+            break;
+        }
+
+        uint8_t slot = chunk % numTransferSlots;
+        uint32_t numSamples = min( inst->transferChunkSize, inst->transferNumSamples - startIndex );
+        bool succeeded;
+
+        inst->transferLog[slot].clear();
+        inst->transferLogSlot = slot;
+
+        try
+        {
+            succeeded = inst->TransferValues( numSamples, startIndex * inst->transferDownsampleRatio,
+                                              inst->transferInputSlots[slot], inst->transferOutputSlots[slot],
+                                              inst->transferSlotCapacity, inst->transferDownsampleRatio, inst->transferOverflow[slot] );
+        }
+        catch (const PicoPowerChange& ex)
+        {
+            inst->transferPowerChanged = true;
+            inst->transferPowerState = ex.GetState();
+            succeeded = false;
+        }
+
+        inst->transferSucceeded[slot] = succeeded;
+        ReleaseSemaphore( inst->hSlotsFilled, 1, NULL );
+
+        if (!succeeded)
+        {
+            break;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method LogTransferMessage
+//
+// Purpose: Logs a message from code the transfer thread shares with the caller's thread
+//
+// Parameters: [in] statusMessage - the message
+//             [in] type - the message's log category
+//
+// Notes: The log control can only take one writer at a time, and the caller's thread logs its own
+//        status during the transfer.  So on the transfer thread the message is kept with the slot
+//        being filled, and GetNextDataChunk or EndDataTransfer logs it from the caller's thread
+//        (see FlushTransferLog).  On any other thread it is logged straight away.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CommonMethod(SCOPE_FAMILY_LT, LogTransferMessage)( const wstring statusMessage, LOG_MESSAGE_FLAGS_T type )
+{
+#if defined(NEW_PS_DRIVER_MODEL)
+    if (NULL != hTransferThread && GetCurrentThreadId() == transferThreadId)
+    {
+        transferLog[transferLogSlot].push_back( make_pair( statusMessage, type ) );
+        return;
+    }
+#endif
+    LogMessage( statusMessage, type );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method FlushTransferLog
+//
+// Purpose: Logs the messages the transfer thread kept with a slot
+//
+// Parameters: [in] slot - the slot
+//
+// Notes: Called on the caller's thread once the slot is filled, or the transfer thread has ended
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(NEW_PS_DRIVER_MODEL)
+void CommonMethod(SCOPE_FAMILY_LT, FlushTransferLog)( uint8_t slot )
+{
+    for (size_t i = 0; i < transferLog[slot].size(); i++)
+    {
+        LogMessage( transferLog[slot][i].first, transferLog[slot][i].second );
+    }
+    transferLog[slot].clear();
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Methods associated with streaming capture
+//
+// Notes: RunStreaming starts a capture that GetNextStreamingChunk delivers while it's still in
+//        progress, so the caller can process each chunk as it arrives, and the capture length isn't
+//        limited by the scope's buffer.  The driver writes the samples into a ring at the front of
+//        the GetData buffers, in the GetStreamingLatestValues calls; a chunk is never split across
+//        the end of the ring, and stays valid until the next GetStreamingLatestValues call.
+//        Streaming is limited by the USB bandwidth, so callers should keep the sampling rate well
+//        below what block mode can do.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method StreamingSupported
+//
+// Purpose: Indicate whether the scope can capture with RunStreaming
+//
+// Parameters: [out] return - true if streaming capture is supported
+//
+// Notes: The old driver model, and the PS4000 and PS5000 families, are not supported
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CommonMethod(SCOPE_FAMILY_LT, StreamingSupported)( void )
+{
+#if defined(STREAMING_SUPPORTED)
+    return true;
+#else
+    return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method RunStreaming
+//
+// Purpose: Starts a sample capture on the scope using streaming mode
+//
+// Parameters: [in] numSamples - number of samples to capture
+//             [in] desiredSampFreqHz - the sampling frequency to request
+//             [in] downsampleRatio - number of captured samples the driver averages into each
+//                                    sample delivered; 1 for no averaging.  No more than
+//                                    GetMaxTransferDownsampleRatio.
+//             [out] actualSampFreqHz - the sampling frequency the driver chose, before averaging
+//             [out] return - whether the function succeeded
+//
+// Notes: numSamples / downsampleRatio samples are delivered.  The capture stops by itself once
+//        they have been captured, or early with CancelCapture.  The sample interval is requested in
+//        whole nanoseconds (microseconds for intervals too long for that), so the actual sampling
+//        frequency differs slightly from the desired one.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CommonMethod(SCOPE_FAMILY_LT, RunStreaming)( uint32_t numSamples, double desiredSampFreqHz, uint32_t downsampleRatio, double& actualSampFreqHz )
+{
+    wstringstream fraStatusText;
+#if defined(STREAMING_SUPPORTED)
+    PICO_STATUS status;
+    uint32_t ringSize;
+    uint32_t sampleInterval;
+    double sampleIntervalNs;
+    double timeUnitNs;
+    CommonEnum(SCOPE_FAMILY_UT, TIME_UNITS) timeUnits;
+    bool averaging = (downsampleRatio > 1);
+
+    EndDataTransfer();
+    streaming = false;
+
+    if (segmentedMemory)
+    {
+        uint32_t numSegments = 1;
+        if (!SetupSegments( numSegments, numSamples ))
+        {
+            return false;
+        }
+    }
+
+    // First check for the programming error of not setting the channel designations
+    if ( PS_CHANNEL_INVALID == mInputChannel ||
+         PS_CHANNEL_INVALID == mOutputChannel )
+    {
+        fraStatusText << L"Fatal error: invalid internal state: input and/or output channel number invalid.";
+        LogMessage( fraStatusText.str() );
+        return false;
+    }
+
+    if (0 == downsampleRatio || downsampleRatio > GetMaxTransferDownsampleRatio() || desiredSampFreqHz <= 0.0)
+    {
+        fraStatusText << L"Fatal error: invalid streaming parameters: sampling frequency " << desiredSampFreqHz
+                      << L" Hz, downsampling ratio " << downsampleRatio;
+        LogMessage( fraStatusText.str() );
+        return false;
+    }
+
+    ringSize = min( maxStreamingRingSize, (uint32_t)mInputBuffer.size() );
+    if (!RegisterBuffers( mInputBuffer.data(), mOutputBuffer.data(), ringSize, averaging ))
+    {
+        return false;
+    }
+
+    sampleIntervalNs = 1.0e9 / desiredSampFreqHz;
+    if (sampleIntervalNs < (double)UINT32_MAX)
+    {
+        timeUnits = CommonEnum(SCOPE_FAMILY_UT, NS);
+        timeUnitNs = 1.0;
+    }
+    else
+    {
+        timeUnits = CommonEnum(SCOPE_FAMILY_UT, US);
+        timeUnitNs = 1.0e3;
+    }
+    sampleInterval = (uint32_t)max( 1.0, min( floor( sampleIntervalNs / timeUnitNs + 0.5 ), (double)UINT32_MAX ) );
+
+    streamingNumSamples = numSamples / downsampleRatio;
+    numSamples = streamingNumSamples * downsampleRatio;
+
+    LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, RunStreaming)), handle, &sampleInterval, timeUnits, 0, numSamples, 1,
+                                                                                     downsampleRatio, TRANSFER_RATIO_MODE(averaging), ringSize );
+    if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, RunStreaming)( handle, &sampleInterval, timeUnits, 0, numSamples, 1,
+                                                             downsampleRatio, TRANSFER_RATIO_MODE(averaging), ringSize )))
+    {
+        fraStatusText << L"Fatal error: Failed to start streaming channel data capture: " << status;
+        LogMessage( fraStatusText.str() );
+        return false;
+    }
+
+    actualSampFreqHz = 1.0e9 / ((double)sampleInterval * timeUnitNs);
+
+    // Allow for a safety factor of 1.5x, and never less than 3 seconds, like block mode captures
+    streamingDeadline = GetTickCount64() + (ULONGLONG)max( 3000.0, 1500.0 * (double)numSamples / actualSampFreqHz );
+    streamingDelivered = 0;
+    streamingAutoStopped = false;
+    streaming = true;
+
+    // The samples will be in the GetData buffers
+    mNumSamples = 0;
+    buffersDirty = true;
+
+    return true;
+#else
+    fraStatusText << L"Fatal error: Streaming capture is not supported by this scope.";
+    LogMessage( fraStatusText.str() );
+    return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method GetNextStreamingChunk
+//
+// Purpose: Gets the next chunk of a capture started with RunStreaming
+//
+// Parameters: [out] startIndex - index in the capture of the first sample of the chunk
+//             [out] numSamples - number of samples in the chunk; 0 if none arrived in the poll
+//                                interval
+//             [out] inputSamples - input samples of the chunk
+//             [out] outputSamples - output samples of the chunk
+//             [out] inputOv - whether the input channel is over-voltage in the chunk
+//             [out] outputOv - whether the output channel is over-voltage in the chunk
+//             [out] complete - whether all the samples have been delivered
+//             [out] return - whether the function succeeded
+//
+// Notes: Returns at least every streamingPollIntervalMs, so the caller can check for
+//        cancellation.  The sample pointers are valid until the next call.  Fails if the capture
+//        ends short or doesn't complete in time.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CommonMethod(SCOPE_FAMILY_LT, GetNextStreamingChunk)( uint32_t& startIndex, uint32_t& numSamples,
+                                                           int16_t** inputSamples, int16_t** outputSamples,
+                                                           bool& inputOv, bool& outputOv, bool& complete )
+{
+    wstringstream fraStatusText;
+
+    numSamples = 0;
+    inputOv = outputOv = false;
+    complete = false;
+
+#if defined(STREAMING_SUPPORTED)
+    PICO_STATUS status;
+
+    startIndex = streamingDelivered;
+
+    if (streamingDelivered >= streamingNumSamples)
+    {
+        complete = true;
+        return true;
+    }
+    else if (!streaming)
+    {
+        fraStatusText << L"Fatal error: invalid internal state: no streaming capture in progress.";
+        LogMessage( fraStatusText.str() );
+        return false;
+    }
+
+    streamingReadyCount = 0;
+
+    LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, GetStreamingLatestValues)), handle,
+                                                                                                 (CommonStreamingReadyCB(SCOPE_FAMILY_LT))StreamingReady, this );
+    if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, GetStreamingLatestValues)( handle, (CommonStreamingReadyCB(SCOPE_FAMILY_LT))StreamingReady, this )) &&
+        PICO_BUSY != status)
+    {
+        fraStatusText << L"Fatal error: Failed to retrieve streaming data: " << status;
+        LogMessage( fraStatusText.str() );
+        CancelCapture();
+        return false;
+    }
+
+    if (streamingReadyCount)
+    {
+        numSamples = min( streamingReadyCount, streamingNumSamples - streamingDelivered );
+        *inputSamples = mInputBuffer.data() + streamingReadyStart;
+        *outputSamples = mOutputBuffer.data() + streamingReadyStart;
+
+        // Decode overflow
+        inputOv = ((streamingReadyOverflow & 1<<mInputChannel) != 0);
+        outputOv = ((streamingReadyOverflow & 1<<mOutputChannel) != 0);
+
+        streamingDelivered += numSamples;
+        if (streamingDelivered >= streamingNumSamples)
+        {
+            complete = true;
+            CancelCapture();
+        }
+    }
+    else if (streamingAutoStopped)
+    {
+        fraStatusText << L"Fatal error: Streaming capture ended after " << streamingDelivered << L" of " << streamingNumSamples << L" samples.";
+        LogMessage( fraStatusText.str() );
+        streaming = false;
+        return false;
+    }
+    else if (GetTickCount64() > streamingDeadline)
+    {
+        fraStatusText << L"Fatal error: Streaming capture timed out after " << streamingDelivered << L" of " << streamingNumSamples << L" samples.";
+        LogMessage( fraStatusText.str() );
+        CancelCapture();
+        return false;
+    }
+    else
+    {
+        Sleep( streamingPollIntervalMs );
+    }
+
+    return true;
+#else
+    startIndex = 0;
+    fraStatusText << L"Fatal error: Streaming capture is not supported by this scope.";
+    LogMessage( fraStatusText.str() );
+    return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method StreamingReady
+//
+// Purpose: Callback from GetStreamingLatestValues, recording where the new samples are
+//
+// Parameters: See the driver's StreamingReady callback type
+//
+// Notes: Called in the thread calling GetStreamingLatestValues.  The count is declared signed to
+//        keep the header family independent; for the PS6000 it is unsigned, and the same size.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(NEW_PS_DRIVER_MODEL)
+void __stdcall CommonMethod(SCOPE_FAMILY_LT, StreamingReady)( int16_t _handle, int32_t noOfSamples, uint32_t startIndex, int16_t overflow,
+                                                             uint32_t triggerAt, int16_t triggered, int16_t autoStop, void* pParameter )
+{
+    CommonClass(SCOPE_FAMILY_LT)* inst = (CommonClass(SCOPE_FAMILY_LT)*)pParameter;
+
+    inst->streamingReadyCount = (uint32_t)noOfSamples;
+    inst->streamingReadyStart = startIndex;
+    inst->streamingReadyOverflow = overflow;
+    inst->streamingAutoStopped = (0 != autoStop);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Methods associated with rapid block capture
+//
+// Notes: RunRapidBlock divides the scope's memory into segments and captures one block into each
+//        of them on a single arm, and GetSegmentData transfers them all with one GetValuesBulk
+//        call, saving the per capture round trips of repeated RunBlock and GetData calls.  The
+//        segments land one after another in the GetData buffers.  RunBlock and RunStreaming
+//        return the memory to a single segment.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method GetMaxSegments
+//
+// Purpose: Gets the largest number of segments RunRapidBlock and GetSegmentData can handle
+//
+// Parameters: [in] numSamples - number of samples per segment
+//             [out] return - the number of segments; 1 if rapid block capture isn't supported
+//
+// Notes: Limited by the scope's maximum number of segments and the size of the GetData buffers.
+//        The scope's memory may hold fewer segments of numSamples; RunRapidBlock adjusts for that.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t CommonMethod(SCOPE_FAMILY_LT, GetMaxSegments)( uint32_t numSamples )
+{
+#if defined(RAPID_BLOCK_SUPPORTED)
+    PICO_STATUS status;
+    wstringstream fraStatusText;
+
+    if (0 == maxSegments)
+    {
+        LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, GetMaxSegments)), handle, &maxSegments );
+        if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, GetMaxSegments)( handle, &maxSegments )) || 0 == maxSegments)
+        {
+            maxSegments = 1;
+        }
+    }
+
+    return max( (uint32_t)1, min( maxSegments, (uint32_t)mInputBuffer.size() / max( numSamples, (uint32_t)1 ) ) );
+#else
+    return 1;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method RunRapidBlock
+//
+// Purpose: Starts a sample capture on the scope using rapid block mode
+//
+// Parameters: [in] numSamples - number of samples to capture in each segment
+//             [in] timebase - sampling timebase for the scope
+//             [in/out] numSegments - number of segments to capture; reduced if the scope's memory
+//                                    or GetMaxSegments can't hold that many
+//             [out] timeIndisposedMs - estimated time it will take to capture the block of data
+//                                      in milliseconds
+//             [in] lpReady - pointer to the callback function to be called when all the segments
+//                            have been captured
+//             [in] pParameter - parameter to be based to the callback function
+//             [out] return - whether the function succeeded
+//
+// Notes:
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CommonMethod(SCOPE_FAMILY_LT, RunRapidBlock)( int32_t numSamples, uint32_t timebase, uint32_t& numSegments,
+                                                   int32_t *timeIndisposedMs, psBlockReady lpReady, void *pParameter )
+{
+    wstringstream fraStatusText;
+#if defined(RAPID_BLOCK_SUPPORTED)
+    PICO_STATUS status;
+
+    EndDataTransfer();
+    streaming = false;
+
+    numSegments = min( numSegments, GetMaxSegments( numSamples ) );
+    if (!SetupSegments( numSegments, numSamples ))
+    {
+        return false;
+    }
+
+    LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, RunBlock)), handle, 0, numSamples, timebase, OVERSAMPLE_ARG timeIndisposedMs, 0,
+                                                                                 (CommonReadyCB(SCOPE_FAMILY_LT))lpReady, pParameter );
+    if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, RunBlock)( handle, 0, numSamples, timebase, OVERSAMPLE_ARG timeIndisposedMs, 0,
+                                                         (CommonReadyCB(SCOPE_FAMILY_LT))lpReady, pParameter)))
+    {
+        fraStatusText << L"Fatal error: Failed to start rapid block channel data capture: " << status;
+        LogMessage( fraStatusText.str() );
+        return false;
+    }
+
+    mNumSamples = numSamples;
+    buffersDirty = true;
+
+    return true;
+#else
+    fraStatusText << L"Fatal error: Rapid block capture is not supported by this scope.";
+    LogMessage( fraStatusText.str() );
+    return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method SetupSegments
+//
+// Purpose: Divides the scope's memory into segments, and sets the number of captures to match
+//
+// Parameters: [in/out] numSegments - number of segments; reduced until each can hold numSamples
+//             [in] numSamples - number of samples per segment
+//             [out] return - whether the function succeeded
+//
+// Notes: The memory's overhead per segment isn't published, so the segments' capacity is only
+//        known from MemorySegments.  Clears the registered buffer cache, so a capture abandoned
+//        before its segments were read doesn't leave TransferValues trusting stale registrations.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(NEW_PS_DRIVER_MODEL)
+bool CommonMethod(SCOPE_FAMILY_LT, SetupSegments)( uint32_t& numSegments, uint32_t numSamples )
+{
+#if defined(RAPID_BLOCK_SUPPORTED)
+    PICO_STATUS status;
+    wstringstream fraStatusText;
+#if defined(PS6000)
+    uint32_t maxSegmentSamples;
+#else
+    int32_t maxSegmentSamples;
+#endif
+
+    for (;;)
+    {
+        LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, MemorySegments)), handle, numSegments, &maxSegmentSamples );
+        if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, MemorySegments)( handle, numSegments, &maxSegmentSamples )))
+        {
+            fraStatusText << L"Fatal error: Failed to set up capture memory segments: " << status;
+            LogMessage( fraStatusText.str() );
+            return false;
+        }
+        if ((uint32_t)maxSegmentSamples >= numSamples || 1 == numSegments)
+        {
+            break;
+        }
+        numSegments = max( (uint32_t)1, min( numSegments - 1, (uint32_t)(((uint64_t)numSegments * (uint32_t)maxSegmentSamples) / numSamples) ) );
+    }
+
+    // Repartitioning the memory drops the buffers registered with the driver
+    registeredBuffers[0] = registeredBuffers[1] = NULL;
+
+    LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, SetNoOfCaptures)), handle, numSegments );
+    if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, SetNoOfCaptures)( handle, numSegments )))
+    {
+        fraStatusText << L"Fatal error: Failed to set the number of captures: " << status;
+        LogMessage( fraStatusText.str() );
+        return false;
+    }
+
+    segmentedMemory = (numSegments > 1);
+
+    return true;
+#else
+    return false;
+#endif
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method GetSegmentData
+//
+// Purpose: Gets the data from all the segments captured with RunRapidBlock
+//
+// Parameters: [in] numSamples - number of samples captured per segment
+//             [in] numSegments - number of segments captured
+//             [in] downsampleRatio - number of captured samples the driver averages into each
+//                                    sample retrieved; 1 for no averaging.  No more than
+//                                    GetMaxTransferDownsampleRatio.
+//             [out] inputSamples - input samples; numSamples / downsampleRatio per segment, one
+//                                  segment after another
+//             [out] outputSamples - output samples, arranged likewise
+//             [out] inputOv - whether the input channel is over-voltage, per segment
+//             [out] outputOv - whether the output channel is over-voltage, per segment
+//             [out] return - whether the function succeeded
+//
+// Notes: The sample pointers are valid until the next capture or transfer
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CommonMethod(SCOPE_FAMILY_LT, GetSegmentData)( uint32_t numSamples, uint32_t numSegments, uint32_t downsampleRatio,
+                                                    int16_t** inputSamples, int16_t** outputSamples,
+                                                    vector<bool>& inputOv, vector<bool>& outputOv )
+{
+    wstringstream fraStatusText;
+#if defined(RAPID_BLOCK_SUPPORTED)
+    PICO_STATUS status;
+    bool averaging = (downsampleRatio > 1);
+    uint32_t segmentSize;
+    uint32_t numSamplesInOut;
+    vector<int16_t> overflow( numSegments, 0 );
+
+    // First check for the programming error of not setting the channel designations
+    if ( PS_CHANNEL_INVALID == mInputChannel ||
+         PS_CHANNEL_INVALID == mOutputChannel )
+    {
+        fraStatusText << L"Fatal error: invalid internal state: input and/or output channel number invalid.";
+        LogMessage( fraStatusText.str() );
+        return false;
+    }
+
+    if (0 == numSegments || 0 == downsampleRatio || downsampleRatio > GetMaxTransferDownsampleRatio() ||
+        (uint64_t)(numSamples / downsampleRatio) * numSegments > mInputBuffer.size())
+    {
+        fraStatusText << L"Fatal error: invalid segmented data request: " << numSegments << L" segments of " << numSamples
+                      << L" samples, downsampling ratio " << downsampleRatio;
+        LogMessage( fraStatusText.str() );
+        return false;
+    }
+
+    segmentSize = numSamples / downsampleRatio;
+
+    // The segments' buffers replace what is registered for GetValues
+    registeredBuffers[0] = registeredBuffers[1] = NULL;
+
+    for (uint32_t segment = 0; segment < numSegments; segment++)
+    {
+        int16_t* inputBuffer = mInputBuffer.data() + (size_t)segment * segmentSize;
+        int16_t* outputBuffer = mOutputBuffer.data() + (size_t)segment * segmentSize;
+
+        LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, SEGMENT_DATA_BUFFER_API)), handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mInputChannel, inputBuffer,
+                                                                                                    segmentSize, segment, TRANSFER_RATIO_MODE(averaging) );
+        if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, SEGMENT_DATA_BUFFER_API)( handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mInputChannel, inputBuffer,
+                                                                            segmentSize, segment, TRANSFER_RATIO_MODE(averaging) )))
+        {
+            fraStatusText.clear();
+            fraStatusText.str(L"");
+            fraStatusText << L"Fatal error: Failed to set input segment data capture buffer: " << status;
+            LogMessage( fraStatusText.str() );
+            return false;
+        }
+
+        LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, SEGMENT_DATA_BUFFER_API)), handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mOutputChannel, outputBuffer,
+                                                                                                    segmentSize, segment, TRANSFER_RATIO_MODE(averaging) );
+        if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, SEGMENT_DATA_BUFFER_API)( handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mOutputChannel, outputBuffer,
+                                                                            segmentSize, segment, TRANSFER_RATIO_MODE(averaging) )))
+        {
+            fraStatusText.clear();
+            fraStatusText.str(L"");
+            fraStatusText << L"Fatal error: Failed to set output segment data capture buffer: " << status;
+            LogMessage( fraStatusText.str() );
+            return false;
+        }
+    }
+
+    numSamplesInOut = segmentSize;
+    LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, GetValuesBulk)), handle, &numSamplesInOut, 0, numSegments - 1,
+                                                                                      downsampleRatio, TRANSFER_RATIO_MODE(averaging), overflow.data() );
+    if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, GetValuesBulk)( handle, &numSamplesInOut, 0, numSegments - 1,
+                                                              downsampleRatio, TRANSFER_RATIO_MODE(averaging), overflow.data() )))
+    {
+        fraStatusText.clear();
+        fraStatusText.str(L"");
+        fraStatusText << L"Fatal error: Failed to retrieve segmented data capture buffers: " << status;
+        LogMessage( fraStatusText.str() );
+        return false;
+    }
+
+    *inputSamples = mInputBuffer.data();
+    *outputSamples = mOutputBuffer.data();
+
+    // Decode overflow
+    inputOv.resize( numSegments );
+    outputOv.resize( numSegments );
+    for (uint32_t segment = 0; segment < numSegments; segment++)
+    {
+        inputOv[segment] = ((overflow[segment] & 1<<mInputChannel) != 0);
+        outputOv[segment] = ((overflow[segment] & 1<<mOutputChannel) != 0);
+    }
+
+    // The GetData buffers no longer hold a block mode capture
+    buffersDirty = true;
+
+    return true;
+#else
+    fraStatusText << L"Fatal error: Rapid block capture is not supported by this scope.";
+    LogMessage( fraStatusText.str() );
+    return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method GetCompressedData
+//
+// Purpose: Gets a compressed form of the data from the scope that was captured in block mode.
+//          The compressed form is an aggregation where a range of samples is provided as the min
+//          and max value in that range.
+//
+// Parameters: [in] downsampleTo - number of samples to store in a compressed aggregate buffer
+//                                 if 0, it means don't compress, just copy
+//             [in] inputCompressedMinBuffer - buffer to store aggregated min input samples
+//             [in] outputCompressedMinBuffer - buffer to store aggregated min ouput samples
+//             [in] inputCompressedMaxBuffer - buffer to store aggregated max input samples
+//             [in] outputCompressedMaxBuffer - buffer to store aggregated max ouput samples
+//             [out] return - whether the function succeeded
+//
+// Notes: For old driver model, need to call GetData first for this to function correctly
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// GetCompressedData
+bool CommonMethod(SCOPE_FAMILY_LT, GetCompressedData)( uint32_t downsampleTo,
+                                                       vector<int16_t>& inputCompressedMinBuffer, vector<int16_t>& outputCompressedMinBuffer,
+                                                       vector<int16_t>& inputCompressedMaxBuffer, vector<int16_t>& outputCompressedMaxBuffer )
+{
+    bool retVal = true;
+    wstringstream fraStatusText;
+    uint32_t compressedBufferSize;
+    uint32_t initialAggregation;
+
+    // First check for the programming error of not setting the channel designations
+    if ( PS_CHANNEL_INVALID == mInputChannel ||
+         PS_CHANNEL_INVALID == mOutputChannel )
+    {
+        fraStatusText << L"Fatal error: invalid internal state: input and/or output channel number invalid.";
+        LogMessage( fraStatusText.str() );
+        return false;
+    }
+
+    // For NEW_PS_DRIVER_MODEL: Get the downsampled (compressed) buffer in one step by using the scope's aggregation function
+    // For non-NEW_PS_DRIVER_MODEL: We're calculating an aggregation parameter for our own manual aggregation 
+
+    // Determine the aggregation parameter, rounding up to ensure that the actual size of the compressed buffer is no more than requested
+    compressedBufferSize = (downsampleTo == 0 || mNumSamples <= downsampleTo) ? mNumSamples : downsampleTo;
+    initialAggregation = mNumSamples / compressedBufferSize;
+    if (mNumSamples % compressedBufferSize)
+    {
+        initialAggregation++;
+    }
+    // Now compute actual size of aggregate buffer
+    compressedBufferSize = mNumSamples / initialAggregation;
+
+    // And allocate the data for the compressed buffers
+    inputCompressedMinBuffer.resize(compressedBufferSize);
+    outputCompressedMinBuffer.resize(compressedBufferSize);
+    inputCompressedMaxBuffer.resize(compressedBufferSize);
+    outputCompressedMaxBuffer.resize(compressedBufferSize);
+
+#if defined(NEW_PS_DRIVER_MODEL)
+    PICO_STATUS status;
+    uint32_t numSamplesInOut;
+
+    // The aggregation buffers replace the channels' registrations made by TransferValues
+    registeredBuffers[0] = registeredBuffers[1] = NULL;
+    int16_t overflow;
+
+    LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, SetDataBuffers)), handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mInputChannel,
+                                                                                       inputCompressedMaxBuffer.data(), inputCompressedMinBuffer.data(), 
+                                                                                       compressedBufferSize SEGMENT_ARG RATIO_MODE_AGGREGATE_ARG );
+    if (PICO_ERROR(CommonApi(SCOPE_FAMILY_LT, SetDataBuffers)( handle, (CommonEnum(SCOPE_FAMILY_UT,CHANNEL))mInputChannel,
+                                                               inputCompressedMaxBuffer.data(), inputCompressedMinBuffer.data(), 
+                                                               compressedBufferSize SEGMENT_ARG RATIO_MODE_AGGREGATE_ARG )))
+    {
+        fraStatusText.clear();
+        fraStatusText.str(L"");
+        fraStatusText << L"Fatal error: Failed to set input data capture aggregation buffers: " << status;
         LogMessage( fraStatusText.str() );
         retVal = false;
     }
@@ -1568,6 +3044,9 @@ bool CommonMethod(SCOPE_FAMILY_LT, GetPeakValues)( uint16_t& inputPeak, uint16_t
 
 #define WORKAROUND_AGGREGATION_BUG
 #if defined(NEW_PS_DRIVER_MODEL)
+    // The aggregation buffers replace the channels' registrations made by TransferValues
+    registeredBuffers[0] = registeredBuffers[1] = NULL;
+
     // This is a workaround for the issue described in Picotech support ID SUPPORT-7588
     // Aggregating down to a single sample causes issues for some drivers.  Instead, this aggregates down to no
     // more than 512 samples.  Once it has the samples, it searches for the min/max among them
@@ -1684,6 +3163,7 @@ bool CommonMethod(SCOPE_FAMILY_LT, GetPeakValues)( uint16_t& inputPeak, uint16_t
     }
     else
     {
+        lastOverflow = overflow;
         buffersDirty = false;
     }
 
@@ -1702,6 +3182,29 @@ bool CommonMethod(SCOPE_FAMILY_LT, GetPeakValues)( uint16_t& inputPeak, uint16_t
     return retVal;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name: Common method GetPeakValuesTransfersData
+//
+// Purpose: Indicates whether GetPeakValues transfers the whole capture
+//
+// Parameters: [out] return - true if GetPeakValues transfers the whole capture
+//
+// Notes: For the new driver model, GetPeakValues uses the driver's aggregation, a transfer much
+//        smaller than the capture.  For the old driver model, it is the full transfer which GetData
+//        would otherwise make, so there is nothing to save by calling it before GetData.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CommonMethod(SCOPE_FAMILY_LT, GetPeakValuesTransfersData)( void )
+{
+#if defined(NEW_PS_DRIVER_MODEL)
+    return false;
+#else
+    return true;
+#endif
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //
 // Name: Common method ChangePower
@@ -1752,6 +3255,9 @@ bool CommonMethod(SCOPE_FAMILY_LT, CancelCapture)(void)
         Sleep(100);
     }
 #endif;
+#if defined(NEW_PS_DRIVER_MODEL)
+    streaming = false;
+#endif
     LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, Stop)), handle );
     status = CommonApi(SCOPE_FAMILY_LT, Stop)( handle );
     return !(PICO_ERROR(status));
@@ -1773,6 +3279,7 @@ bool CommonMethod(SCOPE_FAMILY_LT, Close)(void)
 {
     PICO_STATUS status;
     wstringstream fraStatusText;
+    EndDataTransfer();
     LOG_PICO_API_CALL( BOOST_PP_STRINGIZE(CommonApi(SCOPE_FAMILY_LT, CloseUnit)), handle );
     status = CommonApi(SCOPE_FAMILY_LT, CloseUnit)( handle );
     handle = -1;
@@ -1829,7 +3336,7 @@ void CommonMethod(SCOPE_FAMILY_LT, LogPicoApiCall)(wstringstream& fraStatusText)
     }
 
     fraStatusText << L" );";
-    LogMessage( fraStatusText.str(), PICO_API_CALL );
+    LogTransferMessage( fraStatusText.str(), PICO_API_CALL );
 }
 
 template <typename First, typename... Rest> void CommonMethod(SCOPE_FAMILY_LT, LogPicoApiCall)( wstringstream& fraStatusText, First first, Rest... rest)
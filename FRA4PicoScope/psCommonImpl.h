@@ -53,6 +53,10 @@ bool DisableAllDigitalChannels( void );
 bool DisableChannel( PS_CHANNEL channel );
 bool SetSignalGenerator( double vPP, double offset, double frequency );
 bool DisableSignalGenerator( void );
+bool SignalGeneratorSweepSupported( void );
+bool SetSignalGeneratorSweep( double vPP, double offset, double startFrequency, double stopFrequency, double increment, double dwellTimeSec );
+uint32_t GetMaxArbitraryWaveformSize( void );
+bool SetArbitrarySignalGenerator( vector<int16_t>& waveform, double vPP, double offset, double& frequency );
 bool DisableChannelTriggers( void );
 bool GetMaxSamples( uint32_t* maxSamples );
 bool GetTimebase( double desiredFrequency, double* actualFrequency, uint32_t* timebase );
@@ -60,10 +64,28 @@ bool GetFrequencyFromTimebase( uint32_t timebase, double &frequency );
 bool RunBlock( int32_t numSamples, uint32_t timebase, int32_t *timeIndisposedMs, psBlockReady lpReady, void *pParameter );
 void SetChannelDesignations( PS_CHANNEL inputChannel, PS_CHANNEL outputChannel );
 bool GetData( uint32_t numSamples, uint32_t startIndex, vector<int16_t>** inputBuffer, vector<int16_t>** outputBuffer );
+bool GetData( uint32_t numSamples, uint32_t startIndex, vector<int16_t>** inputBuffer, vector<int16_t>** outputBuffer,
+              bool& inputOv, bool& outputOv );
 bool GetCompressedData( uint32_t numSamples, 
                         vector<int16_t>& inputCompressedMinBuffer, vector<int16_t>& outputCompressedMinBuffer,
                         vector<int16_t>& inputCompressedMaxBuffer, vector<int16_t>& outputCompressedMaxBuffer );
 bool GetPeakValues( uint16_t& inputPeak, uint16_t& outputPeak, bool& inputOv, bool& outputOv );
+bool GetPeakValuesTransfersData( void );
+uint32_t GetTransferChunkSize( uint32_t numSamples );
+bool SetTransferBuffers( int16_t* inputBuffers[], int16_t* outputBuffers[], uint32_t bufferSize );
+uint32_t GetMaxTransferDownsampleRatio( void );
+bool StartDataTransfer( uint32_t numSamples, uint32_t downsampleRatio );
+bool GetNextDataChunk( uint32_t& startIndex, uint32_t& numSamples, int16_t** inputSamples, int16_t** outputSamples,
+                       bool& inputOv, bool& outputOv );
+void EndDataTransfer( void );
+bool StreamingSupported( void );
+bool RunStreaming( uint32_t numSamples, double desiredSampFreqHz, uint32_t downsampleRatio, double& actualSampFreqHz );
+bool GetNextStreamingChunk( uint32_t& startIndex, uint32_t& numSamples, int16_t** inputSamples, int16_t** outputSamples,
+                            bool& inputOv, bool& outputOv, bool& complete );
+uint32_t GetMaxSegments( uint32_t numSamples );
+bool RunRapidBlock( int32_t numSamples, uint32_t timebase, uint32_t& numSegments, int32_t *timeIndisposedMs, psBlockReady lpReady, void *pParameter );
+bool GetSegmentData( uint32_t numSamples, uint32_t numSegments, uint32_t downsampleRatio, int16_t** inputSamples, int16_t** outputSamples,
+                     vector<bool>& inputOv, vector<bool>& outputOv );
 bool ChangePower(PICO_STATUS powerState);
 bool CancelCapture( void );
 bool Close( void );
@@ -82,8 +104,63 @@ PS_CHANNEL mOutputChannel;
 vector<int16_t> mInputBuffer;
 vector<int16_t> mOutputBuffer;
 bool buffersDirty;
+int16_t lastOverflow; // Overflow flags of the last full transfer (old driver model)
 uint32_t mNumSamples;
 static const uint32_t maxDataRequestSize;
+static const uint32_t minTransferChunkSize;
+static const uint32_t targetTransferChunks;
+static const uint32_t maxTransferDownsampleRatio;
+static const uint32_t maxStreamingRingSize;
+static const DWORD streamingPollIntervalMs;
+uint32_t transferNumSamples;
+uint32_t transferChunkSize;
+uint32_t chunksConsumed;
+#if defined(NEW_PS_DRIVER_MODEL)
+bool RegisterBuffers( int16_t* inputBuffer, int16_t* outputBuffer, uint32_t bufferSize, bool averaging );
+bool TransferValues( uint32_t numSamples, uint32_t startIndex, int16_t* inputBuffer, int16_t* outputBuffer, uint32_t bufferSize,
+                     uint32_t downsampleRatio, int16_t& overflow );
+static DWORD WINAPI TransferData(LPVOID lpThreadParameter);
+static const uint8_t numTransferSlots = numTransferBuffers;
+static const size_t transferSlotAlignment = 64;
+HANDLE hTransferThread;
+DWORD transferThreadId;
+uint8_t transferLogSlot; // Slot the transfer thread is keeping messages with; only used on that thread
+vector<pair<wstring, LOG_MESSAGE_FLAGS_T>> transferLog[numTransferSlots];
+void FlushTransferLog( uint8_t slot );
+HANDLE hSlotsFree;
+HANDLE hSlotsFilled;
+int16_t* transferInputSlots[numTransferSlots];
+int16_t* transferOutputSlots[numTransferSlots];
+uint32_t transferSlotCapacity;
+bool callerOwnedSlots;
+// What is registered with the driver for the { input, output } channels, for GetValues
+int16_t* registeredBuffers[2];
+uint32_t registeredSizes[2];
+PS_CHANNEL registeredChannels[2];
+bool registeredAveraging[2];
+uint32_t transferDownsampleRatio;
+int16_t transferOverflow[numTransferSlots];
+bool transferSucceeded[numTransferSlots];
+bool slotHeld;
+volatile bool transferCancelled;
+bool transferPowerChanged;
+PICO_STATUS transferPowerState;
+// Streaming capture; the ring is the front of the GetData buffers
+static void __stdcall StreamingReady( int16_t _handle, int32_t noOfSamples, uint32_t startIndex, int16_t overflow,
+                                      uint32_t triggerAt, int16_t triggered, int16_t autoStop, void* pParameter );
+bool streaming;
+uint32_t streamingNumSamples;
+uint32_t streamingDelivered;
+uint32_t streamingReadyCount;
+uint32_t streamingReadyStart;
+int16_t streamingReadyOverflow;
+bool streamingAutoStopped;
+ULONGLONG streamingDeadline;
+// Rapid block (segmented memory) capture
+bool SetupSegments( uint32_t& numSegments, uint32_t numSamples );
+bool segmentedMemory;
+uint32_t maxSegments;
+#endif
 #if !defined(NEW_PS_DRIVER_MODEL)
 static DWORD WINAPI CheckStatus(LPVOID lpThreadParameter);
 bool InitStatusChecking(void);
@@ -96,5 +173,6 @@ void* cbParam;
 #endif
 bool InitializeScope( void );
 bool IsUSB3_0Connection();
+void LogTransferMessage( const wstring statusMessage, LOG_MESSAGE_FLAGS_T type = FRA_ERROR );
 void LogPicoApiCall( wstringstream& fraStatusText );
 template <typename First, typename... Rest> void LogPicoApiCall( wstringstream& fraStatusText, First first, Rest... rest );
\ No newline at end of file